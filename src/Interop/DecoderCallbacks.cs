@@ -19,7 +19,8 @@ namespace JpegXLFileTypePlugin.Interop
                                                 int canvasHeight,
                                                 JpegXLColorSpace format,
                                                 JpegXLImageChannelRepresentation channelRepresentation,
-                                                [MarshalAs(UnmanagedType.U1) ]bool hasTransparency);
+                                                [MarshalAs(UnmanagedType.U1) ]bool hasTransparency,
+                                                [MarshalAs(UnmanagedType.U1)] bool hasAnimation);
 
     [UnmanagedFunctionPointer(CallingConvention.StdCall)]
     [return: MarshalAs(UnmanagedType.U1)]
@@ -31,7 +32,10 @@ namespace JpegXLFileTypePlugin.Interop
 
     [UnmanagedFunctionPointer(CallingConvention.StdCall)]
     [return: MarshalAs(UnmanagedType.U1)]
-    internal unsafe delegate bool SetLayerDataDelegate(byte* pixels, byte* name, nuint nameLength);
+    internal unsafe delegate bool SetLayerDataDelegate(byte* pixels,
+                                                       DecoderLayerInfo* layerInfo,
+                                                       byte* name,
+                                                       nuint nameLength);
 
     [StructLayout(LayoutKind.Sequential)]
     internal struct DecoderCallbacks
@@ -26,9 +26,11 @@ namespace JpegXLFileTypePlugin.Interop
     {
         private bool hasTransparency;
         private IImagingFactory? imagingFactory;
-        private DecoderLayerData? layerData;
+        private readonly Action<DecoderImage, DecoderLayerData> layerDataHandler;
         private IColorContext? colorContext;
+        private byte[]? exifBytes;
         private ExifValueCollection? exif;
+        private byte[]? xmpBytes;
         private XmpPacket? xmp;
 
         private readonly SetBasicInfoDelegate setBasicInfoDelegate;
@@ -38,10 +40,21 @@ namespace JpegXLFileTypePlugin.Interop
         private readonly SetMetadataDelegate setXmpDelegate;
         private readonly SetLayerDataDelegate setLayerDataDelegate;
 
-        public DecoderImage(IImagingFactory imagingFactory)
+        /// <summary>
+        /// Initializes a new instance of the <see cref="DecoderImage"/> class.
+        /// </summary>
+        /// <param name="imagingFactory">The imaging factory.</param>
+        /// <param name="layerDataHandler">
+        /// The handler that is called when each layer has been decoded.
+        /// The layer data is disposed when the handler returns.
+        /// </param>
+        public DecoderImage(IImagingFactory imagingFactory, Action<DecoderImage, DecoderLayerData> layerDataHandler)
         {
+            ArgumentNullException.ThrowIfNull(layerDataHandler);
+
             hasTransparency = false;
             this.imagingFactory = imagingFactory.CreateRef();
+            this.layerDataHandler = layerDataHandler;
             HdrFormat = HdrFormat.None;
             setBasicInfoDelegate = SetBasicInfo;
             setIccProfileDelegate = SetIccProfile;
@@ -61,13 +74,55 @@ namespace JpegXLFileTypePlugin.Interop
 
         public HdrFormat HdrFormat { get; private set; }
 
-        public DecoderLayerData? LayerData => layerData;
+        /// <summary>
+        /// Gets a value indicating whether the image is an animation, only the first frame of an animation is loaded.
+        /// </summary>
+        public bool HasAnimation { get; private set; }
 
         public IColorContext? TryGetColorContext() => colorContext;
 
-        public ExifValueCollection? TryGetExif() => exif;
+        /// <summary>
+        /// Gets the EXIF metadata, the EXIF data is parsed when this method is first called.
+        /// </summary>
+        public ExifValueCollection? TryGetExif()
+        {
+            if (exif is null && exifBytes != null)
+            {
+                using (MemoryStream stream = new(exifBytes, writable: false))
+                {
+                    exif = ExifParser.Parse(stream);
 
-        public XmpPacket? GetXmp() => xmp;
+                    if (exif != null)
+                    {
+                        exif.Remove(ExifPropertyKeys.Image.InterColorProfile.Path);
+                        // JPEG XL does not use the EXIF data for rotation.
+                        exif.Remove(ExifPropertyKeys.Image.Orientation.Path);
+                    }
+                }
+
+                exifBytes = null;
+            }
+
+            return exif;
+        }
+
+        /// <summary>
+        /// Gets the XMP metadata, the XMP packet is parsed when this method is first called.
+        /// </summary>
+        public XmpPacket? GetXmp()
+        {
+            if (xmp is null && xmpBytes != null)
+            {
+                using (MemoryStream stream = new(xmpBytes, writable: false))
+                {
+                    xmp = XmpPacket.TryParse(stream);
+                }
+
+                xmpBytes = null;
+            }
+
+            return xmp;
+        }
 
         public ExceptionDispatchInfo? ExceptionInfo { get; private set; }
 
@@ -101,13 +156,15 @@ namespace JpegXLFileTypePlugin.Interop
                                   int canvasHeight,
                                   JpegXLColorSpace format,
                                   JpegXLImageChannelRepresentation channelRepresentation,
-                                  bool hasTransparency)
+                                  bool hasTransparency,
+                                  bool hasAnimation)
         {
             Width = canvasWidth;
             Height = canvasHeight;
             ColorSpace = format;
             ChannelRepresentation = channelRepresentation;
             this.hasTransparency = hasTransparency;
+            HasAnimation = hasAnimation;
         }
 
         private bool SetIccProfile(byte* data, nuint dataLength)
@@ -197,17 +254,9 @@ namespace JpegXLFileTypePlugin.Interop
         {
             try
             {
-                using (UnmanagedMemoryStream stream = new(data, checked((long)dataLength)))
-                {
-                    exif = ExifParser.Parse(stream);
-
-                    if (exif != null)
-                    {
-                        exif.Remove(ExifPropertyKeys.Image.InterColorProfile.Path);
-                        // JPEG XL does not use the EXIF data for rotation.
-                        exif.Remove(ExifPropertyKeys.Image.Orientation.Path);
-                    }
-                }
+                // The native buffer is only valid during the callback, the data is copied
+                // and parsed when it is requested.
+                exifBytes = new ReadOnlySpan<byte>(data, checked((int)dataLength)).ToArray();
             }
             catch (Exception ex)
             {
@@ -218,19 +267,23 @@ namespace JpegXLFileTypePlugin.Interop
             return true;
         }
 
-        private bool SetLayerData(byte* pixels, byte* name, nuint nameLength)
+        private bool SetLayerData(byte* pixels, DecoderLayerInfo* layerInfo, byte* name, nuint nameLength)
         {
             try
             {
-                layerData = new DecoderLayerData(Width,
-                                                 Height,
-                                                 ColorSpace,
-                                                 ChannelRepresentation,
-                                                 hasTransparency,
-                                                 imagingFactory!,
-                                                 name,
-                                                 nameLength,
-                                                 pixels);
+                // The native code reuses the pixel buffer for each layer, so the layer
+                // must be consumed before returning to the decoder.
+                using (DecoderLayerData layerData = new(*layerInfo,
+                                                        ColorSpace,
+                                                        ChannelRepresentation,
+                                                        hasTransparency,
+                                                        imagingFactory!,
+                                                        name,
+                                                        nameLength,
+                                                        pixels))
+                {
+                    layerDataHandler(this, layerData);
+                }
             }
             catch (Exception ex)
             {
@@ -245,13 +298,8 @@ namespace JpegXLFileTypePlugin.Interop
         {
             try
             {
-                if (xmp == null)
-                {
-                    using (UnmanagedMemoryStream stream = new(data, checked((long)dataLength)))
-                    {
-                        xmp = XmpPacket.TryParse(stream);
-                    }
-                }
+                // Only the first XMP packet is used.
+                xmpBytes ??= new ReadOnlySpan<byte>(data, checked((int)dataLength)).ToArray();
             }
             catch (Exception ex)
             {
@@ -266,7 +314,6 @@ namespace JpegXLFileTypePlugin.Interop
         {
             if (disposing)
             {
-                DisposableUtil.Free(ref layerData);
                 DisposableUtil.Free(ref imagingFactory);
             }
 
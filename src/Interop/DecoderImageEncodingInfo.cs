@@ -0,0 +1,42 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+
+using System.Runtime.InteropServices;
+
+namespace JpegXLFileTypePlugin.Interop
+{
+    [StructLayout(LayoutKind.Sequential)]
+    internal readonly struct DecoderImageEncodingInfo
+    {
+        private readonly byte usesOriginalColorSpace;
+        private readonly byte hasJpegReconstructionData;
+
+        /// <summary>
+        /// Gets a value indicating whether the image is stored in its original color space instead of XYB.
+        /// </summary>
+        public bool UsesOriginalColorSpace => usesOriginalColorSpace != 0;
+
+        /// <summary>
+        /// Gets a value indicating whether the file has JPEG reconstruction data.
+        /// </summary>
+        public bool HasJpegReconstructionData => hasJpegReconstructionData != 0;
+
+        /// <summary>
+        /// Gets a value indicating whether the image can be lossless.
+        /// </summary>
+        /// <remarks>
+        /// A lossless image must use its original color space, the pixels of a recompressed JPEG are lossy.
+        /// </remarks>
+        public bool MayBeLossless => UsesOriginalColorSpace && !HasJpegReconstructionData;
+    }
+}
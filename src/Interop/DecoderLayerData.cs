@@ -24,8 +24,7 @@ namespace JpegXLFileTypePlugin.Interop
         private IBitmap<ColorAlpha8>? transparency;
 
         public DecoderLayerData(
-            int width,
-            int height,
+            DecoderLayerInfo layerInfo,
             JpegXLColorSpace colorSpace,
             JpegXLImageChannelRepresentation channelRepresentation,
             bool hasTransparency,
@@ -70,11 +69,14 @@ namespace JpegXLFileTypePlugin.Interop
                                                        typeof(JpegXLColorSpace));
             }
 
-            Color = imagingFactory.CreateBitmap(width, height, colorPixelFormat);
+            Bounds = new RectInt32(layerInfo.x, layerInfo.y, layerInfo.width, layerInfo.height);
+            BlendMode = layerInfo.blendMode;
+
+            Color = imagingFactory.CreateBitmap(layerInfo.width, layerInfo.height, colorPixelFormat);
 
             if (hasTransparency)
             {
-                transparency = imagingFactory.CreateBitmap<ColorAlpha8>(width, height);
+                transparency = imagingFactory.CreateBitmap<ColorAlpha8>(layerInfo.width, layerInfo.height);
             }
 
             switch (colorSpace)
@@ -104,6 +106,16 @@ namespace JpegXLFileTypePlugin.Interop
             }
         }
 
+        /// <summary>
+        /// Gets the layer bounds relative to the image canvas.
+        /// </summary>
+        /// <value>
+        /// The layer bounds, this may extend outside of the image canvas.
+        /// </value>
+        public RectInt32 Bounds { get; }
+
+        public DecoderLayerBlendMode BlendMode { get; }
+
         public IBitmap Color { get; }
 
         public IBitmap<ColorAlpha8>? Transparency
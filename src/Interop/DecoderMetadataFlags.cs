@@ -0,0 +1,29 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+using System;
+
+namespace JpegXLFileTypePlugin.Interop
+{
+    /// <summary>
+    /// The metadata that the native decoder reads, the metadata boxes that are not requested
+    /// are skipped without being decompressed.
+    /// </summary>
+    [Flags]
+    internal enum DecoderMetadataFlags : uint
+    {
+        None = 0,
+        Exif = 1 << 0,
+        Xmp = 1 << 1,
+        All = Exif | Xmp,
+    }
+}
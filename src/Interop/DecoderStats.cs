@@ -0,0 +1,52 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+using System.Runtime.InteropServices;
+
+namespace JpegXLFileTypePlugin.Interop
+{
+    /// <summary>
+    /// The decoding statistics, the times are in microseconds.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct DecoderStats
+    {
+        public ulong signatureCheckTime;
+        public ulong headerParseTime;
+        public ulong colorSetupTime;
+        public ulong pixelDecodeTime;
+        public ulong conversionTime;
+        public ulong callbackTime;
+        public ulong totalTime;
+        public ulong fileSize;
+        public ulong codestreamSize;
+        public ulong exifBoxSize;
+        public ulong xmpBoxSize;
+        public ulong jpegReconstructionBoxSize;
+        public ulong otherBoxSize;
+        /// <summary>
+        /// The peak number of bytes that libjxl had allocated.
+        /// </summary>
+        public ulong peakMemoryBytes;
+        public uint boxCount;
+        public uint threadCount;
+
+        public override readonly string ToString()
+        {
+            return $"Load: total {totalTime} us, signature {signatureCheckTime} us, header {headerParseTime} us, " +
+                   $"color {colorSetupTime} us, decode {pixelDecodeTime} us, conversion {conversionTime} us, " +
+                   $"callbacks {callbackTime} us, file {fileSize} bytes, codestream {codestreamSize} bytes, " +
+                   $"Exif {exifBoxSize} bytes, XMP {xmpBoxSize} bytes, JPEG reconstruction {jpegReconstructionBoxSize} bytes, " +
+                   $"other {otherBoxSize} bytes in {boxCount} boxes, {threadCount} threads, peak libjxl memory {peakMemoryBytes} bytes";
+        }
+    }
+}
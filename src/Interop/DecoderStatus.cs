@@ -27,5 +27,8 @@ namespace JpegXLFileTypePlugin.Interop
         DecodeError,
         MetadataError,
         InvalidFileSignature,
+        NoJpegReconstructionData,
+        UserCanceled,
+        WriteError,
     }
 }
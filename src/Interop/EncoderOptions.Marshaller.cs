@@ -24,6 +24,8 @@ namespace JpegXLFileTypePlugin.Interop
                 public float distance;
                 public int effort;
                 public byte lossless;
+                public ulong targetFileSize;
+                public uint timeBudgetMilliseconds;
             }
 
             public static Native ConvertToUnmanaged(EncoderOptions managed)
@@ -32,7 +34,9 @@ namespace JpegXLFileTypePlugin.Interop
                 {
                     distance = managed.distance,
                     effort = managed.effort,
-                    lossless = (byte)(managed.lossless ? 1 : 0)
+                    lossless = (byte)(managed.lossless ? 1 : 0),
+                    targetFileSize = managed.targetFileSize,
+                    timeBudgetMilliseconds = managed.timeBudgetMilliseconds
                 };
             }
         }
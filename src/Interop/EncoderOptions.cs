@@ -20,14 +20,24 @@ namespace JpegXLFileTypePlugin.Interop
         public readonly float distance;
         public readonly int effort;
         public readonly bool lossless;
+        public readonly ulong targetFileSize;
+        public readonly uint timeBudgetMilliseconds;
 
-        public EncoderOptions(int quality, bool lossless, int effort)
+        public EncoderOptions(int quality,
+                              bool lossless,
+                              int effort,
+                              ulong targetFileSize = 0,
+                              uint timeBudgetMilliseconds = 0)
         {
             // Lossless encoding implies a distance value of 0.0, anything higher than that
             // will use lossy encoding.
             distance = lossless ? 0.0f : QualityToDistanceLookupTable.GetValue(quality);
             this.effort = effort;
             this.lossless = lossless;
+            // When the target file size is set the encoder searches for the quality value, it is ignored for lossless images.
+            this.targetFileSize = targetFileSize;
+            // When the time budget is set the effort value is the highest effort that the encoder will use.
+            this.timeBudgetMilliseconds = timeBudgetMilliseconds;
         }
     }
 }
@@ -0,0 +1,52 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+using System.Runtime.InteropServices;
+
+namespace JpegXLFileTypePlugin.Interop
+{
+    /// <summary>
+    /// The encoding statistics, the times are in microseconds.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    internal unsafe struct EncoderStats
+    {
+        public ulong conversionTime;
+        public ulong configureTime;
+        public ulong encodeTime;
+        public ulong outputCallbackTime;
+        public ulong totalTime;
+        public ulong outputSize;
+        public ulong iccProfileSize;
+        public ulong exifSize;
+        public ulong xmpSize;
+        /// <summary>
+        /// The peak number of bytes that libjxl had allocated.
+        /// </summary>
+        public ulong peakMemoryBytes;
+        /// <summary>
+        /// The libjxl encoder statistics indexed by the JxlEncoderStatsKey enumeration,
+        /// only the first <see cref="libJxlStatCount"/> values are valid.
+        /// </summary>
+        public fixed ulong libJxlStats[32];
+        public uint libJxlStatCount;
+        public uint threadCount;
+
+        public override readonly string ToString()
+        {
+            return $"Save: total {totalTime} us, conversion {conversionTime} us, configure {configureTime} us, " +
+                   $"encode {encodeTime} us, output callbacks {outputCallbackTime} us, output {outputSize} bytes, " +
+                   $"ICC profile {iccProfileSize} bytes, Exif {exifSize} bytes, XMP {xmpSize} bytes, " +
+                   $"{libJxlStatCount} libjxl statistics, {threadCount} threads, peak libjxl memory {peakMemoryBytes} bytes";
+        }
+    }
+}
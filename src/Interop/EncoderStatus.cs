@@ -19,6 +19,7 @@ namespace JpegXLFileTypePlugin.Interop
         OutOfMemory,
         UserCancelled,
         EncodeError,
-        WriteError
+        WriteError,
+        JpegReconstructionDataLost
     }
 }
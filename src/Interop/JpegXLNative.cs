@@ -45,7 +45,8 @@ namespace JpegXLFileTypePlugin.Interop
         }
 
         internal static unsafe void LoadImage(byte[] imageData,
-                                              DecoderImage decoderImage)
+                                              DecoderImage decoderImage,
+                                              DecoderMetadataFlags metadataFlags)
         {
             ArgumentNullException.ThrowIfNull(imageData);
             ArgumentNullException.ThrowIfNull(decoderImage);
@@ -61,11 +62,11 @@ namespace JpegXLFileTypePlugin.Interop
 
                 if (RuntimeInformation.ProcessArchitecture == Architecture.X64)
                 {
-                    status = JpegXL_X64.LoadImage(callbacks, data, dataSize, ref errorInfo);
+                    status = JpegXL_X64.LoadImage(callbacks, data, dataSize, metadataFlags, ref errorInfo, null);
                 }
                 else if (RuntimeInformation.ProcessArchitecture == Architecture.Arm64)
                 {
-                    status = JpegXL_Arm64.LoadImage(callbacks, data, dataSize, ref errorInfo);
+                    status = JpegXL_Arm64.LoadImage(callbacks, data, dataSize, metadataFlags, ref errorInfo, null);
                 }
                 else
                 {
@@ -81,11 +82,39 @@ namespace JpegXLFileTypePlugin.Interop
             }
         }
 
-        internal static unsafe void SaveImage(Surface surface,
-                                              EncoderOptions options,
-                                              EncoderImageMetadata metadata,
-                                              ProgressCallback? progressCallback,
-                                              Stream output)
+        internal static unsafe bool TryGetImageEncodingInfo(byte[] imageData, out DecoderImageEncodingInfo info)
+        {
+            ArgumentNullException.ThrowIfNull(imageData);
+
+            DecoderStatus status;
+            ErrorInfo errorInfo = new();
+
+            fixed (byte* data = imageData)
+            {
+                nuint dataSize = (nuint)imageData.Length;
+
+                if (RuntimeInformation.ProcessArchitecture == Architecture.X64)
+                {
+                    status = JpegXL_X64.GetImageEncodingInfo(data, dataSize, out info, ref errorInfo);
+                }
+                else if (RuntimeInformation.ProcessArchitecture == Architecture.Arm64)
+                {
+                    status = JpegXL_Arm64.GetImageEncodingInfo(data, dataSize, out info, ref errorInfo);
+                }
+                else
+                {
+                    throw new PlatformNotSupportedException();
+                }
+            }
+
+            return status == DecoderStatus.Ok;
+        }
+
+        internal static unsafe EncoderResult SaveImage(Surface surface,
+                                                       EncoderOptions options,
+                                                       EncoderImageMetadata metadata,
+                                                       ProgressCallback? progressCallback,
+                                                       Stream output)
         {
             StreamIOCallbacks streamIO = new(output);
 
@@ -102,14 +131,15 @@ namespace JpegXLFileTypePlugin.Interop
             ErrorInfo errorInfo;
 
             EncoderStatus status;
+            EncoderResult result;
 
             if (RuntimeInformation.ProcessArchitecture == Architecture.X64)
             {
-                status = JpegXL_X64.SaveImage(bitmapData, options, metadata, callbacks, ref errorInfo, progressCallback);
+                status = JpegXL_X64.SaveImage(bitmapData, options, metadata, callbacks, ref errorInfo, progressCallback, out result, null);
             }
             else if (RuntimeInformation.ProcessArchitecture == Architecture.Arm64)
             {
-                status = JpegXL_Arm64.SaveImage(bitmapData, options, metadata, callbacks, ref errorInfo, progressCallback);
+                status = JpegXL_Arm64.SaveImage(bitmapData, options, metadata, callbacks, ref errorInfo, progressCallback, out result, null);
             }
             else
             {
@@ -123,6 +153,50 @@ namespace JpegXLFileTypePlugin.Interop
             {
                 HandleEncoderError(status, errorInfo, streamIO);
             }
+
+            return result;
+        }
+
+        internal static unsafe void RewriteMetadata(byte[] imageData,
+                                                    EncoderImageMetadata metadata,
+                                                    bool allowJpegReconstructionLoss,
+                                                    Stream output)
+        {
+            ArgumentNullException.ThrowIfNull(imageData);
+            ArgumentNullException.ThrowIfNull(metadata);
+
+            StreamIOCallbacks streamIO = new(output);
+
+            IOCallbacks callbacks = streamIO.GetIOCallbacks();
+
+            ErrorInfo errorInfo;
+
+            EncoderStatus status;
+
+            fixed (byte* data = imageData)
+            {
+                nuint dataSize = (nuint)imageData.Length;
+
+                if (RuntimeInformation.ProcessArchitecture == Architecture.X64)
+                {
+                    status = JpegXL_X64.RewriteMetadata(data, dataSize, metadata, false, allowJpegReconstructionLoss, callbacks, ref errorInfo);
+                }
+                else if (RuntimeInformation.ProcessArchitecture == Architecture.Arm64)
+                {
+                    status = JpegXL_Arm64.RewriteMetadata(data, dataSize, metadata, false, allowJpegReconstructionLoss, callbacks, ref errorInfo);
+                }
+                else
+                {
+                    throw new PlatformNotSupportedException();
+                }
+            }
+
+            GC.KeepAlive(streamIO);
+
+            if (status != EncoderStatus.Ok)
+            {
+                HandleEncoderError(status, errorInfo, streamIO);
+            }
         }
 
         private static unsafe void HandleDecoderError(DecoderStatus status,
@@ -232,6 +306,8 @@ namespace JpegXLFileTypePlugin.Interop
                         throw new OutOfMemoryException();
                     case EncoderStatus.UserCancelled:
                         throw new OperationCanceledException();
+                    case EncoderStatus.JpegReconstructionDataLost:
+                        throw new InvalidOperationException("The metadata cannot be changed without removing the JPEG reconstruction data.");
                     default:
                         throw new FormatException("An unspecified error occurred when encoding the image.");
                 }
@@ -27,15 +27,36 @@ namespace JpegXLFileTypePlugin.Interop
         internal static unsafe partial DecoderStatus LoadImage(in DecoderCallbacks callbacks,
                                                                byte* data,
                                                                nuint dataSize,
-                                                               ref ErrorInfo errorInfo);
+                                                               DecoderMetadataFlags metadataFlags,
+                                                               ref ErrorInfo errorInfo,
+                                                               DecoderStats* stats);
 
         [LibraryImport(DllName)]
         [UnmanagedCallConv(CallConvs = new System.Type[] { typeof(System.Runtime.CompilerServices.CallConvStdcall) })]
-        internal static partial EncoderStatus SaveImage(in BitmapData bitmap,
-                                                        in EncoderOptions options,
-                                                        in EncoderImageMetadata metadata,
-                                                        in IOCallbacks callbacks,
-                                                        ref ErrorInfo errorInfo,
-                                                        [MarshalAs(UnmanagedType.FunctionPtr)] ProgressCallback? progressCallback);
+        internal static unsafe partial DecoderStatus GetImageEncodingInfo(byte* data,
+                                                                          nuint dataSize,
+                                                                          out DecoderImageEncodingInfo info,
+                                                                          ref ErrorInfo errorInfo);
+
+        [LibraryImport(DllName)]
+        [UnmanagedCallConv(CallConvs = new System.Type[] { typeof(System.Runtime.CompilerServices.CallConvStdcall) })]
+        internal static unsafe partial EncoderStatus SaveImage(in BitmapData bitmap,
+                                                               in EncoderOptions options,
+                                                               in EncoderImageMetadata metadata,
+                                                               in IOCallbacks callbacks,
+                                                               ref ErrorInfo errorInfo,
+                                                               [MarshalAs(UnmanagedType.FunctionPtr)] ProgressCallback? progressCallback,
+                                                               out EncoderResult result,
+                                                               EncoderStats* stats);
+
+        [LibraryImport(DllName)]
+        [UnmanagedCallConv(CallConvs = new System.Type[] { typeof(System.Runtime.CompilerServices.CallConvStdcall) })]
+        internal static unsafe partial EncoderStatus RewriteMetadata(byte* data,
+                                                                     nuint dataSize,
+                                                                     in EncoderImageMetadata metadata,
+                                                                     [MarshalAs(UnmanagedType.U1)] bool compressBoxes,
+                                                                     [MarshalAs(UnmanagedType.U1)] bool allowJpegReconstructionLoss,
+                                                                     in IOCallbacks callbacks,
+                                                                     ref ErrorInfo errorInfo);
     }
 }
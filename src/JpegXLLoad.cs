@@ -29,21 +29,32 @@ namespace JpegXLFileTypePlugin
     {
         public static Document Load(Stream input)
         {
-            Document doc;
+            Document? doc = null;
 
             byte[] data = new byte[input.Length];
             input.ReadExactly(data, 0, data.Length);
 
             using (IImagingFactory imagingFactory = ImagingFactory.CreateRef())
-            using (DecoderImage decoderImage = new(imagingFactory))
+            using (DecoderImage decoderImage = new(imagingFactory, (image, layerData) =>
             {
-                JpegXLNative.LoadImage(data, decoderImage);
+                // The document is created when the first layer is decoded, the image
+                // size and color profile have already been read at that point.
+                if (doc is null)
+                {
+                    doc = new Document(image.Width, image.Height);
 
-                doc = new Document(decoderImage.Width, decoderImage.Height);
+                    SetDocumentColorProfile(image, doc, imagingFactory);
+                }
 
-                SetDocumentColorProfile(decoderImage, doc, imagingFactory);
+                AddLayer(image, layerData, doc, imagingFactory);
+            }))
+            {
+                JpegXLNative.LoadImage(data, decoderImage, DecoderMetadataFlags.All);
 
-                AddBackgroundLayer(decoderImage, doc, imagingFactory);
+                if (doc is null)
+                {
+                    throw new FormatException("The image does not contain any layers.");
+                }
 
                 ExifValueCollection? exifValues = decoderImage.TryGetExif();
 
@@ -63,24 +74,101 @@ namespace JpegXLFileTypePlugin
                 {
                     doc.Metadata.SetXmpPacket(xmpPacket);
                 }
+
+                // Only the first frame of an animation is loaded, so its original data cannot be reused when saving.
+                if (!decoderImage.HasAnimation)
+                {
+                    OriginalImageData.Add(doc, data);
+                }
             }
 
             return doc;
         }
 
-        private static void AddBackgroundLayer(DecoderImage decoderImage, Document doc, IImagingFactory imagingFactory)
+        private static void AddLayer(DecoderImage decoderImage,
+                                     DecoderLayerData layerData,
+                                     Document doc,
+                                     IImagingFactory imagingFactory)
         {
-            DecoderLayerData layerData = decoderImage.LayerData ?? throw new FormatException("The layer data was null.");
+            BitmapLayer bitmapLayer;
+
+            if (doc.Layers.Count == 0)
+            {
+                bitmapLayer = Layer.CreateBackgroundLayer(decoderImage.Width, decoderImage.Height);
+            }
+            else
+            {
+                LayerBlendMode blendMode;
+
+                switch (layerData.BlendMode)
+                {
+                    case DecoderLayerBlendMode.Replace:
+                        // Paint.NET does not have a replace blend mode, the layer is composited over the layers
+                        // below with the normal blend mode. This has the same result as replacing the pixels where
+                        // the layer is opaque, the layers below are not changed so they show through the
+                        // transparent pixels of this layer.
+                        blendMode = LayerBlendMode.Normal;
+                        break;
+                    case DecoderLayerBlendMode.Add:
+                        blendMode = LayerBlendMode.Additive;
+                        break;
+                    case DecoderLayerBlendMode.Blend:
+                        blendMode = LayerBlendMode.Normal;
+                        break;
+                    case DecoderLayerBlendMode.MulAdd:
+                        // The color is multiplied by the layer alpha and added to the layers below, which is what
+                        // the additive blend mode does over an opaque background. The loss of accuracy over a
+                        // transparent background is accepted, the alpha of the layers below should not change
+                        // but Paint.NET blends it with the alpha of this layer.
+                        blendMode = LayerBlendMode.Additive;
+                        break;
+                    case DecoderLayerBlendMode.Mul:
+                        blendMode = LayerBlendMode.Multiply;
+                        break;
+                    default:
+                        throw new InvalidOperationException($"Unknown {nameof(DecoderLayerBlendMode)} value: {layerData.BlendMode}.");
+                }
 
-            BitmapLayer bitmapLayer = Layer.CreateBackgroundLayer(decoderImage.Width, decoderImage.Height);
+                bitmapLayer = new BitmapLayer(decoderImage.Width, decoderImage.Height)
+                {
+                    BlendMode = blendMode
+                };
+            }
 
             if (!string.IsNullOrWhiteSpace(layerData.Name))
             {
                 bitmapLayer.Name = layerData.Name;
             }
 
-            Surface surface = bitmapLayer.Surface;
+            RectInt32 layerBounds = layerData.Bounds;
+
+            if (layerBounds == bitmapLayer.Surface.Bounds)
+            {
+                SetLayerData(decoderImage, layerData, bitmapLayer.Surface, imagingFactory);
+            }
+            else
+            {
+                // Layers that do not cover the whole canvas are decoded into a temporary surface
+                // and then copied to their position in the document, any pixels that are outside
+                // of the document bounds are clipped.
+                bitmapLayer.Surface.Clear();
+
+                using (Surface layerSurface = new(layerBounds.Width, layerBounds.Height))
+                {
+                    SetLayerData(decoderImage, layerData, layerSurface, imagingFactory);
+
+                    bitmapLayer.Surface.CopySurface(layerSurface, layerBounds.Location);
+                }
+            }
+
+            doc.Layers.Add(bitmapLayer);
+        }
 
+        private static void SetLayerData(DecoderImage decoderImage,
+                                         DecoderLayerData layerData,
+                                         Surface surface,
+                                         IImagingFactory imagingFactory)
+        {
             switch (decoderImage.ColorSpace)
             {
                 case JpegXLColorSpace.Cmyk:
@@ -110,8 +198,6 @@ namespace JpegXLFileTypePlugin
             {
                 PixelKernels.SetAlphaChannel(surface.AsRegionPtr().Cast<ColorBgra32>(), ColorAlpha8.Opaque);
             }
-
-            doc.Layers.Add(bitmapLayer);
         }
 
         private static void SetDocumentColorProfile(DecoderImage decoderImage, Document doc, IImagingFactory imagingFactory)
@@ -56,19 +56,36 @@ namespace JpegXLFileTypePlugin
                 });
             }
 
-            EncoderOptions options = new(quality, lossless, effort);
-            EncoderImageMetadata metadata = CreateImageMetadata(input);
+            byte[]? iccProfileBytes = GetIccProfileBytes(input);
+            EncoderImageMetadata metadata = CreateImageMetadata(input, iccProfileBytes);
 
-            JpegXLNative.SaveImage(scratchSurface, options, metadata, progressCallback, output);
+            if (OriginalImageData.TryGet(input, out OriginalImageData? originalImageData)
+                && originalImageData.CanPassThrough(scratchSurface, lossless, iccProfileBytes))
+            {
+                if (originalImageData.MetadataEquals(metadata))
+                {
+                    // The file is written unchanged, this keeps the original metadata boxes and any JPEG reconstruction data.
+                    output.Write(originalImageData.FileData);
+                }
+                else
+                {
+                    // The image has not been changed since it was loaded, only the metadata needs to be updated.
+                    // Encoding the pixels would also lose the JPEG reconstruction data, so the rewrite is
+                    // allowed to remove it.
+                    JpegXLNative.RewriteMetadata(originalImageData.FileData, metadata, true, output);
+                }
+            }
+            else
+            {
+                EncoderOptions options = new(quality, lossless, effort);
+
+                JpegXLNative.SaveImage(scratchSurface, options, metadata, progressCallback, output);
+            }
         }
 
-        private static EncoderImageMetadata CreateImageMetadata(Document input)
+        internal static byte[]? GetIccProfileBytes(Document input)
         {
-            byte[]? exifBytes = null;
             byte[]? iccProfileBytes = null;
-            byte[]? xmpBytes = null;
-
-            ExifColorSpace exifColorSpace = ExifColorSpace.Srgb;
 
             IColorContext? colorContext = input.GetColorContext();
 
@@ -82,13 +99,23 @@ namespace JpegXLFileTypePlugin
                 {
                     iccProfileBytes = colorContext.GetProfileBytes().ToArray();
 
-                    if (iccProfileBytes.Length > 0)
+                    if (iccProfileBytes.Length == 0)
                     {
-                        exifColorSpace = ExifColorSpace.Uncalibrated;
+                        iccProfileBytes = null;
                     }
                 }
             }
 
+            return iccProfileBytes;
+        }
+
+        internal static EncoderImageMetadata CreateImageMetadata(Document input, byte[]? iccProfileBytes)
+        {
+            byte[]? exifBytes = null;
+            byte[]? xmpBytes = null;
+
+            ExifColorSpace exifColorSpace = iccProfileBytes != null ? ExifColorSpace.Uncalibrated : ExifColorSpace.Srgb;
+
             Dictionary<ExifPropertyPath, ExifValue>? propertyItems = GetExifMetadataFromDocument(input);
 
             if (propertyItems != null)
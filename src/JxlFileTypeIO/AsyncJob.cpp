@@ -0,0 +1,557 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "AsyncJob.h"
+#include "JxlDecoder.h"
+#include "JxlEncoder.h"
+#include "Windows.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+enum class AsyncJobKind
+{
+    SaveImage,
+    LoadImage
+};
+
+class AsyncJob
+{
+public:
+    AsyncJob(AsyncJobKind kind, AsyncJobCompletedProc completedCallback)
+        : kind(kind),
+          completedCallback(completedCallback),
+          completedEvent(CreateEventW(nullptr, TRUE, FALSE, nullptr)),
+          state(AsyncJobState::Queued),
+          progressPercentage(0),
+          canceled(false),
+          bitmap{},
+          options{},
+          metadata{},
+          ioCallbacks(nullptr),
+          encoderResult{},
+          decoderCallbacks(nullptr),
+          data(nullptr),
+          dataSize(0),
+          metadataFlags(DecoderMetadataFlags::All),
+          status(0),
+          errorInfo{}
+    {
+        if (!completedEvent)
+        {
+            throw std::runtime_error("CreateEventW failed.");
+        }
+    }
+
+    AsyncJob(const AsyncJob&) = delete;
+    AsyncJob& operator=(const AsyncJob&) = delete;
+
+    ~AsyncJob()
+    {
+        CloseHandle(completedEvent);
+    }
+
+    void SetSaveImageParameters(
+        const BitmapData* bitmap,
+        const EncoderOptions* options,
+        const EncoderImageMetadata* metadata,
+        IOCallbacks* callbacks)
+    {
+        this->bitmap = *bitmap;
+        this->options = *options;
+        this->metadata = *metadata;
+        ioCallbacks = callbacks;
+    }
+
+    void SetLoadImageParameters(
+        DecoderCallbacks* callbacks,
+        const uint8_t* data,
+        size_t dataSize,
+        DecoderMetadataFlags metadataFlags)
+    {
+        decoderCallbacks = callbacks;
+        this->data = data;
+        this->dataSize = dataSize;
+        this->metadataFlags = metadataFlags;
+    }
+
+    AsyncJobKind GetKind() const
+    {
+        return kind;
+    }
+
+    AsyncJobState GetState() const
+    {
+        return state.load();
+    }
+
+    int32_t GetProgress() const
+    {
+        return progressPercentage.load();
+    }
+
+    HANDLE GetWaitHandle() const
+    {
+        return completedEvent;
+    }
+
+    void Cancel()
+    {
+        canceled.store(true);
+    }
+
+    bool ReportProgress(int32_t percentage)
+    {
+        progressPercentage.store(percentage);
+
+        return !canceled.load();
+    }
+
+    bool Wait(uint32_t timeoutMilliseconds) const
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        const auto isCompleted = [this] { return state.load() == AsyncJobState::Completed; };
+
+        if (timeoutMilliseconds == UINT32_MAX)
+        {
+            completed.wait(lock, isCompleted);
+            return true;
+        }
+
+        return completed.wait_for(lock, std::chrono::milliseconds(timeoutMilliseconds), isCompleted);
+    }
+
+    // The status, result and error information are only read after the job has completed.
+    int32_t GetStatus() const
+    {
+        return status;
+    }
+
+    const EncoderResult& GetEncoderResult() const
+    {
+        return encoderResult;
+    }
+
+    const ErrorInfo& GetErrorInfo() const
+    {
+        return errorInfo;
+    }
+
+    void Run(ProgressProc progressCallback) noexcept
+    {
+        state.store(AsyncJobState::Running);
+
+        if (kind == AsyncJobKind::SaveImage)
+        {
+            const EncoderStatus encoderStatus = canceled.load()
+                ? EncoderStatus::UserCanceled
+                : EncoderWriteImage(
+                    &bitmap,
+                    &options,
+                    &metadata,
+                    ioCallbacks,
+                    &errorInfo,
+                    progressCallback,
+                    &encoderResult,
+                    nullptr);
+
+            status = static_cast<int32_t>(encoderStatus);
+        }
+        else
+        {
+            const DecoderStatus decoderStatus = canceled.load()
+                ? DecoderStatus::UserCanceled
+                : DecoderReadImage(
+                    decoderCallbacks,
+                    data,
+                    dataSize,
+                    metadataFlags,
+                    &errorInfo,
+                    progressCallback,
+                    nullptr);
+
+            status = static_cast<int32_t>(decoderStatus);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            state.store(AsyncJobState::Completed);
+        }
+
+        completed.notify_all();
+        SetEvent(completedEvent);
+
+        if (completedCallback)
+        {
+            completedCallback(this);
+        }
+    }
+
+    // The job keeps a reference to itself until the handle is closed, the job thread holds
+    // another reference while the job is running.
+    void SetHandleReference(std::shared_ptr<AsyncJob> reference)
+    {
+        handleReference = std::move(reference);
+    }
+
+    std::shared_ptr<AsyncJob> ReleaseHandleReference()
+    {
+        return std::move(handleReference);
+    }
+
+private:
+    const AsyncJobKind kind;
+    const AsyncJobCompletedProc completedCallback;
+    const HANDLE completedEvent;
+    mutable std::mutex mutex;
+    mutable std::condition_variable completed;
+    std::atomic<AsyncJobState> state;
+    std::atomic<int32_t> progressPercentage;
+    std::atomic<bool> canceled;
+
+    BitmapData bitmap;
+    EncoderOptions options;
+    EncoderImageMetadata metadata;
+    IOCallbacks* ioCallbacks;
+    EncoderResult encoderResult;
+
+    DecoderCallbacks* decoderCallbacks;
+    const uint8_t* data;
+    size_t dataSize;
+    DecoderMetadataFlags metadataFlags;
+
+    int32_t status;
+    ErrorInfo errorInfo;
+
+    std::shared_ptr<AsyncJob> handleReference;
+};
+
+namespace
+{
+    // The job that is running on the current job thread, the progress callback
+    // does not have a context parameter.
+    thread_local AsyncJob* currentJob = nullptr;
+
+    bool __stdcall ReportCurrentJobProgress(int32_t progressPercentage)
+    {
+        return !currentJob || currentJob->ReportProgress(progressPercentage);
+    }
+
+    // The job threads run the jobs in the order that they were started, one job per thread.
+    // Each job also uses the parallel runner threads of its decoder or encoder, so the caller
+    // should limit the number of jobs that run at the same time with AsyncJobSetMaxRunningJobs.
+    class JobQueue
+    {
+    public:
+        // The queue is intentionally never destroyed, joining the job threads while the DLL
+        // is unloaded would deadlock on the loader lock.
+        static JobQueue& Get()
+        {
+            static JobQueue* queue = new JobQueue();
+
+            return *queue;
+        }
+
+        void SetMaxRunningJobs(uint32_t value)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                maxRunningJobs = value > 0 ? value : GetDefaultMaxRunningJobs();
+                StartJobThreads();
+            }
+
+            jobAvailable.notify_all();
+        }
+
+        void Submit(std::shared_ptr<AsyncJob> job)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                jobs.push_back(std::move(job));
+
+                try
+                {
+                    StartJobThreads();
+                }
+                catch (...)
+                {
+                    // The job can still run on one of the existing threads.
+                    if (jobThreadCount == 0)
+                    {
+                        jobs.pop_back();
+                        throw;
+                    }
+                }
+            }
+
+            jobAvailable.notify_one();
+        }
+
+    private:
+        JobQueue() : maxRunningJobs(GetDefaultMaxRunningJobs()), runningJobs(0), jobThreadCount(0)
+        {
+        }
+
+        static uint32_t GetDefaultMaxRunningJobs()
+        {
+            return std::max(std::thread::hardware_concurrency(), 1u);
+        }
+
+        // The job threads are started when there are more queued jobs than threads, up to the
+        // running job limit. The threads are kept when the limit is lowered, the limit is
+        // checked before a thread takes a job.
+        // The caller must hold the mutex.
+        void StartJobThreads()
+        {
+            const size_t wantedThreadCount = std::min<size_t>(maxRunningJobs, runningJobs + jobs.size());
+
+            while (jobThreadCount < wantedThreadCount)
+            {
+                std::thread(&JobQueue::JobThread, this).detach();
+                jobThreadCount++;
+            }
+        }
+
+        void JobThread()
+        {
+            while (true)
+            {
+                std::shared_ptr<AsyncJob> job;
+
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+
+                    jobAvailable.wait(lock, [this] { return !jobs.empty() && runningJobs < maxRunningJobs; });
+
+                    job = std::move(jobs.front());
+                    jobs.pop_front();
+                    runningJobs++;
+                }
+
+                currentJob = job.get();
+                job->Run(ReportCurrentJobProgress);
+                currentJob = nullptr;
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+
+                    runningJobs--;
+                }
+
+                jobAvailable.notify_one();
+            }
+        }
+
+        std::mutex mutex;
+        std::condition_variable jobAvailable;
+        std::deque<std::shared_ptr<AsyncJob>> jobs;
+        uint32_t maxRunningJobs;
+        uint32_t runningJobs;
+        size_t jobThreadCount;
+    };
+
+    AsyncJob* StartJob(const std::shared_ptr<AsyncJob>& job)
+    {
+        job->SetHandleReference(job);
+
+        try
+        {
+            JobQueue::Get().Submit(job);
+        }
+        catch (...)
+        {
+            job->ReleaseHandleReference();
+            throw;
+        }
+
+        return job.get();
+    }
+}
+
+EncoderStatus AsyncJobStartSaveImage(
+    const BitmapData* bitmap,
+    const EncoderOptions* options,
+    const EncoderImageMetadata* metadata,
+    IOCallbacks* callbacks,
+    AsyncJobCompletedProc completedCallback,
+    AsyncJob** job)
+{
+    if (!bitmap || !options || !metadata || !callbacks || !job)
+    {
+        return EncoderStatus::NullParameter;
+    }
+
+    try
+    {
+        auto saveJob = std::make_shared<AsyncJob>(AsyncJobKind::SaveImage, completedCallback);
+        saveJob->SetSaveImageParameters(bitmap, options, metadata, callbacks);
+
+        *job = StartJob(saveJob);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return EncoderStatus::OutOfMemory;
+    }
+    catch (...)
+    {
+        return EncoderStatus::EncodeError;
+    }
+
+    return EncoderStatus::Ok;
+}
+
+DecoderStatus AsyncJobStartLoadImage(
+    DecoderCallbacks* callbacks,
+    const uint8_t* data,
+    size_t dataSize,
+    DecoderMetadataFlags metadataFlags,
+    AsyncJobCompletedProc completedCallback,
+    AsyncJob** job)
+{
+    if (!callbacks || !data || !job)
+    {
+        return DecoderStatus::NullParameter;
+    }
+
+    try
+    {
+        auto loadJob = std::make_shared<AsyncJob>(AsyncJobKind::LoadImage, completedCallback);
+        loadJob->SetLoadImageParameters(callbacks, data, dataSize, metadataFlags);
+
+        *job = StartJob(loadJob);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return DecoderStatus::OutOfMemory;
+    }
+    catch (...)
+    {
+        return DecoderStatus::DecodeError;
+    }
+
+    return DecoderStatus::Ok;
+}
+
+void AsyncJobSetMaxRunningJobs(uint32_t maxRunningJobs)
+{
+    try
+    {
+        JobQueue::Get().SetMaxRunningJobs(maxRunningJobs);
+    }
+    catch (...)
+    {
+        // The queued jobs run on the threads that were already started.
+    }
+}
+
+AsyncJobState AsyncJobGetState(const AsyncJob* job)
+{
+    return job ? job->GetState() : AsyncJobState::Completed;
+}
+
+int32_t AsyncJobGetProgress(const AsyncJob* job)
+{
+    return job ? job->GetProgress() : 0;
+}
+
+void* AsyncJobGetWaitHandle(const AsyncJob* job)
+{
+    return job ? job->GetWaitHandle() : nullptr;
+}
+
+bool AsyncJobWait(const AsyncJob* job, uint32_t timeoutMilliseconds)
+{
+    return !job || job->Wait(timeoutMilliseconds);
+}
+
+void AsyncJobCancel(AsyncJob* job)
+{
+    if (job)
+    {
+        job->Cancel();
+    }
+}
+
+EncoderStatus AsyncJobGetSaveImageResult(const AsyncJob* job, EncoderResult* result, ErrorInfo* errorInfo)
+{
+    if (!job)
+    {
+        return EncoderStatus::NullParameter;
+    }
+
+    if (job->GetKind() != AsyncJobKind::SaveImage)
+    {
+        SetErrorMessage(errorInfo, "The job is not a save image job.");
+        return EncoderStatus::EncodeError;
+    }
+
+    job->Wait(UINT32_MAX);
+
+    if (result)
+    {
+        *result = job->GetEncoderResult();
+    }
+
+    if (errorInfo)
+    {
+        *errorInfo = job->GetErrorInfo();
+    }
+
+    return static_cast<EncoderStatus>(job->GetStatus());
+}
+
+DecoderStatus AsyncJobGetLoadImageResult(const AsyncJob* job, ErrorInfo* errorInfo)
+{
+    if (!job)
+    {
+        return DecoderStatus::NullParameter;
+    }
+
+    if (job->GetKind() != AsyncJobKind::LoadImage)
+    {
+        SetErrorMessage(errorInfo, "The job is not a load image job.");
+        return DecoderStatus::InvalidParameter;
+    }
+
+    job->Wait(UINT32_MAX);
+
+    if (errorInfo)
+    {
+        *errorInfo = job->GetErrorInfo();
+    }
+
+    return static_cast<DecoderStatus>(job->GetStatus());
+}
+
+void AsyncJobClose(AsyncJob* job)
+{
+    if (job)
+    {
+        job->Cancel();
+        job->Wait(UINT32_MAX);
+
+        // The job is destroyed here unless it is still running its completion callback,
+        // in that case the job thread releases the last reference.
+        std::shared_ptr<AsyncJob> reference = job->ReleaseHandleReference();
+    }
+}
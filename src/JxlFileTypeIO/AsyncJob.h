@@ -0,0 +1,70 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include "JxlDecoderTypes.h"
+#include "JxlEncoderTypes.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// The asynchronous load and save jobs run on a process-wide queue of job threads, the job
+// handle is used to poll the progress, cancel the job, wait for it and read the result.
+//
+// The bitmap pixels, image data, metadata buffers and callbacks that are passed to a job must
+// remain valid until the job has completed. The options and the structures that hold the buffer
+// pointers are copied when the job is created.
+
+// The completedCallback parameter is optional and may be null.
+EncoderStatus AsyncJobStartSaveImage(
+    const BitmapData* bitmap,
+    const EncoderOptions* options,
+    const EncoderImageMetadata* metadata,
+    IOCallbacks* callbacks,
+    AsyncJobCompletedProc completedCallback,
+    AsyncJob** job);
+
+// The completedCallback parameter is optional and may be null.
+DecoderStatus AsyncJobStartLoadImage(
+    DecoderCallbacks* callbacks,
+    const uint8_t* data,
+    size_t dataSize,
+    DecoderMetadataFlags metadataFlags,
+    AsyncJobCompletedProc completedCallback,
+    AsyncJob** job);
+
+// Sets the maximum number of jobs that run at the same time, the other jobs wait in the queue.
+// A value of zero selects the default, which is the number of hardware threads.
+void AsyncJobSetMaxRunningJobs(uint32_t maxRunningJobs);
+
+AsyncJobState AsyncJobGetState(const AsyncJob* job);
+
+// Returns the last progress percentage that the job reported, from 0 to 100.
+int32_t AsyncJobGetProgress(const AsyncJob* job);
+
+// Returns a manual-reset event that is signaled when the job has completed, the event is owned by the job.
+void* AsyncJobGetWaitHandle(const AsyncJob* job);
+
+// Returns true if the job completed within the timeout, a timeout of UINT32_MAX waits forever.
+bool AsyncJobWait(const AsyncJob* job, uint32_t timeoutMilliseconds);
+
+// Requests cancellation, the job stops at its next progress report with the UserCanceled status.
+void AsyncJobCancel(AsyncJob* job);
+
+// Waits for a save job to complete and returns its status, the result parameter is optional and may be null.
+EncoderStatus AsyncJobGetSaveImageResult(const AsyncJob* job, EncoderResult* result, ErrorInfo* errorInfo);
+
+// Waits for a load job to complete and returns its status.
+DecoderStatus AsyncJobGetLoadImageResult(const AsyncJob* job, ErrorInfo* errorInfo);
+
+// Cancels the job if it is still running, waits for it to complete and releases the job handle.
+// This may be called from the completion callback.
+void AsyncJobClose(AsyncJob* job);
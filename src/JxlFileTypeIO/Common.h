@@ -52,6 +52,18 @@ struct IOCallbacks
     SeekCallback Seek;
 };
 
+class AsyncJob;
+
+enum class AsyncJobState : int32_t
+{
+    Queued = 0,
+    Running,
+    Completed
+};
+
+// Called on the job thread when an asynchronous job has completed.
+typedef void(__stdcall* AsyncJobCompletedProc)(AsyncJob* job);
+
 struct ErrorInfo
 {
     static const size_t maxErrorMessageLength = 255;
@@ -59,5 +71,43 @@ struct ErrorInfo
     char errorMessage[maxErrorMessageLength + 1];
 };
 
+enum class ParallelRunnerType : int32_t
+{
+    // The libjxl resizable parallel runner, it starts the threads for each image.
+    Resizable = 0,
+    // A process-wide pool of worker threads that steal tasks from each other, the workers
+    // are shared by the images that are decoded or encoded at the same time.
+    WorkStealing
+};
+
+enum class ParallelRunnerThreadAffinity : int32_t
+{
+    None = 0,
+    // Pins each work-stealing worker thread to a different logical processor.
+    PinWorkerThreads
+};
+
+// The parallel runner statistics for the images that have the same runner thread count and size class,
+// the times are in nanoseconds.
+struct ParallelRunnerStats
+{
+    uint32_t threadCount;
+    // The images have between 2^imageSizeLog2 and 2^(imageSizeLog2 + 1) - 1 pixels.
+    uint32_t imageSizeLog2;
+    uint64_t runCount;
+    uint64_t taskCount;
+    // The wall clock time of the parallel runs.
+    uint64_t wallTime;
+    // The time that the runner threads spent running tasks.
+    uint64_t busyTime;
+    // The time that the runner threads were waiting during the parallel runs, this is
+    // threadCount * wallTime - busyTime.
+    uint64_t idleTime;
+    // The busy time of the busiest thread in each run, a value close to wallTime means
+    // that the runs are limited by a single thread.
+    uint64_t busiestThreadTime;
+    uint64_t longestTaskTime;
+};
+
 void SetErrorMessage(ErrorInfo* errorInfo, const char* message);
 void SetErrorMessageFormat(ErrorInfo* errorInfo, const char* format, ...);
@@ -0,0 +1,240 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "AnimationDecoder.h"
+#include <stdexcept>
+
+namespace
+{
+    constexpr uint32_t allReferenceSlots = 0xF;
+
+    bool FrameReplacesCanvas(const JxlFrameHeader& frameHeader, const JxlBasicInfo& basicInfo)
+    {
+        const JxlLayerInfo& layerInfo = frameHeader.layer_info;
+
+        if (layerInfo.blend_info.blendmode != JXL_BLEND_REPLACE)
+        {
+            return false;
+        }
+
+        if (layerInfo.have_crop)
+        {
+            const int64_t left = layerInfo.crop_x0;
+            const int64_t top = layerInfo.crop_y0;
+            const int64_t right = left + static_cast<int64_t>(layerInfo.xsize);
+            const int64_t bottom = top + static_cast<int64_t>(layerInfo.ysize);
+
+            return left <= 0 && top <= 0 && right >= basicInfo.xsize && bottom >= basicInfo.ysize;
+        }
+
+        return true;
+    }
+
+    // Returns true if the result of blending the layer only depends on layers of the displayed frame
+    // that it belongs to. The independentSlots parameter is a bit mask of the reference frame slots
+    // that hold such a result, any part of the canvas that a layer does not replace is taken from the
+    // reference frame that its blend_info.source selects.
+    bool LayerIsIndependent(const JxlFrameHeader& frameHeader, const JxlBasicInfo& basicInfo, uint32_t independentSlots)
+    {
+        if (FrameReplacesCanvas(frameHeader, basicInfo))
+        {
+            return true;
+        }
+
+        const uint32_t source = frameHeader.layer_info.blend_info.source;
+
+        return source < 4 && (independentSlots & (1u << source)) != 0;
+    }
+
+    // Updates the reference frame slot that the layer is saved in, libjxl does not save a frame that
+    // has a non-zero duration and a save_as_reference value of 0.
+    void UpdateReferenceSlots(
+        const JxlFrameHeader& frameHeader,
+        bool layerIsIndependent,
+        uint32_t& independentSlots,
+        uint32_t& savedSlots)
+    {
+        const uint32_t slot = frameHeader.layer_info.save_as_reference;
+
+        if (slot >= 4 || (slot == 0 && frameHeader.duration != 0))
+        {
+            return;
+        }
+
+        savedSlots |= 1u << slot;
+
+        if (layerIsIndependent)
+        {
+            independentSlots |= 1u << slot;
+        }
+        else
+        {
+            independentSlots &= ~(1u << slot);
+        }
+    }
+}
+
+AnimationDecoder::AnimationDecoder(const uint8_t* imageDataBuffer, size_t imageDataBufferSize)
+    : context(imageDataBuffer, imageDataBufferSize, nullptr, nullptr),
+      imageData(imageDataBuffer),
+      imageDataSize(imageDataBufferSize),
+      animationInfo{},
+      frames(),
+      nextFrameIndex(0)
+{
+}
+
+DecoderContext& AnimationDecoder::GetContext()
+{
+    return context;
+}
+
+const AnimationInfo& AnimationDecoder::GetAnimationInfo() const
+{
+    return animationInfo;
+}
+
+const AnimationFrameInfo& AnimationDecoder::GetFrameInfo(uint32_t frameIndex) const
+{
+    return frames.at(frameIndex);
+}
+
+uint32_t AnimationDecoder::GetNextFrameIndex() const
+{
+    return nextFrameIndex;
+}
+
+void AnimationDecoder::SetNextFrameIndex(uint32_t frameIndex)
+{
+    nextFrameIndex = frameIndex;
+}
+
+void AnimationDecoder::BuildFrameIndex()
+{
+    // The index is built using a separate decoder that only parses the frame headers,
+    // libjxl skips the frame data when the full image event is not requested.
+    JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+
+    if (!dec)
+    {
+        throw std::runtime_error("Failed to create the decoder object.");
+    }
+
+    if (JxlDecoderSubscribeEvents(dec.get(), JXL_DEC_BASIC_INFO | JXL_DEC_FRAME) != JXL_DEC_SUCCESS)
+    {
+        throw std::runtime_error("JxlDecoderSubscribeEvents failed.");
+    }
+
+    // Coalescing is disabled so that the frame headers contain the blending information
+    // of each layer, which is used to find the key frames.
+    if (JxlDecoderSetCoalescing(dec.get(), JXL_FALSE) != JXL_DEC_SUCCESS)
+    {
+        throw std::runtime_error("JxlDecoderSetCoalescing failed.");
+    }
+
+    if (JxlDecoderSetInput(dec.get(), imageData, imageDataSize) != JXL_DEC_SUCCESS)
+    {
+        throw std::runtime_error("JxlDecoderSetInput failed.");
+    }
+
+    JxlDecoderCloseInput(dec.get());
+
+    JxlBasicInfo basicInfo{};
+    AnimationFrameInfo currentFrame{};
+    bool startOfDisplayedFrame = true;
+    // The reference frame slots are empty until a layer is saved in them, an empty slot does not
+    // depend on any of the frames.
+    uint32_t independentSlots = allReferenceSlots;
+    uint32_t savedSlots = 0;
+
+    frames.clear();
+
+    while (true)
+    {
+        const JxlDecoderStatus status = JxlDecoderProcessInput(dec.get());
+
+        if (status == JXL_DEC_ERROR)
+        {
+            throw std::runtime_error("JxlDecoderProcessInput failed.");
+        }
+        else if (status == JXL_DEC_SUCCESS)
+        {
+            break;
+        }
+        else if (status == JXL_DEC_NEED_MORE_INPUT)
+        {
+            throw std::runtime_error("JxlDecoderProcessInput needs more input, but it already received the entire image.");
+        }
+        else if (status == JXL_DEC_BASIC_INFO)
+        {
+            if (JxlDecoderGetBasicInfo(dec.get(), &basicInfo) != JXL_DEC_SUCCESS)
+            {
+                throw std::runtime_error("JxlDecoderGetBasicInfo failed.");
+            }
+
+            if (basicInfo.have_animation)
+            {
+                animationInfo.loopCount = basicInfo.animation.num_loops;
+                animationInfo.ticksPerSecondNumerator = basicInfo.animation.tps_numerator;
+                animationInfo.ticksPerSecondDenominator = basicInfo.animation.tps_denominator;
+            }
+        }
+        else if (status == JXL_DEC_FRAME)
+        {
+            JxlFrameHeader frameHeader{};
+
+            if (JxlDecoderGetFrameHeader(dec.get(), &frameHeader) != JXL_DEC_SUCCESS)
+            {
+                throw std::runtime_error("JxlDecoderGetFrameHeader failed.");
+            }
+
+            if (startOfDisplayedFrame)
+            {
+                // A displayed frame is made up of zero or more layers that have a duration of 0,
+                // followed by a layer with the frame duration. The slots that were saved by the
+                // previous displayed frames are not part of this frame.
+                currentFrame = {};
+                independentSlots = allReferenceSlots & ~savedSlots;
+                startOfDisplayedFrame = false;
+            }
+
+            // The displayed frame is a key frame when the last layer, which holds the blended result
+            // of the frame, does not depend on a layer from a previous displayed frame.
+            const bool layerIsIndependent = LayerIsIndependent(frameHeader, basicInfo, independentSlots);
+            currentFrame.isKeyFrame = layerIsIndependent;
+
+            UpdateReferenceSlots(frameHeader, layerIsIndependent, independentSlots, savedSlots);
+
+            if (frameHeader.duration != 0 || frameHeader.is_last || !basicInfo.have_animation)
+            {
+                currentFrame.duration = frameHeader.duration;
+
+                frames.push_back(currentFrame);
+                startOfDisplayedFrame = true;
+
+                if (!basicInfo.have_animation)
+                {
+                    // A still image is always displayed as a single coalesced frame.
+                    break;
+                }
+            }
+        }
+    }
+
+    if (frames.empty())
+    {
+        throw std::runtime_error("The image does not contain any frames.");
+    }
+
+    animationInfo.frameCount = static_cast<uint32_t>(frames.size());
+    nextFrameIndex = 0;
+}
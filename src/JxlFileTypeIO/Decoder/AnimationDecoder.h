@@ -0,0 +1,40 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include "DecoderContext.h"
+#include "JxlDecoderTypes.h"
+#include <vector>
+
+class AnimationDecoder
+{
+public:
+    AnimationDecoder(const uint8_t* imageDataBuffer, size_t imageDataBufferSize);
+
+    DecoderContext& GetContext();
+
+    const AnimationInfo& GetAnimationInfo() const;
+    const AnimationFrameInfo& GetFrameInfo(uint32_t frameIndex) const;
+
+    uint32_t GetNextFrameIndex() const;
+    void SetNextFrameIndex(uint32_t frameIndex);
+
+    void BuildFrameIndex();
+
+private:
+    DecoderContext context;
+    const uint8_t* imageData;
+    size_t imageDataSize;
+    AnimationInfo animationInfo;
+    std::vector<AnimationFrameInfo> frames;
+    uint32_t nextFrameIndex;
+};
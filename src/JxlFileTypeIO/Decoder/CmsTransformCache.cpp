@@ -0,0 +1,433 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "CmsTransformCache.h"
+#include "Tracing.h"
+#include "jxl/cms.h"
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    // The maximum number of unused transforms that are kept in the pool.
+    constexpr size_t maxPooledTransforms = 16;
+    // The maximum number of parsed ICC profiles that are kept in the cache.
+    constexpr size_t maxParsedProfiles = 64;
+
+    template <typename T>
+    void AppendValue(std::string& key, const T& value)
+    {
+        key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    // The color encoding fields are appended one at a time, the structure padding is not initialized.
+    void AppendColorEncoding(std::string& key, const JxlColorEncoding& encoding)
+    {
+        AppendValue(key, encoding.color_space);
+        AppendValue(key, encoding.white_point);
+        AppendValue(key, encoding.white_point_xy);
+        AppendValue(key, encoding.primaries);
+        AppendValue(key, encoding.primaries_red_xy);
+        AppendValue(key, encoding.primaries_green_xy);
+        AppendValue(key, encoding.primaries_blue_xy);
+        AppendValue(key, encoding.transfer_function);
+        AppendValue(key, encoding.gamma);
+        AppendValue(key, encoding.rendering_intent);
+    }
+
+    void AppendColorProfile(std::string& key, const JxlColorProfile* profile)
+    {
+        AppendValue(key, profile->num_channels);
+        AppendColorEncoding(key, profile->color_encoding);
+        AppendValue(key, profile->icc.size);
+
+        if (profile->icc.data && profile->icc.size > 0)
+        {
+            key.append(reinterpret_cast<const char*>(profile->icc.data), profile->icc.size);
+        }
+    }
+
+    // The key holds the color profiles, which include the channel counts of the pixel format, and
+    // the intensity target. The thread count and pixels per thread depend on the image size, so they
+    // are not part of the key. The keys are compared in full so that a hash collision cannot return
+    // the wrong transform.
+    std::string MakeTransformKey(
+        const JxlColorProfile* input,
+        const JxlColorProfile* output,
+        float intensityTarget)
+    {
+        std::string key;
+        key.reserve(128 + input->icc.size + output->icc.size);
+
+        AppendValue(key, intensityTarget);
+        AppendColorProfile(key, input);
+        AppendColorProfile(key, output);
+
+        return key;
+    }
+
+    // A transform that was created by the default CMS, the key is used to return it to the pool.
+    //
+    // The default CMS state has its own buffers for the thread count and pixels per thread that it was
+    // created with. The transform is reused for a decode with a lower or equal thread count, the source
+    // and destination buffers are owned by the transform and grow to the size that each decode requests.
+    // The pixels are passed to the default CMS in chunks that fit in its buffers.
+    struct CachedTransform
+    {
+        std::string key;
+        void* state;
+        size_t stateThreadCount;
+        size_t statePixelsPerThread;
+        size_t inputChannelCount;
+        size_t outputChannelCount;
+        std::vector<std::vector<float>> sourceBuffers;
+        std::vector<std::vector<float>> destinationBuffers;
+    };
+
+    // Sizes the per-thread buffers of the transform for a decode, the buffers are only ever grown.
+    void ResizeBuffers(CachedTransform* transform, size_t threadCount, size_t pixelsPerThread)
+    {
+        const size_t sourceSize = pixelsPerThread * transform->inputChannelCount;
+        const size_t destinationSize = pixelsPerThread * transform->outputChannelCount;
+
+        if (transform->sourceBuffers.size() < threadCount)
+        {
+            transform->sourceBuffers.resize(threadCount);
+            transform->destinationBuffers.resize(threadCount);
+        }
+
+        for (size_t i = 0; i < threadCount; i++)
+        {
+            if (transform->sourceBuffers[i].size() < sourceSize)
+            {
+                transform->sourceBuffers[i].resize(sourceSize);
+            }
+
+            if (transform->destinationBuffers[i].size() < destinationSize)
+            {
+                transform->destinationBuffers[i].resize(destinationSize);
+            }
+        }
+    }
+
+    struct ParsedProfile
+    {
+        JXL_BOOL succeeded;
+        JxlColorEncoding encoding;
+        JXL_BOOL cmyk;
+    };
+
+    // The pooled transforms are not destroyed when the process exits, they only hold memory.
+    class TransformCache
+    {
+    public:
+        static TransformCache& Get()
+        {
+            static TransformCache cache;
+
+            return cache;
+        }
+
+        TransformCache() : defaultCms(*JxlGetDefaultCms())
+        {
+        }
+
+        TransformCache(const TransformCache&) = delete;
+        TransformCache& operator=(const TransformCache&) = delete;
+
+        const JxlCmsInterface& GetDefaultCms() const
+        {
+            return defaultCms;
+        }
+
+        CachedTransform* Init(
+            size_t threadCount,
+            size_t pixelsPerThread,
+            const JxlColorProfile* input,
+            const JxlColorProfile* output,
+            float intensityTarget)
+        {
+            if (threadCount == 0 || pixelsPerThread == 0)
+            {
+                return nullptr;
+            }
+
+            std::string key = MakeTransformKey(input, output, intensityTarget);
+
+            CachedTransform* pooledTransform = nullptr;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                for (auto it = pool.begin(); it != pool.end(); ++it)
+                {
+                    if ((*it)->key == key && (*it)->stateThreadCount >= threadCount)
+                    {
+                        pooledTransform = *it;
+                        pool.erase(it);
+                        break;
+                    }
+                }
+            }
+
+            if (pooledTransform)
+            {
+                try
+                {
+                    ResizeBuffers(pooledTransform, threadCount, pixelsPerThread);
+                }
+                catch (...)
+                {
+                    Release(pooledTransform);
+                    return nullptr;
+                }
+
+                return pooledTransform;
+            }
+
+            Tracing::Span span("JxlCmsInterface::init", "decode");
+
+            void* state = defaultCms.init(
+                defaultCms.init_data,
+                threadCount,
+                pixelsPerThread,
+                input,
+                output,
+                intensityTarget);
+
+            if (!state)
+            {
+                return nullptr;
+            }
+
+            std::unique_ptr<CachedTransform> transform;
+
+            try
+            {
+                transform = std::make_unique<CachedTransform>();
+                transform->key = std::move(key);
+                transform->state = state;
+                transform->stateThreadCount = threadCount;
+                transform->statePixelsPerThread = pixelsPerThread;
+                transform->inputChannelCount = input->num_channels;
+                transform->outputChannelCount = output->num_channels;
+
+                ResizeBuffers(transform.get(), threadCount, pixelsPerThread);
+            }
+            catch (...)
+            {
+                defaultCms.destroy(state);
+                return nullptr;
+            }
+
+            return transform.release();
+        }
+
+        JXL_BOOL Run(CachedTransform* transform, size_t thread, const float* input, float* output, size_t pixelCount) const
+        {
+            const size_t chunkSize = transform->statePixelsPerThread;
+
+            for (size_t offset = 0; offset < pixelCount; offset += chunkSize)
+            {
+                if (!defaultCms.run(
+                    transform->state,
+                    thread,
+                    input + offset * transform->inputChannelCount,
+                    output + offset * transform->outputChannelCount,
+                    std::min(chunkSize, pixelCount - offset)))
+                {
+                    return JXL_FALSE;
+                }
+            }
+
+            return JXL_TRUE;
+        }
+
+        void Release(CachedTransform* transform)
+        {
+            CachedTransform* evicted = transform;
+
+            try
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                pool.push_front(transform);
+                evicted = nullptr;
+
+                if (pool.size() > maxPooledTransforms)
+                {
+                    evicted = pool.back();
+                    pool.pop_back();
+                }
+            }
+            catch (...)
+            {
+                // The transform is destroyed if it cannot be added to the pool.
+            }
+
+            if (evicted)
+            {
+                defaultCms.destroy(evicted->state);
+                delete evicted;
+            }
+        }
+
+        JXL_BOOL SetFieldsFromIcc(
+            const uint8_t* iccData,
+            size_t iccSize,
+            JxlColorEncoding* encoding,
+            JXL_BOOL* cmyk)
+        {
+            std::string key(reinterpret_cast<const char*>(iccData), iccSize);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                auto it = parsedProfiles.find(key);
+
+                if (it != parsedProfiles.end())
+                {
+                    *encoding = it->second.encoding;
+                    *cmyk = it->second.cmyk;
+                    return it->second.succeeded;
+                }
+            }
+
+            ParsedProfile profile{};
+
+            profile.succeeded = defaultCms.set_fields_from_icc(
+                defaultCms.set_fields_data,
+                iccData,
+                iccSize,
+                &profile.encoding,
+                &profile.cmyk);
+
+            *encoding = profile.encoding;
+            *cmyk = profile.cmyk;
+
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (parsedProfiles.size() >= maxParsedProfiles)
+            {
+                // The oldest profile is removed first.
+                parsedProfiles.erase(parsedProfileOrder.front());
+                parsedProfileOrder.pop_front();
+            }
+
+            if (parsedProfiles.emplace(key, profile).second)
+            {
+                parsedProfileOrder.push_back(std::move(key));
+            }
+
+            return profile.succeeded;
+        }
+
+    private:
+        const JxlCmsInterface defaultCms;
+        std::mutex mutex;
+        // The most recently released transforms are at the front of the list.
+        std::list<CachedTransform*> pool;
+        std::unordered_map<std::string, ParsedProfile> parsedProfiles;
+        std::list<std::string> parsedProfileOrder;
+    };
+
+    JXL_BOOL SetFieldsFromIcc(
+        void* userData,
+        const uint8_t* iccData,
+        size_t iccSize,
+        JxlColorEncoding* encoding,
+        JXL_BOOL* cmyk)
+    {
+        try
+        {
+            return static_cast<TransformCache*>(userData)->SetFieldsFromIcc(iccData, iccSize, encoding, cmyk);
+        }
+        catch (...)
+        {
+            return JXL_FALSE;
+        }
+    }
+
+    void* Init(
+        void* initData,
+        size_t threadCount,
+        size_t pixelsPerThread,
+        const JxlColorProfile* input,
+        const JxlColorProfile* output,
+        float intensityTarget)
+    {
+        try
+        {
+            return static_cast<TransformCache*>(initData)->Init(
+                threadCount,
+                pixelsPerThread,
+                input,
+                output,
+                intensityTarget);
+        }
+        catch (...)
+        {
+            return nullptr;
+        }
+    }
+
+    float* GetSourceBuffer(void* userData, size_t thread)
+    {
+        CachedTransform* transform = static_cast<CachedTransform*>(userData);
+
+        return transform->sourceBuffers[thread].data();
+    }
+
+    float* GetDestinationBuffer(void* userData, size_t thread)
+    {
+        CachedTransform* transform = static_cast<CachedTransform*>(userData);
+
+        return transform->destinationBuffers[thread].data();
+    }
+
+    JXL_BOOL Run(void* userData, size_t thread, const float* input, float* output, size_t pixelCount)
+    {
+        CachedTransform* transform = static_cast<CachedTransform*>(userData);
+
+        return TransformCache::Get().Run(transform, thread, input, output, pixelCount);
+    }
+
+    void Destroy(void* userData)
+    {
+        if (userData)
+        {
+            TransformCache::Get().Release(static_cast<CachedTransform*>(userData));
+        }
+    }
+}
+
+const JxlCmsInterface& CmsTransformCache::GetInterface()
+{
+    static const JxlCmsInterface cms
+    {
+        &TransformCache::Get(),
+        SetFieldsFromIcc,
+        &TransformCache::Get(),
+        Init,
+        GetSourceBuffer,
+        GetDestinationBuffer,
+        Run,
+        Destroy
+    };
+
+    return cms;
+}
@@ -0,0 +1,26 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include "jxl/cms_interface.h"
+
+// A JxlCmsInterface that wraps the libjxl default CMS and reuses its work across decodes.
+//
+// The color transforms are kept in a process-wide pool when libjxl destroys them, a later decode that
+// converts between the same color profiles with the same pixel format and intensity target takes the
+// transform from the pool instead of creating it again. The image size does not have to match, the
+// transform buffers are sized for each decode. The results of parsing an ICC profile are also cached,
+// keyed by the profile data.
+namespace CmsTransformCache
+{
+    const JxlCmsInterface& GetInterface();
+}
@@ -0,0 +1,62 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "CmykConversion.h"
+
+void CmykConversion::CmyaAndKeyToCmyka(
+    const uint8_t* cmyaScan0,
+    const uint8_t* keyScan0,
+    size_t width,
+    size_t height,
+    bool hasTransparency,
+    uint8_t* outputScan0)
+{
+    const size_t transparencyChannelCount = hasTransparency ? 1 : 0;
+    const size_t cmyaChannelCount = 3 + transparencyChannelCount;
+    const size_t totalChannelCount = 4 + transparencyChannelCount;
+
+    const size_t outputStride = width * totalChannelCount;
+    const size_t cmyaStride = width * cmyaChannelCount;
+    const size_t keyStride = width;
+
+    for (size_t y = 0; y < height; y++)
+    {
+        const uint8_t* cmya = cmyaScan0 + (y * cmyaStride);
+        const uint8_t* key = keyScan0 + (y * keyStride);
+        uint8_t* dst = outputScan0 + (y * outputStride);
+
+        for (size_t x = 0; x < width; x++)
+        {
+            // Jpeg XL stores CMYK images with 0 representing black/full ink.
+            // https://discord.com/channels/794206087879852103/804324493420920833/1317698217273458738
+            //
+            // "The K channel of a CMYK image. If present, a CMYK ICC profile is also present,
+            // and the RGB samples are to be interpreted as CMY, where 0 denotes full ink."
+            //
+            // WIC requires that 0 is white/no ink, so we have to invert the CMYK data.
+
+            dst[0] = static_cast<uint8_t>(0xff - cmya[0]); // C
+            dst[1] = static_cast<uint8_t>(0xff - cmya[1]); // M
+            dst[2] = static_cast<uint8_t>(0xff - cmya[2]); // Y
+            dst[3] = static_cast<uint8_t>(0xff - key[0]);  // K
+
+            if (hasTransparency)
+            {
+                dst[4] = cmya[3]; // A
+            }
+
+            dst += totalChannelCount;
+            cmya += cmyaChannelCount;
+            key++;
+        }
+    }
+}
@@ -0,0 +1,32 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace CmykConversion
+{
+    // Combines the libjxl CMY(A) color data and K extra channel into an interleaved CMYK(A) image.
+    //
+    // Jpeg XL stores CMYK images with 0 representing full ink, the output uses
+    // 0 for no ink because that is what WIC requires.
+    // The alpha channel is copied without any changes.
+    void CmyaAndKeyToCmyka(
+        const uint8_t* cmyaScan0,
+        const uint8_t* keyScan0,
+        size_t width,
+        size_t height,
+        bool hasTransparency,
+        uint8_t* outputScan0);
+}
@@ -0,0 +1,734 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "DecodedImageCache.h"
+#include "Tracing.h"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    // The 64-bit xxHash algorithm, the cache only needs a fast hash with a low collision rate
+    // and does not depend on the hash values being stable between versions. A hash match is
+    // confirmed by comparing the file data, so a collision cannot replay the wrong image.
+    namespace ContentHash
+    {
+        constexpr uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+        constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+        constexpr uint64_t prime3 = 0x165667B19E3779F9ULL;
+        constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+        constexpr uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+        uint64_t RotateLeft(uint64_t value, int count)
+        {
+            return (value << count) | (value >> (64 - count));
+        }
+
+        uint64_t Read64(const uint8_t* data)
+        {
+            uint64_t value;
+            memcpy(&value, data, sizeof(value));
+            return value;
+        }
+
+        uint32_t Read32(const uint8_t* data)
+        {
+            uint32_t value;
+            memcpy(&value, data, sizeof(value));
+            return value;
+        }
+
+        uint64_t Round(uint64_t accumulator, uint64_t input)
+        {
+            accumulator += input * prime2;
+            accumulator = RotateLeft(accumulator, 31);
+            return accumulator * prime1;
+        }
+
+        uint64_t MergeRound(uint64_t accumulator, uint64_t value)
+        {
+            accumulator ^= Round(0, value);
+            return (accumulator * prime1) + prime4;
+        }
+
+        uint64_t Compute(const uint8_t* data, size_t size)
+        {
+            const uint8_t* const end = data + size;
+            uint64_t hash;
+
+            if (size >= 32)
+            {
+                uint64_t v1 = prime1 + prime2;
+                uint64_t v2 = prime2;
+                uint64_t v3 = 0;
+                uint64_t v4 = 0 - prime1;
+
+                const uint8_t* const limit = end - 32;
+
+                do
+                {
+                    v1 = Round(v1, Read64(data));
+                    v2 = Round(v2, Read64(data + 8));
+                    v3 = Round(v3, Read64(data + 16));
+                    v4 = Round(v4, Read64(data + 24));
+                    data += 32;
+                } while (data <= limit);
+
+                hash = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) + RotateLeft(v4, 18);
+                hash = MergeRound(hash, v1);
+                hash = MergeRound(hash, v2);
+                hash = MergeRound(hash, v3);
+                hash = MergeRound(hash, v4);
+            }
+            else
+            {
+                hash = prime5;
+            }
+
+            hash += static_cast<uint64_t>(size);
+
+            while (end - data >= 8)
+            {
+                hash ^= Round(0, Read64(data));
+                hash = (RotateLeft(hash, 27) * prime1) + prime4;
+                data += 8;
+            }
+
+            if (end - data >= 4)
+            {
+                hash ^= static_cast<uint64_t>(Read32(data)) * prime1;
+                hash = (RotateLeft(hash, 23) * prime2) + prime3;
+                data += 4;
+            }
+
+            while (data < end)
+            {
+                hash ^= (*data) * prime5;
+                hash = RotateLeft(hash, 11) * prime1;
+                data++;
+            }
+
+            hash ^= hash >> 33;
+            hash *= prime2;
+            hash ^= hash >> 29;
+            hash *= prime3;
+            hash ^= hash >> 32;
+
+            return hash;
+        }
+    }
+
+    struct CacheKey
+    {
+        uint64_t hash;
+        uint64_t dataSize;
+        DecoderMetadataFlags metadataFlags;
+
+        bool operator==(const CacheKey& other) const
+        {
+            return hash == other.hash && dataSize == other.dataSize && metadataFlags == other.metadataFlags;
+        }
+    };
+
+    struct CacheKeyHash
+    {
+        size_t operator()(const CacheKey& key) const
+        {
+            return static_cast<size_t>(key.hash);
+        }
+    };
+
+    enum class CachedCallbackType
+    {
+        IccProfile,
+        KnownColorProfile,
+        Exif,
+        Xmp,
+        LayerData
+    };
+
+    // A DecoderCallbacks method call after setBasicInfo, the data holds the profile,
+    // metadata or layer pixels.
+    struct CachedCallback
+    {
+        CachedCallbackType type;
+        KnownColorProfile knownColorProfile;
+        DecoderLayerInfo layerInfo;
+        std::vector<uint8_t> data;
+        std::vector<char> layerName;
+    };
+
+    struct CachedImage
+    {
+        int32_t width;
+        int32_t height;
+        DecoderImageFormat format;
+        ImageChannelRepresentation channelRepresentation;
+        bool hasTransparency;
+        bool hasAnimation;
+        std::vector<CachedCallback> callbacks;
+        // A copy of the file that was decoded, used to confirm that a cache hit is the same image.
+        std::vector<uint8_t> fileData;
+        uint64_t sizeInBytes;
+    };
+
+    bool IsSameFile(const CachedImage& image, const uint8_t* data, size_t dataSize)
+    {
+        Tracing::Span span("DecodedImageCache::CompareFileData", "decode");
+
+        return image.fileData.size() == dataSize
+            && (dataSize == 0 || memcmp(image.fileData.data(), data, dataSize) == 0);
+    }
+
+    // The callbacks are replayed with the same status values that the decoder uses when a callback fails.
+    DecoderStatus ReplayCachedImage(const CachedImage& image, DecoderCallbacks* callbacks)
+    {
+        Tracing::Span span("DecodedImageCache::Replay", "decode");
+
+        callbacks->setBasicInfo(
+            image.width,
+            image.height,
+            image.format,
+            image.channelRepresentation,
+            image.hasTransparency,
+            image.hasAnimation);
+
+        for (const CachedCallback& item : image.callbacks)
+        {
+            // The cached buffers are shared by all of the callers that replay the image.
+            uint8_t* data = const_cast<uint8_t*>(item.data.data());
+
+            switch (item.type)
+            {
+            case CachedCallbackType::IccProfile:
+                if (!callbacks->setIccProfile(data, item.data.size()))
+                {
+                    return DecoderStatus::CreateMetadataError;
+                }
+                break;
+            case CachedCallbackType::KnownColorProfile:
+                if (!callbacks->setKnownColorProfile(item.knownColorProfile))
+                {
+                    return DecoderStatus::CreateMetadataError;
+                }
+                break;
+            case CachedCallbackType::Exif:
+                if (!callbacks->setExif(data, item.data.size()))
+                {
+                    return DecoderStatus::CreateMetadataError;
+                }
+                break;
+            case CachedCallbackType::Xmp:
+                if (!callbacks->setXmp(data, item.data.size()))
+                {
+                    return DecoderStatus::CreateMetadataError;
+                }
+                break;
+            case CachedCallbackType::LayerData:
+                if (!callbacks->setLayerData(
+                    data,
+                    &item.layerInfo,
+                    item.layerName.empty() ? nullptr : const_cast<char*>(item.layerName.data()),
+                    item.layerName.size()))
+                {
+                    return DecoderStatus::CreateLayerError;
+                }
+                break;
+            }
+        }
+
+        return DecoderStatus::Ok;
+    }
+
+    size_t GetBytesPerPixel(const CachedImage& image)
+    {
+        size_t channelCount = 0;
+
+        switch (image.format)
+        {
+        case DecoderImageFormat::Gray:
+            channelCount = 1;
+            break;
+        case DecoderImageFormat::Rgb:
+            channelCount = 3;
+            break;
+        case DecoderImageFormat::Cmyk:
+            channelCount = 4;
+            break;
+        }
+
+        if (image.hasTransparency)
+        {
+            channelCount++;
+        }
+
+        switch (image.channelRepresentation)
+        {
+        case ImageChannelRepresentation::Uint8:
+            return channelCount;
+        case ImageChannelRepresentation::Uint16:
+        case ImageChannelRepresentation::Float16:
+            return channelCount * 2;
+        case ImageChannelRepresentation::Float32:
+            return channelCount * 4;
+        default:
+            return 0;
+        }
+    }
+
+    // Forwards the decoder callbacks to the caller and copies the values into a CachedImage.
+    // The DecoderCallbacks methods do not have a context parameter, so the recorder for the
+    // decode that is running on the current thread is stored in a thread local variable.
+    // The recording stops when the image would be larger than the cache, the image could not
+    // be added to the cache and the recorded buffers would only increase the peak memory usage.
+    class ImageRecorder
+    {
+    public:
+        ImageRecorder(DecoderCallbacks* callbacks, uint64_t maxSizeInBytes)
+            : callbacks(callbacks),
+              image(std::make_shared<CachedImage>()),
+              maxSizeInBytes(maxSizeInBytes),
+              hasBasicInfo(false),
+              failed(false),
+              previousRecorder(currentRecorder)
+        {
+            image->sizeInBytes = sizeof(CachedImage);
+            failed = image->sizeInBytes > maxSizeInBytes;
+            currentRecorder = this;
+        }
+
+        ImageRecorder(const ImageRecorder&) = delete;
+        ImageRecorder& operator=(const ImageRecorder&) = delete;
+
+        ~ImageRecorder()
+        {
+            currentRecorder = previousRecorder;
+        }
+
+        DecoderCallbacks* GetRecordingCallbacks()
+        {
+            return &recordingCallbacks;
+        }
+
+        // Returns null if the image could not be recorded.
+        std::shared_ptr<const CachedImage> GetImage() const
+        {
+            return hasBasicInfo && !failed ? image : nullptr;
+        }
+
+        // Stores a copy of the file data in the image, this is called after the decoding has finished.
+        void RecordFileData(const uint8_t* data, size_t dataSize)
+        {
+            if (failed)
+            {
+                return;
+            }
+
+            if (!Reserve(dataSize))
+            {
+                return;
+            }
+
+            try
+            {
+                if (dataSize > 0)
+                {
+                    image->fileData.assign(data, data + dataSize);
+                }
+            }
+            catch (...)
+            {
+                StopRecording();
+            }
+        }
+
+    private:
+        static void __stdcall SetBasicInfo(
+            int32_t width,
+            int32_t height,
+            DecoderImageFormat format,
+            ImageChannelRepresentation channelFormat,
+            bool hasTransparency,
+            bool hasAnimation)
+        {
+            ImageRecorder* recorder = currentRecorder;
+
+            recorder->callbacks->setBasicInfo(width, height, format, channelFormat, hasTransparency, hasAnimation);
+
+            CachedImage& image = *recorder->image;
+            image.width = width;
+            image.height = height;
+            image.format = format;
+            image.channelRepresentation = channelFormat;
+            image.hasTransparency = hasTransparency;
+            image.hasAnimation = hasAnimation;
+            recorder->hasBasicInfo = true;
+        }
+
+        static bool __stdcall SetIccProfile(uint8_t* data, size_t length)
+        {
+            ImageRecorder* recorder = currentRecorder;
+
+            recorder->Record(CachedCallbackType::IccProfile, data, length);
+
+            return recorder->callbacks->setIccProfile(data, length);
+        }
+
+        static bool __stdcall SetKnownColorProfile(KnownColorProfile profile)
+        {
+            ImageRecorder* recorder = currentRecorder;
+
+            if (CachedCallback* item = recorder->Record(CachedCallbackType::KnownColorProfile, nullptr, 0))
+            {
+                item->knownColorProfile = profile;
+            }
+
+            return recorder->callbacks->setKnownColorProfile(profile);
+        }
+
+        static bool __stdcall SetExif(uint8_t* data, size_t length)
+        {
+            ImageRecorder* recorder = currentRecorder;
+
+            recorder->Record(CachedCallbackType::Exif, data, length);
+
+            return recorder->callbacks->setExif(data, length);
+        }
+
+        static bool __stdcall SetXmp(uint8_t* data, size_t length)
+        {
+            ImageRecorder* recorder = currentRecorder;
+
+            recorder->Record(CachedCallbackType::Xmp, data, length);
+
+            return recorder->callbacks->setXmp(data, length);
+        }
+
+        static bool __stdcall SetLayerData(
+            uint8_t* pixels,
+            const DecoderLayerInfo* layerInfo,
+            char* name,
+            size_t nameLength)
+        {
+            ImageRecorder* recorder = currentRecorder;
+
+            // The decoder does not pass the buffer size, the layer pixels are tightly packed
+            // in the format that was reported by setBasicInfo.
+            const size_t bytesPerPixel = recorder->hasBasicInfo ? GetBytesPerPixel(*recorder->image) : 0;
+
+            if (bytesPerPixel == 0 || layerInfo->width < 0 || layerInfo->height < 0)
+            {
+                recorder->StopRecording();
+            }
+            else
+            {
+                const size_t pixelsSize = static_cast<size_t>(layerInfo->width) * static_cast<size_t>(layerInfo->height) * bytesPerPixel;
+
+                if (CachedCallback* item = recorder->Record(CachedCallbackType::LayerData, pixels, pixelsSize))
+                {
+                    item->layerInfo = *layerInfo;
+
+                    if (name && nameLength > 0 && recorder->Reserve(nameLength))
+                    {
+                        try
+                        {
+                            item->layerName.assign(name, name + nameLength);
+                        }
+                        catch (...)
+                        {
+                            recorder->StopRecording();
+                        }
+                    }
+                }
+            }
+
+            return recorder->callbacks->setLayerData(pixels, layerInfo, name, nameLength);
+        }
+
+        // A failure to record a callback only prevents the image from being cached.
+        CachedCallback* Record(CachedCallbackType type, const uint8_t* data, size_t length)
+        {
+            if (failed || length > SIZE_MAX - sizeof(CachedCallback) || !Reserve(sizeof(CachedCallback) + length))
+            {
+                return nullptr;
+            }
+
+            try
+            {
+                CachedCallback& item = image->callbacks.emplace_back();
+                item.type = type;
+                item.knownColorProfile = KnownColorProfile::Srgb;
+                item.layerInfo = {};
+
+                if (data && length > 0)
+                {
+                    item.data.assign(data, data + length);
+                }
+
+                return &item;
+            }
+            catch (...)
+            {
+                StopRecording();
+                return nullptr;
+            }
+        }
+
+        // Adds the size to the image, or stops the recording if the image would be larger than the cache.
+        bool Reserve(size_t size)
+        {
+            if (failed)
+            {
+                return false;
+            }
+
+            if (size > maxSizeInBytes - image->sizeInBytes)
+            {
+                StopRecording();
+                return false;
+            }
+
+            image->sizeInBytes += size;
+
+            return true;
+        }
+
+        // Frees the recorded buffers, the remaining callbacks are only forwarded to the caller.
+        void StopRecording()
+        {
+            failed = true;
+            std::vector<CachedCallback>().swap(image->callbacks);
+            std::vector<uint8_t>().swap(image->fileData);
+        }
+
+        static thread_local ImageRecorder* currentRecorder;
+
+        DecoderCallbacks* callbacks;
+        std::shared_ptr<CachedImage> image;
+        uint64_t maxSizeInBytes;
+        bool hasBasicInfo;
+        bool failed;
+        ImageRecorder* previousRecorder;
+        DecoderCallbacks recordingCallbacks
+        {
+            SetBasicInfo,
+            SetIccProfile,
+            SetKnownColorProfile,
+            SetExif,
+            SetXmp,
+            SetLayerData
+        };
+    };
+
+    thread_local ImageRecorder* ImageRecorder::currentRecorder = nullptr;
+
+    class Cache
+    {
+    public:
+        Cache() : maxSize(0), currentSize(0)
+        {
+        }
+
+        void SetMaxSize(uint64_t maxSizeInBytes)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            maxSize = maxSizeInBytes;
+            EvictEntries();
+        }
+
+        void Clear()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            entries.clear();
+            index.clear();
+            currentSize = 0;
+        }
+
+        bool IsEnabled()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            return maxSize > 0;
+        }
+
+        uint64_t GetMaxSize()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            return maxSize;
+        }
+
+        std::shared_ptr<const CachedImage> Find(const CacheKey& key)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            auto it = index.find(key);
+
+            if (it == index.end())
+            {
+                return nullptr;
+            }
+
+            // Move the entry to the front of the least recently used list.
+            entries.splice(entries.begin(), entries, it->second);
+
+            return it->second->image;
+        }
+
+        void Add(const CacheKey& key, const std::shared_ptr<const CachedImage>& image)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            // The images that are larger than the cache would evict every other entry.
+            if (image->sizeInBytes > maxSize || index.find(key) != index.end())
+            {
+                return;
+            }
+
+            entries.push_front(Entry{ key, image });
+
+            try
+            {
+                index.emplace(key, entries.begin());
+            }
+            catch (...)
+            {
+                entries.pop_front();
+                throw;
+            }
+
+            currentSize += image->sizeInBytes;
+            EvictEntries();
+        }
+
+    private:
+        struct Entry
+        {
+            CacheKey key;
+            std::shared_ptr<const CachedImage> image;
+        };
+
+        // The entries are removed from the back of the list, which holds the least recently used entries.
+        // An entry that is being replayed stays alive until the replay has finished.
+        void EvictEntries()
+        {
+            while (currentSize > maxSize && !entries.empty())
+            {
+                const Entry& entry = entries.back();
+
+                currentSize -= entry.image->sizeInBytes;
+                index.erase(entry.key);
+                entries.pop_back();
+            }
+        }
+
+        std::mutex mutex;
+        std::list<Entry> entries;
+        std::unordered_map<CacheKey, std::list<Entry>::iterator, CacheKeyHash> index;
+        uint64_t maxSize;
+        uint64_t currentSize;
+    };
+
+    Cache& GetCache()
+    {
+        static Cache cache;
+
+        return cache;
+    }
+}
+
+void DecodedImageCache::SetMaxSize(uint64_t maxSizeInBytes)
+{
+    GetCache().SetMaxSize(maxSizeInBytes);
+}
+
+void DecodedImageCache::Clear()
+{
+    GetCache().Clear();
+}
+
+bool DecodedImageCache::IsEnabled()
+{
+    return GetCache().IsEnabled();
+}
+
+DecoderStatus DecodedImageCache::ReadImage(
+    DecoderCallbacks* callbacks,
+    const uint8_t* data,
+    size_t dataSize,
+    DecoderMetadataFlags metadataFlags,
+    ProgressProc progressCallback,
+    const std::function<DecoderStatus(DecoderCallbacks*)>& decodeImage)
+{
+    CacheKey key{};
+
+    {
+        Tracing::Span span("DecodedImageCache::ComputeKey", "decode");
+
+        key.hash = ContentHash::Compute(data, dataSize);
+        key.dataSize = dataSize;
+        key.metadataFlags = metadataFlags;
+    }
+
+    Cache& cache = GetCache();
+
+    // The key only holds a hash of the file data, an entry with a matching key is treated as
+    // a cache miss if it was created from a different file.
+    std::shared_ptr<const CachedImage> cachedImage = cache.Find(key);
+
+    if (cachedImage && IsSameFile(*cachedImage, data, dataSize))
+    {
+        // The first and last progress values match the ones that the decoder reports.
+        if (progressCallback && !progressCallback(5))
+        {
+            return DecoderStatus::UserCanceled;
+        }
+
+        DecoderStatus status = ReplayCachedImage(*cachedImage, callbacks);
+
+        if (status == DecoderStatus::Ok && progressCallback && !progressCallback(100))
+        {
+            status = DecoderStatus::UserCanceled;
+        }
+
+        return status;
+    }
+
+    ImageRecorder recorder(callbacks, cache.GetMaxSize());
+
+    const DecoderStatus status = decodeImage(recorder.GetRecordingCallbacks());
+
+    if (status == DecoderStatus::Ok)
+    {
+        recorder.RecordFileData(data, dataSize);
+
+        if (std::shared_ptr<const CachedImage> image = recorder.GetImage())
+        {
+            // A failure to add the image only prevents it from being cached.
+            try
+            {
+                cache.Add(key, image);
+            }
+            catch (...)
+            {
+            }
+        }
+    }
+
+    return status;
+}
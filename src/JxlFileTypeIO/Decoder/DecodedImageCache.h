@@ -0,0 +1,49 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include "JxlDecoderTypes.h"
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+
+// A size-bounded least recently used cache of decoded images, the cache is disabled by default.
+//
+// The entries are keyed by a hash of the file data and keep a copy of the file, which is compared
+// with the input before a cached image is used. The entries hold the values that the decoder passed
+// to the DecoderCallbacks methods: the image information, color profile, metadata and the converted
+// pixels of each layer. A cache hit calls the callbacks again with pointers to the cached buffers,
+// so the callbacks must not modify the buffers that they receive while the cache is enabled.
+namespace DecodedImageCache
+{
+    // Sets the maximum total size of the cached images in bytes, 0 disables the cache and removes all entries.
+    void SetMaxSize(uint64_t maxSizeInBytes);
+
+    void Clear();
+
+    bool IsEnabled();
+
+    // Replays the callbacks of a cached decode of the image, or calls decodeImage and adds the result
+    // to the cache when the decoding succeeds. The metadata flags are part of the cache key, because
+    // the cached image only contains the metadata that was requested when it was decoded.
+    // The decodeImage function receives the callbacks that it must pass to the decoder. An image
+    // that is larger than the cache is not recorded.
+    // The progress callback is only called for a cache hit, with the first and last values that
+    // the decoder reports. It is optional and may be null.
+    DecoderStatus ReadImage(
+        DecoderCallbacks* callbacks,
+        const uint8_t* data,
+        size_t dataSize,
+        DecoderMetadataFlags metadataFlags,
+        ProgressProc progressCallback,
+        const std::function<DecoderStatus(DecoderCallbacks*)>& decodeImage);
+}
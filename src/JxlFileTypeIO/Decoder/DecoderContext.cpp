@@ -12,16 +12,27 @@
 
 #include "DecoderContext.h"
 #include "jxl/resizable_parallel_runner.h"
+#include <algorithm>
+#include <limits>
 #include <stdexcept>
 
-DecoderContext::DecoderContext(const uint8_t* imageDataBuffer, size_t imageDataBufferSize)
+DecoderContext::DecoderContext(
+    const uint8_t* imageDataBuffer,
+    size_t imageDataBufferSize,
+    const JxlMemoryManager* memoryManager,
+    DecoderStats* stats)
     : imageData(imageDataBuffer),
       imageDataSize(imageDataBufferSize),
-      dec(JxlDecoderMake(nullptr)),
+      memoryManager(memoryManager),
+      stats(stats),
+      progressCallback(nullptr),
+      progressPercentage(0),
+      dec(JxlDecoderMake(memoryManager)),
       basicInfo{},
       pixelFormat{ 4, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0 },
       decoderImageFormat(DecoderImageFormat::Gray),
-      cmykBlackChannelIndex(std::numeric_limits<uint32_t>::max())
+      cmykBlackChannelIndex(std::numeric_limits<uint32_t>::max()),
+      frameBuffers{}
 {
     if (!dec)
     {
@@ -36,6 +47,16 @@ JxlDecoder* DecoderContext::GetDecoder() const
     return dec.get();
 }
 
+const uint8_t* DecoderContext::GetImageData() const
+{
+    return imageData;
+}
+
+size_t DecoderContext::GetImageDataSize() const
+{
+    return imageDataSize;
+}
+
 const JxlBasicInfo& DecoderContext::GetBasicInfo() const
 {
     return basicInfo;
@@ -91,25 +112,48 @@ void DecoderContext::SetCmykBlackChannelIndex(uint32_t index)
     cmykBlackChannelIndex = index;
 }
 
+DecoderFrameBuffers& DecoderContext::GetFrameBuffers()
+{
+    return frameBuffers;
+}
+
+DecoderStats* DecoderContext::GetStats() const
+{
+    return stats;
+}
+
+void DecoderContext::SetProgressCallback(ProgressProc callback)
+{
+    progressCallback = callback;
+}
+
+bool DecoderContext::ReportProgress(int32_t percentage)
+{
+    progressPercentage = std::max(progressPercentage, percentage);
+
+    return !progressCallback || progressCallback(progressPercentage);
+}
+
 void DecoderContext::SetResizableParallelRunner() const
 {
     if (!runner)
     {
-        runner = JxlResizableParallelRunnerMake(nullptr);
+        const size_t suggestedThreads = JxlResizableParallelRunnerSuggestThreads(basicInfo.xsize, basicInfo.ysize);
+
+        runner = std::make_unique<ParallelRunner>(
+            memoryManager,
+            suggestedThreads,
+            static_cast<uint64_t>(basicInfo.xsize) * basicInfo.ysize);
 
-        if (!runner)
+        if (stats)
         {
-            throw std::runtime_error("JxlResizableParallelRunnerMake failed.");
+            stats->threadCount = static_cast<uint32_t>(suggestedThreads);
         }
 
-        const size_t suggestedThreads = JxlResizableParallelRunnerSuggestThreads(basicInfo.xsize, basicInfo.ysize);
-
-        JxlResizableParallelRunnerSetThreads(runner.get(), suggestedThreads);
-
         if (JxlDecoderSetParallelRunner(
             dec.get(),
-            JxlResizableParallelRunner,
-            runner.get()) != JXL_DEC_SUCCESS)
+            runner->GetRunner(),
+            runner->GetRunnerOpaque()) != JXL_DEC_SUCCESS)
         {
             throw std::runtime_error("JxlDecoderSetParallelRunner failed.");
         }
@@ -124,6 +168,15 @@ void DecoderContext::ResetDecoder()
     SetDecoderInput();
 }
 
+void DecoderContext::RewindDecoder()
+{
+    // Unlike JxlDecoderReset, rewinding keeps the decoder settings and the information
+    // that libjxl uses to skip frames with JxlDecoderSkipFrames.
+    JxlDecoderReleaseInput(dec.get());
+    JxlDecoderRewind(dec.get());
+    SetDecoderInput();
+}
+
 void DecoderContext::SetDecoderInput()
 {
     if (JxlDecoderSetInput(dec.get(), imageData, imageDataSize) != JXL_DEC_SUCCESS)
@@ -12,16 +12,37 @@
 
 #pragma once
 #include "jxl/decode_cxx.h"
-#include "jxl/resizable_parallel_runner_cxx.h"
 #include "JxlDecoderTypes.h"
+#include "ParallelRunner.h"
+#include <memory>
+#include <vector>
+
+// The buffers that are used when decoding the image frames.
+// These buffers are reused for every frame in the image.
+struct DecoderFrameBuffers
+{
+    std::vector<uint8_t> image;
+    std::vector<uint8_t> cmykBlackChannel;
+    std::vector<uint8_t> cmykOutput;
+    std::vector<char> layerName;
+    DecoderLayerInfo layerInfo;
+};
 
 class DecoderContext
 {
 public:
-    DecoderContext(const uint8_t* imageDataBuffer, size_t imageDataBufferSize);
+    // The memory manager and stats parameters are optional and may be null.
+    DecoderContext(
+        const uint8_t* imageDataBuffer,
+        size_t imageDataBufferSize,
+        const JxlMemoryManager* memoryManager,
+        DecoderStats* stats);
 
     JxlDecoder* GetDecoder() const;
 
+    const uint8_t* GetImageData() const;
+    size_t GetImageDataSize() const;
+
     const JxlBasicInfo& GetBasicInfo() const;
     JxlBasicInfo* GetBasicInfoPtr();
 
@@ -38,15 +59,30 @@ public:
     uint32_t GetCmykBlackChannelIndex() const;
     void SetCmykBlackChannelIndex(uint32_t index);
 
+    DecoderFrameBuffers& GetFrameBuffers();
+
+    DecoderStats* GetStats() const;
+
+    void SetProgressCallback(ProgressProc callback);
+    // Reports the progress percentage, the reported value never decreases when the next
+    // frame of a layered image starts decoding.
+    // Returns false if the caller requested cancellation.
+    bool ReportProgress(int32_t percentage);
+
     void SetResizableParallelRunner() const;
 
     void ResetDecoder();
+    void RewindDecoder();
 
 private:
     void SetDecoderInput();
 
+    const JxlMemoryManager* memoryManager;
+    DecoderStats* stats;
+    ProgressProc progressCallback;
+    int32_t progressPercentage;
     JxlDecoderPtr dec;
-    mutable JxlResizableParallelRunnerPtr runner;
+    mutable std::unique_ptr<ParallelRunner> runner;
     const uint8_t* imageData;
     size_t imageDataSize;
     DecoderImageFormat decoderImageFormat;
@@ -54,4 +90,5 @@ private:
     uint32_t cmykBlackChannelIndex;
     JxlBasicInfo basicInfo;
     JxlPixelFormat pixelFormat;
+    DecoderFrameBuffers frameBuffers;
 };
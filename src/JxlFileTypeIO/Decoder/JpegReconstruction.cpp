@@ -0,0 +1,193 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "JpegReconstruction.h"
+#include "jxl/decode_cxx.h"
+#include "Windows.h"
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    constexpr size_t jpegBufferChunkSize = 65536;
+
+    DecoderStatus WriteJpegData(IOCallbacks* callbacks, const uint8_t* buffer, size_t sizeInBytes)
+    {
+        if (sizeInBytes == 0)
+        {
+            return DecoderStatus::Ok;
+        }
+
+        const HRESULT hr = callbacks->Write(buffer, sizeInBytes);
+
+        if (FAILED(hr))
+        {
+            switch (hr)
+            {
+            case E_ABORT:
+                return DecoderStatus::UserCanceled;
+            case E_OUTOFMEMORY:
+                return DecoderStatus::OutOfMemory;
+            default:
+                return DecoderStatus::WriteError;
+            }
+        }
+
+        return DecoderStatus::Ok;
+    }
+}
+
+DecoderStatus DecoderReconstructJpeg(
+    const uint8_t* data,
+    size_t dataSize,
+    IOCallbacks* callbacks,
+    ErrorInfo* errorInfo)
+{
+    if (!data || !callbacks)
+    {
+        return DecoderStatus::NullParameter;
+    }
+
+    try
+    {
+        const JxlSignature fileSignature = JxlSignatureCheck(data, dataSize);
+
+        if (fileSignature == JXL_SIG_CODESTREAM)
+        {
+            // The JPEG reconstruction data is stored in a jbrd box, which requires the container format.
+            return DecoderStatus::NoJpegReconstructionData;
+        }
+        else if (fileSignature != JXL_SIG_CONTAINER)
+        {
+            return DecoderStatus::InvalidFileSignature;
+        }
+
+        JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+
+        if (!dec)
+        {
+            throw std::runtime_error("Failed to create the decoder object.");
+        }
+
+        if (JxlDecoderSubscribeEvents(
+            dec.get(),
+            JXL_DEC_JPEG_RECONSTRUCTION |
+            JXL_DEC_FULL_IMAGE) != JXL_DEC_SUCCESS)
+        {
+            SetErrorMessage(errorInfo, "JxlDecoderSubscribeEvents failed.");
+            return DecoderStatus::DecodeError;
+        }
+
+        if (JxlDecoderSetInput(dec.get(), data, dataSize) != JXL_DEC_SUCCESS)
+        {
+            SetErrorMessage(errorInfo, "JxlDecoderSetInput failed.");
+            return DecoderStatus::DecodeError;
+        }
+        JxlDecoderCloseInput(dec.get());
+
+        std::vector<uint8_t> jpegBuffer;
+        bool hasJpegReconstructionData = false;
+
+        JxlDecoderStatus status = JXL_DEC_ERROR;
+
+        do
+        {
+            status = JxlDecoderProcessInput(dec.get());
+
+            if (status == JXL_DEC_ERROR)
+            {
+                SetErrorMessage(errorInfo, "JxlDecoderProcessInput failed.");
+                return DecoderStatus::DecodeError;
+            }
+            else if (status == JXL_DEC_JPEG_RECONSTRUCTION)
+            {
+                hasJpegReconstructionData = true;
+                jpegBuffer.resize(jpegBufferChunkSize);
+
+                if (JxlDecoderSetJPEGBuffer(dec.get(), jpegBuffer.data(), jpegBuffer.size()) != JXL_DEC_SUCCESS)
+                {
+                    SetErrorMessage(errorInfo, "JxlDecoderSetJPEGBuffer failed.");
+                    return DecoderStatus::DecodeError;
+                }
+            }
+            else if (status == JXL_DEC_JPEG_NEED_MORE_OUTPUT)
+            {
+                // The JPEG buffer is written to the output as soon as it is full, so the
+                // memory usage does not depend on the size of the JPEG image.
+                const size_t remaining = JxlDecoderReleaseJPEGBuffer(dec.get());
+
+                DecoderStatus writeStatus = WriteJpegData(callbacks, jpegBuffer.data(), jpegBuffer.size() - remaining);
+
+                if (writeStatus != DecoderStatus::Ok)
+                {
+                    return writeStatus;
+                }
+
+                if (JxlDecoderSetJPEGBuffer(dec.get(), jpegBuffer.data(), jpegBuffer.size()) != JXL_DEC_SUCCESS)
+                {
+                    SetErrorMessage(errorInfo, "JxlDecoderSetJPEGBuffer failed.");
+                    return DecoderStatus::DecodeError;
+                }
+            }
+            else if (status == JXL_DEC_NEED_IMAGE_OUT_BUFFER)
+            {
+                // libjxl only requests a pixel buffer when the file cannot be reconstructed
+                // as a JPEG image, we stop before any of the pixel data is decoded.
+                return DecoderStatus::NoJpegReconstructionData;
+            }
+            else if (status == JXL_DEC_FULL_IMAGE)
+            {
+                if (!hasJpegReconstructionData)
+                {
+                    return DecoderStatus::NoJpegReconstructionData;
+                }
+
+                const size_t remaining = JxlDecoderReleaseJPEGBuffer(dec.get());
+
+                DecoderStatus writeStatus = WriteJpegData(callbacks, jpegBuffer.data(), jpegBuffer.size() - remaining);
+
+                if (writeStatus != DecoderStatus::Ok)
+                {
+                    return writeStatus;
+                }
+
+                // A reconstructed JPEG image only has a single frame.
+                status = JXL_DEC_SUCCESS;
+            }
+            else if (status == JXL_DEC_NEED_MORE_INPUT)
+            {
+                SetErrorMessage(errorInfo, "JxlDecoderProcessInput needs more input, but it already received the entire image.");
+                return DecoderStatus::DecodeError;
+            }
+        } while (status != JXL_DEC_SUCCESS);
+
+        if (!hasJpegReconstructionData)
+        {
+            return DecoderStatus::NoJpegReconstructionData;
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        return DecoderStatus::OutOfMemory;
+    }
+    catch (const std::exception& e)
+    {
+        SetErrorMessage(errorInfo, e.what());
+        return DecoderStatus::DecodeError;
+    }
+    catch (...)
+    {
+        return DecoderStatus::DecodeError;
+    }
+
+    return DecoderStatus::Ok;
+}
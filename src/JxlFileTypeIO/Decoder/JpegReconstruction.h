@@ -0,0 +1,25 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "JxlDecoderTypes.h"
+
+// Writes the original JPEG image that was losslessly recompressed into the JPEG XL file.
+// This does not decode the image pixels, if the file does not contain the JPEG
+// reconstruction data the method returns DecoderStatus::NoJpegReconstructionData.
+DecoderStatus DecoderReconstructJpeg(
+    const uint8_t* data,
+    size_t dataSize,
+    IOCallbacks* callbacks,
+    ErrorInfo* errorInfo);
@@ -11,14 +11,212 @@
 ////////////////////////////////////////////////////////////////////////
 
 #include "JxlDecoder.h"
+#include "AnimationDecoder.h"
+#include "CmsTransformCache.h"
+#include "CmykConversion.h"
+#include "DecodedImageCache.h"
 #include "DecoderContext.h"
-#include "jxl/cms.h"
+#include "PerformanceStats.h"
+#include "Tracing.h"
+#include "WorkStealingParallelRunner.h"
 #include <algorithm>
+#include <chrono>
+#include <limits>
+#include <memory>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 
 namespace
 {
+    // Returns a pointer to the specified stats field, or null if the stats are not being collected.
+    uint64_t* GetStatsCounter(DecoderStats* stats, uint64_t DecoderStats::* field)
+    {
+        return stats ? &(stats->*field) : nullptr;
+    }
+
+    struct ContainerBox
+    {
+        JxlBoxType type;
+        const uint8_t* contents;
+        uint64_t contentsSize;
+        uint64_t boxSize;
+    };
+
+    // Reads the top level boxes of a container file from the input buffer. This is used to pass
+    // the contents of the uncompressed metadata boxes to the callbacks without copying them.
+    class ContainerBoxReader
+    {
+    public:
+        ContainerBoxReader(const uint8_t* data, size_t dataSize)
+            : data(data), dataSize(dataSize), offset(0)
+        {
+        }
+
+        bool ReadNextBox(ContainerBox& box)
+        {
+            const uint64_t remaining = dataSize - offset;
+
+            if (remaining < 8)
+            {
+                return false;
+            }
+
+            const uint8_t* header = data + offset;
+
+            uint64_t boxSize = (static_cast<uint64_t>(header[0]) << 24)
+                | (static_cast<uint64_t>(header[1]) << 16)
+                | (static_cast<uint64_t>(header[2]) << 8)
+                | static_cast<uint64_t>(header[3]);
+            uint64_t headerSize = 8;
+
+            if (boxSize == 1)
+            {
+                if (remaining < 16)
+                {
+                    return false;
+                }
+
+                boxSize = 0;
+
+                for (size_t i = 8; i < 16; i++)
+                {
+                    boxSize = (boxSize << 8) | header[i];
+                }
+                headerSize = 16;
+            }
+            else if (boxSize == 0)
+            {
+                // The last box may use a size of 0 to indicate that it extends to the end of the file.
+                boxSize = remaining;
+            }
+
+            if (boxSize < headerSize || boxSize > remaining)
+            {
+                return false;
+            }
+
+            memcpy(box.type, header + 4, sizeof(box.type));
+            box.contents = header + headerSize;
+            box.contentsSize = boxSize - headerSize;
+            box.boxSize = boxSize;
+
+            offset += static_cast<size_t>(boxSize);
+            return true;
+        }
+
+    private:
+        const uint8_t* data;
+        size_t dataSize;
+        size_t offset;
+    };
+
+    // Gets the initial size of the buffer that libjxl writes the box contents to, the buffer
+    // size is doubled when libjxl needs more space.
+    size_t GetInitialBoxBufferSize(uint64_t rawBoxSize, bool compressed)
+    {
+        constexpr size_t minimumSize = 65536;
+
+        // The raw box size is 0 if the box extends to the end of the file.
+        if (rawBoxSize <= 8)
+        {
+            return minimumSize;
+        }
+
+        // The raw box size includes the box header, which may be 8 or 16 bytes.
+        uint64_t size = rawBoxSize - 8;
+
+        if (compressed)
+        {
+            // The decompressed size of a brob box is not stored in the file, the XML and
+            // EXIF data usually has a Brotli compression ratio that is above 4:1.
+            size = size <= std::numeric_limits<uint64_t>::max() / 4 ? size * 4 : std::numeric_limits<uint64_t>::max();
+        }
+
+        if (size > std::numeric_limits<size_t>::max())
+        {
+            throw std::bad_alloc();
+        }
+
+        return compressed ? std::max(static_cast<size_t>(size), minimumSize) : static_cast<size_t>(size);
+    }
+
+    void RecordBoxSize(DecoderStats* stats, const JxlDecoder* dec, const JxlBoxType type)
+    {
+        uint64_t boxSize = 0;
+
+        if (JxlDecoderGetBoxSizeRaw(dec, &boxSize) != JXL_DEC_SUCCESS)
+        {
+            return;
+        }
+
+        if (boxSize == 0)
+        {
+            // The last box in the file may use a size of 0 to indicate that it extends to the end of the file.
+            const uint64_t previousBoxesSize = stats->codestreamSize
+                + stats->exifBoxSize
+                + stats->xmpBoxSize
+                + stats->jpegReconstructionBoxSize
+                + stats->otherBoxSize;
+
+            boxSize = SaturatingSubtract(stats->fileSize, previousBoxesSize);
+        }
+
+        if (memcmp(type, "jxlc", 4) == 0 || memcmp(type, "jxlp", 4) == 0)
+        {
+            stats->codestreamSize += boxSize;
+        }
+        else if (memcmp(type, "Exif", 4) == 0)
+        {
+            stats->exifBoxSize += boxSize;
+        }
+        else if (memcmp(type, "xml ", 4) == 0)
+        {
+            stats->xmpBoxSize += boxSize;
+        }
+        else if (memcmp(type, "jbrd", 4) == 0)
+        {
+            stats->jpegReconstructionBoxSize += boxSize;
+        }
+        else
+        {
+            stats->otherBoxSize += boxSize;
+        }
+
+        stats->boxCount++;
+    }
+
+    const char* GetDecoderEventName(JxlDecoderStatus status)
+    {
+        switch (status)
+        {
+        case JXL_DEC_SUCCESS:
+            return "JXL_DEC_SUCCESS";
+        case JXL_DEC_ERROR:
+            return "JXL_DEC_ERROR";
+        case JXL_DEC_NEED_MORE_INPUT:
+            return "JXL_DEC_NEED_MORE_INPUT";
+        case JXL_DEC_NEED_IMAGE_OUT_BUFFER:
+            return "JXL_DEC_NEED_IMAGE_OUT_BUFFER";
+        case JXL_DEC_BOX_NEED_MORE_OUTPUT:
+            return "JXL_DEC_BOX_NEED_MORE_OUTPUT";
+        case JXL_DEC_BASIC_INFO:
+            return "JXL_DEC_BASIC_INFO";
+        case JXL_DEC_COLOR_ENCODING:
+            return "JXL_DEC_COLOR_ENCODING";
+        case JXL_DEC_FRAME:
+            return "JXL_DEC_FRAME";
+        case JXL_DEC_FULL_IMAGE:
+            return "JXL_DEC_FULL_IMAGE";
+        case JXL_DEC_BOX:
+            return "JXL_DEC_BOX";
+        case JXL_DEC_BOX_COMPLETE:
+            return "JXL_DEC_BOX_COMPLETE";
+        default:
+            return "Other";
+        }
+    }
+
     enum class SetProfileFromEncodingStatus
     {
         Ok,
@@ -158,104 +356,336 @@ namespace
 
     bool SetCmykImageDataUInt8(
         DecoderCallbacks* callbacks,
+        DecoderStats* stats,
         size_t width,
         size_t height,
         bool hasTransparency,
         const std::vector<uint8_t>& cmya,
         const std::vector<uint8_t>& key,
+        std::vector<uint8_t>& output,
+        const DecoderLayerInfo& layerInfo,
         char* layerName,
         size_t layerNameLengthInBytes)
     {
-        const size_t transparencyChannelCount = hasTransparency ? 1 : 0;
-        const size_t cmyaChannelCount = 3 + transparencyChannelCount;
-        const size_t totalChannelCount = 4 + transparencyChannelCount;
+        const size_t totalChannelCount = hasTransparency ? 5 : 4;
+        const size_t outputSize = width * height * totalChannelCount;
+
+        // The output buffer is shared between all of the frames in the image,
+        // it only needs to be reallocated if the current frame is larger than
+        // the previous frames.
+        if (output.size() < outputSize)
+        {
+            output.resize(outputSize);
+        }
+
+        {
+            ScopedPhaseTimer conversionTimer(GetStatsCounter(stats, &DecoderStats::conversionTime));
+            Tracing::Span span("CmykConversion::CmyaAndKeyToCmyka", "conversion");
+
+            CmykConversion::CmyaAndKeyToCmyka(
+                cmya.data(),
+                key.data(),
+                width,
+                height,
+                hasTransparency,
+                output.data());
+        }
+
+        ScopedPhaseTimer callbackTimer(GetStatsCounter(stats, &DecoderStats::callbackTime));
+        Tracing::Span callbackSpan("DecoderCallbacks::setLayerData", "callback");
+
+        return callbacks->setLayerData(output.data(), &layerInfo, layerName, layerNameLengthInBytes);
+    }
+
+    DecoderStatus SetLayerInfoFromFrameHeader(const JxlFrameHeader& frameHeader, DecoderLayerInfo& layerInfo)
+    {
+        const JxlLayerInfo& info = frameHeader.layer_info;
+
+        if (info.xsize > static_cast<uint32_t>(std::numeric_limits<int32_t>::max()) ||
+            info.ysize > static_cast<uint32_t>(std::numeric_limits<int32_t>::max()))
+        {
+            return DecoderStatus::ImageDimensionExceedsInt32;
+        }
+
+        // When coalescing is enabled, libjxl reports every frame as a full canvas frame that does
+        // not have a crop offset.
+        layerInfo.x = info.have_crop ? info.crop_x0 : 0;
+        layerInfo.y = info.have_crop ? info.crop_y0 : 0;
+        layerInfo.width = static_cast<int32_t>(info.xsize);
+        layerInfo.height = static_cast<int32_t>(info.ysize);
+
+        switch (info.blend_info.blendmode)
+        {
+        case JXL_BLEND_REPLACE:
+            layerInfo.blendMode = DecoderLayerBlendMode::Replace;
+            break;
+        case JXL_BLEND_ADD:
+            layerInfo.blendMode = DecoderLayerBlendMode::Add;
+            break;
+        case JXL_BLEND_BLEND:
+            layerInfo.blendMode = DecoderLayerBlendMode::Blend;
+            break;
+        case JXL_BLEND_MULADD:
+            layerInfo.blendMode = DecoderLayerBlendMode::MulAdd;
+            break;
+        case JXL_BLEND_MUL:
+            layerInfo.blendMode = DecoderLayerBlendMode::Mul;
+            break;
+        default:
+            layerInfo.blendMode = DecoderLayerBlendMode::Blend;
+            break;
+        }
+
+        return DecoderStatus::Ok;
+    }
+
+    DecoderStatus SetFrameOutputBuffers(DecoderContext& context, ErrorInfo* errorInfo)
+    {
+        DecoderFrameBuffers& buffers = context.GetFrameBuffers();
+        const JxlPixelFormat& format = context.GetPixelFormat();
 
-        std::vector<uint8_t> output(width * height * totalChannelCount);
+        size_t imageOutBufferSize = 0;
+
+        if (JxlDecoderImageOutBufferSize(
+            context.GetDecoder(),
+            &format,
+            &imageOutBufferSize) != JXL_DEC_SUCCESS)
+        {
+            SetErrorMessage(errorInfo, "JxlDecoderImageOutBufferSize failed.");
+            return DecoderStatus::DecodeError;
+        }
 
-        uint8_t* const outputScan0 = output.data();
-        const uint8_t* cmyaScan0 = cmya.data();
-        const uint8_t* keyScan0 = key.data();
-        const size_t outputStride = width * totalChannelCount;
-        const size_t cmyaStride = width * cmyaChannelCount;
-        const size_t keyStride = width;
+        if (buffers.image.size() < imageOutBufferSize)
+        {
+            buffers.image.resize(imageOutBufferSize);
+        }
 
-        for (size_t y = 0; y < height; y++)
+        if (JxlDecoderSetImageOutBuffer(
+            context.GetDecoder(),
+            &format,
+            buffers.image.data(),
+            imageOutBufferSize) != JXL_DEC_SUCCESS)
         {
-            const uint8_t* cmya = cmyaScan0 + (y * cmyaStride);
-            const uint8_t* key = keyScan0 + (y * keyStride);
-            uint8_t* dst = outputScan0 + (y * outputStride);
+            SetErrorMessage(errorInfo, "JxlDecoderSetImageOutBuffer failed.");
+            return DecoderStatus::DecodeError;
+        }
 
-            for (size_t x = 0; x < width; x++)
+        if (context.GetDecoderImageFormat() == DecoderImageFormat::Cmyk)
+        {
+            if (format.data_type != JXL_TYPE_UINT8)
             {
-                // Jpeg XL stores CMYK images with 0 representing black/full ink.
-                // https://discord.com/channels/794206087879852103/804324493420920833/1317698217273458738
-                //
-                // "The K channel of a CMYK image. If present, a CMYK ICC profile is also present,
-                // and the RGB samples are to be interpreted as CMY, where 0 denotes full ink."
-                //
-                // WIC requires that 0 is white/no ink, so we have to invert the CMYK data.
+                SetErrorMessage(errorInfo, "Unsupported CMYK black channel bytes per pixel.");
+                return DecoderStatus::DecodeError;
+            }
 
-                dst[0] = static_cast<uint8_t>(0xff - cmya[0]); // C
-                dst[1] = static_cast<uint8_t>(0xff - cmya[1]); // M
-                dst[2] = static_cast<uint8_t>(0xff - cmya[2]); // Y
-                dst[3] = static_cast<uint8_t>(0xff - key[0]);  // K
+            size_t cmykBlackChannelBufferSize = 0;
 
-                if (hasTransparency)
-                {
-                    dst[4] = cmya[3]; // A
-                }
+            if (JxlDecoderExtraChannelBufferSize(
+                context.GetDecoder(),
+                &format,
+                &cmykBlackChannelBufferSize,
+                context.GetCmykBlackChannelIndex()) != JXL_DEC_SUCCESS)
+            {
+                SetErrorMessage(errorInfo, "JxlDecoderExtraChannelBufferSize failed.");
+                return DecoderStatus::DecodeError;
+            }
+
+            if (buffers.cmykBlackChannel.size() < cmykBlackChannelBufferSize)
+            {
+                buffers.cmykBlackChannel.resize(cmykBlackChannelBufferSize);
+            }
 
-                dst += totalChannelCount;
-                cmya += cmyaChannelCount;
-                key++;
+            if (JxlDecoderSetExtraChannelBuffer(
+                context.GetDecoder(),
+                &format,
+                buffers.cmykBlackChannel.data(),
+                cmykBlackChannelBufferSize,
+                context.GetCmykBlackChannelIndex()) != JXL_DEC_SUCCESS)
+            {
+                SetErrorMessage(errorInfo, "JxlDecoderSetExtraChannelBuffer failed.");
+                return DecoderStatus::DecodeError;
             }
         }
 
-        return callbacks->setLayerData(outputScan0, layerName, layerNameLengthInBytes);
+        return DecoderStatus::Ok;
     }
 
-    DecoderStatus ReadFrameData(
-        DecoderCallbacks* callbacks,
-        const DecoderContext& context,
+    DecoderStatus SetFrameLayerData(DecoderCallbacks* callbacks, DecoderContext& context)
+    {
+        DecoderFrameBuffers& buffers = context.GetFrameBuffers();
+
+        char* layerNamePtr = nullptr;
+        size_t layerNameLengthInBytes = 0;
+
+        if (buffers.layerName.size() > 0)
+        {
+            layerNamePtr = buffers.layerName.data();
+            layerNameLengthInBytes = buffers.layerName.size();
+        }
+
+        if (context.GetDecoderImageFormat() == DecoderImageFormat::Cmyk)
+        {
+            if (!SetCmykImageDataUInt8(
+                callbacks,
+                context.GetStats(),
+                static_cast<size_t>(buffers.layerInfo.width),
+                static_cast<size_t>(buffers.layerInfo.height),
+                context.GetBasicInfo().alpha_bits != 0,
+                buffers.image,
+                buffers.cmykBlackChannel,
+                buffers.cmykOutput,
+                buffers.layerInfo,
+                layerNamePtr,
+                layerNameLengthInBytes))
+            {
+                return DecoderStatus::CreateLayerError;
+            }
+        }
+        else
+        {
+            ScopedPhaseTimer callbackTimer(GetStatsCounter(context.GetStats(), &DecoderStats::callbackTime));
+            Tracing::Span callbackSpan("DecoderCallbacks::setLayerData", "callback");
+
+            if (!callbacks->setLayerData(
+                buffers.image.data(),
+                &buffers.layerInfo,
+                layerNamePtr,
+                layerNameLengthInBytes))
+            {
+                return DecoderStatus::CreateLayerError;
+            }
+        }
+
+        return DecoderStatus::Ok;
+    }
+
+    DecoderStatus SetDecoderOutputColorProfile(
+        DecoderContext& context,
+        DecoderImageFormat decoderImageFormat,
         ErrorInfo* errorInfo)
     {
-        context.SetResizableParallelRunner();
+        // An image can have two different color profiles.
+        // 1. The target data color profile.
+        // 2. The original color profile for XYB images.
 
-        if (JxlDecoderSubscribeEvents(
+        JxlColorEncoding originalEncodedProfile{};
+
+        if (JxlDecoderGetColorAsEncodedProfile(
             context.GetDecoder(),
-            JXL_DEC_FRAME |
-            JXL_DEC_FULL_IMAGE) != JXL_DEC_SUCCESS)
+            JXL_COLOR_PROFILE_TARGET_ORIGINAL,
+            &originalEncodedProfile) == JXL_DEC_SUCCESS)
         {
-            SetErrorMessage(errorInfo, "JxlDecoderSubscribeEvents failed.");
-            return DecoderStatus::DecodeError;
-        }
+            // The original profile is a libjxl encoded profile.
 
-        if (JxlDecoderSetUnpremultiplyAlpha(context.GetDecoder(), JXL_TRUE) != JXL_DEC_SUCCESS)
+            if (JxlDecoderSetPreferredColorProfile(context.GetDecoder(), &originalEncodedProfile) == JXL_DEC_SUCCESS)
+            {
+                JxlColorEncoding asTargetData{};
+
+                if (JxlDecoderGetColorAsEncodedProfile(
+                    context.GetDecoder(),
+                    JXL_COLOR_PROFILE_TARGET_DATA,
+                    &asTargetData) != JXL_DEC_SUCCESS)
+                {
+                    // If the original profile cannot be used for the output, we fall back to sRGB/sGray for the XYB conversion.
+                    JxlColorEncoding fallbackProfile{};
+                    fallbackProfile.color_space = decoderImageFormat == DecoderImageFormat::Gray ? JXL_COLOR_SPACE_GRAY : JXL_COLOR_SPACE_RGB;
+                    fallbackProfile.primaries = JXL_PRIMARIES_SRGB;
+                    fallbackProfile.transfer_function = JXL_TRANSFER_FUNCTION_SRGB;
+                    fallbackProfile.white_point = JXL_WHITE_POINT_D65;
+                    fallbackProfile.rendering_intent = JXL_RENDERING_INTENT_PERCEPTUAL;
+
+                    if (JxlDecoderSetPreferredColorProfile(context.GetDecoder(), &fallbackProfile) != JXL_DEC_SUCCESS)
+                    {
+                        SetErrorMessage(errorInfo, "JxlDecoderSetPreferredColorProfile failed for the fall back profile.");
+                        return DecoderStatus::DecodeError;
+                    }
+                }
+            }
+        }
+        else
         {
-            SetErrorMessage(errorInfo, "JxlDecoderSetUnpremultiplyAlpha failed.");
-            return DecoderStatus::DecodeError;
+            size_t iccProfileSize = 0;
+
+            if (JxlDecoderGetICCProfileSize(
+                context.GetDecoder(),
+                JXL_COLOR_PROFILE_TARGET_ORIGINAL,
+                &iccProfileSize) == JXL_DEC_SUCCESS)
+            {
+                // The original profile is an ICC profile.
+                if (iccProfileSize > 0)
+                {
+                    std::vector<uint8_t> iccProfileBuffer(iccProfileSize);
+
+                    if (JxlDecoderGetColorAsICCProfile(
+                        context.GetDecoder(),
+                        JXL_COLOR_PROFILE_TARGET_ORIGINAL,
+                        iccProfileBuffer.data(),
+                        iccProfileSize) == JXL_DEC_SUCCESS)
+                    {
+                        if (JxlDecoderSetCms(context.GetDecoder(), CmsTransformCache::GetInterface()) == JXL_DEC_SUCCESS)
+                        {
+                            // Instruct libjxl to convert the image to the original color
+                            // profile as part of the decoding process.
+                            JxlDecoderSetOutputColorProfile(
+                                context.GetDecoder(),
+                                nullptr,
+                                iccProfileBuffer.data(),
+                                iccProfileSize);
+                        }
+                    }
+                }
+            }
         }
 
-        std::vector<uint8_t> imageOutBuffer;
+        return DecoderStatus::Ok;
+    }
 
-        std::vector<char> layerNameBuffer;
-        std::vector<uint8_t> cmykBlackChannelBuffer;
+    DecoderStatus ProcessFrames(
+        DecoderCallbacks* callbacks,
+        DecoderContext& context,
+        ErrorInfo* errorInfo,
+        bool readAllFrames)
+    {
+        DecoderFrameBuffers& buffers = context.GetFrameBuffers();
+        DecoderStats* stats = context.GetStats();
 
         JxlDecoderStatus status = JXL_DEC_ERROR;
 
-        auto& basicInfo = context.GetBasicInfo();
-        auto& format = context.GetPixelFormat();
-        auto decoderImageFormat = context.GetDecoderImageFormat();
-
         do
         {
-            status = JxlDecoderProcessInput(context.GetDecoder());
+            {
+                ScopedPhaseTimer pixelDecodeTimer(GetStatsCounter(stats, &DecoderStats::pixelDecodeTime));
+                Tracing::Span span("JxlDecoderProcessInput", "decode");
+
+                status = JxlDecoderProcessInput(context.GetDecoder());
+
+                span.SetDetail(GetDecoderEventName(status));
+            }
+
+            if (!context.ReportProgress(status == JXL_DEC_FULL_IMAGE ? 90 : 20))
+            {
+                return DecoderStatus::UserCanceled;
+            }
 
             if (status == JXL_DEC_ERROR)
             {
                 SetErrorMessage(errorInfo, "JxlDecoderProcessInput failed.");
                 return DecoderStatus::DecodeError;
             }
+            else if (status == JXL_DEC_COLOR_ENCODING)
+            {
+                ScopedPhaseTimer colorSetupTimer(GetStatsCounter(stats, &DecoderStats::colorSetupTime));
+
+                DecoderStatus colorProfileStatus = SetDecoderOutputColorProfile(
+                    context,
+                    context.GetDecoderImageFormat(),
+                    errorInfo);
+
+                if (colorProfileStatus != DecoderStatus::Ok)
+                {
+                    return colorProfileStatus;
+                }
+            }
             else if (status == JXL_DEC_FRAME)
             {
                 JxlFrameHeader frameHeader{};
@@ -266,138 +696,47 @@ namespace
                     return DecoderStatus::DecodeError;
                 }
 
-                char* layerNamePtr = nullptr;
-                uint32_t layerNameLengthInBytes = 0;
+                DecoderStatus layerInfoStatus = SetLayerInfoFromFrameHeader(frameHeader, buffers.layerInfo);
+
+                if (layerInfoStatus != DecoderStatus::Ok)
+                {
+                    return layerInfoStatus;
+                }
 
                 if (frameHeader.name_length > 0)
                 {
-                    layerNameBuffer.resize(static_cast<size_t>(frameHeader.name_length) + 1);
+                    buffers.layerName.resize(static_cast<size_t>(frameHeader.name_length) + 1);
 
                     if (JxlDecoderGetFrameName(
                         context.GetDecoder(),
-                        layerNameBuffer.data(),
-                        layerNameBuffer.size()) != JXL_DEC_SUCCESS)
+                        buffers.layerName.data(),
+                        buffers.layerName.size()) != JXL_DEC_SUCCESS)
                     {
-                        layerNameBuffer.clear();
+                        buffers.layerName.clear();
                     }
                 }
                 else
                 {
-                    layerNameBuffer.clear();
+                    buffers.layerName.clear();
                 }
             }
             else if (status == JXL_DEC_NEED_IMAGE_OUT_BUFFER)
             {
-                if (imageOutBuffer.size() == 0)
-                {
-                    size_t bytesPerPixel = 0;
-
-                    switch (format.data_type)
-                    {
-                    case JXL_TYPE_UINT8:
-                        bytesPerPixel = format.num_channels;
-                        break;
-                    case JXL_TYPE_UINT16:
-                    case JXL_TYPE_FLOAT16:
-                        bytesPerPixel = static_cast<size_t>(format.num_channels) * 2;
-                        break;
-                    case JXL_TYPE_FLOAT:
-                        bytesPerPixel = static_cast<size_t>(format.num_channels) * 4;
-                        break;
-                    default:
-                        SetErrorMessage(errorInfo, "Unsupported color channel bytes per pixel.");
-                        return DecoderStatus::DecodeError;
-                    }
-
-                    imageOutBuffer.resize(static_cast<size_t>(basicInfo.xsize) * basicInfo.ysize * bytesPerPixel);
-                }
-
-                if (JxlDecoderSetImageOutBuffer(
-                    context.GetDecoder(),
-                    &format,
-                    imageOutBuffer.data(),
-                    imageOutBuffer.size()) != JXL_DEC_SUCCESS)
-                {
-                    SetErrorMessage(errorInfo, "JxlDecoderSetImageOutBuffer failed.");
-                    return DecoderStatus::DecodeError;
-                }
+                DecoderStatus bufferStatus = SetFrameOutputBuffers(context, errorInfo);
 
-                if (decoderImageFormat == DecoderImageFormat::Cmyk)
+                if (bufferStatus != DecoderStatus::Ok)
                 {
-                    if (cmykBlackChannelBuffer.size() == 0)
-                    {
-                        size_t bytesPerPixel = 0;
-
-                        switch (format.data_type)
-                        {
-                        case JXL_TYPE_UINT8:
-                            bytesPerPixel = 1;
-                            break;
-                        case JXL_TYPE_UINT16:
-                            bytesPerPixel = 2;
-                            break;
-                        case JXL_TYPE_FLOAT16:
-                        case JXL_TYPE_FLOAT:
-                        default:
-                            SetErrorMessage(errorInfo, "Unsupported CMYK black channel bytes per pixel.");
-                            return DecoderStatus::DecodeError;
-                        }
-
-                        cmykBlackChannelBuffer.resize(static_cast<size_t>(basicInfo.xsize) * basicInfo.ysize * bytesPerPixel);
-                    }
-
-                    if (JxlDecoderSetExtraChannelBuffer(
-                        context.GetDecoder(),
-                        &format,
-                        cmykBlackChannelBuffer.data(),
-                        cmykBlackChannelBuffer.size(),
-                        context.GetCmykBlackChannelIndex()) != JXL_DEC_SUCCESS)
-                    {
-                        SetErrorMessage(errorInfo, "JxlDecoderSetExtraChannelBuffer failed.");
-                        return DecoderStatus::DecodeError;
-                    }
+                    return bufferStatus;
                 }
             }
             else if (status == JXL_DEC_FULL_IMAGE)
             {
-                char* layerNamePtr = nullptr;
-                size_t layerNameLengthInBytes = 0;
+                DecoderStatus layerStatus = SetFrameLayerData(callbacks, context);
 
-                if (layerNameBuffer.size() > 0)
-                {
-                    layerNamePtr = layerNameBuffer.data();
-                    layerNameLengthInBytes = layerNameBuffer.size();
-                }
-
-                if (decoderImageFormat == DecoderImageFormat::Cmyk)
-                {
-                    if (!SetCmykImageDataUInt8(
-                        callbacks,
-                        basicInfo.xsize,
-                        basicInfo.ysize,
-                        basicInfo.alpha_bits != 0,
-                        imageOutBuffer,
-                        cmykBlackChannelBuffer,
-                        layerNamePtr,
-                        layerNameLengthInBytes))
-                    {
-                        return DecoderStatus::CreateLayerError;
-                    }
-                }
-                else
+                if (layerStatus != DecoderStatus::Ok || !readAllFrames)
                 {
-                    if (!callbacks->setLayerData(
-                        imageOutBuffer.data(),
-                        layerNamePtr,
-                        layerNameLengthInBytes))
-                    {
-                        return DecoderStatus::CreateLayerError;
-                    }
+                    return layerStatus;
                 }
-
-                // Break out of the loop after the first image has been read.
-                // TODO: Implement support for loading layers, multi-frame images, and animations.
-                status = JXL_DEC_SUCCESS;
             }
             else if (status == JXL_DEC_NEED_MORE_INPUT)
             {
@@ -406,18 +745,108 @@ namespace
             }
         } while (status != JXL_DEC_SUCCESS);
 
+        if (!readAllFrames)
+        {
+            SetErrorMessage(errorInfo, "The image does not contain the requested frame.");
+            return DecoderStatus::DecodeError;
+        }
+
         return DecoderStatus::Ok;
     }
 
-    DecoderStatus ReadImageInfoAndMetadata(
+    DecoderStatus ReadFrameData(
         DecoderCallbacks* callbacks,
         DecoderContext& context,
-        ErrorInfo* errorInfo,
-        bool mayHaveMetadata)
+        ErrorInfo* errorInfo)
     {
-        int eventsWanted = JXL_DEC_BASIC_INFO | JXL_DEC_COLOR_ENCODING;
+        Tracing::Span span("ReadFrameData", "decode");
 
-        if (mayHaveMetadata)
+        context.SetResizableParallelRunner();
+
+        // The color encoding event is used to set the output color profile and the CMS, the settings
+        // from the image information pass are cleared when the decoder is reset.
+        if (JxlDecoderSubscribeEvents(
+            context.GetDecoder(),
+            JXL_DEC_COLOR_ENCODING |
+            JXL_DEC_FRAME |
+            JXL_DEC_FULL_IMAGE) != JXL_DEC_SUCCESS)
+        {
+            SetErrorMessage(errorInfo, "JxlDecoderSubscribeEvents failed.");
+            return DecoderStatus::DecodeError;
+        }
+
+        if (JxlDecoderSetUnpremultiplyAlpha(context.GetDecoder(), JXL_TRUE) != JXL_DEC_SUCCESS)
+        {
+            SetErrorMessage(errorInfo, "JxlDecoderSetUnpremultiplyAlpha failed.");
+            return DecoderStatus::DecodeError;
+        }
+
+        auto& basicInfo = context.GetBasicInfo();
+
+        // Animations are loaded as a single coalesced frame.
+        // Layered still images are decoded without coalescing, this allows each layer to be
+        // passed to the caller as it is decoded, with its own position and blend mode.
+        // libjxl does not support disabling coalescing when it has to apply the image orientation.
+        const bool loadAllFrames = !basicInfo.have_animation && basicInfo.orientation == JXL_ORIENT_IDENTITY;
+
+        if (loadAllFrames)
+        {
+            if (JxlDecoderSetCoalescing(context.GetDecoder(), JXL_FALSE) != JXL_DEC_SUCCESS)
+            {
+                SetErrorMessage(errorInfo, "JxlDecoderSetCoalescing failed.");
+                return DecoderStatus::DecodeError;
+            }
+        }
+
+        // The frame buffers are reused for every frame in the image, so the memory usage is
+        // proportional to the largest frame instead of the total size of all frames.
+        return ProcessFrames(callbacks, context, errorInfo, loadAllFrames);
+    }
+
+    DecoderStatus PrepareAnimationFrameDecoding(DecoderContext& context, ErrorInfo* errorInfo)
+    {
+        context.SetResizableParallelRunner();
+
+        // The color encoding event is used to set the output color profile, the settings
+        // from the image information pass are cleared when the decoder is reset.
+        if (JxlDecoderSubscribeEvents(
+            context.GetDecoder(),
+            JXL_DEC_COLOR_ENCODING |
+            JXL_DEC_FRAME |
+            JXL_DEC_FULL_IMAGE) != JXL_DEC_SUCCESS)
+        {
+            SetErrorMessage(errorInfo, "JxlDecoderSubscribeEvents failed.");
+            return DecoderStatus::DecodeError;
+        }
+
+        if (JxlDecoderSetUnpremultiplyAlpha(context.GetDecoder(), JXL_TRUE) != JXL_DEC_SUCCESS)
+        {
+            SetErrorMessage(errorInfo, "JxlDecoderSetUnpremultiplyAlpha failed.");
+            return DecoderStatus::DecodeError;
+        }
+
+        return DecoderStatus::Ok;
+    }
+
+    DecoderStatus ReadImageInfoAndMetadata(
+        DecoderCallbacks* callbacks,
+        DecoderContext& context,
+        ErrorInfo* errorInfo,
+        bool mayHaveMetadata,
+        DecoderMetadataFlags metadataFlags)
+    {
+        Tracing::Span span("ReadImageInfoAndMetadata", "decode");
+
+        const bool readExif = mayHaveMetadata && HasMetadataFlag(metadataFlags, DecoderMetadataFlags::Exif);
+        const bool readXmp = mayHaveMetadata && HasMetadataFlag(metadataFlags, DecoderMetadataFlags::Xmp);
+
+        DecoderStats* stats = context.GetStats();
+
+        int eventsWanted = JXL_DEC_BASIC_INFO | JXL_DEC_COLOR_ENCODING;
+
+        // The box events are also used to measure the box sizes for the stats, libjxl skips the
+        // contents of the boxes that are not given an output buffer.
+        if (readExif || readXmp || (mayHaveMetadata && stats))
         {
             eventsWanted |= JXL_DEC_BOX | JXL_DEC_BOX_COMPLETE;
         }
@@ -430,7 +859,7 @@ namespace
             return DecoderStatus::DecodeError;
         }
 
-        if (mayHaveMetadata)
+        if (readExif || readXmp)
         {
             if (JxlDecoderSetDecompressBoxes(context.GetDecoder(), JXL_TRUE) != JXL_DEC_SUCCESS)
             {
@@ -440,8 +869,9 @@ namespace
         }
 
         std::vector<uint8_t> boxMetadataBuffer;
-        size_t boxMetadataBufferOffset = 0;
-        constexpr size_t boxMetadataChunkSize = 65536;
+        ContainerBoxReader boxReader(context.GetImageData(), context.GetImageDataSize());
+        // The box reader is disabled if its boxes do not match the boxes that libjxl reports.
+        bool boxReaderMatchesDecoder = true;
         bool foundExifBox = false;
         bool readingExifBox = false;
         bool readingXmpBox = false;
@@ -451,7 +881,19 @@ namespace
 
         do
         {
-            status = JxlDecoderProcessInput(context.GetDecoder());
+            {
+                ScopedPhaseTimer headerParseTimer(GetStatsCounter(stats, &DecoderStats::headerParseTime));
+                Tracing::Span span("JxlDecoderProcessInput", "decode");
+
+                status = JxlDecoderProcessInput(context.GetDecoder());
+
+                span.SetDetail(GetDecoderEventName(status));
+            }
+
+            if (!context.ReportProgress(5))
+            {
+                return DecoderStatus::UserCanceled;
+            }
 
             if (status == JXL_DEC_ERROR)
             {
@@ -555,94 +997,46 @@ namespace
                     }
                 }
 
-                callbacks->setBasicInfo(width, height, decoderImageFormat, channelRepresentation, hasTransparency);
+                {
+                    ScopedPhaseTimer callbackTimer(GetStatsCounter(stats, &DecoderStats::callbackTime));
+
+                    callbacks->setBasicInfo(
+                        width,
+                        height,
+                        decoderImageFormat,
+                        channelRepresentation,
+                        hasTransparency,
+                        basicInfo.have_animation != JXL_FALSE);
+                }
                 context.SetDecoderImageFormat(decoderImageFormat);
                 context.SetImageChannelRepresentation(channelRepresentation);
             }
             else if (status == JXL_DEC_COLOR_ENCODING)
             {
-                // An image can have two different color profiles.
-                // 1. The target data color profile.
-                // 2. The original color profile for XYB images.
-
-                JxlColorEncoding originalEncodedProfile{};
+                SetProfileFromEncodingStatus encodedProfileStatus = SetProfileFromEncodingStatus::UnsupportedColorEncoding;
+                JxlColorEncoding colorEncoding{};
+                bool hasEncodedProfile = false;
 
-                if (JxlDecoderGetColorAsEncodedProfile(
-                    context.GetDecoder(),
-                    JXL_COLOR_PROFILE_TARGET_ORIGINAL,
-                    &originalEncodedProfile) == JXL_DEC_SUCCESS)
                 {
-                    // The original profile is a libjxl encoded profile.
+                    ScopedPhaseTimer colorSetupTimer(GetStatsCounter(stats, &DecoderStats::colorSetupTime));
 
-                    if (JxlDecoderSetPreferredColorProfile(context.GetDecoder(), &originalEncodedProfile) == JXL_DEC_SUCCESS)
-                    {
-                        JxlColorEncoding asTargetData{};
+                    DecoderStatus colorProfileStatus = SetDecoderOutputColorProfile(context, decoderImageFormat, errorInfo);
 
-                        if (JxlDecoderGetColorAsEncodedProfile(
-                            context.GetDecoder(),
-                            JXL_COLOR_PROFILE_TARGET_DATA,
-                            &asTargetData) != JXL_DEC_SUCCESS)
-                        {
-                            // If the original profile cannot be used for the output, we fall back to sRGB/sGray for the XYB conversion.
-                            JxlColorEncoding fallbackProfile{};
-                            fallbackProfile.color_space = decoderImageFormat == DecoderImageFormat::Gray ? JXL_COLOR_SPACE_GRAY : JXL_COLOR_SPACE_RGB;
-                            fallbackProfile.primaries = JXL_PRIMARIES_SRGB;
-                            fallbackProfile.transfer_function = JXL_TRANSFER_FUNCTION_SRGB;
-                            fallbackProfile.white_point = JXL_WHITE_POINT_D65;
-                            fallbackProfile.rendering_intent = JXL_RENDERING_INTENT_PERCEPTUAL;
-
-                            if (JxlDecoderSetPreferredColorProfile(context.GetDecoder(), &fallbackProfile) != JXL_DEC_SUCCESS)
-                            {
-                                SetErrorMessage(errorInfo, "JxlDecoderSetPreferredColorProfile failed for the fall back profile.");
-                                return DecoderStatus::DecodeError;
-                            }
-                        }
+                    if (colorProfileStatus != DecoderStatus::Ok)
+                    {
+                        return colorProfileStatus;
                     }
-                }
-                else
-                {
-                    size_t iccProfileSize = 0;
 
-                    if (JxlDecoderGetICCProfileSize(
+                    hasEncodedProfile = JxlDecoderGetColorAsEncodedProfile(
                         context.GetDecoder(),
-                        JXL_COLOR_PROFILE_TARGET_ORIGINAL,
-                        &iccProfileSize) == JXL_DEC_SUCCESS)
-                    {
-                        // The original profile is an ICC profile.
-                        if (iccProfileSize > 0)
-                        {
-                            std::vector<uint8_t> iccProfileBuffer(iccProfileSize);
-
-                            if (JxlDecoderGetColorAsICCProfile(
-                                context.GetDecoder(),
-                                JXL_COLOR_PROFILE_TARGET_ORIGINAL,
-                                iccProfileBuffer.data(),
-                                iccProfileSize) == JXL_DEC_SUCCESS)
-                            {
-                                if (JxlDecoderSetCms(context.GetDecoder(), *JxlGetDefaultCms()) == JXL_DEC_SUCCESS)
-                                {
-                                    // Instruct libjxl to convert the image to the original color
-                                    // profile as part of the decoding process.
-                                    JxlDecoderSetOutputColorProfile(
-                                        context.GetDecoder(),
-                                        nullptr,
-                                        iccProfileBuffer.data(),
-                                        iccProfileSize);
-                                }
-                            }
-                        }
-                    }
+                        JXL_COLOR_PROFILE_TARGET_DATA,
+                        &colorEncoding) == JXL_DEC_SUCCESS;
                 }
 
-                SetProfileFromEncodingStatus encodedProfileStatus = SetProfileFromEncodingStatus::UnsupportedColorEncoding;
-
-                JxlColorEncoding colorEncoding{};
-
-                if (JxlDecoderGetColorAsEncodedProfile(
-                    context.GetDecoder(),
-                    JXL_COLOR_PROFILE_TARGET_DATA,
-                    &colorEncoding) == JXL_DEC_SUCCESS)
+                if (hasEncodedProfile)
                 {
+                    ScopedPhaseTimer callbackTimer(GetStatsCounter(stats, &DecoderStats::callbackTime));
+
                     encodedProfileStatus = SetProfileFromColorEncoding(callbacks, colorEncoding);
 
                     if (encodedProfileStatus == SetProfileFromEncodingStatus::Error)
@@ -663,17 +1057,24 @@ namespace
                         if (iccProfileSize > 0)
                         {
                             std::vector<uint8_t> iccProfileBuffer;
-                            iccProfileBuffer.resize(iccProfileSize);
 
-                            if (JxlDecoderGetColorAsICCProfile(
-                                context.GetDecoder(),
-                                JXL_COLOR_PROFILE_TARGET_DATA,
-                                iccProfileBuffer.data(),
-                                iccProfileSize) != JXL_DEC_SUCCESS)
                             {
-                                return DecoderStatus::MetadataError;
+                                ScopedPhaseTimer colorSetupTimer(GetStatsCounter(stats, &DecoderStats::colorSetupTime));
+
+                                iccProfileBuffer.resize(iccProfileSize);
+
+                                if (JxlDecoderGetColorAsICCProfile(
+                                    context.GetDecoder(),
+                                    JXL_COLOR_PROFILE_TARGET_DATA,
+                                    iccProfileBuffer.data(),
+                                    iccProfileSize) != JXL_DEC_SUCCESS)
+                                {
+                                    return DecoderStatus::MetadataError;
+                                }
                             }
 
+                            ScopedPhaseTimer callbackTimer(GetStatsCounter(stats, &DecoderStats::callbackTime));
+
                             if (!callbacks->setIccProfile(
                                 iccProfileBuffer.data(),
                                 iccProfileBuffer.size()))
@@ -687,25 +1088,71 @@ namespace
             else if (status == JXL_DEC_BOX)
             {
                 JxlBoxType type;
+                JxlBoxType rawType;
 
-                if (JxlDecoderGetBoxType(context.GetDecoder(), type, JXL_TRUE) != JXL_DEC_SUCCESS)
+                if (JxlDecoderGetBoxType(context.GetDecoder(), type, JXL_TRUE) != JXL_DEC_SUCCESS
+                    || JxlDecoderGetBoxType(context.GetDecoder(), rawType, JXL_FALSE) != JXL_DEC_SUCCESS)
                 {
                     SetErrorMessage(errorInfo, "JxlDecoderGetBoxType failed.");
                     return DecoderStatus::DecodeError;
                 }
 
-                if (memcmp(type, "Exif", 4) == 0)
+                uint64_t rawBoxSize = 0;
+
+                if (JxlDecoderGetBoxSizeRaw(context.GetDecoder(), &rawBoxSize) != JXL_DEC_SUCCESS)
+                {
+                    rawBoxSize = 0;
+                }
+
+                ContainerBox containerBox{};
+                bool hasContainerBox = false;
+
+                if (boxReaderMatchesDecoder)
+                {
+                    // libjxl reports every top level box in file order, so the box reader is always at the same box.
+                    hasContainerBox = boxReader.ReadNextBox(containerBox)
+                        && memcmp(containerBox.type, rawType, sizeof(rawType)) == 0
+                        && (rawBoxSize == 0 || rawBoxSize == containerBox.boxSize);
+                    boxReaderMatchesDecoder = hasContainerBox;
+                }
+
+                if (stats)
+                {
+                    RecordBoxSize(stats, context.GetDecoder(), type);
+                }
+
+                const bool isExifBox = readExif && !foundExifBox && memcmp(type, "Exif", 4) == 0;
+                const bool isXmpBox = readXmp && memcmp(type, "xml ", 4) == 0;
+
+                if (isExifBox || isXmpBox)
                 {
-                    if (!foundExifBox)
+                    foundExifBox = foundExifBox || isExifBox;
+
+                    const bool compressed = memcmp(rawType, "brob", 4) == 0;
+
+                    if (!compressed
+                        && hasContainerBox
+                        && containerBox.contentsSize <= std::numeric_limits<size_t>::max())
                     {
-                        foundExifBox = true;
-                        readingExifBox = true;
+                        // The contents of an uncompressed box are passed from the input buffer, libjxl skips
+                        // the box because it does not have an output buffer.
+                        ScopedPhaseTimer callbackTimer(GetStatsCounter(stats, &DecoderStats::callbackTime));
 
-                        if (boxMetadataBuffer.size() < boxMetadataChunkSize)
+                        DecoderSetMetadata setMetadata = isExifBox ? callbacks->setExif : callbacks->setXmp;
+
+                        if (!setMetadata(
+                            const_cast<uint8_t*>(containerBox.contents),
+                            static_cast<size_t>(containerBox.contentsSize)))
                         {
-                            boxMetadataBuffer.resize(boxMetadataChunkSize);
+                            return DecoderStatus::CreateMetadataError;
                         }
-                        boxMetadataBufferOffset = 0;
+                    }
+                    else
+                    {
+                        readingExifBox = isExifBox;
+                        readingXmpBox = isXmpBox;
+
+                        boxMetadataBuffer.resize(GetInitialBoxBufferSize(rawBoxSize, compressed));
 
                         if (JxlDecoderSetBoxBuffer(
                             context.GetDecoder(),
@@ -717,32 +1164,20 @@ namespace
                         }
                     }
                 }
-                else if (memcmp(type, "xml ", 4) == 0)
-                {
-                    readingXmpBox = true;
-
-                    if (boxMetadataBuffer.size() < boxMetadataChunkSize)
-                    {
-                        boxMetadataBuffer.resize(boxMetadataChunkSize);
-                    }
-                    boxMetadataBufferOffset = 0;
-
-                    if (JxlDecoderSetBoxBuffer(
-                        context.GetDecoder(),
-                        boxMetadataBuffer.data(),
-                        boxMetadataBuffer.size()) != JXL_DEC_SUCCESS)
-                    {
-                        SetErrorMessage(errorInfo, "JxlDecoderSetBoxBuffer failed.");
-                        return DecoderStatus::DecodeError;
-                    }
-                }
             }
             else if (status == JXL_DEC_BOX_NEED_MORE_OUTPUT)
             {
-                size_t remaining = JxlDecoderReleaseBoxBuffer(context.GetDecoder());
+                // The box buffer always extends to the end of the vector, so the amount of data
+                // that libjxl has written is the vector size minus the unused space.
+                const size_t remaining = JxlDecoderReleaseBoxBuffer(context.GetDecoder());
+                const size_t boxMetadataBufferOffset = boxMetadataBuffer.size() - remaining;
+
+                if (boxMetadataBuffer.size() > std::numeric_limits<size_t>::max() / 2)
+                {
+                    throw std::bad_alloc();
+                }
 
-                boxMetadataBufferOffset += boxMetadataChunkSize - remaining;
-                boxMetadataBuffer.resize(boxMetadataBuffer.size() + boxMetadataChunkSize);
+                boxMetadataBuffer.resize(boxMetadataBuffer.size() * 2);
 
                 if (JxlDecoderSetBoxBuffer(
                     context.GetDecoder(),
@@ -761,6 +1196,8 @@ namespace
 
                     size_t remaining = JxlDecoderReleaseBoxBuffer(context.GetDecoder());
 
+                    ScopedPhaseTimer callbackTimer(GetStatsCounter(stats, &DecoderStats::callbackTime));
+
                     if (!callbacks->setExif(
                         boxMetadataBuffer.data(),
                         boxMetadataBuffer.size() - remaining))
@@ -774,6 +1211,8 @@ namespace
 
                     size_t remaining = JxlDecoderReleaseBoxBuffer(context.GetDecoder());
 
+                    ScopedPhaseTimer callbackTimer(GetStatsCounter(stats, &DecoderStats::callbackTime));
+
                     if (!callbacks->setXmp(
                         boxMetadataBuffer.data(),
                         boxMetadataBuffer.size() - remaining))
@@ -791,22 +1230,84 @@ namespace
 
         return DecoderStatus::Ok;
     }
-}
 
-DecoderStatus DecoderReadImage(
-    DecoderCallbacks* callbacks,
-    const uint8_t* data,
-    size_t dataSize,
-    ErrorInfo* errorInfo)
-{
-    if (!callbacks || !data)
+    // Reads the image size from the header, the batch decoder uses this to choose between
+    // decoding the image on its own with intra-image parallelism or together with other images.
+    bool TryGetImageSize(const uint8_t* data, size_t dataSize, uint32_t& width, uint32_t& height) noexcept
     {
-        return DecoderStatus::NullParameter;
+        auto dec = JxlDecoderMake(nullptr);
+
+        if (!dec
+            || JxlDecoderSubscribeEvents(dec.get(), JXL_DEC_BASIC_INFO) != JXL_DEC_SUCCESS
+            || JxlDecoderSetInput(dec.get(), data, dataSize) != JXL_DEC_SUCCESS)
+        {
+            return false;
+        }
+
+        JxlDecoderCloseInput(dec.get());
+
+        JxlBasicInfo basicInfo;
+
+        if (JxlDecoderProcessInput(dec.get()) != JXL_DEC_BASIC_INFO
+            || JxlDecoderGetBasicInfo(dec.get(), &basicInfo) != JXL_DEC_SUCCESS)
+        {
+            return false;
+        }
+
+        width = basicInfo.xsize;
+        height = basicInfo.ysize;
+
+        return true;
     }
 
-    try
+    struct BatchDecode
     {
-        const JxlSignature fileSignature = JxlSignatureCheck(data, dataSize);
+        DecoderBatchItem* items;
+        const uint32_t* itemIndices;
+    };
+
+    JxlParallelRetCode BatchDecodeInit(void* opaque, size_t threadCount)
+    {
+        (void)opaque;
+        (void)threadCount;
+
+        return 0;
+    }
+
+    void BatchDecodeItem(void* opaque, uint32_t value, size_t threadId)
+    {
+        (void)threadId;
+
+        const BatchDecode* batch = static_cast<const BatchDecode*>(opaque);
+        DecoderBatchItem& item = batch->items[batch->itemIndices[value]];
+
+        item.status = DecoderReadImage(
+            item.callbacks,
+            item.data,
+            item.dataSize,
+            item.metadataFlags,
+            &item.errorInfo,
+            nullptr,
+            nullptr);
+    }
+
+    DecoderStatus DecodeImage(
+        DecoderCallbacks* callbacks,
+        const uint8_t* data,
+        size_t dataSize,
+        DecoderMetadataFlags metadataFlags,
+        ErrorInfo* errorInfo,
+        ProgressProc progressCallback,
+        const JxlMemoryManager* memoryManager,
+        DecoderStats* stats)
+    {
+        JxlSignature fileSignature = JXL_SIG_INVALID;
+
+        {
+            ScopedPhaseTimer signatureCheckTimer(GetStatsCounter(stats, &DecoderStats::signatureCheckTime));
+
+            fileSignature = JxlSignatureCheck(data, dataSize);
+        }
 
         if (fileSignature != JXL_SIG_CODESTREAM && fileSignature != JXL_SIG_CONTAINER)
         {
@@ -815,40 +1316,773 @@ DecoderStatus DecoderReadImage(
 
         const bool mayHaveMetadata = fileSignature == JXL_SIG_CONTAINER;
 
-        DecoderContext context(data, dataSize);
-
-        DecoderStatus status = ReadImageInfoAndMetadata(callbacks, context, errorInfo, mayHaveMetadata);
-
-        if (status != DecoderStatus::Ok)
+        if (stats && !mayHaveMetadata)
         {
-            return status;
+            // A bare codestream does not have any boxes.
+            stats->codestreamSize = dataSize;
         }
 
-        // Parse the file again to read the frame data.
-        context.ResetDecoder();
+        DecoderContext context(data, dataSize, memoryManager, stats);
+        context.SetProgressCallback(progressCallback);
 
-        status = ReadFrameData(callbacks, context, errorInfo);
+        DecoderStatus status = ReadImageInfoAndMetadata(callbacks, context, errorInfo, mayHaveMetadata, metadataFlags);
 
-        if (status != DecoderStatus::Ok)
+        if (status == DecoderStatus::Ok)
         {
-            return status;
+            // Parse the file again to read the frame data.
+            context.ResetDecoder();
+
+            status = ReadFrameData(callbacks, context, errorInfo);
         }
+
+        if (status == DecoderStatus::Ok && !context.ReportProgress(100))
+        {
+            status = DecoderStatus::UserCanceled;
+        }
+
+        return status;
     }
-    catch (const std::bad_alloc&)
-    {
-        return DecoderStatus::OutOfMemory;
-    }
-    catch (const std::exception& e)
+
+    // The splitmix64 finalizer.
+    uint64_t MixBits(uint64_t value)
     {
-        SetErrorMessage(errorInfo, e.what());
-        return DecoderStatus::DecodeError;
+        value ^= value >> 30;
+        value *= 0xbf58476d1ce4e5b9;
+        value ^= value >> 27;
+        value *= 0x94d049bb133111eb;
+        value ^= value >> 31;
+
+        return value;
     }
-    catch (...)
+
+    // Computes a checksum of the pixels that libjxl passes to the image out callback.
+    // Each pixel is hashed with its frame and position, and the pixel hashes are added together,
+    // so the result does not depend on the order in which the threads deliver the pixels or on
+    // how libjxl splits the rows.
+    class PixelChecksum
     {
-        return DecoderStatus::DecodeError;
-    }
+    public:
+        explicit PixelChecksum(bool enabled)
+            : enabled(enabled), bytesPerPixel(0), frameIndex(0), sum(0), initFailed(false)
+        {
+        }
 
-    return DecoderStatus::Ok;
-}
+        void SetBytesPerPixel(size_t value)
+        {
+            bytesPerPixel = value;
+        }
+
+        void EndFrame()
+        {
+            frameIndex++;
+        }
+
+        bool InitFailed() const
+        {
+            return initFailed;
+        }
+
+        uint64_t GetHash() const
+        {
+            return MixBits(sum ^ MixBits(frameIndex));
+        }
+
+        static void* Init(void* initOpaque, size_t threadCount, size_t pixelsPerThread)
+        {
+            (void)pixelsPerThread;
+
+            PixelChecksum* checksum = static_cast<PixelChecksum*>(initOpaque);
+
+            try
+            {
+                checksum->threadSums.assign(threadCount, ThreadSum{});
+            }
+            catch (...)
+            {
+                // Returning null makes libjxl fail the decoding.
+                checksum->initFailed = true;
+                return nullptr;
+            }
+
+            return checksum;
+        }
+
+        static void Run(void* runOpaque, size_t threadId, size_t x, size_t y, size_t pixelCount, const void* pixels)
+        {
+            PixelChecksum* checksum = static_cast<PixelChecksum*>(runOpaque);
+
+            if (checksum->enabled)
+            {
+                checksum->threadSums[threadId].value += checksum->HashPixels(x, y, pixelCount, static_cast<const uint8_t*>(pixels));
+            }
+        }
+
+        static void Destroy(void* runOpaque)
+        {
+            PixelChecksum* checksum = static_cast<PixelChecksum*>(runOpaque);
+
+            if (!checksum)
+            {
+                return;
+            }
 
+            for (const ThreadSum& threadSum : checksum->threadSums)
+            {
+                checksum->sum += threadSum.value;
+            }
+
+            checksum->threadSums.clear();
+        }
 
+    private:
+        uint64_t HashPixels(size_t x, size_t y, size_t pixelCount, const uint8_t* pixels) const
+        {
+            const uint64_t rowSeed = MixBits((frameIndex << 32) ^ static_cast<uint64_t>(y));
+            uint64_t result = 0;
+
+            for (size_t i = 0; i < pixelCount; i++)
+            {
+                // The largest pixel format is 4 channels of 32-bit floating point data.
+                uint64_t value[2] = {};
+                memcpy(value, pixels + (i * bytesPerPixel), bytesPerPixel);
+
+                const uint64_t positionHash = MixBits(rowSeed + static_cast<uint64_t>(x + i));
+
+                result += MixBits(value[0] ^ positionHash) + MixBits(value[1] ^ ~positionHash);
+            }
+
+            return result;
+        }
+
+        // The thread sums are placed on separate cache lines to avoid false sharing.
+        struct alignas(64) ThreadSum
+        {
+            uint64_t value;
+        };
+
+        const bool enabled;
+        size_t bytesPerPixel;
+        uint64_t frameIndex;
+        uint64_t sum;
+        bool initFailed;
+        std::vector<ThreadSum> threadSums;
+    };
+
+    // The validation decodes to the native bit depth of the image, using little endian
+    // byte order so that the checksum is the same on all platforms.
+    JxlPixelFormat GetValidationPixelFormat(const JxlBasicInfo& basicInfo)
+    {
+        JxlPixelFormat format{};
+        format.num_channels = basicInfo.num_color_channels + (basicInfo.alpha_bits != 0 ? 1 : 0);
+        format.endianness = JXL_LITTLE_ENDIAN;
+        format.align = 0;
+
+        if (basicInfo.exponent_bits_per_sample > 0)
+        {
+            format.data_type = basicInfo.bits_per_sample <= 16 ? JXL_TYPE_FLOAT16 : JXL_TYPE_FLOAT;
+        }
+        else
+        {
+            format.data_type = basicInfo.bits_per_sample <= 8 ? JXL_TYPE_UINT8 : JXL_TYPE_UINT16;
+        }
+
+        return format;
+    }
+
+    size_t GetBytesPerPixel(const JxlPixelFormat& format)
+    {
+        size_t bytesPerChannel = 1;
+
+        switch (format.data_type)
+        {
+        case JXL_TYPE_UINT16:
+        case JXL_TYPE_FLOAT16:
+            bytesPerChannel = 2;
+            break;
+        case JXL_TYPE_FLOAT:
+            bytesPerChannel = 4;
+            break;
+        default:
+            break;
+        }
+
+        return bytesPerChannel * format.num_channels;
+    }
+}
+
+DecoderStatus DecoderReadImage(
+    DecoderCallbacks* callbacks,
+    const uint8_t* data,
+    size_t dataSize,
+    DecoderMetadataFlags metadataFlags,
+    ErrorInfo* errorInfo,
+    ProgressProc progressCallback,
+    DecoderStats* stats)
+{
+    if (!callbacks || !data)
+    {
+        return DecoderStatus::NullParameter;
+    }
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    // The libjxl allocations are only tracked when the caller requested the stats.
+    TrackingMemoryManager memoryManager;
+
+    if (stats)
+    {
+        *stats = {};
+        stats->fileSize = dataSize;
+    }
+
+    DecoderStatus status = DecoderStatus::Ok;
+
+    try
+    {
+        const JxlMemoryManager* trackingMemoryManager = stats ? memoryManager.Get() : nullptr;
+
+        if (DecodedImageCache::IsEnabled())
+        {
+            status = DecodedImageCache::ReadImage(
+                callbacks,
+                data,
+                dataSize,
+                metadataFlags,
+                progressCallback,
+                [&](DecoderCallbacks* decoderCallbacks)
+                {
+                    return DecodeImage(
+                        decoderCallbacks,
+                        data,
+                        dataSize,
+                        metadataFlags,
+                        errorInfo,
+                        progressCallback,
+                        trackingMemoryManager,
+                        stats);
+                });
+        }
+        else
+        {
+            status = DecodeImage(
+                callbacks,
+                data,
+                dataSize,
+                metadataFlags,
+                errorInfo,
+                progressCallback,
+                trackingMemoryManager,
+                stats);
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        status = DecoderStatus::OutOfMemory;
+    }
+    catch (const std::exception& e)
+    {
+        SetErrorMessage(errorInfo, e.what());
+        status = DecoderStatus::DecodeError;
+    }
+    catch (...)
+    {
+        status = DecoderStatus::DecodeError;
+    }
+
+    // The stats are also filled in when decoding fails, this shows which phase the time was spent in.
+    if (stats)
+    {
+        stats->peakMemoryBytes = memoryManager.GetPeakBytes();
+        stats->totalTime = ElapsedMicroseconds(startTime);
+    }
+
+    return status;
+}
+
+DecoderStatus DecoderReadImages(DecoderBatchItem* items, uint32_t itemCount)
+{
+    if (!items)
+    {
+        return DecoderStatus::NullParameter;
+    }
+
+    try
+    {
+        std::vector<uint32_t> smallItems;
+        std::vector<uint32_t> largeItems;
+        smallItems.reserve(itemCount);
+
+        for (uint32_t i = 0; i < itemCount; i++)
+        {
+            DecoderBatchItem& item = items[i];
+
+            item.status = DecoderStatus::Ok;
+            item.errorInfo.errorMessage[0] = '\0';
+
+            uint32_t width = 0;
+            uint32_t height = 0;
+
+            // The images that libjxl would decode with a single thread are decoded at the same time
+            // as other images, the invalid images are also handled by this group.
+            if (item.data
+                && TryGetImageSize(item.data, item.dataSize, width, height)
+                && JxlResizableParallelRunnerSuggestThreads(width, height) > 1)
+            {
+                largeItems.push_back(i);
+            }
+            else
+            {
+                smallItems.push_back(i);
+            }
+        }
+
+        // The large images use the intra-image parallelism of the decoder, so they are decoded
+        // one at a time to avoid oversubscribing the processor.
+        for (const uint32_t index : largeItems)
+        {
+            DecoderBatchItem& item = items[index];
+
+            item.status = DecoderReadImage(
+                item.callbacks,
+                item.data,
+                item.dataSize,
+                item.metadataFlags,
+                &item.errorInfo,
+                nullptr,
+                nullptr);
+        }
+
+        if (!smallItems.empty())
+        {
+            Tracing::Span span("Batch decode", "decode");
+
+            WorkStealingParallelRunner runner(std::max(std::thread::hardware_concurrency(), 1u));
+            BatchDecode batch{ items, smallItems.data() };
+
+            if (WorkStealingParallelRunner::Run(
+                &runner,
+                &batch,
+                BatchDecodeInit,
+                BatchDecodeItem,
+                0,
+                static_cast<uint32_t>(smallItems.size())) != 0)
+            {
+                // The runner fails before it starts any of the tasks, e.g. if the worker threads
+                // cannot be created, so the images are decoded on the calling thread instead.
+                for (uint32_t i = 0; i < smallItems.size(); i++)
+                {
+                    BatchDecodeItem(&batch, i, 0);
+                }
+            }
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        return DecoderStatus::OutOfMemory;
+    }
+
+    return DecoderStatus::Ok;
+}
+
+DecoderStatus DecoderValidateImage(
+    const uint8_t* data,
+    size_t dataSize,
+    ErrorInfo* errorInfo,
+    uint64_t* pixelHash)
+{
+    if (!data)
+    {
+        return DecoderStatus::NullParameter;
+    }
+
+    if (pixelHash)
+    {
+        *pixelHash = 0;
+    }
+
+    try
+    {
+        Tracing::Span span("DecoderValidateImage", "decode");
+
+        const JxlSignature fileSignature = JxlSignatureCheck(data, dataSize);
+
+        if (fileSignature != JXL_SIG_CODESTREAM && fileSignature != JXL_SIG_CONTAINER)
+        {
+            return DecoderStatus::InvalidFileSignature;
+        }
+
+        // The checksum must outlive the decoder, libjxl calls the destroy callback
+        // when a frame that failed to decode is released.
+        PixelChecksum checksum(pixelHash != nullptr);
+        DecoderContext context(data, dataSize, nullptr, nullptr);
+        JxlPixelFormat format{};
+
+        // The box event makes libjxl walk the header of every box in the container up to the end of
+        // the file, including the boxes after the codestream. No box buffer is set, so the box
+        // contents are skipped.
+        if (JxlDecoderSubscribeEvents(
+            context.GetDecoder(),
+            JXL_DEC_BASIC_INFO |
+            JXL_DEC_BOX |
+            JXL_DEC_FULL_IMAGE) != JXL_DEC_SUCCESS)
+        {
+            SetErrorMessage(errorInfo, "JxlDecoderSubscribeEvents failed.");
+            return DecoderStatus::DecodeError;
+        }
+
+        // Every frame is decoded on its own, without being blended onto the canvas or rotated
+        // by the image orientation.
+        if (JxlDecoderSetCoalescing(context.GetDecoder(), JXL_FALSE) != JXL_DEC_SUCCESS)
+        {
+            SetErrorMessage(errorInfo, "JxlDecoderSetCoalescing failed.");
+            return DecoderStatus::DecodeError;
+        }
+
+        if (JxlDecoderSetKeepOrientation(context.GetDecoder(), JXL_TRUE) != JXL_DEC_SUCCESS)
+        {
+            SetErrorMessage(errorInfo, "JxlDecoderSetKeepOrientation failed.");
+            return DecoderStatus::DecodeError;
+        }
+
+        JxlDecoderStatus status = JXL_DEC_ERROR;
+
+        do
+        {
+            status = JxlDecoderProcessInput(context.GetDecoder());
+
+            if (status == JXL_DEC_ERROR)
+            {
+                if (checksum.InitFailed())
+                {
+                    return DecoderStatus::OutOfMemory;
+                }
+
+                SetErrorMessage(errorInfo, "JxlDecoderProcessInput failed.");
+                return DecoderStatus::DecodeError;
+            }
+            else if (status == JXL_DEC_NEED_MORE_INPUT)
+            {
+                SetErrorMessage(errorInfo, "The image data is truncated.");
+                return DecoderStatus::DecodeError;
+            }
+            else if (status == JXL_DEC_BASIC_INFO)
+            {
+                if (JxlDecoderGetBasicInfo(context.GetDecoder(), context.GetBasicInfoPtr()) != JXL_DEC_SUCCESS)
+                {
+                    SetErrorMessage(errorInfo, "JxlDecoderGetBasicInfo failed.");
+                    return DecoderStatus::DecodeError;
+                }
+
+                format = GetValidationPixelFormat(context.GetBasicInfo());
+                checksum.SetBytesPerPixel(GetBytesPerPixel(format));
+
+                context.SetResizableParallelRunner();
+            }
+            else if (status == JXL_DEC_NEED_IMAGE_OUT_BUFFER)
+            {
+                if (JxlDecoderSetMultithreadedImageOutCallback(
+                    context.GetDecoder(),
+                    &format,
+                    PixelChecksum::Init,
+                    PixelChecksum::Run,
+                    PixelChecksum::Destroy,
+                    &checksum) != JXL_DEC_SUCCESS)
+                {
+                    SetErrorMessage(errorInfo, "JxlDecoderSetMultithreadedImageOutCallback failed.");
+                    return DecoderStatus::DecodeError;
+                }
+            }
+            else if (status == JXL_DEC_FULL_IMAGE)
+            {
+                checksum.EndFrame();
+            }
+        } while (status != JXL_DEC_SUCCESS);
+
+        if (pixelHash)
+        {
+            *pixelHash = checksum.GetHash();
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        return DecoderStatus::OutOfMemory;
+    }
+    catch (const std::exception& e)
+    {
+        SetErrorMessage(errorInfo, e.what());
+        return DecoderStatus::DecodeError;
+    }
+    catch (...)
+    {
+        return DecoderStatus::DecodeError;
+    }
+
+    return DecoderStatus::Ok;
+}
+
+DecoderStatus DecoderGetImageEncodingInfo(
+    const uint8_t* data,
+    size_t dataSize,
+    DecoderImageEncodingInfo* info,
+    ErrorInfo* errorInfo)
+{
+    if (!data || !info)
+    {
+        return DecoderStatus::NullParameter;
+    }
+
+    *info = {};
+
+    try
+    {
+        const JxlSignature fileSignature = JxlSignatureCheck(data, dataSize);
+
+        if (fileSignature != JXL_SIG_CODESTREAM && fileSignature != JXL_SIG_CONTAINER)
+        {
+            return DecoderStatus::InvalidFileSignature;
+        }
+
+        DecoderContext context(data, dataSize, nullptr, nullptr);
+
+        // libjxl skips the frames because the frame and image events are not requested, the box event
+        // walks the container boxes up to the end of the file.
+        if (JxlDecoderSubscribeEvents(context.GetDecoder(), JXL_DEC_BASIC_INFO | JXL_DEC_BOX) != JXL_DEC_SUCCESS)
+        {
+            SetErrorMessage(errorInfo, "JxlDecoderSubscribeEvents failed.");
+            return DecoderStatus::DecodeError;
+        }
+
+        JxlDecoderStatus status = JXL_DEC_ERROR;
+
+        do
+        {
+            status = JxlDecoderProcessInput(context.GetDecoder());
+
+            if (status == JXL_DEC_ERROR)
+            {
+                SetErrorMessage(errorInfo, "JxlDecoderProcessInput failed.");
+                return DecoderStatus::DecodeError;
+            }
+            else if (status == JXL_DEC_NEED_MORE_INPUT)
+            {
+                SetErrorMessage(errorInfo, "The image data is truncated.");
+                return DecoderStatus::DecodeError;
+            }
+            else if (status == JXL_DEC_BASIC_INFO)
+            {
+                if (JxlDecoderGetBasicInfo(context.GetDecoder(), context.GetBasicInfoPtr()) != JXL_DEC_SUCCESS)
+                {
+                    SetErrorMessage(errorInfo, "JxlDecoderGetBasicInfo failed.");
+                    return DecoderStatus::DecodeError;
+                }
+
+                info->usesOriginalColorSpace = context.GetBasicInfo().uses_original_profile != JXL_FALSE;
+            }
+            else if (status == JXL_DEC_BOX)
+            {
+                JxlBoxType type;
+
+                if (JxlDecoderGetBoxType(context.GetDecoder(), type, JXL_FALSE) != JXL_DEC_SUCCESS)
+                {
+                    SetErrorMessage(errorInfo, "JxlDecoderGetBoxType failed.");
+                    return DecoderStatus::DecodeError;
+                }
+
+                if (memcmp(type, "jbrd", 4) == 0)
+                {
+                    info->hasJpegReconstructionData = true;
+                }
+            }
+        } while (status != JXL_DEC_SUCCESS);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return DecoderStatus::OutOfMemory;
+    }
+    catch (const std::exception& e)
+    {
+        SetErrorMessage(errorInfo, e.what());
+        return DecoderStatus::DecodeError;
+    }
+    catch (...)
+    {
+        return DecoderStatus::DecodeError;
+    }
+
+    return DecoderStatus::Ok;
+}
+
+DecoderStatus DecoderOpenAnimation(
+    DecoderCallbacks* callbacks,
+    const uint8_t* data,
+    size_t dataSize,
+    AnimationDecoder** animation,
+    ErrorInfo* errorInfo)
+{
+    if (!callbacks || !data || !animation)
+    {
+        return DecoderStatus::NullParameter;
+    }
+
+    *animation = nullptr;
+
+    try
+    {
+        const JxlSignature fileSignature = JxlSignatureCheck(data, dataSize);
+
+        if (fileSignature != JXL_SIG_CODESTREAM && fileSignature != JXL_SIG_CONTAINER)
+        {
+            return DecoderStatus::InvalidFileSignature;
+        }
+
+        const bool mayHaveMetadata = fileSignature == JXL_SIG_CONTAINER;
+
+        std::unique_ptr<AnimationDecoder> animationDecoder = std::make_unique<AnimationDecoder>(data, dataSize);
+        DecoderContext& context = animationDecoder->GetContext();
+
+        DecoderStatus status = ReadImageInfoAndMetadata(
+            callbacks,
+            context,
+            errorInfo,
+            mayHaveMetadata,
+            DecoderMetadataFlags::All);
+
+        if (status != DecoderStatus::Ok)
+        {
+            return status;
+        }
+
+        animationDecoder->BuildFrameIndex();
+
+        // Parse the file again to read the frame data.
+        context.ResetDecoder();
+
+        status = PrepareAnimationFrameDecoding(context, errorInfo);
+
+        if (status != DecoderStatus::Ok)
+        {
+            return status;
+        }
+
+        *animation = animationDecoder.release();
+    }
+    catch (const std::bad_alloc&)
+    {
+        return DecoderStatus::OutOfMemory;
+    }
+    catch (const std::exception& e)
+    {
+        SetErrorMessage(errorInfo, e.what());
+        return DecoderStatus::DecodeError;
+    }
+    catch (...)
+    {
+        return DecoderStatus::DecodeError;
+    }
+
+    return DecoderStatus::Ok;
+}
+
+DecoderStatus DecoderGetAnimationInfo(
+    AnimationDecoder* animation,
+    AnimationInfo* info)
+{
+    if (!animation || !info)
+    {
+        return DecoderStatus::NullParameter;
+    }
+
+    *info = animation->GetAnimationInfo();
+
+    return DecoderStatus::Ok;
+}
+
+DecoderStatus DecoderGetAnimationFrameInfo(
+    AnimationDecoder* animation,
+    uint32_t frameIndex,
+    AnimationFrameInfo* info)
+{
+    if (!animation || !info)
+    {
+        return DecoderStatus::NullParameter;
+    }
+
+    if (frameIndex >= animation->GetAnimationInfo().frameCount)
+    {
+        return DecoderStatus::InvalidParameter;
+    }
+
+    *info = animation->GetFrameInfo(frameIndex);
+
+    return DecoderStatus::Ok;
+}
+
+DecoderStatus DecoderReadAnimationFrame(
+    AnimationDecoder* animation,
+    uint32_t frameIndex,
+    DecoderCallbacks* callbacks,
+    ErrorInfo* errorInfo)
+{
+    if (!animation || !callbacks)
+    {
+        return DecoderStatus::NullParameter;
+    }
+
+    const uint32_t frameCount = animation->GetAnimationInfo().frameCount;
+
+    if (frameIndex >= frameCount)
+    {
+        return DecoderStatus::InvalidParameter;
+    }
+
+    DecoderStatus status = DecoderStatus::Ok;
+
+    try
+    {
+        DecoderContext& context = animation->GetContext();
+
+        if (frameIndex < animation->GetNextFrameIndex())
+        {
+            // The decoder has already passed the requested frame, so it has to start again from
+            // the beginning of the file. libjxl keeps the frame dependency information when
+            // rewinding, this allows JxlDecoderSkipFrames to only decode the reference frames
+            // that the requested frame depends on. libjxl cannot start decoding at a frame
+            // offset, the headers of the skipped frames are still read.
+            context.RewindDecoder();
+            animation->SetNextFrameIndex(0);
+        }
+
+        const uint32_t framesToSkip = frameIndex - animation->GetNextFrameIndex();
+
+        if (framesToSkip > 0)
+        {
+            JxlDecoderSkipFrames(context.GetDecoder(), framesToSkip);
+        }
+
+        status = ProcessFrames(callbacks, context, errorInfo, false);
+    }
+    catch (const std::bad_alloc&)
+    {
+        status = DecoderStatus::OutOfMemory;
+    }
+    catch (const std::exception& e)
+    {
+        SetErrorMessage(errorInfo, e.what());
+        status = DecoderStatus::DecodeError;
+    }
+    catch (...)
+    {
+        status = DecoderStatus::DecodeError;
+    }
+
+    // If decoding failed the decoder position is unknown, setting the next frame index
+    // past the end of the animation forces the decoder to be rewound on the next call.
+    animation->SetNextFrameIndex(status == DecoderStatus::Ok ? frameIndex + 1 : frameCount);
+
+    return status;
+}
+
+void DecoderCloseAnimation(AnimationDecoder* animation)
+{
+    delete animation;
+}
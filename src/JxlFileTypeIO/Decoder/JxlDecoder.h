@@ -14,8 +14,61 @@
 
 #include "JxlDecoderTypes.h"
 
+// The progressCallback and stats parameters are optional and may be null.
+// The progress callback is called between the libjxl decoder events, so a request to cancel
+// the decoding takes effect after the current frame has been decoded.
 DecoderStatus DecoderReadImage(
     DecoderCallbacks* callbacks,
     const uint8_t* data,
     size_t dataSize,
+    DecoderMetadataFlags metadataFlags,
+    ErrorInfo* errorInfo,
+    ProgressProc progressCallback,
+    DecoderStats* stats);
+
+// Decodes a batch of images, the status and error information of each image are stored in the item.
+// The small images are decoded at the same time on a shared worker pool, so the callbacks of different
+// items may be called at the same time from different threads. The large images are decoded one at a
+// time with the intra-image parallelism of libjxl.
+DecoderStatus DecoderReadImages(DecoderBatchItem* items, uint32_t itemCount);
+
+// Decodes the image with an image out callback that checksums the pixels, so no image buffer is allocated.
+// The frames are not coalesced and the orientation is not applied.
+// The container box headers are walked to the end of the file, the box contents are skipped.
+// The pixelHash parameter is optional and may be null.
+DecoderStatus DecoderValidateImage(
+    const uint8_t* data,
+    size_t dataSize,
+    ErrorInfo* errorInfo,
+    uint64_t* pixelHash);
+
+// Reads the image header and walks the container boxes without decoding any frames.
+DecoderStatus DecoderGetImageEncodingInfo(
+    const uint8_t* data,
+    size_t dataSize,
+    DecoderImageEncodingInfo* info,
+    ErrorInfo* errorInfo);
+
+DecoderStatus DecoderOpenAnimation(
+    DecoderCallbacks* callbacks,
+    const uint8_t* data,
+    size_t dataSize,
+    AnimationDecoder** animation,
     ErrorInfo* errorInfo);
+
+DecoderStatus DecoderGetAnimationInfo(
+    AnimationDecoder* animation,
+    AnimationInfo* info);
+
+DecoderStatus DecoderGetAnimationFrameInfo(
+    AnimationDecoder* animation,
+    uint32_t frameIndex,
+    AnimationFrameInfo* info);
+
+DecoderStatus DecoderReadAnimationFrame(
+    AnimationDecoder* animation,
+    uint32_t frameIndex,
+    DecoderCallbacks* callbacks,
+    ErrorInfo* errorInfo);
+
+void DecoderCloseAnimation(AnimationDecoder* animation);
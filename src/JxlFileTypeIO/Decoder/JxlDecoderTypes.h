@@ -29,6 +29,9 @@ enum class DecoderStatus : int32_t
     DecodeError,
     MetadataError,
     InvalidFileSignature,
+    NoJpegReconstructionData,
+    UserCanceled,
+    WriteError,
 };
 
 enum class DecoderImageFormat : int32_t
@@ -38,6 +41,21 @@ enum class DecoderImageFormat : int32_t
     Cmyk
 };
 
+// The metadata boxes that the decoder passes to the DecoderCallbacks, the boxes that are not requested
+// are skipped without being decompressed. The color profile is always read.
+enum class DecoderMetadataFlags : uint32_t
+{
+    None = 0,
+    Exif = 1 << 0,
+    Xmp = 1 << 1,
+    All = Exif | Xmp
+};
+
+inline bool HasMetadataFlag(DecoderMetadataFlags flags, DecoderMetadataFlags flag)
+{
+    return (static_cast<uint32_t>(flags) & static_cast<uint32_t>(flag)) != 0;
+}
+
 enum class KnownColorProfile : int32_t
 {
     Srgb = 0,
@@ -50,16 +68,107 @@ enum class KnownColorProfile : int32_t
     Rec2020PQ,
 };
 
+// The layer blending modes, these values must match JxlBlendMode.
+enum class DecoderLayerBlendMode : int32_t
+{
+    Replace = 0,
+    Add,
+    Blend,
+    MulAdd,
+    Mul
+};
+
+struct DecoderLayerInfo
+{
+    // The layer position relative to the image canvas, this may be negative.
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+    DecoderLayerBlendMode blendMode;
+};
+
+// The compression information that can be read from the image header and container boxes, libjxl
+// does not store the distance that the image was encoded with.
+struct DecoderImageEncodingInfo
+{
+    // The image is stored in its original color space instead of XYB, which is required for lossless images.
+    bool usesOriginalColorSpace;
+    // The file has a jbrd box, the pixels were decoded from a JPEG.
+    bool hasJpegReconstructionData;
+};
+
+struct AnimationInfo
+{
+    uint32_t frameCount;
+    // The number of times the animation repeats, 0 means it loops forever.
+    uint32_t loopCount;
+    // The frame durations are measured in ticks, ticksPerSecondNumerator / ticksPerSecondDenominator
+    // is the number of ticks per second.
+    uint32_t ticksPerSecondNumerator;
+    uint32_t ticksPerSecondDenominator;
+};
+
+struct AnimationFrameInfo
+{
+    // The frame duration in ticks.
+    uint32_t duration;
+    // A key frame does not depend on any of the previous frames, the result of its layers only uses
+    // layers that replace the whole canvas and reference frames that were saved by earlier layers of
+    // the same frame. The reference-only frames and patches that libjxl does not report are not checked.
+    bool isKeyFrame;
+};
+
+// The decoding statistics, the times are in microseconds.
+// The phase times do not overlap, time that is not covered by a phase is only included in the total time.
+struct DecoderStats
+{
+    uint64_t signatureCheckTime;
+    // The time spent in libjxl reading the image header, color profile and metadata boxes.
+    uint64_t headerParseTime;
+    // The time spent selecting the output color profile.
+    uint64_t colorSetupTime;
+    // The time spent in libjxl decoding the frame pixels.
+    uint64_t pixelDecodeTime;
+    // The time spent converting the decoded pixels to the output format.
+    uint64_t conversionTime;
+    // The time spent in the DecoderCallbacks methods.
+    uint64_t callbackTime;
+    uint64_t totalTime;
+    uint64_t fileSize;
+    // The size of the codestream, including the jxlc and jxlp box headers for container files.
+    uint64_t codestreamSize;
+    // The box sizes include the box headers, and are the compressed size for brob boxes.
+    uint64_t exifBoxSize;
+    uint64_t xmpBoxSize;
+    uint64_t jpegReconstructionBoxSize;
+    // The total size of the boxes that are not listed above, including the container signature.
+    uint64_t otherBoxSize;
+    // The peak number of bytes that libjxl had allocated.
+    uint64_t peakMemoryBytes;
+    uint32_t boxCount;
+    uint32_t threadCount;
+};
+
+class AnimationDecoder;
+
 typedef void(__stdcall* DecoderSetBasicInfo)(
     int32_t width,
     int32_t height,
     DecoderImageFormat format,
     ImageChannelRepresentation channelFormat,
-    bool hasTransparency);
+    bool hasTransparency,
+    bool hasAnimation);
 typedef bool(__stdcall* DecoderSetMetadata)(uint8_t* data, size_t length);
 typedef bool(__stdcall* DecoderSetKnownColorProfile)(KnownColorProfile profile);
-typedef bool(__stdcall* DecoderSetLayerData)(uint8_t* pixels, char* name, size_t nameLength);
+typedef bool(__stdcall* DecoderSetLayerData)(
+    uint8_t* pixels,
+    const DecoderLayerInfo* layerInfo,
+    char* name,
+    size_t nameLength);
 
+// The metadata passed to setExif and setXmp may point into the image data that was given to the decoder,
+// so the callbacks must treat it as read-only. The buffers are only valid during the callback.
 struct DecoderCallbacks
 {
     DecoderSetBasicInfo setBasicInfo;
@@ -69,3 +178,14 @@ struct DecoderCallbacks
     DecoderSetMetadata setXmp;
     DecoderSetLayerData setLayerData;
 };
+
+// An image for the LoadImages batch decoder, the status and errorInfo fields are set by the decoder.
+struct DecoderBatchItem
+{
+    DecoderCallbacks* callbacks;
+    const uint8_t* data;
+    size_t dataSize;
+    DecoderMetadataFlags metadataFlags;
+    DecoderStatus status;
+    ErrorInfo errorInfo;
+};
@@ -0,0 +1,136 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "EffortCalibration.h"
+#include <algorithm>
+#include <array>
+#include <mutex>
+
+namespace
+{
+    constexpr size_t effortCount = EffortCalibration::MaxEffort - EffortCalibration::MinEffort + 1;
+    constexpr size_t maxChannelCount = 4;
+
+    // The initial encoding cost in nanoseconds per channel sample for 8-bit images on a
+    // typical quad-core machine, indexed by effort. These are replaced by measured values
+    // as images are encoded.
+    constexpr std::array<double, effortCount> defaultLossyCost =
+    {
+        0.7, 1.0, 2.5, 4.0, 6.5, 8.5, 13.0, 50.0, 130.0, 650.0
+    };
+
+    constexpr std::array<double, effortCount> defaultLosslessCost =
+    {
+        1.0, 5.0, 8.5, 20.0, 27.0, 33.0, 50.0, 170.0, 650.0, 3300.0
+    };
+
+    // The weight of a new measurement in the exponential moving average of the encoding cost.
+    constexpr double measurementWeight = 0.3;
+
+    // Small images have a fixed setup cost that would distort the per sample cost.
+    constexpr uint64_t minCalibrationSampleCount = 256 * 256;
+
+    class CalibrationTable
+    {
+    public:
+        CalibrationTable()
+        {
+            for (size_t channel = 0; channel < maxChannelCount; channel++)
+            {
+                lossyCost[channel] = defaultLossyCost;
+                losslessCost[channel] = defaultLosslessCost;
+            }
+        }
+
+        double GetCost(uint32_t channelCount, bool lossless, int32_t effort)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            return GetTable(channelCount, lossless)[GetEffortIndex(effort)];
+        }
+
+        void UpdateCost(uint32_t channelCount, bool lossless, int32_t effort, double measuredCost)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            double& cost = GetTable(channelCount, lossless)[GetEffortIndex(effort)];
+
+            cost += (measuredCost - cost) * measurementWeight;
+        }
+
+    private:
+        static size_t GetEffortIndex(int32_t effort)
+        {
+            return static_cast<size_t>(std::clamp(effort, EffortCalibration::MinEffort, EffortCalibration::MaxEffort) - EffortCalibration::MinEffort);
+        }
+
+        std::array<double, effortCount>& GetTable(uint32_t channelCount, bool lossless)
+        {
+            const size_t channelIndex = std::clamp<size_t>(channelCount, 1, maxChannelCount) - 1;
+
+            return lossless ? losslessCost[channelIndex] : lossyCost[channelIndex];
+        }
+
+        std::mutex mutex;
+        std::array<std::array<double, effortCount>, maxChannelCount> lossyCost;
+        std::array<std::array<double, effortCount>, maxChannelCount> losslessCost;
+    };
+
+    CalibrationTable calibrationTable;
+
+    uint64_t GetSampleCount(uint32_t width, uint32_t height, uint32_t channelCount)
+    {
+        return static_cast<uint64_t>(width) * height * std::max<uint32_t>(channelCount, 1);
+    }
+}
+
+int32_t EffortCalibration::SelectEffort(
+    uint32_t width,
+    uint32_t height,
+    uint32_t channelCount,
+    bool lossless,
+    int32_t maxEffort,
+    uint32_t timeBudgetMilliseconds)
+{
+    const double sampleCount = static_cast<double>(GetSampleCount(width, height, channelCount));
+    const double budgetNanoseconds = static_cast<double>(timeBudgetMilliseconds) * 1000000.0;
+
+    for (int32_t effort = std::clamp(maxEffort, MinEffort, MaxEffort); effort > MinEffort; effort--)
+    {
+        const double predictedNanoseconds = sampleCount * calibrationTable.GetCost(channelCount, lossless, effort);
+
+        if (predictedNanoseconds <= budgetNanoseconds)
+        {
+            return effort;
+        }
+    }
+
+    return MinEffort;
+}
+
+void EffortCalibration::RecordEncodeTime(
+    uint32_t width,
+    uint32_t height,
+    uint32_t channelCount,
+    bool lossless,
+    int32_t effort,
+    std::chrono::steady_clock::duration elapsed)
+{
+    const uint64_t sampleCount = GetSampleCount(width, height, channelCount);
+
+    if (sampleCount >= minCalibrationSampleCount)
+    {
+        const double elapsedNanoseconds = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+
+        calibrationTable.UpdateCost(channelCount, lossless, effort, elapsedNanoseconds / static_cast<double>(sampleCount));
+    }
+}
@@ -0,0 +1,43 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include "Common.h"
+#include <chrono>
+
+// Predicts the encoding time of each effort value from a per-process table of the
+// measured encoding speed, the table is updated after every single image encode.
+namespace EffortCalibration
+{
+    constexpr int32_t MinEffort = 1;
+    constexpr int32_t MaxEffort = 10;
+
+    // Returns the highest effort up to maxEffort that is predicted to finish within the time budget,
+    // the minimum effort is returned if none of the effort values are predicted to finish in time.
+    int32_t SelectEffort(
+        uint32_t width,
+        uint32_t height,
+        uint32_t channelCount,
+        bool lossless,
+        int32_t maxEffort,
+        uint32_t timeBudgetMilliseconds);
+
+    // The encodes must use the thread count that libjxl suggests for the image size without sharing
+    // the processors with other encodes, e.g. the concurrent variant encodes are not recorded.
+    void RecordEncodeTime(
+        uint32_t width,
+        uint32_t height,
+        uint32_t channelCount,
+        bool lossless,
+        int32_t effort,
+        std::chrono::steady_clock::duration elapsed);
+}
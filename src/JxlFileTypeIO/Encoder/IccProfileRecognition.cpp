@@ -0,0 +1,716 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "IccProfileRecognition.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+    typedef std::array<double, 3> Vector3;
+    typedef std::array<double, 9> Matrix3x3;
+
+    struct Chromaticity
+    {
+        double x;
+        double y;
+    };
+
+    struct KnownPrimaries
+    {
+        JxlPrimaries primaries;
+        Chromaticity red;
+        Chromaticity green;
+        Chromaticity blue;
+    };
+
+    enum class ToneCurveType
+    {
+        Linear,
+        Srgb,
+        Rec709,
+        Gamma
+    };
+
+    struct ToneCurve
+    {
+        ToneCurveType type;
+        // The decoding exponent for ToneCurveType::Gamma, this is always greater than 1.
+        double gamma;
+    };
+
+    constexpr uint32_t MakeSignature(char a, char b, char c, char d)
+    {
+        return (static_cast<uint32_t>(static_cast<uint8_t>(a)) << 24)
+             | (static_cast<uint32_t>(static_cast<uint8_t>(b)) << 16)
+             | (static_cast<uint32_t>(static_cast<uint8_t>(c)) << 8)
+             | static_cast<uint32_t>(static_cast<uint8_t>(d));
+    }
+
+    constexpr size_t IccHeaderSize = 128;
+    constexpr size_t IccTagEntrySize = 12;
+
+    // The maximum difference between the profile chromaticities and the known values.
+    // This allows for the s15Fixed16 rounding of the colorant tags and for profiles that
+    // were created with slightly different white point coordinates.
+    constexpr double ChromaticityTolerance = 0.002;
+    // The maximum difference between a sampled tone curve and the known curve, with both normalized to [0, 1].
+    constexpr double ToneCurveTolerance = 0.001;
+    constexpr double GammaTolerance = 0.0001;
+
+    constexpr Vector3 D50WhitePoint = { 0.9642, 1.0, 0.8249 };
+    constexpr Chromaticity D65WhitePoint = { 0.3127, 0.3290 };
+
+    // Adobe RGB uses the same red and blue primaries as sRGB, it is signaled with custom primaries.
+    constexpr std::array<KnownPrimaries, 4> KnownPrimariesTable =
+    {
+        KnownPrimaries{ JXL_PRIMARIES_SRGB, { 0.640, 0.330 }, { 0.300, 0.600 }, { 0.150, 0.060 } },
+        KnownPrimaries{ JXL_PRIMARIES_P3, { 0.680, 0.320 }, { 0.265, 0.690 }, { 0.150, 0.060 } },
+        KnownPrimaries{ JXL_PRIMARIES_2100, { 0.708, 0.292 }, { 0.170, 0.797 }, { 0.131, 0.046 } },
+        KnownPrimaries{ JXL_PRIMARIES_CUSTOM, { 0.640, 0.330 }, { 0.210, 0.710 }, { 0.150, 0.060 } },
+    };
+
+    constexpr Matrix3x3 BradfordMatrix =
+    {
+         0.8951,  0.2664, -0.1614,
+        -0.7502,  1.7135,  0.0367,
+         0.0389, -0.0685,  1.0296
+    };
+
+    uint16_t ReadUInt16(const uint8_t* data)
+    {
+        return static_cast<uint16_t>((data[0] << 8) | data[1]);
+    }
+
+    uint32_t ReadUInt32(const uint8_t* data)
+    {
+        return (static_cast<uint32_t>(data[0]) << 24)
+             | (static_cast<uint32_t>(data[1]) << 16)
+             | (static_cast<uint32_t>(data[2]) << 8)
+             | static_cast<uint32_t>(data[3]);
+    }
+
+    double ReadS15Fixed16(const uint8_t* data)
+    {
+        return static_cast<double>(static_cast<int32_t>(ReadUInt32(data))) / 65536.0;
+    }
+
+    class IccTagReader
+    {
+    public:
+        IccTagReader(const uint8_t* profile, size_t profileSize)
+            : profile(profile), profileSize(profileSize), tagCount(0)
+        {
+            if (profileSize >= IccHeaderSize + 4)
+            {
+                const size_t maxTagCount = (profileSize - IccHeaderSize - 4) / IccTagEntrySize;
+
+                tagCount = std::min(static_cast<size_t>(ReadUInt32(profile + IccHeaderSize)), maxTagCount);
+            }
+        }
+
+        bool HasTag(uint32_t signature) const
+        {
+            const uint8_t* data;
+            size_t size;
+
+            return FindTag(signature, &data, &size);
+        }
+
+        bool FindTag(uint32_t signature, const uint8_t** data, size_t* size) const
+        {
+            const uint8_t* entry = profile + IccHeaderSize + 4;
+
+            for (size_t i = 0; i < tagCount; i++, entry += IccTagEntrySize)
+            {
+                if (ReadUInt32(entry) == signature)
+                {
+                    const size_t offset = ReadUInt32(entry + 4);
+                    const size_t length = ReadUInt32(entry + 8);
+
+                    if (offset > profileSize || length > profileSize - offset)
+                    {
+                        return false;
+                    }
+
+                    *data = profile + offset;
+                    *size = length;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        bool ReadXYZ(uint32_t signature, Vector3* xyz) const
+        {
+            const uint8_t* data;
+            size_t size;
+
+            if (!FindTag(signature, &data, &size) || size < 20 || ReadUInt32(data) != MakeSignature('X', 'Y', 'Z', ' '))
+            {
+                return false;
+            }
+
+            for (size_t i = 0; i < 3; i++)
+            {
+                (*xyz)[i] = ReadS15Fixed16(data + 8 + (i * 4));
+            }
+
+            return true;
+        }
+
+        bool ReadChromaticAdaptation(Matrix3x3* matrix) const
+        {
+            const uint8_t* data;
+            size_t size;
+
+            if (!FindTag(MakeSignature('c', 'h', 'a', 'd'), &data, &size)
+                || size < 44
+                || ReadUInt32(data) != MakeSignature('s', 'f', '3', '2'))
+            {
+                return false;
+            }
+
+            for (size_t i = 0; i < 9; i++)
+            {
+                (*matrix)[i] = ReadS15Fixed16(data + 8 + (i * 4));
+            }
+
+            return true;
+        }
+
+        bool ReadToneCurve(uint32_t signature, ToneCurve* curve) const;
+
+    private:
+        const uint8_t* profile;
+        size_t profileSize;
+        size_t tagCount;
+    };
+
+    double SrgbToLinear(double value)
+    {
+        return value <= 0.04045 ? value / 12.92 : std::pow((value + 0.055) / 1.055, 2.4);
+    }
+
+    double Rec709ToLinear(double value)
+    {
+        return value < 0.081 ? value / 4.5 : std::pow((value + 0.099) / 1.099, 1.0 / 0.45);
+    }
+
+    // The ICC parametric curve types, see section 10.18 of the ICC.1:2022 specification.
+    double EvaluateParametricCurve(uint16_t functionType, const std::array<double, 7>& p, double x)
+    {
+        const double g = p[0];
+        const double a = p[1];
+        const double b = p[2];
+        const double c = p[3];
+        const double d = p[4];
+        const double e = p[5];
+        const double f = p[6];
+
+        double y;
+
+        switch (functionType)
+        {
+        case 0:
+            y = std::pow(x, g);
+            break;
+        case 1:
+            y = (a != 0.0 && x >= -b / a) ? std::pow(std::max(a * x + b, 0.0), g) : 0.0;
+            break;
+        case 2:
+            y = (a != 0.0 && x >= -b / a) ? std::pow(std::max(a * x + b, 0.0), g) + c : c;
+            break;
+        case 3:
+            y = x >= d ? std::pow(std::max(a * x + b, 0.0), g) : c * x;
+            break;
+        case 4:
+            y = x >= d ? std::pow(std::max(a * x + b, 0.0), g) + e : c * x + f;
+            break;
+        default:
+            y = 0.0;
+            break;
+        }
+
+        return y;
+    }
+
+    bool MatchesCurve(const std::vector<double>& samples, double (*function)(double))
+    {
+        const size_t lastIndex = samples.size() - 1;
+
+        for (size_t i = 0; i < samples.size(); i++)
+        {
+            const double x = static_cast<double>(i) / static_cast<double>(lastIndex);
+
+            if (std::fabs(samples[i] - function(x)) > ToneCurveTolerance)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    double Identity(double value)
+    {
+        return value;
+    }
+
+    bool ClassifyGamma(double gamma, ToneCurve* curve)
+    {
+        if (std::fabs(gamma - 1.0) <= GammaTolerance)
+        {
+            curve->type = ToneCurveType::Linear;
+            curve->gamma = 1.0;
+            return true;
+        }
+        else if (gamma > 1.0)
+        {
+            curve->type = ToneCurveType::Gamma;
+            curve->gamma = gamma;
+            return true;
+        }
+
+        return false;
+    }
+
+    bool ClassifySamples(const std::vector<double>& samples, ToneCurve* curve)
+    {
+        curve->gamma = 1.0;
+
+        if (MatchesCurve(samples, Identity))
+        {
+            curve->type = ToneCurveType::Linear;
+            return true;
+        }
+        else if (MatchesCurve(samples, SrgbToLinear))
+        {
+            curve->type = ToneCurveType::Srgb;
+            return true;
+        }
+        else if (MatchesCurve(samples, Rec709ToLinear))
+        {
+            curve->type = ToneCurveType::Rec709;
+            return true;
+        }
+
+        return false;
+    }
+
+    bool IccTagReader::ReadToneCurve(uint32_t signature, ToneCurve* curve) const
+    {
+        const uint8_t* data;
+        size_t size;
+
+        if (!FindTag(signature, &data, &size) || size < 12)
+        {
+            return false;
+        }
+
+        const uint32_t type = ReadUInt32(data);
+
+        if (type == MakeSignature('c', 'u', 'r', 'v'))
+        {
+            const size_t entryCount = ReadUInt32(data + 8);
+
+            if (entryCount > (size - 12) / 2)
+            {
+                return false;
+            }
+
+            if (entryCount == 0)
+            {
+                curve->type = ToneCurveType::Linear;
+                curve->gamma = 1.0;
+                return true;
+            }
+            else if (entryCount == 1)
+            {
+                // A single entry is a u8Fixed8Number gamma value.
+                return ClassifyGamma(static_cast<double>(ReadUInt16(data + 12)) / 256.0, curve);
+            }
+
+            std::vector<double> samples(entryCount);
+
+            for (size_t i = 0; i < entryCount; i++)
+            {
+                samples[i] = static_cast<double>(ReadUInt16(data + 12 + (i * 2))) / 65535.0;
+            }
+
+            return ClassifySamples(samples, curve);
+        }
+        else if (type == MakeSignature('p', 'a', 'r', 'a'))
+        {
+            static constexpr std::array<size_t, 5> parameterCounts = { 1, 3, 4, 5, 7 };
+
+            const uint16_t functionType = ReadUInt16(data + 8);
+
+            if (functionType >= parameterCounts.size())
+            {
+                return false;
+            }
+
+            const size_t parameterCount = parameterCounts[functionType];
+
+            if (size < 12 + (parameterCount * 4))
+            {
+                return false;
+            }
+
+            std::array<double, 7> parameters{};
+
+            for (size_t i = 0; i < parameterCount; i++)
+            {
+                parameters[i] = ReadS15Fixed16(data + 12 + (i * 4));
+            }
+
+            if (functionType == 0)
+            {
+                return ClassifyGamma(parameters[0], curve);
+            }
+
+            std::vector<double> samples(1024);
+
+            for (size_t i = 0; i < samples.size(); i++)
+            {
+                const double x = static_cast<double>(i) / static_cast<double>(samples.size() - 1);
+
+                samples[i] = EvaluateParametricCurve(functionType, parameters, x);
+            }
+
+            return ClassifySamples(samples, curve);
+        }
+
+        return false;
+    }
+
+    Vector3 Multiply(const Matrix3x3& m, const Vector3& v)
+    {
+        return
+        {
+            (m[0] * v[0]) + (m[1] * v[1]) + (m[2] * v[2]),
+            (m[3] * v[0]) + (m[4] * v[1]) + (m[5] * v[2]),
+            (m[6] * v[0]) + (m[7] * v[1]) + (m[8] * v[2])
+        };
+    }
+
+    Matrix3x3 Multiply(const Matrix3x3& a, const Matrix3x3& b)
+    {
+        Matrix3x3 result{};
+
+        for (size_t row = 0; row < 3; row++)
+        {
+            for (size_t column = 0; column < 3; column++)
+            {
+                for (size_t i = 0; i < 3; i++)
+                {
+                    result[(row * 3) + column] += a[(row * 3) + i] * b[(i * 3) + column];
+                }
+            }
+        }
+
+        return result;
+    }
+
+    bool Invert(const Matrix3x3& m, Matrix3x3* result)
+    {
+        const double c0 = (m[4] * m[8]) - (m[5] * m[7]);
+        const double c1 = (m[5] * m[6]) - (m[3] * m[8]);
+        const double c2 = (m[3] * m[7]) - (m[4] * m[6]);
+
+        const double determinant = (m[0] * c0) + (m[1] * c1) + (m[2] * c2);
+
+        if (std::fabs(determinant) < 1e-12)
+        {
+            return false;
+        }
+
+        const double inverseDeterminant = 1.0 / determinant;
+
+        *result =
+        {
+            c0 * inverseDeterminant,
+            ((m[2] * m[7]) - (m[1] * m[8])) * inverseDeterminant,
+            ((m[1] * m[5]) - (m[2] * m[4])) * inverseDeterminant,
+            c1 * inverseDeterminant,
+            ((m[0] * m[8]) - (m[2] * m[6])) * inverseDeterminant,
+            ((m[2] * m[3]) - (m[0] * m[5])) * inverseDeterminant,
+            c2 * inverseDeterminant,
+            ((m[1] * m[6]) - (m[0] * m[7])) * inverseDeterminant,
+            ((m[0] * m[4]) - (m[1] * m[3])) * inverseDeterminant
+        };
+
+        return true;
+    }
+
+    // Computes the Bradford transform that adapts colors from the source white point to the D50 PCS white point.
+    bool GetBradfordAdaptation(const Vector3& sourceWhite, Matrix3x3* matrix)
+    {
+        Matrix3x3 inverseBradford;
+
+        if (!Invert(BradfordMatrix, &inverseBradford))
+        {
+            return false;
+        }
+
+        const Vector3 sourceCone = Multiply(BradfordMatrix, sourceWhite);
+        const Vector3 destinationCone = Multiply(BradfordMatrix, D50WhitePoint);
+
+        Matrix3x3 scale{};
+
+        for (size_t i = 0; i < 3; i++)
+        {
+            if (sourceCone[i] == 0.0)
+            {
+                return false;
+            }
+
+            scale[i * 4] = destinationCone[i] / sourceCone[i];
+        }
+
+        *matrix = Multiply(inverseBradford, Multiply(scale, BradfordMatrix));
+        return true;
+    }
+
+    bool ToChromaticity(const Vector3& xyz, Chromaticity* chromaticity)
+    {
+        const double sum = xyz[0] + xyz[1] + xyz[2];
+
+        if (sum <= 0.0)
+        {
+            return false;
+        }
+
+        chromaticity->x = xyz[0] / sum;
+        chromaticity->y = xyz[1] / sum;
+        return true;
+    }
+
+    bool IsClose(const Chromaticity& a, const Chromaticity& b)
+    {
+        return std::fabs(a.x - b.x) <= ChromaticityTolerance && std::fabs(a.y - b.y) <= ChromaticityTolerance;
+    }
+
+    bool IsSameCurve(const ToneCurve& a, const ToneCurve& b)
+    {
+        return a.type == b.type && std::fabs(a.gamma - b.gamma) <= GammaTolerance;
+    }
+
+    bool HasLutTransform(const IccTagReader& reader)
+    {
+        static constexpr std::array<uint32_t, 8> lutTags =
+        {
+            MakeSignature('A', '2', 'B', '0'),
+            MakeSignature('A', '2', 'B', '1'),
+            MakeSignature('A', '2', 'B', '2'),
+            MakeSignature('B', '2', 'A', '0'),
+            MakeSignature('B', '2', 'A', '1'),
+            MakeSignature('B', '2', 'A', '2'),
+            MakeSignature('D', '2', 'B', '0'),
+            MakeSignature('B', '2', 'D', '0'),
+        };
+
+        for (uint32_t tag : lutTags)
+        {
+            if (reader.HasTag(tag))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Gets the colorant and white point chromaticities of the source color space, before the
+    // profile creator adapted them to the D50 PCS white point.
+    bool GetSourceChromaticities(
+        const IccTagReader& reader,
+        Chromaticity* white,
+        Chromaticity* red,
+        Chromaticity* green,
+        Chromaticity* blue)
+    {
+        Vector3 redXYZ;
+        Vector3 greenXYZ;
+        Vector3 blueXYZ;
+
+        if (!reader.ReadXYZ(MakeSignature('r', 'X', 'Y', 'Z'), &redXYZ)
+            || !reader.ReadXYZ(MakeSignature('g', 'X', 'Y', 'Z'), &greenXYZ)
+            || !reader.ReadXYZ(MakeSignature('b', 'X', 'Y', 'Z'), &blueXYZ))
+        {
+            return false;
+        }
+
+        Vector3 mediaWhite;
+
+        if (!reader.ReadXYZ(MakeSignature('w', 't', 'p', 't'), &mediaWhite))
+        {
+            mediaWhite = D50WhitePoint;
+        }
+
+        Matrix3x3 adaptation;
+        Vector3 sourceWhite;
+
+        if (reader.ReadChromaticAdaptation(&adaptation))
+        {
+            // ICC v4 profiles always use a D50 media white point, the source white
+            // point is found by undoing the chromatic adaptation.
+            Matrix3x3 inverseAdaptation;
+
+            if (!Invert(adaptation, &inverseAdaptation))
+            {
+                return false;
+            }
+
+            sourceWhite = Multiply(inverseAdaptation, D50WhitePoint);
+        }
+        else
+        {
+            // ICC v2 profiles store the source white point in the media white point tag,
+            // the colorants were adapted to D50 with the Bradford transform.
+            sourceWhite = mediaWhite;
+
+            if (!GetBradfordAdaptation(sourceWhite, &adaptation))
+            {
+                return false;
+            }
+        }
+
+        Matrix3x3 inverseAdaptation;
+
+        if (!Invert(adaptation, &inverseAdaptation))
+        {
+            return false;
+        }
+
+        return ToChromaticity(sourceWhite, white)
+            && ToChromaticity(Multiply(inverseAdaptation, redXYZ), red)
+            && ToChromaticity(Multiply(inverseAdaptation, greenXYZ), green)
+            && ToChromaticity(Multiply(inverseAdaptation, blueXYZ), blue);
+    }
+}
+
+bool IccProfileRecognition::TryGetColorEncoding(
+    const uint8_t* profile,
+    size_t profileSize,
+    JxlColorEncoding* colorEncoding)
+{
+    if (!profile || profileSize < IccHeaderSize + 4)
+    {
+        return false;
+    }
+
+    const uint32_t deviceClass = ReadUInt32(profile + 12);
+
+    if (ReadUInt32(profile + 36) != MakeSignature('a', 'c', 's', 'p')
+        || ReadUInt32(profile + 16) != MakeSignature('R', 'G', 'B', ' ')
+        || ReadUInt32(profile + 20) != MakeSignature('X', 'Y', 'Z', ' ')
+        || (deviceClass != MakeSignature('m', 'n', 't', 'r')
+            && deviceClass != MakeSignature('s', 'c', 'n', 'r')
+            && deviceClass != MakeSignature('s', 'p', 'a', 'c')))
+    {
+        return false;
+    }
+
+    const uint32_t renderingIntent = ReadUInt32(profile + 64);
+
+    if (renderingIntent > JXL_RENDERING_INTENT_ABSOLUTE)
+    {
+        return false;
+    }
+
+    const IccTagReader reader(profile, profileSize);
+
+    if (HasLutTransform(reader))
+    {
+        return false;
+    }
+
+    ToneCurve redCurve;
+    ToneCurve greenCurve;
+    ToneCurve blueCurve;
+
+    if (!reader.ReadToneCurve(MakeSignature('r', 'T', 'R', 'C'), &redCurve)
+        || !reader.ReadToneCurve(MakeSignature('g', 'T', 'R', 'C'), &greenCurve)
+        || !reader.ReadToneCurve(MakeSignature('b', 'T', 'R', 'C'), &blueCurve)
+        || !IsSameCurve(redCurve, greenCurve)
+        || !IsSameCurve(redCurve, blueCurve))
+    {
+        return false;
+    }
+
+    Chromaticity white;
+    Chromaticity red;
+    Chromaticity green;
+    Chromaticity blue;
+
+    if (!GetSourceChromaticities(reader, &white, &red, &green, &blue) || !IsClose(white, D65WhitePoint))
+    {
+        return false;
+    }
+
+    const auto knownPrimaries = std::find_if(
+        KnownPrimariesTable.begin(),
+        KnownPrimariesTable.end(),
+        [&](const KnownPrimaries& item)
+        {
+            return IsClose(red, item.red) && IsClose(green, item.green) && IsClose(blue, item.blue);
+        });
+
+    if (knownPrimaries == KnownPrimariesTable.end())
+    {
+        return false;
+    }
+
+    *colorEncoding = {};
+    colorEncoding->color_space = JXL_COLOR_SPACE_RGB;
+    colorEncoding->white_point = JXL_WHITE_POINT_D65;
+    colorEncoding->primaries = knownPrimaries->primaries;
+
+    if (knownPrimaries->primaries == JXL_PRIMARIES_CUSTOM)
+    {
+        colorEncoding->primaries_red_xy[0] = knownPrimaries->red.x;
+        colorEncoding->primaries_red_xy[1] = knownPrimaries->red.y;
+        colorEncoding->primaries_green_xy[0] = knownPrimaries->green.x;
+        colorEncoding->primaries_green_xy[1] = knownPrimaries->green.y;
+        colorEncoding->primaries_blue_xy[0] = knownPrimaries->blue.x;
+        colorEncoding->primaries_blue_xy[1] = knownPrimaries->blue.y;
+    }
+
+    switch (redCurve.type)
+    {
+    case ToneCurveType::Linear:
+        colorEncoding->transfer_function = JXL_TRANSFER_FUNCTION_LINEAR;
+        break;
+    case ToneCurveType::Srgb:
+        colorEncoding->transfer_function = JXL_TRANSFER_FUNCTION_SRGB;
+        break;
+    case ToneCurveType::Rec709:
+        colorEncoding->transfer_function = JXL_TRANSFER_FUNCTION_709;
+        break;
+    case ToneCurveType::Gamma:
+        // libjxl uses the encoding exponent, which is the reciprocal of the ICC decoding exponent.
+        colorEncoding->transfer_function = JXL_TRANSFER_FUNCTION_GAMMA;
+        colorEncoding->gamma = 1.0 / redCurve.gamma;
+        break;
+    default:
+        return false;
+    }
+
+    colorEncoding->rendering_intent = static_cast<JxlRenderingIntent>(renderingIntent);
+
+    return true;
+}
@@ -0,0 +1,28 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include "jxl/color_encoding.h"
+#include <stddef.h>
+#include <stdint.h>
+
+namespace IccProfileRecognition
+{
+    // Checks if an RGB matrix/TRC ICC profile describes a color space that JPEG XL can signal without
+    // embedding the profile, the sRGB, Display P3, Rec. 2020 and Adobe RGB primaries with a linear, sRGB,
+    // Rec. 709 or pure gamma transfer curve.
+    // The primaries and white point are taken from the colorant tags with the chromatic adaptation undone,
+    // profiles that contain LUT-based transforms are never recognized because a CMS would use those instead
+    // of the colorant and TRC tags.
+    // Returns true and sets colorEncoding if the profile was recognized.
+    bool TryGetColorEncoding(const uint8_t* profile, size_t profileSize, JxlColorEncoding* colorEncoding);
+}
@@ -0,0 +1,149 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "ImageDownscaling.h"
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+    // The input pixels that are covered by an output pixel, and the fraction of each input pixel that is covered.
+    struct Coverage
+    {
+        uint32_t first;
+        std::vector<float> weights;
+    };
+
+    std::vector<Coverage> GetCoverage(uint32_t srcSize, uint32_t dstSize)
+    {
+        std::vector<Coverage> coverage(dstSize);
+
+        const double scale = static_cast<double>(srcSize) / static_cast<double>(dstSize);
+
+        for (uint32_t i = 0; i < dstSize; i++)
+        {
+            const double start = i * scale;
+            const double end = std::min((i + 1) * scale, static_cast<double>(srcSize));
+
+            const uint32_t first = static_cast<uint32_t>(start);
+            const uint32_t last = std::min(static_cast<uint32_t>(end - 1e-9), srcSize - 1);
+
+            coverage[i].first = first;
+            coverage[i].weights.reserve(last - first + 1);
+
+            for (uint32_t j = first; j <= last; j++)
+            {
+                const double overlap = std::min<double>(j + 1, end) - std::max<double>(j, start);
+
+                coverage[i].weights.push_back(static_cast<float>(overlap / scale));
+            }
+        }
+
+        return coverage;
+    }
+
+    uint8_t ToUInt8(float value)
+    {
+        return static_cast<uint8_t>(std::clamp(value + 0.5f, 0.0f, 255.0f));
+    }
+}
+
+void ImageDownscaling::AreaAverage(
+    const uint8_t* src,
+    uint32_t srcWidth,
+    uint32_t srcHeight,
+    uint32_t channelCount,
+    bool hasAlpha,
+    uint8_t* dst,
+    uint32_t dstWidth,
+    uint32_t dstHeight)
+{
+    const std::vector<Coverage> columns = GetCoverage(srcWidth, dstWidth);
+    const std::vector<Coverage> rows = GetCoverage(srcHeight, dstHeight);
+
+    const uint32_t alphaIndex = hasAlpha ? channelCount - 1 : channelCount;
+
+    // The horizontal pass stores the color channels premultiplied by alpha, the vertical pass
+    // divides the averaged color by the averaged alpha.
+    std::vector<float> horizontal(static_cast<size_t>(dstWidth) * srcHeight * channelCount);
+
+    for (uint32_t y = 0; y < srcHeight; y++)
+    {
+        const uint8_t* srcRow = src + (static_cast<size_t>(y) * srcWidth * channelCount);
+        float* dstRow = horizontal.data() + (static_cast<size_t>(y) * dstWidth * channelCount);
+
+        for (uint32_t x = 0; x < dstWidth; x++)
+        {
+            const Coverage& column = columns[x];
+            float* dstPixel = dstRow + (static_cast<size_t>(x) * channelCount);
+
+            for (size_t i = 0; i < column.weights.size(); i++)
+            {
+                const uint8_t* srcPixel = srcRow + (static_cast<size_t>(column.first + i) * channelCount);
+                const float weight = column.weights[i];
+                const float alphaWeight = hasAlpha ? weight * (srcPixel[alphaIndex] / 255.0f) : weight;
+
+                for (uint32_t c = 0; c < channelCount; c++)
+                {
+                    dstPixel[c] += srcPixel[c] * (c == alphaIndex ? weight : alphaWeight);
+                }
+            }
+        }
+    }
+
+    std::vector<float> accumulator(static_cast<size_t>(dstWidth) * channelCount);
+
+    for (uint32_t y = 0; y < dstHeight; y++)
+    {
+        const Coverage& row = rows[y];
+
+        std::fill(accumulator.begin(), accumulator.end(), 0.0f);
+
+        for (size_t i = 0; i < row.weights.size(); i++)
+        {
+            const float* srcRow = horizontal.data() + (static_cast<size_t>(row.first + i) * dstWidth * channelCount);
+            const float weight = row.weights[i];
+
+            for (size_t x = 0; x < accumulator.size(); x++)
+            {
+                accumulator[x] += srcRow[x] * weight;
+            }
+        }
+
+        uint8_t* dstRow = dst + (static_cast<size_t>(y) * dstWidth * channelCount);
+
+        for (uint32_t x = 0; x < dstWidth; x++)
+        {
+            const float* pixel = accumulator.data() + (static_cast<size_t>(x) * channelCount);
+            uint8_t* dstPixel = dstRow + (static_cast<size_t>(x) * channelCount);
+
+            if (hasAlpha)
+            {
+                const float alpha = pixel[alphaIndex];
+                const float colorScale = alpha > 0.0f ? 255.0f / alpha : 0.0f;
+
+                for (uint32_t c = 0; c < alphaIndex; c++)
+                {
+                    dstPixel[c] = ToUInt8(pixel[c] * colorScale);
+                }
+                dstPixel[alphaIndex] = ToUInt8(alpha);
+            }
+            else
+            {
+                for (uint32_t c = 0; c < channelCount; c++)
+                {
+                    dstPixel[c] = ToUInt8(pixel[c]);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,32 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+namespace ImageDownscaling
+{
+    // Downscales an interleaved 8-bit image with area averaging, each output pixel is the average of the
+    // input pixels that it covers. The color channels are weighted by the alpha channel, which is the last
+    // channel when hasAlpha is true, so fully transparent pixels do not change the color of the output.
+    // The output size must not be larger than the input size.
+    void AreaAverage(
+        const uint8_t* src,
+        uint32_t srcWidth,
+        uint32_t srcHeight,
+        uint32_t channelCount,
+        bool hasAlpha,
+        uint8_t* dst,
+        uint32_t dstWidth,
+        uint32_t dstHeight);
+}
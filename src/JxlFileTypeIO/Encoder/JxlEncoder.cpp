@@ -11,69 +11,34 @@
 ////////////////////////////////////////////////////////////////////////
 
 #include "JxlEncoder.h"
+#include "EffortCalibration.h"
+#include "IccProfileRecognition.h"
+#include "ImageDownscaling.h"
 #include "OutputProcessor.h"
+#include "ParallelRunner.h"
+#include "PerformanceStats.h"
 #include "PixelFormatConversion.h"
+#include "Tracing.h"
+#include "TrialOutputProcessor.h"
 #include <jxl/encode_cxx.h>
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 #include <jxl/resizable_parallel_runner.h>
-#include <jxl/resizable_parallel_runner_cxx.h>
 
 namespace
 {
-    enum class OutputPixelFormat
+    // Returns a pointer to the specified stats field, or null if the stats are not being collected.
+    uint64_t* GetStatsCounter(EncoderStats* stats, uint64_t EncoderStats::* field)
     {
-        Gray,
-        GrayAlpha,
-        Rgb,
-        Rgba
-    };
-
-    OutputPixelFormat GetOutputPixelFormat(const BitmapData* bitmap, bool hasICCProfile)
-    {
-        bool isGray = true;
-        bool hasTransparency = false;
-
-        const size_t width = static_cast<size_t>(bitmap->width);
-        const size_t height = static_cast<size_t>(bitmap->height);
-        const size_t stride = static_cast<size_t>(bitmap->stride);
-        const uint8_t* scan0 = bitmap->scan0;
-
-        for (size_t y = 0; y < height; y++)
-        {
-            const ColorBgra* ptr = reinterpret_cast<const ColorBgra*>(scan0 + (y * stride));
-
-            for (size_t x = 0; x < width; x++)
-            {
-                if (!(ptr->r == ptr->g && ptr->g == ptr->b))
-                {
-                    isGray = false;
-                }
-
-                if (ptr->a < 255)
-                {
-                    hasTransparency = true;
-                }
-
-                ptr++;
-            }
-        }
-
-        OutputPixelFormat format;
-
-        // Don't auto-convert images with an ICC profile to gray scale.
-        // The image's profile is RGB, and RGB profiles should not be used with a gray scale image.
-        if (isGray && !hasICCProfile)
-        {
-            format = hasTransparency ? OutputPixelFormat::GrayAlpha : OutputPixelFormat::Gray;
-        }
-        else
-        {
-            format = hasTransparency ? OutputPixelFormat::Rgba : OutputPixelFormat::Rgb;
-        }
-
-        return format;
+        return stats ? &(stats->*field) : nullptr;
     }
 
     bool ReportProgress(ProgressProc progressProc, int32_t progressPercentage)
@@ -88,130 +53,29 @@ namespace
         return shouldContinue;
     }
 
-    EncoderStatus AddFrame(
-        const BitmapData* bitmap,
-        const JxlBasicInfo& basicInfo,
-        const JxlEncoderFrameSettings* frameSettings,
-        const OutputProcessor& outputProcessor,
-        ErrorInfo* errorInfo)
-    {
-        const uint32_t numberOfChannels = basicInfo.num_color_channels + basicInfo.num_extra_channels;
-
-        std::vector<uint8_t> frameBuffer;
-        frameBuffer.resize(static_cast<size_t>(basicInfo.xsize) * basicInfo.ysize * numberOfChannels);
-
-        switch (numberOfChannels)
-        {
-        case 1:
-            PixelFormatConversion::BgraToGray(bitmap, frameBuffer.data());
-            break;
-        case 2:
-            PixelFormatConversion::BgraToGrayAlpha(bitmap, frameBuffer.data());
-            break;
-        case 3:
-            PixelFormatConversion::BgraToRgb(bitmap, frameBuffer.data());
-            break;
-        case 4:
-            PixelFormatConversion::BgraToRgba(bitmap, frameBuffer.data());
-            break;
-        default:
-            return EncoderStatus::EncodeError;
-        }
-
-        JxlPixelFormat format{};
-        format.num_channels = numberOfChannels;
-        format.data_type = JXL_TYPE_UINT8;
-        format.endianness = JXL_NATIVE_ENDIAN;
-
-        EncoderStatus status = EncoderStatus::Ok;
-
-        if (JxlEncoderAddImageFrame(
-            frameSettings,
-            &format,
-            frameBuffer.data(),
-            frameBuffer.size()) != JXL_ENC_SUCCESS)
-        {
-            status = outputProcessor.GetWriteStatus();
-
-            if (status == EncoderStatus::Ok)
-            {
-                SetErrorMessage(errorInfo, "JxlEncoderAddImageFrame failed.");
-                status = EncoderStatus::EncodeError;
-            }
-        }
-
-        return status;
-    }
-}
-
-EncoderStatus EncoderWriteImage(
-    const BitmapData* bitmap,
-    const EncoderOptions* options,
-    const EncoderImageMetadata* metadata,
-    IOCallbacks* callbacks,
-    ErrorInfo* errorInfo,
-    ProgressProc progressCallback)
-{
-    if (!bitmap || !options || !callbacks || !metadata)
+    struct EncoderImage
     {
-        return EncoderStatus::NullParameter;
-    }
+        JxlBasicInfo basicInfo;
+        JxlPixelFormat pixelFormat;
+        std::vector<uint8_t> pixels;
+        bool isGray;
+    };
 
-    try
+    // Converts the image to the output pixel format, the converted image is
+    // shared by all of the encoder instances that are used for the image.
+    void InitializeEncoderImage(
+        const BitmapData* bitmap,
+        OutputPixelFormat outputPixelFormat,
+        EncoderImage& image)
     {
-        if (!ReportProgress(progressCallback, 0))
-        {
-            return EncoderStatus::UserCanceled;
-        }
-
-        const OutputPixelFormat outputPixelFormat = GetOutputPixelFormat(bitmap, metadata->iccProfileSize > 0);
-
-        if (!ReportProgress(progressCallback, 5))
-        {
-            return EncoderStatus::UserCanceled;
-        }
-
-        auto runner = JxlResizableParallelRunnerMake(nullptr);
-
-        JxlResizableParallelRunnerSetThreads(
-            runner.get(),
-            JxlResizableParallelRunnerSuggestThreads(bitmap->width, bitmap->height));
-
-        auto enc = JxlEncoderMake(nullptr);
-
-        if (JxlEncoderSetParallelRunner(
-            enc.get(),
-            JxlResizableParallelRunner,
-            runner.get()) != JXL_ENC_SUCCESS)
-        {
-            SetErrorMessage(errorInfo, "JxlEncoderSetParallelRunner failed.");
-            return EncoderStatus::EncodeError;
-        }
-
-        OutputProcessor outputProcessor(callbacks);
-
-        if (JxlEncoderSetOutputProcessor(
-            enc.get(),
-            outputProcessor.ToJxlOutputProcessor()) != JXL_ENC_SUCCESS)
-        {
-            SetErrorMessage(errorInfo, "JxlEncoderSetOutputProcessor failed.");
-            return EncoderStatus::EncodeError;
-        }
-
-        if (JxlEncoderUseBoxes(enc.get()) != JXL_ENC_SUCCESS)
-        {
-            SetErrorMessage(errorInfo, "JxlEncoderUseBoxes failed.");
-            return EncoderStatus::EncodeError;
-        }
-
-        JxlBasicInfo basicInfo;
+        JxlBasicInfo& basicInfo = image.basicInfo;
         JxlEncoderInitBasicInfo(&basicInfo);
 
         basicInfo.xsize = bitmap->width;
         basicInfo.ysize = bitmap->height;
         basicInfo.bits_per_sample = 8;
         basicInfo.exponent_bits_per_sample = 0;
-        basicInfo.uses_original_profile = options->lossless;
+        basicInfo.uses_original_profile = false;
         basicInfo.alpha_exponent_bits = 0;
         basicInfo.alpha_premultiplied = false;
 
@@ -239,52 +103,110 @@ EncoderStatus EncoderWriteImage(
             break;
         }
 
-        if (!ReportProgress(progressCallback, 15))
+        image.isGray = outputPixelFormat == OutputPixelFormat::Gray || outputPixelFormat == OutputPixelFormat::GrayAlpha;
+
+        const uint32_t numberOfChannels = basicInfo.num_color_channels + basicInfo.num_extra_channels;
+
+        image.pixels.resize(static_cast<size_t>(basicInfo.xsize) * basicInfo.ysize * numberOfChannels);
+
+        Tracing::Span span("PixelFormatConversion", "conversion");
+
+        switch (numberOfChannels)
         {
-            return EncoderStatus::UserCanceled;
+        case 1:
+            span.SetDetail("BgraToGray");
+            PixelFormatConversion::BgraToGray(bitmap, image.pixels.data());
+            break;
+        case 2:
+            span.SetDetail("BgraToGrayAlpha");
+            PixelFormatConversion::BgraToGrayAlpha(bitmap, image.pixels.data());
+            break;
+        case 3:
+            span.SetDetail("BgraToRgb");
+            PixelFormatConversion::BgraToRgb(bitmap, image.pixels.data());
+            break;
+        case 4:
+            span.SetDetail("BgraToRgba");
+            PixelFormatConversion::BgraToRgba(bitmap, image.pixels.data());
+            break;
+        default:
+            throw std::runtime_error("Unsupported number of channels.");
         }
 
-        if (JxlEncoderSetBasicInfo(enc.get(), &basicInfo) != JXL_ENC_SUCCESS)
+        image.pixelFormat = {};
+        image.pixelFormat.num_channels = numberOfChannels;
+        image.pixelFormat.data_type = JXL_TYPE_UINT8;
+        image.pixelFormat.endianness = JXL_NATIVE_ENDIAN;
+    }
+
+    EncoderStatus ConfigureEncoder(
+        JxlEncoder* enc,
+        const EncoderImage& image,
+        const EncoderImageMetadata* metadata,
+        bool lossless,
+        ErrorInfo* errorInfo)
+    {
+        if (JxlEncoderUseBoxes(enc) != JXL_ENC_SUCCESS)
         {
-            SetErrorMessage(errorInfo, "JxlEncoderSetBasicInfo failed.");
+            SetErrorMessage(errorInfo, "JxlEncoderUseBoxes failed.");
             return EncoderStatus::EncodeError;
         }
 
-        if (!ReportProgress(progressCallback, 20))
+        // The image is shared by encoders that use different settings, so the lossless
+        // flag is applied to a copy of the basic info.
+        JxlBasicInfo basicInfo = image.basicInfo;
+        basicInfo.uses_original_profile = lossless;
+
+        if (JxlEncoderSetBasicInfo(enc, &basicInfo) != JXL_ENC_SUCCESS)
         {
-            return EncoderStatus::UserCanceled;
+            SetErrorMessage(errorInfo, "JxlEncoderSetBasicInfo failed.");
+            return EncoderStatus::EncodeError;
         }
 
+        JxlColorEncoding colorEncoding{};
+        bool useColorEncoding = true;
+
         if (metadata->iccProfileSize > 0)
         {
-            if (JxlEncoderSetICCProfile(
-                enc.get(),
-                metadata->iccProfile,
-                metadata->iccProfileSize) != JXL_ENC_SUCCESS)
-            {
-                SetErrorMessage(errorInfo, "JxlEncoderSetICCProfile failed.");
-                return EncoderStatus::EncodeError;
-            }
+            // Well-known color spaces are signaled with the compact color encoding instead of embedding the
+            // ICC profile, this allows the decoders to skip parsing the profile and setting up a CMS.
+            // Images with an ICC profile are never converted to gray scale, so the profile is always RGB.
+            useColorEncoding = !image.isGray
+                && IccProfileRecognition::TryGetColorEncoding(
+                    metadata->iccProfile,
+                    metadata->iccProfileSize,
+                    &colorEncoding);
         }
         else
         {
-            JxlColorEncoding colorEncoding{};
-            bool isGray = outputPixelFormat == OutputPixelFormat::Gray || outputPixelFormat == OutputPixelFormat::GrayAlpha;
-
-            JxlColorEncodingSetToSRGB(&colorEncoding, isGray);
+            JxlColorEncodingSetToSRGB(&colorEncoding, image.isGray);
             colorEncoding.rendering_intent = JXL_RENDERING_INTENT_PERCEPTUAL;
+        }
 
-            if (JxlEncoderSetColorEncoding(enc.get(), &colorEncoding) != JXL_ENC_SUCCESS)
+        if (useColorEncoding)
+        {
+            if (JxlEncoderSetColorEncoding(enc, &colorEncoding) != JXL_ENC_SUCCESS)
             {
                 SetErrorMessage(errorInfo, "JxlEncoderSetColorEncoding failed.");
                 return EncoderStatus::EncodeError;
             }
         }
+        else
+        {
+            if (JxlEncoderSetICCProfile(
+                enc,
+                metadata->iccProfile,
+                metadata->iccProfileSize) != JXL_ENC_SUCCESS)
+            {
+                SetErrorMessage(errorInfo, "JxlEncoderSetICCProfile failed.");
+                return EncoderStatus::EncodeError;
+            }
+        }
 
         if (metadata->exifSize > 0)
         {
             if (JxlEncoderAddBox(
-                enc.get(),
+                enc,
                 "Exif",
                 metadata->exif,
                 metadata->exifSize,
@@ -298,7 +220,7 @@ EncoderStatus EncoderWriteImage(
         if (metadata->xmpSize > 0)
         {
             if (JxlEncoderAddBox(
-                enc.get(),
+                enc,
                 "xml ",
                 metadata->xmp,
                 metadata->xmpSize,
@@ -309,75 +231,1121 @@ EncoderStatus EncoderWriteImage(
             }
         }
 
-        if (!ReportProgress(progressCallback, 25))
-        {
-            return EncoderStatus::UserCanceled;
-        }
-
-        JxlEncoderFrameSettings* frameSettings = JxlEncoderFrameSettingsCreate(enc.get(), nullptr);
+        return EncoderStatus::Ok;
+    }
 
-        if (JxlEncoderSetFrameDistance(frameSettings, options->distance) != JXL_ENC_SUCCESS)
+    EncoderStatus SetFrameSettings(
+        JxlEncoderFrameSettings* frameSettings,
+        float distance,
+        bool lossless,
+        int32_t effort,
+        ErrorInfo* errorInfo)
+    {
+        if (JxlEncoderSetFrameDistance(frameSettings, distance) != JXL_ENC_SUCCESS)
         {
             SetErrorMessage(errorInfo, "JxlEncoderOptionsSetDistance failed.");
             return EncoderStatus::EncodeError;
         }
 
-        if (JxlEncoderSetFrameLossless(frameSettings, options->lossless) != JXL_ENC_SUCCESS)
+        if (JxlEncoderSetFrameLossless(frameSettings, lossless) != JXL_ENC_SUCCESS)
         {
             SetErrorMessage(errorInfo, "JxlEncoderOptionsSetLossless failed.");
             return EncoderStatus::EncodeError;
         }
 
-        if (JxlEncoderFrameSettingsSetOption(frameSettings, JXL_ENC_FRAME_SETTING_EFFORT, options->effort) != JXL_ENC_SUCCESS)
+        if (JxlEncoderFrameSettingsSetOption(frameSettings, JXL_ENC_FRAME_SETTING_EFFORT, effort) != JXL_ENC_SUCCESS)
         {
             SetErrorMessage(errorInfo, "JxlEncoderOptionsSetEffort failed.");
             return EncoderStatus::EncodeError;
         }
 
-        // The libjxl process output loop reserves the 40% to 90% range of the progress percentage.
-        // If the process output loop takes more than 10 iterations the progress bar will stop at 90% but the
-        // progress callback will still be called to allow for cancellation.
-        outputProcessor.InitializeProgressReporting(
-            progressCallback,
-            30,
-            90,
-            5);
+        return EncoderStatus::Ok;
+    }
 
-        EncoderStatus status = AddFrame(bitmap, basicInfo, frameSettings, outputProcessor, errorInfo);
+    // The distance used for quality 100 in QualityToDistanceLookupTable.
+    constexpr float minRateControlDistance = 0.1f;
+    // The maximum distance that libjxl supports.
+    constexpr float maxRateControlDistance = 25.0f;
+    constexpr size_t rateControlTrialsPerRound = 3;
+    constexpr int32_t maxRateControlRounds = 6;
+    // The search stops when the distance that fits and the distance that does not are within 2% of each other.
+    constexpr float rateControlDistanceTolerance = 1.02f;
 
-        if (status != EncoderStatus::Ok)
+    struct RateControlTrial
+    {
+        float distance;
+        EncoderStatus status;
+        bool fitsSizeLimit;
+        std::vector<uint8_t> output;
+        ErrorInfo errorInfo;
+    };
+
+    void RunRateControlTrial(
+        const EncoderImage& image,
+        const EncoderImageMetadata* metadata,
+        int32_t effort,
+        uint64_t sizeLimit,
+        size_t threadCount,
+        const JxlMemoryManager* memoryManager,
+        std::atomic<float>& bestFittingDistance,
+        RateControlTrial& trial) noexcept
+    {
+        trial.status = EncoderStatus::Ok;
+        trial.fitsSizeLimit = false;
+        trial.errorInfo.errorMessage[0] = '\0';
+
+        try
         {
-            return status;
+            Tracing::Span span("Rate control trial", "encode");
+
+            ParallelRunner runner(
+                memoryManager,
+                threadCount,
+                static_cast<uint64_t>(image.basicInfo.xsize) * image.basicInfo.ysize);
+
+            auto enc = JxlEncoderMake(memoryManager);
+
+            if (JxlEncoderSetParallelRunner(
+                enc.get(),
+                runner.GetRunner(),
+                runner.GetRunnerOpaque()) != JXL_ENC_SUCCESS)
+            {
+                SetErrorMessage(&trial.errorInfo, "JxlEncoderSetParallelRunner failed.");
+                trial.status = EncoderStatus::EncodeError;
+                return;
+            }
+
+            TrialOutputProcessor outputProcessor(sizeLimit, trial.distance, &bestFittingDistance);
+
+            if (JxlEncoderSetOutputProcessor(
+                enc.get(),
+                outputProcessor.ToJxlOutputProcessor()) != JXL_ENC_SUCCESS)
+            {
+                SetErrorMessage(&trial.errorInfo, "JxlEncoderSetOutputProcessor failed.");
+                trial.status = EncoderStatus::EncodeError;
+                return;
+            }
+
+            trial.status = ConfigureEncoder(enc.get(), image, metadata, false, &trial.errorInfo);
+
+            if (trial.status != EncoderStatus::Ok)
+            {
+                return;
+            }
+
+            JxlEncoderFrameSettings* frameSettings = JxlEncoderFrameSettingsCreate(enc.get(), nullptr);
+
+            trial.status = SetFrameSettings(frameSettings, trial.distance, false, effort, &trial.errorInfo);
+
+            if (trial.status != EncoderStatus::Ok)
+            {
+                return;
+            }
+
+            bool succeeded = JxlEncoderAddImageFrame(
+                frameSettings,
+                &image.pixelFormat,
+                image.pixels.data(),
+                image.pixels.size()) == JXL_ENC_SUCCESS;
+
+            if (succeeded)
+            {
+                JxlEncoderCloseInput(enc.get());
+
+                succeeded = JxlEncoderFlushInput(enc.get()) == JXL_ENC_SUCCESS;
+            }
+
+            if (!succeeded)
+            {
+                // Trials that exceed the size limit or cannot produce the best image are stopped
+                // by the output processor, these trials are not errors.
+                if (!outputProcessor.SizeLimitExceeded() && !outputProcessor.IsCanceled())
+                {
+                    SetErrorMessage(&trial.errorInfo, "The rate control trial encode failed.");
+                    trial.status = EncoderStatus::EncodeError;
+                }
+                return;
+            }
+
+            trial.fitsSizeLimit = true;
+            trial.output = std::move(outputProcessor.GetOutput());
+
+            float currentBestDistance = bestFittingDistance.load();
+
+            while (trial.distance < currentBestDistance
+                && !bestFittingDistance.compare_exchange_weak(currentBestDistance, trial.distance))
+            {
+            }
+        }
+        catch (const std::bad_alloc&)
+        {
+            trial.status = EncoderStatus::OutOfMemory;
+        }
+        catch (...)
+        {
+            trial.status = EncoderStatus::EncodeError;
         }
+    }
 
-        JxlEncoderCloseInput(enc.get());
+    void RunRateControlRound(
+        const EncoderImage& image,
+        const EncoderImageMetadata* metadata,
+        int32_t effort,
+        uint64_t sizeLimit,
+        size_t threadsPerTrial,
+        const JxlMemoryManager* memoryManager,
+        std::atomic<float>& bestFittingDistance,
+        std::vector<RateControlTrial>& trials)
+    {
+        std::vector<std::thread> threads;
+        threads.reserve(trials.size() - 1);
 
-        status = outputProcessor.GetWriteStatus();
+        try
+        {
+            for (size_t i = 1; i < trials.size(); i++)
+            {
+                threads.emplace_back(
+                    RunRateControlTrial,
+                    std::cref(image),
+                    metadata,
+                    effort,
+                    sizeLimit,
+                    threadsPerTrial,
+                    memoryManager,
+                    std::ref(bestFittingDistance),
+                    std::ref(trials[i]));
+            }
+        }
+        catch (...)
+        {
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+            throw;
+        }
 
-        if (status != EncoderStatus::Ok)
+        RunRateControlTrial(image, metadata, effort, sizeLimit, threadsPerTrial, memoryManager, bestFittingDistance, trials[0]);
+
+        for (std::thread& thread : threads)
         {
-            return status;
+            thread.join();
         }
+    }
 
-        if (!ReportProgress(progressCallback, 95))
+    // Searches for the lowest distance that produces a file within the target size.
+    // Each round runs several trial encodes in parallel with distances that are spaced
+    // logarithmically between the highest distance known to exceed the target size and
+    // the lowest distance known to fit, the output of the best trial is written to the file.
+    EncoderStatus EncodeWithTargetFileSize(
+        const EncoderImage& image,
+        const EncoderImageMetadata* metadata,
+        int32_t effort,
+        uint64_t targetFileSize,
+        IOCallbacks* callbacks,
+        ErrorInfo* errorInfo,
+        ProgressProc progressCallback,
+        size_t totalThreads,
+        const JxlMemoryManager* memoryManager,
+        EncoderStats* stats)
+    {
+        const size_t threadsPerTrial = std::max<size_t>(1, totalThreads / rateControlTrialsPerRound);
+
+        if (stats)
         {
-            return EncoderStatus::UserCanceled;
+            stats->threadCount = static_cast<uint32_t>(threadsPerTrial * rateControlTrialsPerRound);
         }
 
-        if (JxlEncoderFlushInput(enc.get()) != JXL_ENC_SUCCESS)
+        std::atomic<float> bestFittingDistance(std::numeric_limits<float>::max());
+        std::vector<RateControlTrial> trials(rateControlTrialsPerRound);
+        std::vector<uint8_t> bestOutput;
+
+        bool foundFittingDistance = false;
+        float fittingDistance = maxRateControlDistance;
+        float exceedingDistance = minRateControlDistance;
+
+        for (int32_t round = 0; round < maxRateControlRounds; round++)
         {
-            status = outputProcessor.GetWriteStatus();
+            const int32_t progressPercentage = 30 + ((round * 60) / maxRateControlRounds);
 
-            if (status != EncoderStatus::Ok)
+            if (!ReportProgress(progressCallback, progressPercentage))
             {
-                return status;
+                return EncoderStatus::UserCanceled;
             }
-            else
+
+            // The first round includes both ends of the distance range, the later rounds
+            // only search between the current bounds.
+            const bool firstRound = round == 0;
+            const float logLower = std::log(exceedingDistance);
+            const float logRange = std::log(fittingDistance) - logLower;
+            const size_t divisions = firstRound ? trials.size() - 1 : trials.size() + 1;
+
+            for (size_t i = 0; i < trials.size(); i++)
+            {
+                const size_t step = firstRound ? i : i + 1;
+
+                trials[i].distance = std::exp(logLower + (logRange * static_cast<float>(step) / static_cast<float>(divisions)));
+            }
+
+            {
+                ScopedPhaseTimer encodeTimer(GetStatsCounter(stats, &EncoderStats::encodeTime));
+
+                RunRateControlRound(
+                    image,
+                    metadata,
+                    effort,
+                    targetFileSize,
+                    threadsPerTrial,
+                    memoryManager,
+                    bestFittingDistance,
+                    trials);
+            }
+
+            for (RateControlTrial& trial : trials)
+            {
+                if (trial.status != EncoderStatus::Ok)
+                {
+                    SetErrorMessage(errorInfo, trial.errorInfo.errorMessage);
+                    return trial.status;
+                }
+
+                if (trial.fitsSizeLimit)
+                {
+                    if (!foundFittingDistance || trial.distance < fittingDistance)
+                    {
+                        foundFittingDistance = true;
+                        fittingDistance = trial.distance;
+                        bestOutput = std::move(trial.output);
+                    }
+                }
+                else if (trial.distance > exceedingDistance && trial.distance < fittingDistance)
+                {
+                    // Trials that were canceled because a lower distance fits are also above the
+                    // fitting distance, so only the trials that exceeded the size limit move this bound.
+                    exceedingDistance = trial.distance;
+                }
+            }
+
+            if (!foundFittingDistance)
+            {
+                SetErrorMessage(errorInfo, "The image cannot be encoded within the target file size.");
+                return EncoderStatus::EncodeError;
+            }
+
+            if (fittingDistance <= minRateControlDistance
+                || fittingDistance <= (exceedingDistance * rateControlDistanceTolerance))
+            {
+                break;
+            }
+        }
+
+        if (!ReportProgress(progressCallback, 95))
+        {
+            return EncoderStatus::UserCanceled;
+        }
+
+        ScopedPhaseTimer outputCallbackTimer(GetStatsCounter(stats, &EncoderStats::outputCallbackTime));
+
+        const EncoderStatus status = WriteOutputData(callbacks, bestOutput.data(), bestOutput.size());
+
+        if (stats && status == EncoderStatus::Ok)
+        {
+            stats->outputSize = bestOutput.size();
+        }
+
+        return status;
+    }
+
+    bool TryGetJpegImageSize(const uint8_t* data, size_t dataSize, uint32_t& width, uint32_t& height)
+    {
+        // Check for the JPEG start of image marker.
+        if (dataSize < 4 || data[0] != 0xFF || data[1] != 0xD8)
+        {
+            return false;
+        }
+
+        size_t offset = 2;
+
+        while (offset + 4 <= dataSize)
+        {
+            if (data[offset] != 0xFF)
+            {
+                return false;
+            }
+
+            const uint8_t marker = data[offset + 1];
+
+            if (marker == 0xFF)
+            {
+                // Fill byte.
+                offset++;
+                continue;
+            }
+
+            const size_t segmentLength = (static_cast<size_t>(data[offset + 2]) << 8) | data[offset + 3];
+
+            // The start of frame markers are 0xC0 to 0xCF, excluding DHT (0xC4), JPG (0xC8) and DAC (0xCC).
+            if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+            {
+                if (segmentLength < 7 || offset + 2 + segmentLength > dataSize)
+                {
+                    return false;
+                }
+
+                const uint8_t* frameHeader = data + offset + 4;
+
+                height = (static_cast<uint32_t>(frameHeader[1]) << 8) | frameHeader[2];
+                width = (static_cast<uint32_t>(frameHeader[3]) << 8) | frameHeader[4];
+
+                return width > 0 && height > 0;
+            }
+            else if (marker == 0xDA || marker == 0xD9)
+            {
+                // The image data started before a frame header was found.
+                return false;
+            }
+
+            offset += 2 + segmentLength;
+        }
+
+        return false;
+    }
+
+    EncoderStatus FlushEncoderOutput(
+        JxlEncoder* enc,
+        const OutputProcessor& outputProcessor,
+        ErrorInfo* errorInfo)
+    {
+        Tracing::Span span("JxlEncoderFlushInput", "encode");
+
+        if (JxlEncoderFlushInput(enc) != JXL_ENC_SUCCESS)
+        {
+            EncoderStatus status = outputProcessor.GetWriteStatus();
+
+            if (status != EncoderStatus::Ok)
+            {
+                return status;
+            }
+            else
             {
                 SetErrorMessage(errorInfo, "JxlEncoderFlushInput failed.");
                 return EncoderStatus::EncodeError;
             }
         }
+
+        return EncoderStatus::Ok;
+    }
+
+    struct LibJxlEncoderStatsDeleter
+    {
+        void operator()(JxlEncoderStats* stats) const
+        {
+            JxlEncoderStatsDestroy(stats);
+        }
+    };
+
+    typedef std::unique_ptr<JxlEncoderStats, LibJxlEncoderStatsDeleter> LibJxlEncoderStatsPtr;
+
+    void CopyLibJxlEncoderStats(const JxlEncoderStats* libJxlStats, EncoderStats* stats)
+    {
+        const uint32_t count = static_cast<uint32_t>(std::min<size_t>(JXL_ENC_NUM_STATS, maxLibJxlEncoderStats));
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            stats->libJxlStats[i] = JxlEncoderStatsGet(libJxlStats, static_cast<JxlEncoderStatsKey>(i));
+        }
+
+        stats->libJxlStatCount = count;
+    }
+
+    // Encodes an image that has been converted to the output pixel format.
+    EncoderStatus EncodeImage(
+        const EncoderImage& image,
+        const EncoderOptions* options,
+        const EncoderImageMetadata* metadata,
+        IOCallbacks* callbacks,
+        ErrorInfo* errorInfo,
+        ProgressProc progressCallback,
+        EncoderResult* result,
+        size_t threadCount,
+        bool recordEncodeTime,
+        const JxlMemoryManager* memoryManager,
+        EncoderStats* stats)
+    {
+        const bool useRateControl = options->targetFileSize > 0 && !options->lossless;
+        const uint32_t channelCount = image.pixelFormat.num_channels;
+        int32_t effort = options->effort;
+
+        if (options->timeBudgetMilliseconds > 0)
+        {
+            // The rate control search runs several rounds of trial encodes, each round must
+            // finish within its share of the time budget.
+            const uint32_t encodeTimeBudget = useRateControl
+                ? std::max<uint32_t>(options->timeBudgetMilliseconds / maxRateControlRounds, 1)
+                : options->timeBudgetMilliseconds;
+
+            effort = EffortCalibration::SelectEffort(
+                image.basicInfo.xsize,
+                image.basicInfo.ysize,
+                channelCount,
+                options->lossless,
+                options->effort,
+                encodeTimeBudget);
+        }
+
+        if (result)
+        {
+            result->effort = effort;
+        }
+
+        // The target file size is ignored for lossless images.
+        if (useRateControl)
+        {
+            return EncodeWithTargetFileSize(
+                image,
+                metadata,
+                effort,
+                options->targetFileSize,
+                callbacks,
+                errorInfo,
+                progressCallback,
+                threadCount,
+                memoryManager,
+                stats);
+        }
+
+        std::chrono::steady_clock::time_point configureStartTime;
+
+        if (stats)
+        {
+            configureStartTime = std::chrono::steady_clock::now();
+        }
+
+        ParallelRunner runner(
+            memoryManager,
+            threadCount,
+            static_cast<uint64_t>(image.basicInfo.xsize) * image.basicInfo.ysize);
+
+        if (stats)
+        {
+            stats->threadCount = static_cast<uint32_t>(threadCount);
+        }
+
+        auto enc = JxlEncoderMake(memoryManager);
+
+        if (JxlEncoderSetParallelRunner(
+            enc.get(),
+            runner.GetRunner(),
+            runner.GetRunnerOpaque()) != JXL_ENC_SUCCESS)
+        {
+            SetErrorMessage(errorInfo, "JxlEncoderSetParallelRunner failed.");
+            return EncoderStatus::EncodeError;
+        }
+
+        OutputProcessor outputProcessor(callbacks);
+
+        if (JxlEncoderSetOutputProcessor(
+            enc.get(),
+            outputProcessor.ToJxlOutputProcessor()) != JXL_ENC_SUCCESS)
+        {
+            SetErrorMessage(errorInfo, "JxlEncoderSetOutputProcessor failed.");
+            return EncoderStatus::EncodeError;
+        }
+
+        EncoderStatus status = ConfigureEncoder(enc.get(), image, metadata, options->lossless, errorInfo);
+
+        if (status != EncoderStatus::Ok)
+        {
+            return status;
+        }
+
+        if (!ReportProgress(progressCallback, 25))
+        {
+            return EncoderStatus::UserCanceled;
+        }
+
+        JxlEncoderFrameSettings* frameSettings = JxlEncoderFrameSettingsCreate(enc.get(), nullptr);
+
+        status = SetFrameSettings(frameSettings, options->distance, options->lossless, effort, errorInfo);
+
+        if (status != EncoderStatus::Ok)
+        {
+            return status;
+        }
+
+        // The libjxl statistics are only collected when requested, collecting them adds work to the encoder.
+        // A failure to collect the statistics does not stop the image from being encoded.
+        LibJxlEncoderStatsPtr libJxlStats;
+
+        if (stats)
+        {
+            libJxlStats.reset(JxlEncoderStatsCreate());
+
+            if (libJxlStats && JxlEncoderCollectStats(frameSettings, libJxlStats.get()) != JXL_ENC_SUCCESS)
+            {
+                libJxlStats.reset();
+            }
+
+            stats->configureTime = ElapsedMicroseconds(configureStartTime);
+        }
+
+        // The libjxl process output loop reserves the 40% to 90% range of the progress percentage.
+        // If the process output loop takes more than 10 iterations the progress bar will stop at 90% but the
+        // progress callback will still be called to allow for cancellation.
+        outputProcessor.InitializeProgressReporting(
+            progressCallback,
+            30,
+            90,
+            5);
+
+        const auto encodeStartTime = std::chrono::steady_clock::now();
+
+        {
+            Tracing::Span span("JxlEncoderAddImageFrame", "encode");
+
+            if (JxlEncoderAddImageFrame(
+                frameSettings,
+                &image.pixelFormat,
+                image.pixels.data(),
+                image.pixels.size()) != JXL_ENC_SUCCESS)
+            {
+                status = outputProcessor.GetWriteStatus();
+
+                if (status == EncoderStatus::Ok)
+                {
+                    SetErrorMessage(errorInfo, "JxlEncoderAddImageFrame failed.");
+                    status = EncoderStatus::EncodeError;
+                }
+
+                return status;
+            }
+        }
+
+        JxlEncoderCloseInput(enc.get());
+
+        status = outputProcessor.GetWriteStatus();
+
+        if (status != EncoderStatus::Ok)
+        {
+            return status;
+        }
+
+        if (!ReportProgress(progressCallback, 95))
+        {
+            return EncoderStatus::UserCanceled;
+        }
+
+        status = FlushEncoderOutput(enc.get(), outputProcessor, errorInfo);
+
+        if (status != EncoderStatus::Ok)
+        {
+            return status;
+        }
+
+        const auto encodeTime = std::chrono::steady_clock::now() - encodeStartTime;
+
+        if (recordEncodeTime)
+        {
+            EffortCalibration::RecordEncodeTime(
+                image.basicInfo.xsize,
+                image.basicInfo.ysize,
+                channelCount,
+                options->lossless,
+                effort,
+                encodeTime);
+        }
+
+        if (stats)
+        {
+            const uint64_t encodeMicroseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(encodeTime).count());
+
+            // The output processor callbacks run inside the libjxl encode calls.
+            stats->outputCallbackTime = outputProcessor.GetCallbackTime();
+            stats->encodeTime = SaturatingSubtract(encodeMicroseconds, stats->outputCallbackTime);
+            stats->outputSize = outputProcessor.GetOutputSize();
+
+            if (libJxlStats)
+            {
+                CopyLibJxlEncoderStats(libJxlStats.get(), stats);
+            }
+        }
+
+        return EncoderStatus::Ok;
+    }
+
+    EncoderStatus WriteImage(
+        const BitmapData* bitmap,
+        const EncoderOptions* options,
+        const EncoderImageMetadata* metadata,
+        IOCallbacks* callbacks,
+        ErrorInfo* errorInfo,
+        ProgressProc progressCallback,
+        EncoderResult* result,
+        const JxlMemoryManager* memoryManager,
+        EncoderStats* stats)
+    {
+        if (!ReportProgress(progressCallback, 0))
+        {
+            return EncoderStatus::UserCanceled;
+        }
+
+        OutputPixelFormat outputPixelFormat = OutputPixelFormat::Rgba;
+
+        {
+            ScopedPhaseTimer conversionTimer(GetStatsCounter(stats, &EncoderStats::conversionTime));
+
+            Tracing::Span span("PixelFormatConversion::GetOutputPixelFormat", "conversion");
+
+            outputPixelFormat = PixelFormatConversion::GetOutputPixelFormat(bitmap, metadata->iccProfileSize > 0);
+        }
+
+        if (!ReportProgress(progressCallback, 5))
+        {
+            return EncoderStatus::UserCanceled;
+        }
+
+        EncoderImage image;
+
+        {
+            ScopedPhaseTimer conversionTimer(GetStatsCounter(stats, &EncoderStats::conversionTime));
+
+            InitializeEncoderImage(bitmap, outputPixelFormat, image);
+        }
+
+        if (!ReportProgress(progressCallback, 15))
+        {
+            return EncoderStatus::UserCanceled;
+        }
+
+        return EncodeImage(
+            image,
+            options,
+            metadata,
+            callbacks,
+            errorInfo,
+            progressCallback,
+            result,
+            JxlResizableParallelRunnerSuggestThreads(bitmap->width, bitmap->height),
+            true,
+            memoryManager,
+            stats);
+    }
+
+    // Returns the other dimension of an image that is scaled to the specified size, the result is
+    // rounded to the nearest pixel and is at least 1.
+    uint32_t ScaleDimension(uint32_t imageSize, uint32_t imageOtherSize, uint32_t scaledSize)
+    {
+        const uint64_t scaledOtherSize = ((static_cast<uint64_t>(imageOtherSize) * scaledSize) + (imageSize / 2)) / imageSize;
+
+        return static_cast<uint32_t>(std::clamp<uint64_t>(scaledOtherSize, 1, imageOtherSize));
+    }
+
+    EncoderImage DownscaleEncoderImage(const EncoderImage& image, uint32_t width, uint32_t height)
+    {
+        Tracing::Span span("ImageDownscaling::AreaAverage", "conversion");
+
+        EncoderImage downscaled;
+        downscaled.basicInfo = image.basicInfo;
+        downscaled.basicInfo.xsize = width;
+        downscaled.basicInfo.ysize = height;
+        downscaled.pixelFormat = image.pixelFormat;
+        downscaled.isGray = image.isGray;
+        downscaled.pixels.resize(static_cast<size_t>(width) * height * image.pixelFormat.num_channels);
+
+        ImageDownscaling::AreaAverage(
+            image.pixels.data(),
+            image.basicInfo.xsize,
+            image.basicInfo.ysize,
+            image.pixelFormat.num_channels,
+            image.basicInfo.num_extra_channels > 0,
+            downscaled.pixels.data(),
+            width,
+            height);
+
+        return downscaled;
+    }
+
+    void EncodeVariant(
+        const EncoderImage& image,
+        const EncoderImageMetadata* metadata,
+        size_t threadCount,
+        bool recordEncodeTime,
+        EncoderVariant& variant) noexcept
+    {
+        try
+        {
+            Tracing::Span span("Encode variant", "encode");
+
+            variant.status = EncodeImage(
+                image,
+                &variant.options,
+                metadata,
+                variant.callbacks,
+                &variant.errorInfo,
+                nullptr,
+                &variant.result,
+                threadCount,
+                recordEncodeTime,
+                nullptr,
+                nullptr);
+        }
+        catch (const std::bad_alloc&)
+        {
+            variant.status = EncoderStatus::OutOfMemory;
+        }
+        catch (...)
+        {
+            variant.status = EncoderStatus::EncodeError;
+        }
+    }
+
+    void WriteImageVariants(
+        const BitmapData* bitmap,
+        const EncoderImageMetadata* metadata,
+        EncoderVariant* variants,
+        uint32_t variantCount)
+    {
+        OutputPixelFormat outputPixelFormat = OutputPixelFormat::Rgba;
+
+        {
+            Tracing::Span span("PixelFormatConversion::GetOutputPixelFormat", "conversion");
+
+            outputPixelFormat = PixelFormatConversion::GetOutputPixelFormat(bitmap, metadata->iccProfileSize > 0);
+        }
+
+        // The first image is the full size image, the downscaled images are created once for each
+        // distinct output size and shared by the variants that use that size.
+        std::vector<EncoderImage> images(1);
+        images.reserve(static_cast<size_t>(variantCount) + 1);
+
+        InitializeEncoderImage(bitmap, outputPixelFormat, images[0]);
+
+        std::vector<uint32_t> variantsToEncode;
+        std::vector<size_t> imageIndexes;
+        variantsToEncode.reserve(variantCount);
+        imageIndexes.reserve(variantCount);
+
+        for (uint32_t i = 0; i < variantCount; i++)
+        {
+            EncoderVariant& variant = variants[i];
+
+            variant.status = EncoderStatus::Ok;
+            variant.result = {};
+            variant.errorInfo.errorMessage[0] = '\0';
+
+            if (!variant.callbacks)
+            {
+                variant.status = EncoderStatus::NullParameter;
+                continue;
+            }
+
+            if (variant.width > bitmap->width || variant.height > bitmap->height)
+            {
+                SetErrorMessage(&variant.errorInfo, "The variant size is larger than the image.");
+                variant.status = EncoderStatus::EncodeError;
+                continue;
+            }
+
+            uint32_t width = bitmap->width;
+            uint32_t height = bitmap->height;
+
+            if (variant.width > 0 && variant.height > 0)
+            {
+                width = variant.width;
+                height = variant.height;
+            }
+            else if (variant.width > 0)
+            {
+                width = variant.width;
+                height = ScaleDimension(bitmap->width, bitmap->height, variant.width);
+            }
+            else if (variant.height > 0)
+            {
+                width = ScaleDimension(bitmap->height, bitmap->width, variant.height);
+                height = variant.height;
+            }
+
+            size_t imageIndex = 0;
+
+            while (imageIndex < images.size()
+                && (images[imageIndex].basicInfo.xsize != width || images[imageIndex].basicInfo.ysize != height))
+            {
+                imageIndex++;
+            }
+
+            if (imageIndex == images.size())
+            {
+                images.push_back(DownscaleEncoderImage(images[0], width, height));
+            }
+
+            variantsToEncode.push_back(i);
+            imageIndexes.push_back(imageIndex);
+        }
+
+        if (variantsToEncode.empty())
+        {
+            return;
+        }
+
+        // The variants are encoded at the same time, so each encoder gets its share of the
+        // threads that libjxl would use for a single image.
+        // The effort calibration table assumes that an encode has all of those threads to itself,
+        // so the encoding time is only recorded when there is a single variant to encode.
+        const bool recordEncodeTime = variantsToEncode.size() == 1;
+        std::vector<size_t> threadCounts(variantsToEncode.size());
+
+        for (size_t i = 0; i < variantsToEncode.size(); i++)
+        {
+            const JxlBasicInfo& basicInfo = images[imageIndexes[i]].basicInfo;
+
+            threadCounts[i] = std::max<size_t>(
+                1,
+                JxlResizableParallelRunnerSuggestThreads(basicInfo.xsize, basicInfo.ysize) / variantsToEncode.size());
+        }
+
+        std::vector<std::thread> threads;
+        threads.reserve(variantsToEncode.size() - 1);
+
+        try
+        {
+            for (size_t i = 1; i < variantsToEncode.size(); i++)
+            {
+                threads.emplace_back(
+                    EncodeVariant,
+                    std::cref(images[imageIndexes[i]]),
+                    metadata,
+                    threadCounts[i],
+                    recordEncodeTime,
+                    std::ref(variants[variantsToEncode[i]]));
+            }
+        }
+        catch (...)
+        {
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+            throw;
+        }
+
+        EncodeVariant(images[imageIndexes[0]], metadata, threadCounts[0], recordEncodeTime, variants[variantsToEncode[0]]);
+
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+    }
+}
+
+EncoderStatus EncoderWriteImage(
+    const BitmapData* bitmap,
+    const EncoderOptions* options,
+    const EncoderImageMetadata* metadata,
+    IOCallbacks* callbacks,
+    ErrorInfo* errorInfo,
+    ProgressProc progressCallback,
+    EncoderResult* result,
+    EncoderStats* stats)
+{
+    if (!bitmap || !options || !callbacks || !metadata)
+    {
+        return EncoderStatus::NullParameter;
+    }
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    // The libjxl allocations are only tracked when the caller requested the stats.
+    TrackingMemoryManager memoryManager;
+
+    if (stats)
+    {
+        *stats = {};
+        stats->iccProfileSize = metadata->iccProfileSize;
+        stats->exifSize = metadata->exifSize;
+        stats->xmpSize = metadata->xmpSize;
+    }
+
+    EncoderStatus status = EncoderStatus::Ok;
+
+    try
+    {
+        status = WriteImage(
+            bitmap,
+            options,
+            metadata,
+            callbacks,
+            errorInfo,
+            progressCallback,
+            result,
+            stats ? memoryManager.Get() : nullptr,
+            stats);
+    }
+    catch (const std::bad_alloc&)
+    {
+        status = EncoderStatus::OutOfMemory;
+    }
+    catch (...)
+    {
+        status = EncoderStatus::EncodeError;
+    }
+
+    // The stats are also filled in when encoding fails, this shows which phase the time was spent in.
+    if (stats)
+    {
+        stats->peakMemoryBytes = memoryManager.GetPeakBytes();
+        stats->totalTime = ElapsedMicroseconds(startTime);
+    }
+
+    return status;
+}
+
+EncoderStatus EncoderWriteImageVariants(
+    const BitmapData* bitmap,
+    const EncoderImageMetadata* metadata,
+    EncoderVariant* variants,
+    uint32_t variantCount)
+{
+    if (!bitmap || !metadata || !variants)
+    {
+        return EncoderStatus::NullParameter;
+    }
+
+    try
+    {
+        WriteImageVariants(bitmap, metadata, variants, variantCount);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return EncoderStatus::OutOfMemory;
+    }
+    catch (...)
+    {
+        return EncoderStatus::EncodeError;
+    }
+
+    return EncoderStatus::Ok;
+}
+
+EncoderStatus EncoderRecompressJpeg(
+    const uint8_t* jpegData,
+    size_t jpegDataSize,
+    const EncoderOptions* options,
+    IOCallbacks* callbacks,
+    ErrorInfo* errorInfo,
+    ProgressProc progressCallback)
+{
+    if (!jpegData || !options || !callbacks)
+    {
+        return EncoderStatus::NullParameter;
+    }
+
+    try
+    {
+        if (!ReportProgress(progressCallback, 0))
+        {
+            return EncoderStatus::UserCanceled;
+        }
+
+        uint32_t width = 0;
+        uint32_t height = 0;
+
+        if (!TryGetJpegImageSize(jpegData, jpegDataSize, width, height))
+        {
+            SetErrorMessage(errorInfo, "The input is not a valid JPEG image.");
+            return EncoderStatus::EncodeError;
+        }
+
+        ParallelRunner runner(
+            nullptr,
+            JxlResizableParallelRunnerSuggestThreads(width, height),
+            static_cast<uint64_t>(width) * height);
+
+        auto enc = JxlEncoderMake(nullptr);
+
+        if (JxlEncoderSetParallelRunner(
+            enc.get(),
+            runner.GetRunner(),
+            runner.GetRunnerOpaque()) != JXL_ENC_SUCCESS)
+        {
+            SetErrorMessage(errorInfo, "JxlEncoderSetParallelRunner failed.");
+            return EncoderStatus::EncodeError;
+        }
+
+        OutputProcessor outputProcessor(callbacks);
+
+        if (JxlEncoderSetOutputProcessor(
+            enc.get(),
+            outputProcessor.ToJxlOutputProcessor()) != JXL_ENC_SUCCESS)
+        {
+            SetErrorMessage(errorInfo, "JxlEncoderSetOutputProcessor failed.");
+            return EncoderStatus::EncodeError;
+        }
+
+        // Store the JPEG bit stream reconstruction data, this allows the original JPEG
+        // file to be recreated from the JPEG XL image.
+        // The JPEG's Exif, XMP and ICC profile are copied by libjxl, adding our own
+        // metadata boxes would prevent the file from being reconstructed.
+        if (JxlEncoderStoreJPEGMetadata(enc.get(), JXL_TRUE) != JXL_ENC_SUCCESS)
+        {
+            SetErrorMessage(errorInfo, "JxlEncoderStoreJPEGMetadata failed.");
+            return EncoderStatus::EncodeError;
+        }
+
+        if (!ReportProgress(progressCallback, 20))
+        {
+            return EncoderStatus::UserCanceled;
+        }
+
+        JxlEncoderFrameSettings* frameSettings = JxlEncoderFrameSettingsCreate(enc.get(), nullptr);
+
+        // The DCT coefficients are transcoded losslessly, so the distance and lossless options are not used.
+        if (JxlEncoderFrameSettingsSetOption(frameSettings, JXL_ENC_FRAME_SETTING_EFFORT, options->effort) != JXL_ENC_SUCCESS)
+        {
+            SetErrorMessage(errorInfo, "JxlEncoderOptionsSetEffort failed.");
+            return EncoderStatus::EncodeError;
+        }
+
+        // The transcoding is reported through the output processor, as with the pixel encoding path.
+        outputProcessor.InitializeProgressReporting(
+            progressCallback,
+            30,
+            90,
+            5);
+
+        if (JxlEncoderAddJPEGFrame(frameSettings, jpegData, jpegDataSize) != JXL_ENC_SUCCESS)
+        {
+            EncoderStatus status = outputProcessor.GetWriteStatus();
+
+            if (status == EncoderStatus::Ok)
+            {
+                // libjxl does not support all JPEG files, e.g. CMYK and arithmetic coded images.
+                SetErrorMessage(errorInfo, "JxlEncoderAddJPEGFrame failed.");
+                status = EncoderStatus::EncodeError;
+            }
+
+            return status;
+        }
+
+        JxlEncoderCloseInput(enc.get());
+
+        EncoderStatus status = outputProcessor.GetWriteStatus();
+
+        if (status != EncoderStatus::Ok)
+        {
+            return status;
+        }
+
+        if (!ReportProgress(progressCallback, 95))
+        {
+            return EncoderStatus::UserCanceled;
+        }
+
+        status = FlushEncoderOutput(enc.get(), outputProcessor, errorInfo);
+
+        if (status != EncoderStatus::Ok)
+        {
+            return status;
+        }
     }
     catch (const std::bad_alloc&)
     {
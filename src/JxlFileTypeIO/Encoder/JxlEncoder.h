@@ -15,10 +15,31 @@
 #include "Common.h"
 #include "JxlEncoderTypes.h"
 
+// The result and stats parameters are optional and may be null.
 EncoderStatus EncoderWriteImage(
     const BitmapData* bitmap,
     const EncoderOptions* options,
     const EncoderImageMetadata* metadata,
     IOCallbacks* callbacks,
     ErrorInfo* errorInfo,
+    ProgressProc progressCallback,
+    EncoderResult* result,
+    EncoderStats* stats);
+
+// Encodes the image once for each variant, the variants share the pixel format conversion and
+// metadata and are encoded at the same time. The return value is Ok if the variants were processed,
+// the result of each variant is stored in its status, result and errorInfo fields.
+EncoderStatus EncoderWriteImageVariants(
+    const BitmapData* bitmap,
+    const EncoderImageMetadata* metadata,
+    EncoderVariant* variants,
+    uint32_t variantCount);
+
+// Losslessly recompresses a JPEG image, only the effort value is used from the encoder options.
+EncoderStatus EncoderRecompressJpeg(
+    const uint8_t* jpegData,
+    size_t jpegDataSize,
+    const EncoderOptions* options,
+    IOCallbacks* callbacks,
+    ErrorInfo* errorInfo,
     ProgressProc progressCallback);
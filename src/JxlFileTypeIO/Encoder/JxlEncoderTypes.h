@@ -12,6 +12,8 @@
 
 #pragma once
 
+#include "Common.h"
+#include <stddef.h>
 #include <stdint.h>
 
 enum class EncoderStatus : int32_t
@@ -21,7 +23,9 @@ enum class EncoderStatus : int32_t
     OutOfMemory,
     UserCanceled,
     EncodeError,
-    WriteError
+    WriteError,
+    // The metadata could only be changed by removing the JPEG reconstruction data.
+    JpegReconstructionDataLost
 };
 
 struct EncoderOptions
@@ -29,6 +33,52 @@ struct EncoderOptions
     float distance;
     int32_t effort;
     bool lossless;
+    // The maximum output file size in bytes, 0 disables the rate control mode.
+    // When set, the distance is searched for the highest quality that fits
+    // and the distance value above is not used.
+    uint64_t targetFileSize;
+    // The encoding time limit in milliseconds, 0 disables the time budget mode.
+    // When set, the encoder uses the highest effort value up to the effort above
+    // that is predicted to finish within the time limit.
+    uint32_t timeBudgetMilliseconds;
+};
+
+struct EncoderResult
+{
+    // The effort value that was used to encode the image.
+    int32_t effort;
+};
+
+// The maximum number of libjxl encoder statistics that EncoderStats can hold.
+constexpr size_t maxLibJxlEncoderStats = 32;
+
+// The encoding statistics, the times are in microseconds.
+// The phase times do not overlap, time that is not covered by a phase is only included in the total time.
+struct EncoderStats
+{
+    // The time spent converting the image to the encoder pixel format.
+    uint64_t conversionTime;
+    // The time spent creating and configuring the encoder.
+    uint64_t configureTime;
+    // The time spent in libjxl encoding the image, this includes all of the trial encodes
+    // when the target file size is used.
+    uint64_t encodeTime;
+    // The time spent in the IOCallbacks methods.
+    uint64_t outputCallbackTime;
+    uint64_t totalTime;
+    uint64_t outputSize;
+    // The metadata sizes, the ICC profile is stored in the codestream and the others in their own boxes.
+    uint64_t iccProfileSize;
+    uint64_t exifSize;
+    uint64_t xmpSize;
+    // The peak number of bytes that libjxl had allocated.
+    uint64_t peakMemoryBytes;
+    // The values from JxlEncoderStatsGet indexed by JxlEncoderStatsKey, these are only collected
+    // when a single encode is used.
+    uint64_t libJxlStats[maxLibJxlEncoderStats];
+    // The number of libJxlStats entries that are valid.
+    uint32_t libJxlStatCount;
+    uint32_t threadCount;
 };
 
 struct EncoderImageMetadata
@@ -40,3 +90,17 @@ struct EncoderImageMetadata
     uint8_t* xmp;
     size_t xmpSize;
 };
+
+// An output image for EncoderWriteImageVariants, the status, result and errorInfo fields are set by the encoder.
+struct EncoderVariant
+{
+    EncoderOptions options;
+    // The output size, the image can only be downscaled. When only one dimension is set the other is
+    // derived from the image aspect ratio, if both are 0 the image size is used.
+    uint32_t width;
+    uint32_t height;
+    IOCallbacks* callbacks;
+    EncoderStatus status;
+    EncoderResult result;
+    ErrorInfo errorInfo;
+};
@@ -0,0 +1,506 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "MetadataRewriter.h"
+#include "OutputProcessor.h"
+#include "jxl/decode.h"
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <memory>
+#include <string.h>
+#include <vector>
+
+namespace
+{
+    constexpr size_t boxHeaderSize = 8;
+    constexpr size_t largeBoxHeaderSize = 16;
+
+    // The signature and file type boxes that start every JPEG XL container, see ISO/IEC 18181-2.
+    constexpr std::array<uint8_t, 32> containerHeader =
+    {
+        0x00, 0x00, 0x00, 0x0C, 'J', 'X', 'L', ' ', 0x0D, 0x0A, 0x87, 0x0A,
+        0x00, 0x00, 0x00, 0x14, 'f', 't', 'y', 'p', 'j', 'x', 'l', ' ', 0x00, 0x00, 0x00, 0x00, 'j', 'x', 'l', ' '
+    };
+
+    struct BoxHeader
+    {
+        char type[4];
+        size_t headerSize;
+        size_t totalSize;
+    };
+
+    bool BoxTypeEquals(const char* type, const char* expected)
+    {
+        return memcmp(type, expected, 4) == 0;
+    }
+
+    bool IsMetadataBoxType(const char* type)
+    {
+        return BoxTypeEquals(type, "Exif") || BoxTypeEquals(type, "xml ");
+    }
+
+    bool TryReadBoxHeader(const uint8_t* data, size_t dataSize, size_t offset, BoxHeader& header)
+    {
+        const size_t remaining = dataSize - offset;
+
+        if (remaining < boxHeaderSize)
+        {
+            return false;
+        }
+
+        const uint8_t* box = data + offset;
+
+        uint64_t boxSize = (static_cast<uint64_t>(box[0]) << 24)
+                         | (static_cast<uint64_t>(box[1]) << 16)
+                         | (static_cast<uint64_t>(box[2]) << 8)
+                         | static_cast<uint64_t>(box[3]);
+        memcpy(header.type, box + 4, 4);
+        header.headerSize = boxHeaderSize;
+
+        if (boxSize == 1)
+        {
+            if (remaining < largeBoxHeaderSize)
+            {
+                return false;
+            }
+
+            boxSize = 0;
+
+            for (size_t i = 8; i < 16; i++)
+            {
+                boxSize = (boxSize << 8) | box[i];
+            }
+
+            header.headerSize = largeBoxHeaderSize;
+        }
+        else if (boxSize == 0)
+        {
+            // The box extends to the end of the file.
+            boxSize = remaining;
+        }
+
+        if (boxSize < header.headerSize || boxSize > remaining)
+        {
+            return false;
+        }
+
+        header.totalSize = static_cast<size_t>(boxSize);
+
+        return true;
+    }
+
+    std::vector<uint8_t> CreateBoxHeader(const char* type, size_t payloadSize)
+    {
+        std::vector<uint8_t> header;
+
+        if (payloadSize <= std::numeric_limits<uint32_t>::max() - boxHeaderSize)
+        {
+            const uint32_t boxSize = static_cast<uint32_t>(payloadSize + boxHeaderSize);
+
+            header.resize(boxHeaderSize);
+            header[0] = static_cast<uint8_t>(boxSize >> 24);
+            header[1] = static_cast<uint8_t>(boxSize >> 16);
+            header[2] = static_cast<uint8_t>(boxSize >> 8);
+            header[3] = static_cast<uint8_t>(boxSize);
+            memcpy(&header[4], type, 4);
+        }
+        else
+        {
+            const uint64_t boxSize = static_cast<uint64_t>(payloadSize) + largeBoxHeaderSize;
+
+            header.resize(largeBoxHeaderSize);
+            header[3] = 1;
+            memcpy(&header[4], type, 4);
+
+            for (size_t i = 0; i < 8; i++)
+            {
+                header[8 + i] = static_cast<uint8_t>(boxSize >> (56 - (i * 8)));
+            }
+        }
+
+        return header;
+    }
+
+    EncoderStatus WriteBox(IOCallbacks* callbacks, const char* type, const uint8_t* payload, size_t payloadSize)
+    {
+        const std::vector<uint8_t> header = CreateBoxHeader(type, payloadSize);
+
+        EncoderStatus status = WriteOutputData(callbacks, header.data(), header.size());
+
+        if (status == EncoderStatus::Ok)
+        {
+            status = WriteOutputData(callbacks, payload, payloadSize);
+        }
+
+        return status;
+    }
+
+    EncoderStatus WriteMetadataBox(
+        IOCallbacks* callbacks,
+        const char* type,
+        const uint8_t* payload,
+        size_t payloadSize,
+        bool compress)
+    {
+        if (compress)
+        {
+            // A brob box stores the type of the original box followed by the Brotli-compressed box contents.
+            std::vector<uint8_t> brobPayload(4 + BrotliEncoderMaxCompressedSize(payloadSize));
+            memcpy(brobPayload.data(), type, 4);
+
+            size_t compressedSize = brobPayload.size() - 4;
+
+            if (BrotliEncoderCompress(
+                BROTLI_DEFAULT_QUALITY,
+                BROTLI_DEFAULT_WINDOW,
+                BROTLI_MODE_GENERIC,
+                payloadSize,
+                payload,
+                &compressedSize,
+                brobPayload.data() + 4) == BROTLI_TRUE)
+            {
+                // The compressed box is only used when it is smaller than the original.
+                if ((compressedSize + 4) < payloadSize)
+                {
+                    return WriteBox(callbacks, "brob", brobPayload.data(), compressedSize + 4);
+                }
+            }
+        }
+
+        return WriteBox(callbacks, type, payload, payloadSize);
+    }
+
+    EncoderStatus WriteMetadataBoxes(
+        IOCallbacks* callbacks,
+        const EncoderImageMetadata* metadata,
+        bool compressBoxes)
+    {
+        EncoderStatus status = EncoderStatus::Ok;
+
+        if (metadata->exifSize > 0)
+        {
+            status = WriteMetadataBox(callbacks, "Exif", metadata->exif, metadata->exifSize, compressBoxes);
+        }
+
+        if (status == EncoderStatus::Ok && metadata->xmpSize > 0)
+        {
+            status = WriteMetadataBox(callbacks, "xml ", metadata->xmp, metadata->xmpSize, compressBoxes);
+        }
+
+        return status;
+    }
+
+    // Decompresses the contents of a brob box, the payload starts with the type of the original box.
+    bool TryDecompressBrobPayload(const uint8_t* payload, size_t payloadSize, std::vector<uint8_t>& output)
+    {
+        output.clear();
+
+        if (payloadSize < 4)
+        {
+            return false;
+        }
+
+        std::unique_ptr<BrotliDecoderState, decltype(&BrotliDecoderDestroyInstance)> decoder(
+            BrotliDecoderCreateInstance(nullptr, nullptr, nullptr),
+            BrotliDecoderDestroyInstance);
+
+        if (!decoder)
+        {
+            throw std::bad_alloc();
+        }
+
+        const uint8_t* nextIn = payload + 4;
+        size_t availableIn = payloadSize - 4;
+        BrotliDecoderResult result = BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT;
+
+        while (result == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT)
+        {
+            const size_t outputOffset = output.size();
+            output.resize(outputOffset + std::max<size_t>(availableIn * 4, 4096));
+
+            uint8_t* nextOut = output.data() + outputOffset;
+            size_t availableOut = output.size() - outputOffset;
+
+            result = BrotliDecoderDecompressStream(
+                decoder.get(),
+                &availableIn,
+                &nextIn,
+                &availableOut,
+                &nextOut,
+                nullptr);
+
+            output.resize(output.size() - availableOut);
+        }
+
+        return result == BROTLI_DECODER_RESULT_SUCCESS;
+    }
+
+    // The contents of the Exif and XMP boxes in the original file, a compressed box is decompressed.
+    struct ContainerMetadata
+    {
+        std::vector<uint8_t> exif;
+        std::vector<uint8_t> xmp;
+        bool hasExif;
+        bool hasXmp;
+        bool hasJpegReconstructionData;
+    };
+
+    // Returns false if the container cannot be parsed or it has more than one box of a metadata type,
+    // the rewrite is used in that case.
+    bool TryReadContainerMetadata(const uint8_t* data, size_t dataSize, ContainerMetadata& containerMetadata)
+    {
+        containerMetadata.hasExif = false;
+        containerMetadata.hasXmp = false;
+        containerMetadata.hasJpegReconstructionData = false;
+
+        size_t offset = 0;
+
+        while (offset < dataSize)
+        {
+            BoxHeader header;
+
+            if (!TryReadBoxHeader(data, dataSize, offset, header))
+            {
+                return false;
+            }
+
+            const uint8_t* payload = data + offset + header.headerSize;
+            const size_t payloadSize = header.totalSize - header.headerSize;
+
+            const char* type = header.type;
+            const bool compressed = BoxTypeEquals(type, "brob");
+
+            if (compressed && payloadSize >= 4)
+            {
+                type = reinterpret_cast<const char*>(payload);
+            }
+
+            if (IsMetadataBoxType(type))
+            {
+                const bool isExif = BoxTypeEquals(type, "Exif");
+                bool& found = isExif ? containerMetadata.hasExif : containerMetadata.hasXmp;
+                std::vector<uint8_t>& contents = isExif ? containerMetadata.exif : containerMetadata.xmp;
+
+                if (found)
+                {
+                    return false;
+                }
+
+                found = true;
+
+                if (compressed)
+                {
+                    if (!TryDecompressBrobPayload(payload, payloadSize, contents))
+                    {
+                        return false;
+                    }
+                }
+                else
+                {
+                    contents.assign(payload, payload + payloadSize);
+                }
+            }
+            else if (BoxTypeEquals(header.type, "jbrd"))
+            {
+                containerMetadata.hasJpegReconstructionData = true;
+            }
+
+            offset += header.totalSize;
+        }
+
+        return true;
+    }
+
+    bool MetadataEquals(const std::vector<uint8_t>& original, bool hasOriginal, const uint8_t* data, size_t dataSize)
+    {
+        if (!hasOriginal)
+        {
+            return dataSize == 0;
+        }
+
+        return original.size() == dataSize && (dataSize == 0 || memcmp(original.data(), data, dataSize) == 0);
+    }
+
+    EncoderStatus RewriteContainer(
+        const uint8_t* data,
+        size_t dataSize,
+        const EncoderImageMetadata* metadata,
+        bool compressBoxes,
+        bool allowJpegReconstructionLoss,
+        IOCallbacks* callbacks,
+        ErrorInfo* errorInfo)
+    {
+        ContainerMetadata containerMetadata;
+        const bool haveContainerMetadata = TryReadContainerMetadata(data, dataSize, containerMetadata);
+
+        if (haveContainerMetadata
+            && MetadataEquals(containerMetadata.exif, containerMetadata.hasExif, metadata->exif, metadata->exifSize)
+            && MetadataEquals(containerMetadata.xmp, containerMetadata.hasXmp, metadata->xmp, metadata->xmpSize))
+        {
+            // The metadata has not changed, copying the file keeps the original boxes and the JPEG reconstruction data.
+            return WriteOutputData(callbacks, data, dataSize);
+        }
+
+        if (!allowJpegReconstructionLoss && (!haveContainerMetadata || containerMetadata.hasJpegReconstructionData))
+        {
+            SetErrorMessage(errorInfo, "Changing the metadata would remove the JPEG reconstruction data.");
+            return EncoderStatus::JpegReconstructionDataLost;
+        }
+
+        bool metadataWritten = false;
+        size_t offset = 0;
+
+        while (offset < dataSize)
+        {
+            BoxHeader header;
+
+            if (!TryReadBoxHeader(data, dataSize, offset, header))
+            {
+                SetErrorMessage(errorInfo, "The JPEG XL container has an invalid box header.");
+                return EncoderStatus::EncodeError;
+            }
+
+            const uint8_t* box = data + offset;
+            const uint8_t* payload = box + header.headerSize;
+            const size_t payloadSize = header.totalSize - header.headerSize;
+
+            bool copyBox = true;
+
+            if (IsMetadataBoxType(header.type))
+            {
+                copyBox = false;
+            }
+            else if (BoxTypeEquals(header.type, "brob"))
+            {
+                copyBox = !(payloadSize >= 4 && IsMetadataBoxType(reinterpret_cast<const char*>(payload)));
+            }
+            else if (BoxTypeEquals(header.type, "jbrd"))
+            {
+                // The JPEG reconstruction data references the original Exif and XMP boxes, the JPEG
+                // cannot be reconstructed after they are changed so the box is removed.
+                copyBox = false;
+            }
+            else if (BoxTypeEquals(header.type, "jxlc") || BoxTypeEquals(header.type, "jxlp"))
+            {
+                // The new metadata boxes are placed before the codestream, this matches the libjxl encoder
+                // and keeps any boxes that must precede the codestream (e.g. jxll) in their original order.
+                if (!metadataWritten)
+                {
+                    EncoderStatus status = WriteMetadataBoxes(callbacks, metadata, compressBoxes);
+
+                    if (status != EncoderStatus::Ok)
+                    {
+                        return status;
+                    }
+
+                    metadataWritten = true;
+                }
+            }
+
+            if (copyBox)
+            {
+                EncoderStatus status = WriteOutputData(callbacks, box, header.totalSize);
+
+                if (status != EncoderStatus::Ok)
+                {
+                    return status;
+                }
+            }
+
+            offset += header.totalSize;
+        }
+
+        if (!metadataWritten)
+        {
+            SetErrorMessage(errorInfo, "The JPEG XL container does not have a codestream box.");
+            return EncoderStatus::EncodeError;
+        }
+
+        return EncoderStatus::Ok;
+    }
+
+    EncoderStatus WrapCodestream(
+        const uint8_t* data,
+        size_t dataSize,
+        const EncoderImageMetadata* metadata,
+        bool compressBoxes,
+        IOCallbacks* callbacks)
+    {
+        // The metadata boxes require the container format, so the bare codestream
+        // is written to a jxlc box.
+        EncoderStatus status = WriteOutputData(callbacks, containerHeader.data(), containerHeader.size());
+
+        if (status == EncoderStatus::Ok)
+        {
+            status = WriteMetadataBoxes(callbacks, metadata, compressBoxes);
+
+            if (status == EncoderStatus::Ok)
+            {
+                status = WriteBox(callbacks, "jxlc", data, dataSize);
+            }
+        }
+
+        return status;
+    }
+}
+
+EncoderStatus EncoderRewriteMetadata(
+    const uint8_t* data,
+    size_t dataSize,
+    const EncoderImageMetadata* metadata,
+    bool compressBoxes,
+    bool allowJpegReconstructionLoss,
+    IOCallbacks* callbacks,
+    ErrorInfo* errorInfo)
+{
+    if (!data || !metadata || !callbacks)
+    {
+        return EncoderStatus::NullParameter;
+    }
+
+    try
+    {
+        const JxlSignature fileSignature = JxlSignatureCheck(data, dataSize);
+
+        if (fileSignature == JXL_SIG_CONTAINER)
+        {
+            return RewriteContainer(data, dataSize, metadata, compressBoxes, allowJpegReconstructionLoss, callbacks, errorInfo);
+        }
+        else if (fileSignature == JXL_SIG_CODESTREAM)
+        {
+            // A bare codestream does not have any metadata boxes, so it is only wrapped in a
+            // container when metadata is added.
+            if (metadata->exifSize == 0 && metadata->xmpSize == 0)
+            {
+                return WriteOutputData(callbacks, data, dataSize);
+            }
+
+            return WrapCodestream(data, dataSize, metadata, compressBoxes, callbacks);
+        }
+        else
+        {
+            SetErrorMessage(errorInfo, "The input is not a JPEG XL image.");
+            return EncoderStatus::EncodeError;
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        return EncoderStatus::OutOfMemory;
+    }
+    catch (...)
+    {
+        return EncoderStatus::EncodeError;
+    }
+}
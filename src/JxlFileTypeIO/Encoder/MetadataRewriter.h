@@ -0,0 +1,33 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "JxlEncoderTypes.h"
+
+// Writes a copy of the JPEG XL file with its Exif and XMP boxes replaced by the ones in the metadata.
+// The codestream is copied without being decoded, so the image data is not changed.
+// The ICC profile is stored in the codestream and cannot be changed by this method.
+//
+// The file is copied unchanged when the Exif and XMP payloads are the same as the original boxes,
+// this keeps the JPEG reconstruction data. Changing the metadata of a file that has a jbrd box
+// removes the box, when allowJpegReconstructionLoss is false the JpegReconstructionDataLost
+// status is returned instead and nothing is written.
+EncoderStatus EncoderRewriteMetadata(
+    const uint8_t* data,
+    size_t dataSize,
+    const EncoderImageMetadata* metadata,
+    bool compressBoxes,
+    bool allowJpegReconstructionLoss,
+    IOCallbacks* callbacks,
+    ErrorInfo* errorInfo);
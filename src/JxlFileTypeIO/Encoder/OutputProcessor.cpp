@@ -11,17 +11,36 @@
 ////////////////////////////////////////////////////////////////////////
 
 #include "OutputProcessor.h"
+#include "PerformanceStats.h"
+#include "Tracing.h"
 #include "Windows.h"
 
 static constexpr size_t maxBufferSize = 65536;
 
+static EncoderStatus HResultToEncoderStatus(HRESULT hr)
+{
+    switch (hr)
+    {
+    case E_ABORT:
+        return EncoderStatus::UserCanceled;
+    case E_OUTOFMEMORY:
+        return EncoderStatus::OutOfMemory;
+    default:
+        return EncoderStatus::WriteError;
+    }
+}
+
 OutputProcessor::OutputProcessor(IOCallbacks* callbacks)
     : callbacks(callbacks),
       status(EncoderStatus::Ok),
       progressCallback(nullptr),
       progressPercentage(0),
       maxProgressPercentage(0),
-      progressStep(0)
+      progressStep(0),
+      callbackTime(0),
+      position(0),
+      outputSize(0),
+      bufferStartTime()
 {
 }
 
@@ -30,6 +49,16 @@ EncoderStatus OutputProcessor::GetWriteStatus() const
     return status;
 }
 
+uint64_t OutputProcessor::GetCallbackTime() const
+{
+    return callbackTime;
+}
+
+uint64_t OutputProcessor::GetOutputSize() const
+{
+    return outputSize;
+}
+
 void OutputProcessor::InitializeProgressReporting(
     ProgressProc progressCallback,
     int32_t initialProgressPercentage,
@@ -91,18 +120,48 @@ void* OutputProcessor::GetBuffer(size_t* size)
         buffer.resize(*size);
     }
 
+    if (Tracing::IsEnabled())
+    {
+        bufferStartTime = std::chrono::steady_clock::now();
+    }
+
     return buffer.data();
 }
 
 void OutputProcessor::ReleaseBuffer(size_t writtenBytes)
 {
-    SetWriteStatusIfFailed(callbacks->Write(buffer.data(), writtenBytes));
+    {
+        ScopedPhaseTimer timer(&callbackTime);
+        Tracing::Span span("IOCallbacks::Write", "io");
+
+        SetWriteStatusIfFailed(callbacks->Write(buffer.data(), writtenBytes));
+    }
     buffer.clear();
+
+    // The round trip covers the time that libjxl spent filling the buffer and the write callback.
+    // The start time is not set if tracing was enabled after libjxl received the buffer.
+    if (bufferStartTime != std::chrono::steady_clock::time_point())
+    {
+        Tracing::AddSpan("OutputProcessor buffer", "io", nullptr, bufferStartTime);
+        bufferStartTime = std::chrono::steady_clock::time_point();
+    }
+
+    // libjxl can seek back to rewrite the earlier parts of the file, so the output size
+    // is the furthest position that has been written.
+    position += writtenBytes;
+    outputSize = max(outputSize, position);
 }
 
 void OutputProcessor::Seek(uint64_t position)
 {
-    SetWriteStatusIfFailed(callbacks->Seek(position));
+    {
+        ScopedPhaseTimer timer(&callbackTime);
+        Tracing::Span span("IOCallbacks::Seek", "io");
+
+        SetWriteStatusIfFailed(callbacks->Seek(position));
+    }
+
+    this->position = position;
 }
 
 void OutputProcessor::SetFinalizedPosition(uint64_t finalizedPosition)
@@ -135,17 +194,18 @@ void OutputProcessor::SetWriteStatusIfFailed(int hr)
 {
     if (FAILED(hr))
     {
-        switch (hr)
-        {
-        case E_ABORT:
-            status = EncoderStatus::UserCanceled;
-            break;
-        case E_OUTOFMEMORY:
-            status = EncoderStatus::OutOfMemory;
-            break;
-        default:
-            status = EncoderStatus::WriteError;
-            break;
-        }
+        status = HResultToEncoderStatus(hr);
+    }
+}
+
+EncoderStatus WriteOutputData(IOCallbacks* callbacks, const uint8_t* buffer, size_t sizeInBytes)
+{
+    if (sizeInBytes == 0)
+    {
+        return EncoderStatus::Ok;
     }
+
+    const HRESULT hr = callbacks->Write(buffer, sizeInBytes);
+
+    return FAILED(hr) ? HResultToEncoderStatus(hr) : EncoderStatus::Ok;
 }
@@ -14,6 +14,7 @@
 #include "Common.h"
 #include "JxlEncoderTypes.h"
 #include "jxl/encode.h"
+#include <chrono>
 #include <vector>
 
 class OutputProcessor
@@ -22,6 +23,9 @@ public:
     OutputProcessor(IOCallbacks* callbacks);
 
     EncoderStatus GetWriteStatus() const;
+    // The time spent in the IOCallbacks methods, in microseconds.
+    uint64_t GetCallbackTime() const;
+    uint64_t GetOutputSize() const;
     void InitializeProgressReporting(
         ProgressProc progressCallback,
         int32_t initialProgressPercentage,
@@ -50,5 +54,13 @@ private:
     int32_t progressPercentage;
     int32_t maxProgressPercentage;
     int32_t progressStep;
+    uint64_t callbackTime;
+    uint64_t position;
+    uint64_t outputSize;
+    // The time that libjxl received the current buffer, this is only set when tracing is enabled.
+    std::chrono::steady_clock::time_point bufferStartTime;
 };
 
+// Writes the data to the output stream, this is used when the image has been encoded to memory.
+EncoderStatus WriteOutputData(IOCallbacks* callbacks, const uint8_t* buffer, size_t sizeInBytes);
+
@@ -13,6 +13,52 @@
 #include "PixelFormatConversion.h"
 #include "Common.h"
 
+OutputPixelFormat PixelFormatConversion::GetOutputPixelFormat(const BitmapData* bitmap, bool hasICCProfile)
+{
+    bool isGray = true;
+    bool hasTransparency = false;
+
+    const size_t width = static_cast<size_t>(bitmap->width);
+    const size_t height = static_cast<size_t>(bitmap->height);
+    const size_t stride = static_cast<size_t>(bitmap->stride);
+    const uint8_t* scan0 = bitmap->scan0;
+
+    for (size_t y = 0; y < height; y++)
+    {
+        const ColorBgra* ptr = reinterpret_cast<const ColorBgra*>(scan0 + (y * stride));
+
+        for (size_t x = 0; x < width; x++)
+        {
+            if (!(ptr->r == ptr->g && ptr->g == ptr->b))
+            {
+                isGray = false;
+            }
+
+            if (ptr->a < 255)
+            {
+                hasTransparency = true;
+            }
+
+            ptr++;
+        }
+    }
+
+    OutputPixelFormat format;
+
+    // Don't auto-convert images with an ICC profile to gray scale.
+    // The image's profile is RGB, and RGB profiles should not be used with a gray scale image.
+    if (isGray && !hasICCProfile)
+    {
+        format = hasTransparency ? OutputPixelFormat::GrayAlpha : OutputPixelFormat::Gray;
+    }
+    else
+    {
+        format = hasTransparency ? OutputPixelFormat::Rgba : OutputPixelFormat::Rgb;
+    }
+
+    return format;
+}
+
 void PixelFormatConversion::BgraToGray(const BitmapData* bitmap, uint8_t* destScan0)
 {
     const size_t width = static_cast<size_t>(bitmap->width);
@@ -13,8 +13,18 @@
 #pragma once
 #include "Common.h"
 
+enum class OutputPixelFormat
+{
+    Gray,
+    GrayAlpha,
+    Rgb,
+    Rgba
+};
+
 namespace PixelFormatConversion
 {
+    OutputPixelFormat GetOutputPixelFormat(const BitmapData* bitmap, bool hasICCProfile);
+
     void BgraToGray(const BitmapData* bitmap, uint8_t* gray);
     void BgraToGrayAlpha(const BitmapData* bitmap, uint8_t* gray);
     void BgraToRgb(const BitmapData* bitmap, uint8_t* rgb);
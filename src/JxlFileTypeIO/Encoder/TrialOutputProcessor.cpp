@@ -0,0 +1,135 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "TrialOutputProcessor.h"
+#include <algorithm>
+#include <string.h>
+
+static constexpr size_t maxBufferSize = 65536;
+
+TrialOutputProcessor::TrialOutputProcessor(
+    uint64_t sizeLimit,
+    float distance,
+    const std::atomic<float>* bestFittingDistance)
+    : position(0),
+      sizeLimit(sizeLimit),
+      distance(distance),
+      bestFittingDistance(bestFittingDistance),
+      sizeLimitExceeded(false),
+      canceled(false)
+{
+}
+
+bool TrialOutputProcessor::IsCanceled() const
+{
+    return canceled;
+}
+
+bool TrialOutputProcessor::SizeLimitExceeded() const
+{
+    return sizeLimitExceeded;
+}
+
+const std::vector<uint8_t>& TrialOutputProcessor::GetOutput() const
+{
+    return output;
+}
+
+std::vector<uint8_t>& TrialOutputProcessor::GetOutput()
+{
+    return output;
+}
+
+JxlEncoderOutputProcessor TrialOutputProcessor::ToJxlOutputProcessor()
+{
+    JxlEncoderOutputProcessor processor{};
+    processor.opaque = this;
+    processor.get_buffer = GetBufferStatic;
+    processor.release_buffer = ReleaseBufferStatic;
+    processor.seek = SeekStatic;
+    processor.set_finalized_position = SetFinalizedPositionStatic;
+
+    return processor;
+}
+
+void* TrialOutputProcessor::GetBufferStatic(void* opaque, size_t* size)
+{
+    return static_cast<TrialOutputProcessor*>(opaque)->GetBuffer(size);
+}
+
+void TrialOutputProcessor::ReleaseBufferStatic(void* opaque, size_t writtenBytes)
+{
+    static_cast<TrialOutputProcessor*>(opaque)->ReleaseBuffer(writtenBytes);
+}
+
+void TrialOutputProcessor::SeekStatic(void* opaque, uint64_t position)
+{
+    static_cast<TrialOutputProcessor*>(opaque)->Seek(position);
+}
+
+void TrialOutputProcessor::SetFinalizedPositionStatic(void* opaque, uint64_t finalizedPosition)
+{
+    // The trial output is kept in memory until the best trial is chosen, so the finalized position is not used.
+    (void)opaque;
+    (void)finalizedPosition;
+}
+
+void* TrialOutputProcessor::GetBuffer(size_t* size)
+{
+    if (!sizeLimitExceeded && bestFittingDistance->load(std::memory_order_relaxed) < distance)
+    {
+        // Another trial has produced a higher quality image that fits within the size limit.
+        canceled = true;
+    }
+
+    if (sizeLimitExceeded || canceled)
+    {
+        // Returning a null pointer and a size of 0 will tell the library
+        // to stop processing and return an error.
+        *size = 0;
+        return nullptr;
+    }
+
+    *size = std::min(maxBufferSize, *size);
+
+    if (buffer.size() < *size)
+    {
+        buffer.resize(*size);
+    }
+
+    return buffer.data();
+}
+
+void TrialOutputProcessor::ReleaseBuffer(size_t writtenBytes)
+{
+    const uint64_t endPosition = position + writtenBytes;
+
+    if (endPosition > sizeLimit)
+    {
+        sizeLimitExceeded = true;
+    }
+    else if (writtenBytes > 0)
+    {
+        if (output.size() < endPosition)
+        {
+            output.resize(static_cast<size_t>(endPosition));
+        }
+
+        memcpy(output.data() + position, buffer.data(), writtenBytes);
+        position = endPosition;
+    }
+}
+
+void TrialOutputProcessor::Seek(uint64_t position)
+{
+    this->position = position;
+}
@@ -0,0 +1,53 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include "jxl/encode.h"
+#include <atomic>
+#include <vector>
+
+// Collects the output of a rate control trial encode in memory.
+// The encode is stopped when the output exceeds the size limit, or when a trial
+// with a lower distance has already produced an image that fits within the limit.
+class TrialOutputProcessor
+{
+public:
+    TrialOutputProcessor(
+        uint64_t sizeLimit,
+        float distance,
+        const std::atomic<float>* bestFittingDistance);
+
+    bool IsCanceled() const;
+    bool SizeLimitExceeded() const;
+    const std::vector<uint8_t>& GetOutput() const;
+    std::vector<uint8_t>& GetOutput();
+    JxlEncoderOutputProcessor ToJxlOutputProcessor();
+
+private:
+    static void* GetBufferStatic(void* opaque, size_t* size);
+    static void ReleaseBufferStatic(void* opaque, size_t writtenBytes);
+    static void SeekStatic(void* opaque, uint64_t position);
+    static void SetFinalizedPositionStatic(void* opaque, uint64_t finalizedPosition);
+
+    void* GetBuffer(size_t* size);
+    void ReleaseBuffer(size_t writtenBytes);
+    void Seek(uint64_t position);
+
+    std::vector<uint8_t> buffer;
+    std::vector<uint8_t> output;
+    uint64_t position;
+    uint64_t sizeLimit;
+    float distance;
+    const std::atomic<float>* bestFittingDistance;
+    bool sizeLimitExceeded;
+    bool canceled;
+};
@@ -11,9 +11,18 @@
 ////////////////////////////////////////////////////////////////////////
 
 #include "JxlFileTypeIO.h"
+#include "AsyncJob.h"
+#include "DecodedImageCache.h"
 #include "JxlDecoder.h"
+#include "JpegReconstruction.h"
 #include "JxlEncoder.h"
+#include "MetadataRewriter.h"
+#include "OutputProcessor.h"
+#include "ParallelRunner.h"
+#include "Tracing.h"
 #include "jxl/version.h"
+#include <new>
+#include <string>
 
 uint32_t __stdcall GetLibJxlVersion()
 {
@@ -24,9 +33,94 @@ DecoderStatus __stdcall LoadImage(
     DecoderCallbacks* callbacks,
     const uint8_t* data,
     size_t dataSize,
+    DecoderMetadataFlags metadataFlags,
+    ErrorInfo* errorInfo,
+    DecoderStats* stats)
+{
+    return DecoderReadImage(callbacks, data, dataSize, metadataFlags, errorInfo, nullptr, stats);
+}
+
+DecoderStatus __stdcall LoadImages(
+    DecoderBatchItem* items,
+    uint32_t itemCount)
+{
+    return DecoderReadImages(items, itemCount);
+}
+
+DecoderStatus __stdcall ValidateImage(
+    const uint8_t* data,
+    size_t dataSize,
+    ErrorInfo* errorInfo,
+    uint64_t* pixelHash)
+{
+    return DecoderValidateImage(data, dataSize, errorInfo, pixelHash);
+}
+
+DecoderStatus __stdcall GetImageEncodingInfo(
+    const uint8_t* data,
+    size_t dataSize,
+    DecoderImageEncodingInfo* info,
     ErrorInfo* errorInfo)
 {
-    return DecoderReadImage(callbacks, data, dataSize, errorInfo);
+    return DecoderGetImageEncodingInfo(data, dataSize, info, errorInfo);
+}
+
+void __stdcall SetDecodedImageCacheSize(uint64_t maxSizeInBytes)
+{
+    DecodedImageCache::SetMaxSize(maxSizeInBytes);
+}
+
+void __stdcall ClearDecodedImageCache()
+{
+    DecodedImageCache::Clear();
+}
+
+DecoderStatus __stdcall OpenAnimation(
+    DecoderCallbacks* callbacks,
+    const uint8_t* data,
+    size_t dataSize,
+    AnimationDecoder** animation,
+    ErrorInfo* errorInfo)
+{
+    return DecoderOpenAnimation(callbacks, data, dataSize, animation, errorInfo);
+}
+
+DecoderStatus __stdcall GetAnimationInfo(
+    AnimationDecoder* animation,
+    AnimationInfo* info)
+{
+    return DecoderGetAnimationInfo(animation, info);
+}
+
+DecoderStatus __stdcall GetAnimationFrameInfo(
+    AnimationDecoder* animation,
+    uint32_t frameIndex,
+    AnimationFrameInfo* info)
+{
+    return DecoderGetAnimationFrameInfo(animation, frameIndex, info);
+}
+
+DecoderStatus __stdcall DecodeAnimationFrame(
+    AnimationDecoder* animation,
+    uint32_t frameIndex,
+    DecoderCallbacks* callbacks,
+    ErrorInfo* errorInfo)
+{
+    return DecoderReadAnimationFrame(animation, frameIndex, callbacks, errorInfo);
+}
+
+void __stdcall CloseAnimation(AnimationDecoder* animation)
+{
+    DecoderCloseAnimation(animation);
+}
+
+DecoderStatus __stdcall ReconstructJpeg(
+    const uint8_t* data,
+    size_t dataSize,
+    IOCallbacks* callbacks,
+    ErrorInfo* errorInfo)
+{
+    return DecoderReconstructJpeg(data, dataSize, callbacks, errorInfo);
 }
 
 EncoderStatus __stdcall SaveImage(
@@ -35,7 +129,157 @@ EncoderStatus __stdcall SaveImage(
     const EncoderImageMetadata* metadata,
     IOCallbacks* callbacks,
     ErrorInfo* errorInfo,
+    ProgressProc progressCallback,
+    EncoderResult* result,
+    EncoderStats* stats)
+{
+    return EncoderWriteImage(bitmap, options, metadata, callbacks, errorInfo, progressCallback, result, stats);
+}
+
+EncoderStatus __stdcall SaveImageVariants(
+    const BitmapData* bitmap,
+    const EncoderImageMetadata* metadata,
+    EncoderVariant* variants,
+    uint32_t variantCount)
+{
+    return EncoderWriteImageVariants(bitmap, metadata, variants, variantCount);
+}
+
+EncoderStatus __stdcall RecompressJpeg(
+    const uint8_t* jpegData,
+    size_t jpegDataSize,
+    const EncoderOptions* options,
+    IOCallbacks* callbacks,
+    ErrorInfo* errorInfo,
     ProgressProc progressCallback)
 {
-    return EncoderWriteImage(bitmap, options, metadata, callbacks, errorInfo, progressCallback);
+    return EncoderRecompressJpeg(jpegData, jpegDataSize, options, callbacks, errorInfo, progressCallback);
+}
+
+EncoderStatus __stdcall RewriteMetadata(
+    const uint8_t* data,
+    size_t dataSize,
+    const EncoderImageMetadata* metadata,
+    bool compressBoxes,
+    bool allowJpegReconstructionLoss,
+    IOCallbacks* callbacks,
+    ErrorInfo* errorInfo)
+{
+    return EncoderRewriteMetadata(data, dataSize, metadata, compressBoxes, allowJpegReconstructionLoss, callbacks, errorInfo);
+}
+
+EncoderStatus __stdcall SaveImageAsync(
+    const BitmapData* bitmap,
+    const EncoderOptions* options,
+    const EncoderImageMetadata* metadata,
+    IOCallbacks* callbacks,
+    AsyncJobCompletedProc completedCallback,
+    AsyncJob** job)
+{
+    return AsyncJobStartSaveImage(bitmap, options, metadata, callbacks, completedCallback, job);
+}
+
+DecoderStatus __stdcall LoadImageAsync(
+    DecoderCallbacks* callbacks,
+    const uint8_t* data,
+    size_t dataSize,
+    DecoderMetadataFlags metadataFlags,
+    AsyncJobCompletedProc completedCallback,
+    AsyncJob** job)
+{
+    return AsyncJobStartLoadImage(callbacks, data, dataSize, metadataFlags, completedCallback, job);
+}
+
+void __stdcall SetAsyncJobLimit(uint32_t maxRunningJobs)
+{
+    AsyncJobSetMaxRunningJobs(maxRunningJobs);
+}
+
+AsyncJobState __stdcall GetAsyncJobState(const AsyncJob* job)
+{
+    return AsyncJobGetState(job);
+}
+
+int32_t __stdcall GetAsyncJobProgress(const AsyncJob* job)
+{
+    return AsyncJobGetProgress(job);
+}
+
+void* __stdcall GetAsyncJobWaitHandle(const AsyncJob* job)
+{
+    return AsyncJobGetWaitHandle(job);
+}
+
+bool __stdcall WaitForAsyncJob(const AsyncJob* job, uint32_t timeoutMilliseconds)
+{
+    return AsyncJobWait(job, timeoutMilliseconds);
+}
+
+void __stdcall CancelAsyncJob(AsyncJob* job)
+{
+    AsyncJobCancel(job);
+}
+
+EncoderStatus __stdcall GetSaveImageAsyncResult(
+    const AsyncJob* job,
+    EncoderResult* result,
+    ErrorInfo* errorInfo)
+{
+    return AsyncJobGetSaveImageResult(job, result, errorInfo);
+}
+
+DecoderStatus __stdcall GetLoadImageAsyncResult(
+    const AsyncJob* job,
+    ErrorInfo* errorInfo)
+{
+    return AsyncJobGetLoadImageResult(job, errorInfo);
+}
+
+void __stdcall CloseAsyncJob(AsyncJob* job)
+{
+    AsyncJobClose(job);
+}
+
+void __stdcall StartTracing()
+{
+    Tracing::Start();
+}
+
+EncoderStatus __stdcall StopTracing(IOCallbacks* callbacks)
+{
+    if (!callbacks)
+    {
+        return EncoderStatus::NullParameter;
+    }
+
+    try
+    {
+        const std::string json = Tracing::Stop();
+
+        return WriteOutputData(callbacks, reinterpret_cast<const uint8_t*>(json.data()), json.size());
+    }
+    catch (const std::bad_alloc&)
+    {
+        return EncoderStatus::OutOfMemory;
+    }
+}
+
+void __stdcall EnableParallelRunnerStats(bool enabled)
+{
+    ParallelRunnerStatistics::SetEnabled(enabled);
+}
+
+uint32_t __stdcall GetParallelRunnerStats(ParallelRunnerStats* stats, uint32_t maxCount)
+{
+    return ParallelRunnerStatistics::Get(stats, maxCount);
+}
+
+void __stdcall ResetParallelRunnerStats()
+{
+    ParallelRunnerStatistics::Reset();
+}
+
+void __stdcall SetParallelRunnerOptions(ParallelRunnerType type, ParallelRunnerThreadAffinity affinity)
+{
+    ParallelRunnerOptions::Set(type, affinity);
 }
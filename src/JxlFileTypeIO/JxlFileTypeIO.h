@@ -28,20 +28,202 @@ extern "C" {
 
 JXLFILETYPEIO_API uint32_t __stdcall GetLibJxlVersion();
 
+// The metadataFlags parameter selects the metadata boxes that are passed to the callbacks,
+// callers that only need the image pixels can use DecoderMetadataFlags::None.
+// The stats parameter can be null, the phase timers and memory tracking are skipped in that case.
 JXLFILETYPEIO_API DecoderStatus __stdcall LoadImage(
     DecoderCallbacks* callbacks,
     const uint8_t* data,
     size_t dataSize,
+    DecoderMetadataFlags metadataFlags,
+    ErrorInfo* errorInfo,
+    DecoderStats* stats);
+
+// Decodes a batch of images, e.g. a sprite sheet or icon set. The return value is Ok if the items
+// were processed, the result of each image is stored in the status and errorInfo item fields.
+// The callbacks of different items may be called at the same time from different threads.
+JXLFILETYPEIO_API DecoderStatus __stdcall LoadImages(
+    DecoderBatchItem* items,
+    uint32_t itemCount);
+
+// Decodes every frame of the image to check that it is intact, e.g. when scanning an archive.
+// The decoded pixels are discarded instead of being stored in an image buffer, and the color
+// management is skipped. The header of every container box is read up to the end of the file, so a
+// truncated or malformed trailing box is reported, but the box contents, e.g. the Exif and XMP
+// metadata, are not checked. The pixelHash parameter is optional and may be null,
+// it receives a checksum of the decoded pixels that stays the same between scans with the same
+// libjxl version.
+JXLFILETYPEIO_API DecoderStatus __stdcall ValidateImage(
+    const uint8_t* data,
+    size_t dataSize,
+    ErrorInfo* errorInfo,
+    uint64_t* pixelHash);
+
+// Reads the header of the image, e.g. to decide whether a file can be written again without being encoded.
+// An image that is lossless uses its original color space and does not have JPEG reconstruction data.
+JXLFILETYPEIO_API DecoderStatus __stdcall GetImageEncodingInfo(
+    const uint8_t* data,
+    size_t dataSize,
+    DecoderImageEncodingInfo* info,
     ErrorInfo* errorInfo);
 
+// Sets the maximum size in bytes of the decoded image cache that is used by the LoadImage calls, 0 disables
+// the cache. A cached image is returned by calling the DecoderCallbacks methods with pointers to the cached
+// buffers, so the callbacks must not modify the buffers while the cache is enabled.
+JXLFILETYPEIO_API void __stdcall SetDecodedImageCacheSize(uint64_t maxSizeInBytes);
+
+JXLFILETYPEIO_API void __stdcall ClearDecodedImageCache();
+
+JXLFILETYPEIO_API DecoderStatus __stdcall OpenAnimation(
+    DecoderCallbacks* callbacks,
+    const uint8_t* data,
+    size_t dataSize,
+    AnimationDecoder** animation,
+    ErrorInfo* errorInfo);
+
+JXLFILETYPEIO_API DecoderStatus __stdcall GetAnimationInfo(
+    AnimationDecoder* animation,
+    AnimationInfo* info);
+
+JXLFILETYPEIO_API DecoderStatus __stdcall GetAnimationFrameInfo(
+    AnimationDecoder* animation,
+    uint32_t frameIndex,
+    AnimationFrameInfo* info);
+
+JXLFILETYPEIO_API DecoderStatus __stdcall DecodeAnimationFrame(
+    AnimationDecoder* animation,
+    uint32_t frameIndex,
+    DecoderCallbacks* callbacks,
+    ErrorInfo* errorInfo);
+
+JXLFILETYPEIO_API void __stdcall CloseAnimation(AnimationDecoder* animation);
+
+JXLFILETYPEIO_API DecoderStatus __stdcall ReconstructJpeg(
+    const uint8_t* data,
+    size_t dataSize,
+    IOCallbacks* callbacks,
+    ErrorInfo* errorInfo);
+
+// The stats parameter can be null, the phase timers and memory tracking are skipped in that case.
 JXLFILETYPEIO_API EncoderStatus __stdcall SaveImage(
     const BitmapData* bitmap,
     const EncoderOptions* options,
     const EncoderImageMetadata* metadata,
     IOCallbacks* callbacks,
     ErrorInfo* errorInfo,
+    ProgressProc progressCallback,
+    EncoderResult* result,
+    EncoderStats* stats);
+
+// Encodes the image once for each variant, e.g. different distances, efforts or downscaled sizes.
+// The return value is Ok if the variants were processed, the result of each variant is stored in
+// its status, result and errorInfo fields. The callbacks of different variants may be called at the
+// same time from different threads.
+JXLFILETYPEIO_API EncoderStatus __stdcall SaveImageVariants(
+    const BitmapData* bitmap,
+    const EncoderImageMetadata* metadata,
+    EncoderVariant* variants,
+    uint32_t variantCount);
+
+JXLFILETYPEIO_API EncoderStatus __stdcall RecompressJpeg(
+    const uint8_t* jpegData,
+    size_t jpegDataSize,
+    const EncoderOptions* options,
+    IOCallbacks* callbacks,
+    ErrorInfo* errorInfo,
     ProgressProc progressCallback);
 
+// The file is copied unchanged when the metadata is the same as the original Exif and XMP boxes.
+// Changing the metadata removes the JPEG reconstruction data, if allowJpegReconstructionLoss is
+// false the JpegReconstructionDataLost status is returned instead so that the caller can decide
+// how to save the image.
+JXLFILETYPEIO_API EncoderStatus __stdcall RewriteMetadata(
+    const uint8_t* data,
+    size_t dataSize,
+    const EncoderImageMetadata* metadata,
+    bool compressBoxes,
+    bool allowJpegReconstructionLoss,
+    IOCallbacks* callbacks,
+    ErrorInfo* errorInfo);
+
+// Starts an asynchronous SaveImage or LoadImage call on a native job thread and returns the job handle.
+// The jobs are queued and SetAsyncJobLimit sets how many of them run at the same time, each job uses
+// its own parallel runner for the pixel work. The job threads are not taken from the shared parallel runner worker
+// pool because a job blocks its thread for the whole load or save, which would leave fewer workers
+// for the parallel runs of that job and of the synchronous calls.
+// The bitmap, image data, metadata buffers and callbacks must remain valid until the job has completed.
+// The completedCallback parameter is optional and may be null, it is called on the job thread.
+JXLFILETYPEIO_API EncoderStatus __stdcall SaveImageAsync(
+    const BitmapData* bitmap,
+    const EncoderOptions* options,
+    const EncoderImageMetadata* metadata,
+    IOCallbacks* callbacks,
+    AsyncJobCompletedProc completedCallback,
+    AsyncJob** job);
+
+JXLFILETYPEIO_API DecoderStatus __stdcall LoadImageAsync(
+    DecoderCallbacks* callbacks,
+    const uint8_t* data,
+    size_t dataSize,
+    DecoderMetadataFlags metadataFlags,
+    AsyncJobCompletedProc completedCallback,
+    AsyncJob** job);
+
+// Sets the maximum number of asynchronous jobs that run at the same time, a value of zero selects the
+// default limit, which is the number of hardware threads. Each running job has its own parallel runner threads, so a caller that starts
+// many jobs should use a lower limit to avoid oversubscribing the processors.
+JXLFILETYPEIO_API void __stdcall SetAsyncJobLimit(uint32_t maxRunningJobs);
+
+JXLFILETYPEIO_API AsyncJobState __stdcall GetAsyncJobState(const AsyncJob* job);
+
+// Returns the last progress percentage that the job reported, the jobs do not call a ProgressProc.
+JXLFILETYPEIO_API int32_t __stdcall GetAsyncJobProgress(const AsyncJob* job);
+
+// Returns a manual-reset event HANDLE that is signaled when the job has completed.
+// The event is owned by the job and is closed by CloseAsyncJob.
+JXLFILETYPEIO_API void* __stdcall GetAsyncJobWaitHandle(const AsyncJob* job);
+
+// Returns true if the job completed within the timeout, a timeout of UINT32_MAX waits forever.
+JXLFILETYPEIO_API bool __stdcall WaitForAsyncJob(const AsyncJob* job, uint32_t timeoutMilliseconds);
+
+// Requests cancellation, the job completes with the UserCanceled status at its next progress update.
+JXLFILETYPEIO_API void __stdcall CancelAsyncJob(AsyncJob* job);
+
+// Waits for the job to complete and returns the SaveImage status, the result parameter is optional and may be null.
+JXLFILETYPEIO_API EncoderStatus __stdcall GetSaveImageAsyncResult(
+    const AsyncJob* job,
+    EncoderResult* result,
+    ErrorInfo* errorInfo);
+
+// Waits for the job to complete and returns the LoadImage status.
+JXLFILETYPEIO_API DecoderStatus __stdcall GetLoadImageAsyncResult(
+    const AsyncJob* job,
+    ErrorInfo* errorInfo);
+
+// Cancels the job if it is still running, waits for it to complete and releases the job handle.
+JXLFILETYPEIO_API void __stdcall CloseAsyncJob(AsyncJob* job);
+
+// Starts recording Chrome trace event spans for the load and save calls, this discards
+// the events from any previous tracing session.
+JXLFILETYPEIO_API void __stdcall StartTracing();
+
+// Stops recording and writes the trace event JSON to the callbacks.
+JXLFILETYPEIO_API EncoderStatus __stdcall StopTracing(IOCallbacks* callbacks);
+
+// Enables or disables the parallel runner statistics for the decoders and encoders that are created after this call.
+// The statistics are disabled by default.
+JXLFILETYPEIO_API void __stdcall EnableParallelRunnerStats(bool enabled);
+
+// Copies up to maxCount entries of the parallel runner statistics, the return value is the total number of entries.
+// The stats parameter can be null to query the number of entries.
+JXLFILETYPEIO_API uint32_t __stdcall GetParallelRunnerStats(ParallelRunnerStats* stats, uint32_t maxCount);
+
+JXLFILETYPEIO_API void __stdcall ResetParallelRunnerStats();
+
+// Selects the parallel runner that is used by the decoders and encoders that are created after this call.
+// The resizable runner is used by default, unknown values select the defaults.
+JXLFILETYPEIO_API void __stdcall SetParallelRunnerOptions(ParallelRunnerType type, ParallelRunnerThreadAffinity affinity);
+
 #ifdef __cplusplus
 }
 #endif
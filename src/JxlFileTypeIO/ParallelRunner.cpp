@@ -0,0 +1,340 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "ParallelRunner.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    struct InstrumentedRun
+    {
+        JxlParallelRunInit init;
+        JxlParallelRunFunction func;
+        void* jpegxlOpaque;
+        size_t threadCount;
+        std::unique_ptr<std::atomic<uint64_t>[]> threadBusyTime;
+        std::atomic<uint64_t> longestTaskTime;
+    };
+
+    std::atomic<ParallelRunnerType> selectedRunnerType(ParallelRunnerType::Resizable);
+
+    std::atomic<bool> statsEnabled(false);
+    std::mutex statsMutex;
+    std::vector<ParallelRunnerStats> statsTable;
+
+    uint64_t ToNanoseconds(std::chrono::steady_clock::duration duration)
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+    }
+
+    uint32_t GetImageSizeLog2(uint64_t imagePixelCount)
+    {
+        uint32_t log2 = 0;
+
+        while (imagePixelCount > 1)
+        {
+            imagePixelCount >>= 1;
+            log2++;
+        }
+
+        return log2;
+    }
+
+    std::vector<ParallelRunnerStats>::iterator FindStatsEntry(
+        std::vector<ParallelRunnerStats>& table,
+        uint32_t threadCount,
+        uint32_t imageSizeLog2)
+    {
+        auto entry = std::find_if(
+            table.begin(),
+            table.end(),
+            [&](const ParallelRunnerStats& stats)
+            {
+                return stats.threadCount == threadCount && stats.imageSizeLog2 == imageSizeLog2;
+            });
+
+        if (entry == table.end())
+        {
+            ParallelRunnerStats stats{};
+            stats.threadCount = threadCount;
+            stats.imageSizeLog2 = imageSizeLog2;
+
+            entry = table.insert(entry, stats);
+        }
+
+        return entry;
+    }
+
+    void AddStatsToTable(const std::vector<ParallelRunnerStats>& runStats)
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+
+        for (const ParallelRunnerStats& stats : runStats)
+        {
+            auto entry = FindStatsEntry(statsTable, stats.threadCount, stats.imageSizeLog2);
+
+            entry->runCount += stats.runCount;
+            entry->taskCount += stats.taskCount;
+            entry->wallTime += stats.wallTime;
+            entry->busyTime += stats.busyTime;
+            entry->idleTime += stats.idleTime;
+            entry->busiestThreadTime += stats.busiestThreadTime;
+            entry->longestTaskTime = std::max(entry->longestTaskTime, stats.longestTaskTime);
+        }
+    }
+
+    JxlParallelRetCode InstrumentedRunInit(void* opaque, size_t threadCount)
+    {
+        InstrumentedRun* run = static_cast<InstrumentedRun*>(opaque);
+
+        try
+        {
+            run->threadBusyTime = std::make_unique<std::atomic<uint64_t>[]>(threadCount);
+        }
+        catch (...)
+        {
+            return JXL_PARALLEL_RET_RUNNER_ERROR;
+        }
+
+        for (size_t i = 0; i < threadCount; i++)
+        {
+            run->threadBusyTime[i].store(0);
+        }
+        run->threadCount = threadCount;
+
+        return run->init(run->jpegxlOpaque, threadCount);
+    }
+
+    void InstrumentedRunFunction(void* opaque, uint32_t value, size_t threadId)
+    {
+        InstrumentedRun* run = static_cast<InstrumentedRun*>(opaque);
+
+        const auto startTime = std::chrono::steady_clock::now();
+
+        run->func(run->jpegxlOpaque, value, threadId);
+
+        const uint64_t taskTime = ToNanoseconds(std::chrono::steady_clock::now() - startTime);
+
+        if (threadId < run->threadCount)
+        {
+            run->threadBusyTime[threadId].fetch_add(taskTime, std::memory_order_relaxed);
+        }
+
+        uint64_t longestTaskTime = run->longestTaskTime.load(std::memory_order_relaxed);
+
+        while (taskTime > longestTaskTime
+            && !run->longestTaskTime.compare_exchange_weak(longestTaskTime, taskTime, std::memory_order_relaxed))
+        {
+        }
+    }
+}
+
+InstrumentedParallelRunner::InstrumentedParallelRunner(
+    JxlParallelRunner runner,
+    void* runnerOpaque,
+    uint64_t imagePixelCount)
+    : runner(runner),
+      runnerOpaque(runnerOpaque),
+      imageSizeLog2(GetImageSizeLog2(imagePixelCount))
+{
+}
+
+InstrumentedParallelRunner::~InstrumentedParallelRunner()
+{
+    if (!runStats.empty())
+    {
+        try
+        {
+            AddStatsToTable(runStats);
+        }
+        catch (...)
+        {
+            // The statistics must not change the result of the decode or encode.
+        }
+    }
+}
+
+void InstrumentedParallelRunner::AddRun(
+    uint32_t threadCount,
+    uint64_t taskCount,
+    uint64_t wallTime,
+    uint64_t busyTime,
+    uint64_t busiestThreadTime,
+    uint64_t longestTaskTime)
+{
+    auto entry = FindStatsEntry(runStats, threadCount, imageSizeLog2);
+
+    const uint64_t totalThreadTime = wallTime * threadCount;
+
+    entry->runCount++;
+    entry->taskCount += taskCount;
+    entry->wallTime += wallTime;
+    entry->busyTime += busyTime;
+    entry->idleTime += totalThreadTime > busyTime ? totalThreadTime - busyTime : 0;
+    entry->busiestThreadTime += busiestThreadTime;
+    entry->longestTaskTime = std::max(entry->longestTaskTime, longestTaskTime);
+}
+
+JxlParallelRetCode InstrumentedParallelRunner::Run(
+    void* runnerOpaque,
+    void* jpegxlOpaque,
+    JxlParallelRunInit init,
+    JxlParallelRunFunction func,
+    uint32_t startRange,
+    uint32_t endRange)
+{
+    InstrumentedParallelRunner* instance = static_cast<InstrumentedParallelRunner*>(runnerOpaque);
+
+    InstrumentedRun run{ init, func, jpegxlOpaque, 0, nullptr, 0 };
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    const JxlParallelRetCode result = instance->runner(
+        instance->runnerOpaque,
+        &run,
+        InstrumentedRunInit,
+        InstrumentedRunFunction,
+        startRange,
+        endRange);
+
+    const uint64_t wallTime = ToNanoseconds(std::chrono::steady_clock::now() - startTime);
+
+    if (result == 0 && run.threadCount > 0)
+    {
+        uint64_t busyTime = 0;
+        uint64_t busiestThreadTime = 0;
+
+        for (size_t i = 0; i < run.threadCount; i++)
+        {
+            const uint64_t threadBusyTime = run.threadBusyTime[i].load();
+
+            busyTime += threadBusyTime;
+            busiestThreadTime = std::max(busiestThreadTime, threadBusyTime);
+        }
+
+        try
+        {
+            instance->AddRun(
+                static_cast<uint32_t>(run.threadCount),
+                endRange - startRange,
+                wallTime,
+                busyTime,
+                busiestThreadTime,
+                run.longestTaskTime.load());
+        }
+        catch (...)
+        {
+            // The statistics must not change the result of the parallel run.
+        }
+    }
+
+    return result;
+}
+
+ParallelRunner::ParallelRunner(const JxlMemoryManager* memoryManager, size_t threadCount, uint64_t imagePixelCount)
+    : type(selectedRunnerType.load(std::memory_order_relaxed)),
+      resizableRunner(type == ParallelRunnerType::Resizable ? JxlResizableParallelRunnerMake(memoryManager) : nullptr),
+      workStealingRunner(threadCount),
+      instrumentedRunner(
+          type == ParallelRunnerType::Resizable ? JxlResizableParallelRunner : WorkStealingParallelRunner::Run,
+          type == ParallelRunnerType::Resizable ? resizableRunner.get() : static_cast<void*>(&workStealingRunner),
+          imagePixelCount),
+      instrumented(statsEnabled.load(std::memory_order_relaxed)),
+      tracingRunner(GetInnerRunner(), GetInnerRunnerOpaque()),
+      traced(Tracing::IsEnabled())
+{
+    if (type == ParallelRunnerType::Resizable)
+    {
+        if (!resizableRunner)
+        {
+            throw std::runtime_error("JxlResizableParallelRunnerMake failed.");
+        }
+
+        JxlResizableParallelRunnerSetThreads(resizableRunner.get(), threadCount);
+    }
+}
+
+JxlParallelRunner ParallelRunner::GetRunner() const
+{
+    return traced ? Tracing::TracingParallelRunner::Run : GetInnerRunner();
+}
+
+void* ParallelRunner::GetRunnerOpaque() const
+{
+    return traced ? const_cast<Tracing::TracingParallelRunner*>(&tracingRunner) : GetInnerRunnerOpaque();
+}
+
+JxlParallelRunner ParallelRunner::GetInnerRunner() const
+{
+    if (instrumented)
+    {
+        return InstrumentedParallelRunner::Run;
+    }
+
+    return type == ParallelRunnerType::Resizable ? JxlResizableParallelRunner : WorkStealingParallelRunner::Run;
+}
+
+void* ParallelRunner::GetInnerRunnerOpaque() const
+{
+    if (instrumented)
+    {
+        return const_cast<InstrumentedParallelRunner*>(&instrumentedRunner);
+    }
+
+    return type == ParallelRunnerType::Resizable
+        ? resizableRunner.get()
+        : static_cast<void*>(const_cast<WorkStealingParallelRunner*>(&workStealingRunner));
+}
+
+void ParallelRunnerStatistics::SetEnabled(bool enabled)
+{
+    statsEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+uint32_t ParallelRunnerStatistics::Get(ParallelRunnerStats* stats, uint32_t maxCount)
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+
+    const uint32_t count = static_cast<uint32_t>(statsTable.size());
+
+    if (stats)
+    {
+        std::copy_n(statsTable.begin(), std::min(count, maxCount), stats);
+    }
+
+    return count;
+}
+
+void ParallelRunnerStatistics::Reset()
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+
+    statsTable.clear();
+}
+
+void ParallelRunnerOptions::Set(ParallelRunnerType type, ParallelRunnerThreadAffinity affinity)
+{
+    selectedRunnerType.store(
+        type == ParallelRunnerType::WorkStealing ? ParallelRunnerType::WorkStealing : ParallelRunnerType::Resizable,
+        std::memory_order_relaxed);
+
+    WorkStealingParallelRunner::SetThreadAffinity(
+        affinity == ParallelRunnerThreadAffinity::PinWorkerThreads
+        ? ParallelRunnerThreadAffinity::PinWorkerThreads
+        : ParallelRunnerThreadAffinity::None);
+}
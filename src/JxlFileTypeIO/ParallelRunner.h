@@ -0,0 +1,106 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include "Common.h"
+#include "Tracing.h"
+#include "WorkStealingParallelRunner.h"
+#include "jxl/memory_manager.h"
+#include "jxl/parallel_runner.h"
+#include "jxl/resizable_parallel_runner_cxx.h"
+#include <vector>
+
+// Wraps a libjxl parallel runner to measure the task balance and idle time of each parallel run.
+// The measurements are accumulated in the runner, libjxl does not start a parallel run while another
+// one is running on the same runner. They are added to a process-wide table that is grouped by the
+// thread count and image size when the runner is destroyed, at the end of the decode or encode.
+class InstrumentedParallelRunner
+{
+public:
+    InstrumentedParallelRunner(JxlParallelRunner runner, void* runnerOpaque, uint64_t imagePixelCount);
+    ~InstrumentedParallelRunner();
+
+    InstrumentedParallelRunner(const InstrumentedParallelRunner&) = delete;
+    InstrumentedParallelRunner& operator=(const InstrumentedParallelRunner&) = delete;
+
+    static JxlParallelRetCode Run(
+        void* runnerOpaque,
+        void* jpegxlOpaque,
+        JxlParallelRunInit init,
+        JxlParallelRunFunction func,
+        uint32_t startRange,
+        uint32_t endRange);
+
+private:
+    void AddRun(
+        uint32_t threadCount,
+        uint64_t taskCount,
+        uint64_t wallTime,
+        uint64_t busyTime,
+        uint64_t busiestThreadTime,
+        uint64_t longestTaskTime);
+
+    JxlParallelRunner runner;
+    void* runnerOpaque;
+    uint32_t imageSizeLog2;
+    // The runs are grouped by the thread count, the image size is the same for all of them.
+    std::vector<ParallelRunnerStats> runStats;
+};
+
+// The parallel runner that is used by the decoder and encoder, this adds the instrumentation
+// and tracing wrappers to the runner that is selected with ParallelRunnerOptions::Set.
+// The instrumentation is only used when the statistics are enabled, and the tracing wrapper
+// when a trace is being recorded.
+class ParallelRunner
+{
+public:
+    ParallelRunner(const JxlMemoryManager* memoryManager, size_t threadCount, uint64_t imagePixelCount);
+
+    ParallelRunner(const ParallelRunner&) = delete;
+    ParallelRunner& operator=(const ParallelRunner&) = delete;
+
+    JxlParallelRunner GetRunner() const;
+    void* GetRunnerOpaque() const;
+
+private:
+    // The runner that the tracing wrapper calls, or that libjxl calls when tracing is disabled.
+    JxlParallelRunner GetInnerRunner() const;
+    void* GetInnerRunnerOpaque() const;
+
+    ParallelRunnerType type;
+    JxlResizableParallelRunnerPtr resizableRunner;
+    WorkStealingParallelRunner workStealingRunner;
+    InstrumentedParallelRunner instrumentedRunner;
+    bool instrumented;
+    Tracing::TracingParallelRunner tracingRunner;
+    bool traced;
+};
+
+namespace ParallelRunnerStatistics
+{
+    // The statistics are disabled by default, the runners that are created while they are
+    // disabled do not measure their runs.
+    void SetEnabled(bool enabled);
+
+    // Copies up to maxCount entries of the statistics table, the return value is the
+    // total number of entries in the table.
+    uint32_t Get(ParallelRunnerStats* stats, uint32_t maxCount);
+
+    void Reset();
+}
+
+namespace ParallelRunnerOptions
+{
+    // Sets the runner that is used by the decoders and encoders that are created after this call.
+    // The thread affinity only applies to the work-stealing runner.
+    void Set(ParallelRunnerType type, ParallelRunnerThreadAffinity affinity);
+}
@@ -0,0 +1,119 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "PerformanceStats.h"
+#include <cstddef>
+#include <stdlib.h>
+
+namespace
+{
+    // The allocation size is stored in front of each block, the header size keeps
+    // the alignment that malloc guarantees.
+    constexpr size_t allocationHeaderSize = alignof(std::max_align_t) > sizeof(size_t)
+        ? alignof(std::max_align_t)
+        : sizeof(size_t);
+}
+
+ScopedPhaseTimer::ScopedPhaseTimer(uint64_t* counterMicroseconds)
+    : counter(counterMicroseconds),
+      startTime()
+{
+    if (counter)
+    {
+        startTime = std::chrono::steady_clock::now();
+    }
+}
+
+ScopedPhaseTimer::~ScopedPhaseTimer()
+{
+    if (counter)
+    {
+        *counter += ElapsedMicroseconds(startTime);
+    }
+}
+
+uint64_t ElapsedMicroseconds(std::chrono::steady_clock::time_point startTime)
+{
+    const auto elapsed = std::chrono::steady_clock::now() - startTime;
+
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+}
+
+uint64_t SaturatingSubtract(uint64_t a, uint64_t b)
+{
+    return a > b ? a - b : 0;
+}
+
+TrackingMemoryManager::TrackingMemoryManager()
+    : memoryManager{ this, AllocStatic, FreeStatic },
+      currentBytes(0),
+      peakBytes(0)
+{
+}
+
+const JxlMemoryManager* TrackingMemoryManager::Get() const
+{
+    return &memoryManager;
+}
+
+uint64_t TrackingMemoryManager::GetPeakBytes() const
+{
+    return peakBytes.load();
+}
+
+void* TrackingMemoryManager::AllocStatic(void* opaque, size_t size)
+{
+    return static_cast<TrackingMemoryManager*>(opaque)->Alloc(size);
+}
+
+void TrackingMemoryManager::FreeStatic(void* opaque, void* address)
+{
+    static_cast<TrackingMemoryManager*>(opaque)->Free(address);
+}
+
+void* TrackingMemoryManager::Alloc(size_t size)
+{
+    if (size > SIZE_MAX - allocationHeaderSize)
+    {
+        return nullptr;
+    }
+
+    uint8_t* block = static_cast<uint8_t*>(malloc(size + allocationHeaderSize));
+
+    if (!block)
+    {
+        return nullptr;
+    }
+
+    *reinterpret_cast<size_t*>(block) = size;
+
+    const uint64_t current = currentBytes.fetch_add(size) + size;
+    uint64_t peak = peakBytes.load();
+
+    while (current > peak && !peakBytes.compare_exchange_weak(peak, current))
+    {
+    }
+
+    return block + allocationHeaderSize;
+}
+
+void TrackingMemoryManager::Free(void* address)
+{
+    if (address)
+    {
+        uint8_t* block = static_cast<uint8_t*>(address) - allocationHeaderSize;
+
+        currentBytes.fetch_sub(*reinterpret_cast<size_t*>(block));
+
+        free(block);
+    }
+}
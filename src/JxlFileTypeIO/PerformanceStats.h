@@ -0,0 +1,64 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "jxl/memory_manager.h"
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+// Adds the time between construction and destruction to a microsecond counter.
+// The counter may be null, in which case the clock is not read.
+class ScopedPhaseTimer
+{
+public:
+    explicit ScopedPhaseTimer(uint64_t* counterMicroseconds);
+    ~ScopedPhaseTimer();
+
+    ScopedPhaseTimer(const ScopedPhaseTimer&) = delete;
+    ScopedPhaseTimer& operator=(const ScopedPhaseTimer&) = delete;
+
+private:
+    uint64_t* counter;
+    std::chrono::steady_clock::time_point startTime;
+};
+
+uint64_t ElapsedMicroseconds(std::chrono::steady_clock::time_point startTime);
+
+// Returns a - b, or 0 if b is larger than a.
+uint64_t SaturatingSubtract(uint64_t a, uint64_t b);
+
+// A libjxl memory manager that records the peak number of bytes that were allocated
+// through it. It can be shared by encoder and decoder instances that run on different threads.
+class TrackingMemoryManager
+{
+public:
+    TrackingMemoryManager();
+
+    TrackingMemoryManager(const TrackingMemoryManager&) = delete;
+    TrackingMemoryManager& operator=(const TrackingMemoryManager&) = delete;
+
+    const JxlMemoryManager* Get() const;
+    uint64_t GetPeakBytes() const;
+
+private:
+    static void* AllocStatic(void* opaque, size_t size);
+    static void FreeStatic(void* opaque, void* address);
+
+    void* Alloc(size_t size);
+    void Free(void* address);
+
+    JxlMemoryManager memoryManager;
+    std::atomic<uint64_t> currentBytes;
+    std::atomic<uint64_t> peakBytes;
+};
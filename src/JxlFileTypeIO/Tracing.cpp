@@ -0,0 +1,263 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "Tracing.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <vector>
+
+namespace
+{
+    struct TraceEvent
+    {
+        const char* name;
+        const char* category;
+        const char* detail;
+        std::chrono::steady_clock::time_point startTime;
+        std::chrono::steady_clock::duration duration;
+    };
+
+    // Each thread records its events in its own buffer, this keeps the tasks on the
+    // parallel runner threads from contending for a shared lock.
+    struct ThreadEventBuffer
+    {
+        std::mutex mutex;
+        std::vector<TraceEvent> events;
+        uint32_t threadId;
+    };
+
+    std::atomic<bool> tracingEnabled(false);
+    std::mutex sessionMutex;
+    std::chrono::steady_clock::time_point sessionStartTime;
+    // The buffers are kept after their thread exits, libjxl destroys the runner threads
+    // when the decoder or encoder is destroyed.
+    std::vector<std::shared_ptr<ThreadEventBuffer>> threadBuffers;
+    uint32_t nextThreadId = 1;
+
+    ThreadEventBuffer* GetThreadBuffer()
+    {
+        thread_local std::shared_ptr<ThreadEventBuffer> buffer;
+
+        if (!buffer)
+        {
+            buffer = std::make_shared<ThreadEventBuffer>();
+
+            std::lock_guard<std::mutex> lock(sessionMutex);
+
+            buffer->threadId = nextThreadId++;
+            threadBuffers.push_back(buffer);
+        }
+
+        return buffer.get();
+    }
+
+    void AddEvent(const TraceEvent& event)
+    {
+        try
+        {
+            ThreadEventBuffer* buffer = GetThreadBuffer();
+
+            std::lock_guard<std::mutex> lock(buffer->mutex);
+
+            buffer->events.push_back(event);
+        }
+        catch (...)
+        {
+            // Tracing must not change the result of the traced operation, the event is dropped.
+        }
+    }
+
+    double ToMicroseconds(std::chrono::steady_clock::duration duration)
+    {
+        return std::chrono::duration<double, std::micro>(duration).count();
+    }
+
+    void AppendEventJson(std::string& json, const TraceEvent& event, uint32_t threadId)
+    {
+        char buffer[512];
+
+        int length = snprintf(
+            buffer,
+            sizeof(buffer),
+            "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u",
+            event.name,
+            event.category,
+            ToMicroseconds(event.startTime - sessionStartTime),
+            ToMicroseconds(event.duration),
+            threadId);
+
+        if (length > 0)
+        {
+            json.append(buffer, std::min<size_t>(static_cast<size_t>(length), sizeof(buffer) - 1));
+        }
+
+        if (event.detail)
+        {
+            json.append(",\"args\":{\"detail\":\"");
+            json.append(event.detail);
+            json.append("\"}");
+        }
+
+        json.append("}");
+    }
+
+    struct TracedRun
+    {
+        JxlParallelRunInit init;
+        JxlParallelRunFunction func;
+        void* jpegxlOpaque;
+    };
+
+    JxlParallelRetCode TracedRunInit(void* opaque, size_t numThreads)
+    {
+        const TracedRun* run = static_cast<const TracedRun*>(opaque);
+
+        return run->init(run->jpegxlOpaque, numThreads);
+    }
+
+    void TracedRunFunction(void* opaque, uint32_t value, size_t threadId)
+    {
+        const TracedRun* run = static_cast<const TracedRun*>(opaque);
+
+        Tracing::Span span("Parallel task", "runner");
+
+        run->func(run->jpegxlOpaque, value, threadId);
+    }
+}
+
+void Tracing::Start()
+{
+    std::lock_guard<std::mutex> lock(sessionMutex);
+
+    // Remove the buffers of the threads that have exited.
+    threadBuffers.erase(
+        std::remove_if(
+            threadBuffers.begin(),
+            threadBuffers.end(),
+            [](const std::shared_ptr<ThreadEventBuffer>& buffer) { return buffer.use_count() == 1; }),
+        threadBuffers.end());
+
+    for (const std::shared_ptr<ThreadEventBuffer>& buffer : threadBuffers)
+    {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+
+        buffer->events.clear();
+    }
+
+    sessionStartTime = std::chrono::steady_clock::now();
+    tracingEnabled.store(true);
+}
+
+std::string Tracing::Stop()
+{
+    tracingEnabled.store(false);
+
+    std::lock_guard<std::mutex> lock(sessionMutex);
+
+    std::string json("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    bool firstEvent = true;
+
+    for (const std::shared_ptr<ThreadEventBuffer>& buffer : threadBuffers)
+    {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+
+        for (const TraceEvent& event : buffer->events)
+        {
+            if (!firstEvent)
+            {
+                json.append(",\n");
+            }
+            firstEvent = false;
+
+            AppendEventJson(json, event, buffer->threadId);
+        }
+
+        buffer->events.clear();
+    }
+
+    json.append("]}\n");
+
+    return json;
+}
+
+bool Tracing::IsEnabled()
+{
+    return tracingEnabled.load(std::memory_order_relaxed);
+}
+
+void Tracing::AddSpan(
+    const char* name,
+    const char* category,
+    const char* detail,
+    std::chrono::steady_clock::time_point startTime)
+{
+    if (IsEnabled())
+    {
+        AddEvent({ name, category, detail, startTime, std::chrono::steady_clock::now() - startTime });
+    }
+}
+
+Tracing::Span::Span(const char* name, const char* category)
+    : name(name),
+      category(category),
+      detail(nullptr),
+      enabled(IsEnabled()),
+      startTime()
+{
+    if (enabled)
+    {
+        startTime = std::chrono::steady_clock::now();
+    }
+}
+
+Tracing::Span::~Span()
+{
+    if (enabled)
+    {
+        AddEvent({ name, category, detail, startTime, std::chrono::steady_clock::now() - startTime });
+    }
+}
+
+void Tracing::Span::SetDetail(const char* value)
+{
+    detail = value;
+}
+
+Tracing::TracingParallelRunner::TracingParallelRunner(JxlParallelRunner runner, void* runnerOpaque)
+    : runner(runner),
+      runnerOpaque(runnerOpaque)
+{
+}
+
+JxlParallelRetCode Tracing::TracingParallelRunner::Run(
+    void* runnerOpaque,
+    void* jpegxlOpaque,
+    JxlParallelRunInit init,
+    JxlParallelRunFunction func,
+    uint32_t startRange,
+    uint32_t endRange)
+{
+    const TracingParallelRunner* instance = static_cast<const TracingParallelRunner*>(runnerOpaque);
+
+    if (!IsEnabled())
+    {
+        return instance->runner(instance->runnerOpaque, jpegxlOpaque, init, func, startRange, endRange);
+    }
+
+    Span span("Parallel run", "runner");
+    TracedRun run{ init, func, jpegxlOpaque };
+
+    return instance->runner(instance->runnerOpaque, &run, TracedRunInit, TracedRunFunction, startRange, endRange);
+}
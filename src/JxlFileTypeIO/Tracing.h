@@ -0,0 +1,80 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include "jxl/parallel_runner.h"
+#include <chrono>
+#include <stdint.h>
+#include <string>
+
+// Records spans in the Chrome trace event format, the output can be loaded in
+// chrome://tracing or the Perfetto UI. Tracing is disabled by default, the spans
+// do not read the clock or allocate memory while it is disabled.
+// The span names, categories and details must be string literals.
+namespace Tracing
+{
+    // Discards the previously recorded events and starts recording.
+    void Start();
+
+    // Stops recording and returns the recorded events as a trace event JSON document.
+    std::string Stop();
+
+    bool IsEnabled();
+
+    // Records a span that started at the specified time and ends now.
+    void AddSpan(
+        const char* name,
+        const char* category,
+        const char* detail,
+        std::chrono::steady_clock::time_point startTime);
+
+    // Records a span that covers the lifetime of the object.
+    class Span
+    {
+    public:
+        Span(const char* name, const char* category);
+        ~Span();
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+        // Sets an optional detail string that is shown with the span.
+        void SetDetail(const char* value);
+
+    private:
+        const char* name;
+        const char* category;
+        const char* detail;
+        bool enabled;
+        std::chrono::steady_clock::time_point startTime;
+    };
+
+    // Wraps a libjxl parallel runner to record a span for every task and for each
+    // parallel run as a whole.
+    class TracingParallelRunner
+    {
+    public:
+        TracingParallelRunner(JxlParallelRunner runner, void* runnerOpaque);
+
+        static JxlParallelRetCode Run(
+            void* runnerOpaque,
+            void* jpegxlOpaque,
+            JxlParallelRunInit init,
+            JxlParallelRunFunction func,
+            uint32_t startRange,
+            uint32_t endRange);
+
+    private:
+        JxlParallelRunner runner;
+        void* runnerOpaque;
+    };
+}
@@ -0,0 +1,409 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "WorkStealingParallelRunner.h"
+#include "Windows.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // The number of times that an idle thread checks for new work before it waits on the condition variable.
+    constexpr int idleSpinCount = 2000;
+
+    std::atomic<ParallelRunnerThreadAffinity> workerThreadAffinity(ParallelRunnerThreadAffinity::None);
+
+    // The task range is packed into a single value so that the owner and the thieves can update it
+    // with a compare and swap, the first task is in the high 32 bits and the end of the range is in
+    // the low 32 bits.
+    struct alignas(64) TaskRange
+    {
+        std::atomic<uint64_t> value;
+    };
+
+    uint64_t PackTaskRange(uint32_t begin, uint32_t end)
+    {
+        return (static_cast<uint64_t>(begin) << 32) | end;
+    }
+
+    struct ParallelRun
+    {
+        JxlParallelRunFunction func;
+        void* jpegxlOpaque;
+        uint32_t slotCount;
+        // The next slot that a worker can claim, this is protected by the WorkerPool mutex.
+        uint32_t nextSlot;
+        std::unique_ptr<TaskRange[]> ranges;
+        std::atomic<uint32_t> remainingTasks;
+        std::mutex completionMutex;
+        std::condition_variable completion;
+    };
+
+    bool TryPopTask(TaskRange& range, uint32_t& task)
+    {
+        uint64_t value = range.value.load(std::memory_order_acquire);
+
+        for (;;)
+        {
+            const uint32_t begin = static_cast<uint32_t>(value >> 32);
+            const uint32_t end = static_cast<uint32_t>(value);
+
+            if (begin >= end)
+            {
+                return false;
+            }
+
+            if (range.value.compare_exchange_weak(
+                value,
+                PackTaskRange(begin + 1, end),
+                std::memory_order_acq_rel,
+                std::memory_order_acquire))
+            {
+                task = begin;
+                return true;
+            }
+        }
+    }
+
+    bool TryStealTasks(TaskRange& victim, uint32_t& stolenBegin, uint32_t& stolenEnd)
+    {
+        uint64_t value = victim.value.load(std::memory_order_acquire);
+
+        for (;;)
+        {
+            const uint32_t begin = static_cast<uint32_t>(value >> 32);
+            const uint32_t end = static_cast<uint32_t>(value);
+
+            if (begin >= end)
+            {
+                return false;
+            }
+
+            // The thief takes the upper half, the owner keeps the tasks that it is about to run.
+            const uint32_t middle = end - ((end - begin + 1) / 2);
+
+            if (victim.value.compare_exchange_weak(
+                value,
+                PackTaskRange(begin, middle),
+                std::memory_order_acq_rel,
+                std::memory_order_acquire))
+            {
+                stolenBegin = middle;
+                stolenEnd = end;
+                return true;
+            }
+        }
+    }
+
+    void RunTasks(ParallelRun& run, uint32_t slot)
+    {
+        TaskRange& ownRange = run.ranges[slot];
+        uint32_t completedTasks = 0;
+
+        for (;;)
+        {
+            uint32_t task = 0;
+
+            while (TryPopTask(ownRange, task))
+            {
+                run.func(run.jpegxlOpaque, task, slot);
+                completedTasks++;
+            }
+
+            bool stoleTasks = false;
+
+            for (uint32_t i = 1; i < run.slotCount; i++)
+            {
+                uint32_t begin = 0;
+                uint32_t end = 0;
+
+                if (TryStealTasks(run.ranges[(slot + i) % run.slotCount], begin, end))
+                {
+                    // The own range is empty, so the other threads cannot modify it until the new range is stored.
+                    ownRange.value.store(PackTaskRange(begin, end), std::memory_order_release);
+                    stoleTasks = true;
+                    break;
+                }
+            }
+
+            if (!stoleTasks)
+            {
+                break;
+            }
+        }
+
+        if (completedTasks > 0
+            && run.remainingTasks.fetch_sub(completedTasks, std::memory_order_acq_rel) == completedTasks)
+        {
+            std::lock_guard<std::mutex> lock(run.completionMutex);
+            run.completion.notify_all();
+        }
+    }
+
+    void ApplyThreadAffinity(size_t workerIndex, ParallelRunnerThreadAffinity affinity)
+    {
+        const size_t processorCount = std::max(std::thread::hardware_concurrency(), 1u);
+        const size_t maskBits = sizeof(DWORD_PTR) * 8;
+
+        DWORD_PTR mask = 0;
+
+        if (affinity == ParallelRunnerThreadAffinity::PinWorkerThreads)
+        {
+            // Processor 0 is left for the calling thread, which also runs tasks.
+            mask = static_cast<DWORD_PTR>(1) << (((workerIndex + 1) % processorCount) % maskBits);
+        }
+        else
+        {
+            mask = processorCount >= maskBits ? ~static_cast<DWORD_PTR>(0) : (static_cast<DWORD_PTR>(1) << processorCount) - 1;
+        }
+
+        SetThreadAffinityMask(GetCurrentThread(), mask);
+    }
+
+    class WorkerPool
+    {
+    public:
+        // The pool is intentionally never destroyed, joining the worker threads while the DLL
+        // is unloaded would deadlock on the loader lock.
+        static WorkerPool& Get()
+        {
+            static WorkerPool* pool = new WorkerPool();
+
+            return *pool;
+        }
+
+        size_t GetWorkerCount() const
+        {
+            return workers.size();
+        }
+
+        void Submit(const std::shared_ptr<ParallelRun>& run)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                runs.push_back(run);
+                generation.fetch_add(1, std::memory_order_release);
+            }
+
+            for (uint32_t i = 1; i < run->slotCount; i++)
+            {
+                workAvailable.notify_one();
+            }
+        }
+
+        void Remove(const ParallelRun* run)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            runs.erase(std::remove_if(
+                runs.begin(),
+                runs.end(),
+                [run](const std::shared_ptr<ParallelRun>& item) { return item.get() == run; }),
+                runs.end());
+        }
+
+    private:
+        WorkerPool() : generation(0)
+        {
+            const unsigned int hardwareThreads = std::thread::hardware_concurrency();
+
+            // The calling thread of each parallel run is also used to run tasks.
+            const size_t workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+
+            workers.reserve(workerCount);
+
+            for (size_t i = 0; i < workerCount; i++)
+            {
+                workers.emplace_back(&WorkerPool::WorkerThread, this, i);
+                workers.back().detach();
+            }
+        }
+
+        std::shared_ptr<ParallelRun> TryClaimRun(uint32_t& slot)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            for (const std::shared_ptr<ParallelRun>& run : runs)
+            {
+                if (run->nextSlot < run->slotCount)
+                {
+                    slot = run->nextSlot++;
+                    return run;
+                }
+            }
+
+            return nullptr;
+        }
+
+        void WorkerThread(size_t workerIndex)
+        {
+            ParallelRunnerThreadAffinity appliedAffinity = ParallelRunnerThreadAffinity::None;
+
+            for (;;)
+            {
+                const ParallelRunnerThreadAffinity affinity = workerThreadAffinity.load(std::memory_order_relaxed);
+
+                if (affinity != appliedAffinity)
+                {
+                    ApplyThreadAffinity(workerIndex, affinity);
+                    appliedAffinity = affinity;
+                }
+
+                const uint64_t seenGeneration = generation.load(std::memory_order_acquire);
+
+                uint32_t slot = 0;
+                std::shared_ptr<ParallelRun> run = TryClaimRun(slot);
+
+                if (run)
+                {
+                    RunTasks(*run, slot);
+                    continue;
+                }
+
+                bool hasNewWork = false;
+
+                for (int i = 0; i < idleSpinCount; i++)
+                {
+                    if (generation.load(std::memory_order_acquire) != seenGeneration)
+                    {
+                        hasNewWork = true;
+                        break;
+                    }
+
+                    std::this_thread::yield();
+                }
+
+                if (!hasNewWork)
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+
+                    workAvailable.wait(lock, [&]() { return generation.load(std::memory_order_acquire) != seenGeneration; });
+                }
+            }
+        }
+
+        std::mutex mutex;
+        std::condition_variable workAvailable;
+        std::vector<std::shared_ptr<ParallelRun>> runs;
+        std::atomic<uint64_t> generation;
+        std::vector<std::thread> workers;
+    };
+
+    void WaitForCompletion(ParallelRun& run)
+    {
+        for (int i = 0; i < idleSpinCount; i++)
+        {
+            if (run.remainingTasks.load(std::memory_order_acquire) == 0)
+            {
+                return;
+            }
+
+            std::this_thread::yield();
+        }
+
+        std::unique_lock<std::mutex> lock(run.completionMutex);
+
+        run.completion.wait(lock, [&]() { return run.remainingTasks.load(std::memory_order_acquire) == 0; });
+    }
+}
+
+WorkStealingParallelRunner::WorkStealingParallelRunner(size_t threadCount) : threadCount(std::max<size_t>(threadCount, 1))
+{
+}
+
+JxlParallelRetCode WorkStealingParallelRunner::Run(
+    void* runnerOpaque,
+    void* jpegxlOpaque,
+    JxlParallelRunInit init,
+    JxlParallelRunFunction func,
+    uint32_t startRange,
+    uint32_t endRange)
+{
+    const WorkStealingParallelRunner* instance = static_cast<const WorkStealingParallelRunner*>(runnerOpaque);
+
+    if (startRange >= endRange)
+    {
+        return 0;
+    }
+
+    const uint32_t taskCount = endRange - startRange;
+
+    try
+    {
+        WorkerPool& pool = WorkerPool::Get();
+
+        const uint32_t slotCount = static_cast<uint32_t>(std::min<size_t>(
+            std::min<size_t>(instance->threadCount, pool.GetWorkerCount() + 1),
+            taskCount));
+
+        const JxlParallelRetCode initResult = init(jpegxlOpaque, slotCount);
+
+        if (initResult != 0)
+        {
+            return initResult;
+        }
+
+        if (slotCount == 1)
+        {
+            for (uint32_t task = startRange; task < endRange; task++)
+            {
+                func(jpegxlOpaque, task, 0);
+            }
+
+            return 0;
+        }
+
+        std::shared_ptr<ParallelRun> run = std::make_shared<ParallelRun>();
+        run->func = func;
+        run->jpegxlOpaque = jpegxlOpaque;
+        run->slotCount = slotCount;
+        // The calling thread uses the first slot.
+        run->nextSlot = 1;
+        run->ranges = std::make_unique<TaskRange[]>(slotCount);
+        run->remainingTasks.store(taskCount);
+
+        for (uint32_t i = 0; i < slotCount; i++)
+        {
+            const uint32_t begin = startRange + static_cast<uint32_t>(static_cast<uint64_t>(taskCount) * i / slotCount);
+            const uint32_t end = startRange + static_cast<uint32_t>(static_cast<uint64_t>(taskCount) * (i + 1) / slotCount);
+
+            run->ranges[i].value.store(PackTaskRange(begin, end));
+        }
+
+        pool.Submit(run);
+
+        RunTasks(*run, 0);
+
+        // All of the tasks have been started when the calling thread runs out of work, so the
+        // workers that claim a slot after this point would not find any tasks.
+        pool.Remove(run.get());
+
+        WaitForCompletion(*run);
+    }
+    catch (...)
+    {
+        return JXL_PARALLEL_RET_RUNNER_ERROR;
+    }
+
+    return 0;
+}
+
+void WorkStealingParallelRunner::SetThreadAffinity(ParallelRunnerThreadAffinity affinity)
+{
+    workerThreadAffinity.store(affinity, std::memory_order_relaxed);
+}
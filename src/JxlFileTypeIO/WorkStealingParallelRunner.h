@@ -0,0 +1,43 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include "Common.h"
+#include "jxl/parallel_runner.h"
+#include <stddef.h>
+
+// A libjxl parallel runner that uses a process-wide pool of worker threads.
+//
+// The tasks of each parallel run are split into one range per thread, a thread that runs out of
+// tasks steals the upper half of the remaining tasks in another range. The calling thread also runs
+// tasks, so a parallel run completes even when the workers are busy with other images.
+// Idle workers spin for a short time before they wait for new work, this avoids the cost of waking
+// the threads for every parallel run when many small images are processed.
+class WorkStealingParallelRunner
+{
+public:
+    explicit WorkStealingParallelRunner(size_t threadCount);
+
+    static JxlParallelRetCode Run(
+        void* runnerOpaque,
+        void* jpegxlOpaque,
+        JxlParallelRunInit init,
+        JxlParallelRunFunction func,
+        uint32_t startRange,
+        uint32_t endRange);
+
+    // The workers apply the new affinity the next time that they look for work.
+    static void SetThreadAffinity(ParallelRunnerThreadAffinity affinity);
+
+private:
+    size_t threadCount;
+};
@@ -0,0 +1,172 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+using JpegXLFileTypePlugin.Interop;
+using PaintDotNet;
+using PaintDotNet.Imaging;
+using PaintDotNet.Rendering;
+using System;
+using System.Diagnostics.CodeAnalysis;
+using System.Numerics;
+using System.Runtime.CompilerServices;
+using System.Runtime.InteropServices;
+
+namespace JpegXLFileTypePlugin
+{
+    /// <summary>
+    /// The original file data of a document that was loaded from a single frame JPEG XL image.
+    /// </summary>
+    /// <remarks>
+    /// When the rendered document pixels have not changed since the image was loaded the
+    /// original codestream is written to the output file, this avoids the generation loss
+    /// and encoding time of compressing the decoded pixels again.
+    /// </remarks>
+    internal sealed class OriginalImageData
+    {
+        private static readonly ConditionalWeakTable<Document, OriginalImageData> documentTable = new();
+
+        private readonly ulong pixelChecksum;
+        private readonly byte[]? iccProfile;
+        private readonly EncoderImageMetadata metadata;
+        private bool? mayBeLossless;
+
+        private OriginalImageData(byte[] fileData, ulong pixelChecksum, byte[]? iccProfile, EncoderImageMetadata metadata)
+        {
+            FileData = fileData;
+            this.pixelChecksum = pixelChecksum;
+            this.iccProfile = iccProfile;
+            this.metadata = metadata;
+        }
+
+        public byte[] FileData { get; }
+
+        public static void Add(Document document, byte[] fileData)
+        {
+            ArgumentNullException.ThrowIfNull(document);
+            ArgumentNullException.ThrowIfNull(fileData);
+
+            // The rendered image is only the same as the layer pixels for a single layer document.
+            if (document.Layers.Count == 1 && document.Layers[0] is BitmapLayer layer)
+            {
+                ulong pixelChecksum = ComputePixelChecksum(layer.Surface);
+                byte[]? iccProfile = JpegXLSave.GetIccProfileBytes(document);
+                // The metadata is stored in the form that a save would write, so an unchanged
+                // document can be detected without parsing the original metadata boxes.
+                EncoderImageMetadata metadata = JpegXLSave.CreateImageMetadata(document, iccProfile);
+
+                documentTable.AddOrUpdate(document, new OriginalImageData(fileData, pixelChecksum, iccProfile, metadata));
+            }
+        }
+
+        public static bool TryGet(Document document, [NotNullWhen(true)] out OriginalImageData? originalImageData)
+        {
+            ArgumentNullException.ThrowIfNull(document);
+
+            return documentTable.TryGetValue(document, out originalImageData);
+        }
+
+        public bool CanPassThrough(Surface renderedImage, bool lossless, byte[]? currentIccProfile)
+        {
+            ArgumentNullException.ThrowIfNull(renderedImage);
+
+            // The color profile is stored in the codestream, it cannot be changed without encoding the image.
+            if (!iccProfile.AsSpan().SequenceEqual(currentIccProfile))
+            {
+                return false;
+            }
+
+            if (ComputePixelChecksum(renderedImage) != pixelChecksum)
+            {
+                return false;
+            }
+
+            // libjxl does not store the distance that the image was encoded with, so the original is only
+            // used when it has the same kind of compression that was requested. A lossy original is not
+            // written when the user asked for a lossless image, and a lossless original is not written when
+            // the user asked for a smaller lossy image.
+            mayBeLossless ??= JpegXLNative.TryGetImageEncodingInfo(FileData, out DecoderImageEncodingInfo info) ? info.MayBeLossless : null;
+
+            return mayBeLossless.HasValue && mayBeLossless.Value == lossless;
+        }
+
+        public bool MetadataEquals(EncoderImageMetadata currentMetadata)
+        {
+            ArgumentNullException.ThrowIfNull(currentMetadata);
+
+            return metadata.exif.Span.SequenceEqual(currentMetadata.exif.Span)
+                && metadata.xmp.Span.SequenceEqual(currentMetadata.xmp.Span);
+        }
+
+        // A non-cryptographic checksum is used because the document is only compared with itself, the
+        // rows are read as four interleaved 64-bit lanes so that the multiplications do not depend on
+        // each other.
+        private static unsafe ulong ComputePixelChecksum(Surface surface)
+        {
+            const ulong Prime1 = 0x9E3779B185EBCA87UL;
+            const ulong Prime2 = 0xC2B2AE3D27D4EB4FUL;
+
+            RegionPtr<ColorBgra32> region = surface.AsRegionPtr().Cast<ColorBgra32>();
+
+            int width = region.Width;
+            int height = region.Height;
+
+            ulong lane0 = Prime1;
+            ulong lane1 = Prime2;
+            ulong lane2 = 0;
+            ulong lane3 = unchecked(0 - Prime1);
+
+            for (int y = 0; y < height; y++)
+            {
+                ReadOnlySpan<byte> row = new(region.Rows[y].Ptr, width * sizeof(ColorBgra32));
+                ReadOnlySpan<ulong> values = MemoryMarshal.Cast<byte, ulong>(row);
+
+                int i = 0;
+
+                for (; i + 4 <= values.Length; i += 4)
+                {
+                    lane0 = Round(lane0, values[i]);
+                    lane1 = Round(lane1, values[i + 1]);
+                    lane2 = Round(lane2, values[i + 2]);
+                    lane3 = Round(lane3, values[i + 3]);
+                }
+
+                for (; i < values.Length; i++)
+                {
+                    lane0 = Round(lane0, values[i]);
+                }
+
+                // A row with an odd width ends with a single pixel.
+                for (int j = values.Length * sizeof(ulong); j < row.Length; j += sizeof(uint))
+                {
+                    lane1 = Round(lane1, MemoryMarshal.Read<uint>(row.Slice(j)));
+                }
+            }
+
+            ulong hash = BitOperations.RotateLeft(lane0, 1)
+                       + BitOperations.RotateLeft(lane1, 7)
+                       + BitOperations.RotateLeft(lane2, 12)
+                       + BitOperations.RotateLeft(lane3, 18);
+
+            hash ^= hash >> 33;
+            hash *= Prime2;
+            hash ^= hash >> 29;
+
+            return hash;
+
+            static ulong Round(ulong accumulator, ulong value)
+            {
+                accumulator += value * Prime2;
+                return BitOperations.RotateLeft(accumulator, 31) * Prime1;
+            }
+        }
+    }
+}
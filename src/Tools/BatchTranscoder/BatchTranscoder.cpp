@@ -0,0 +1,662 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+// Converts batches of images between JPEG XL and the PGM, PPM, PAM, raw and JPEG formats with the
+// plugin decoder and encoder, for bulk conversions outside of Paint.NET.
+//
+// The conversion is a three stage pipeline: a reader thread loads the input files, a group of
+// worker threads decodes or encodes them and the main thread writes the output files. The stages
+// overlap, so the file I/O is hidden behind the conversions, and the number of items in the
+// pipeline is limited to bound the memory usage.
+//
+// The files are converted by several workers at the same time, and the work-stealing parallel
+// runner shares one thread pool between the files that are being converted. This keeps all of the
+// hardware threads busy for both a few large images and many small images.
+
+#include "CommandLine.h"
+#include "ImageTranscode.h"
+#include "ParallelRunner.h"
+#include "PnmImage.h"
+#include "WorkQueue.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <ctype.h>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    struct Options
+    {
+        std::string outputDirectory;
+        // A distance of 0 selects lossless encoding.
+        float distance = 1.0f;
+        int32_t effort = 7;
+        // 0 selects the number of workers automatically.
+        uint32_t jobs = 0;
+        // 0 selects twice the number of workers.
+        uint32_t maxInFlight = 0;
+        ParallelRunnerType runnerType = ParallelRunnerType::WorkStealing;
+        bool skipExisting = false;
+        // The raw images do not have a header, so their size and channel count are set on the command line.
+        uint32_t rawWidth = 0;
+        uint32_t rawHeight = 0;
+        uint32_t rawChannelCount = 3;
+        // Writes the decoded JPEG XL images as raw samples instead of PNM images.
+        bool rawOutput = false;
+        std::vector<std::string> inputs;
+    };
+
+    enum class Conversion
+    {
+        JxlToImage,
+        PnmToJxl,
+        RawToJxl,
+        JpegToJxl
+    };
+
+    struct InputFile
+    {
+        fs::path path;
+        // The output path relative to the output directory, without the file extension.
+        fs::path outputStem;
+        Conversion conversion;
+    };
+
+    struct WorkItem
+    {
+        const InputFile* file;
+        std::vector<uint8_t> data;
+        fs::path outputPath;
+        double convertSeconds;
+        std::string error;
+    };
+
+    // Limits the number of items between the reader and the writer stages.
+    class InFlightLimiter
+    {
+    public:
+        explicit InFlightLimiter(uint32_t limit) : available(limit)
+        {
+        }
+
+        void Acquire()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            released.wait(lock, [this]() { return available > 0; });
+            available--;
+        }
+
+        void Release()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                available++;
+            }
+
+            released.notify_one();
+        }
+
+    private:
+        std::mutex mutex;
+        std::condition_variable released;
+        uint32_t available;
+    };
+
+    void PrintUsage()
+    {
+        std::cout << "Usage: BatchTranscoder --output <directory> [options] <images, directories or @list files>\n"
+                     "\n"
+                     "JPEG XL images are decoded to PGM, PPM or PAM images, PGM, PPM, raw and JPEG images are encoded\n"
+                     "to JPEG XL. JPEG images are losslessly recompressed. The directories are searched recursively,\n"
+                     "and the relative paths of the images are kept in the output directory. A @list file contains\n"
+                     "one image path per line.\n"
+                     "\n"
+                     "Options:\n"
+                     "  --output <directory>     The output directory.\n"
+                     "  --distance <value>       The encoder distance, 0 is lossless. The default is 1.\n"
+                     "  --effort <value>         The encoder effort, the default is 7.\n"
+                     "  --jobs <n>               The number of images that are converted at the same time.\n"
+                     "                           The default is half of the hardware threads, the other threads\n"
+                     "                           are used by the parallel runner within the images.\n"
+                     "  --max-in-flight <n>      The maximum number of images that are held in memory,\n"
+                     "                           the default is twice the number of jobs.\n"
+                     "  --runner <name>          The parallel runner, work-stealing (the default) or resizable.\n"
+                     "  --skip-existing          Skips the images that already have an output file.\n"
+                     "  --raw-size <w>x<h>       The size of the .raw input images.\n"
+                     "  --raw-channels <n>       The channel count of the .raw input images: 1 for gray, 2 for gray\n"
+                     "                           and alpha, 3 for RGB (the default) and 4 for RGBA.\n"
+                     "  --raw-output             Writes the decoded images as .raw files without a header.\n"
+                     "\n"
+                     "The raw images hold interleaved samples in the same layout as the PNM image data. The raw\n"
+                     "inputs must use 8-bit samples, the 16-bit samples of the outputs are big-endian.\n"
+                     "\n"
+                     "The decoded images are written with 8-bit or 16-bit samples and without the color profile,\n"
+                     "the images with an alpha channel are written as PAM. The layers are composited onto the\n"
+                     "image canvas. CMYK and floating point images are not supported.\n";
+    }
+
+    Options ParseCommandLine(int argc, char** argv)
+    {
+        Options options;
+
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string arg = argv[i];
+            const bool hasValue = (i + 1) < argc;
+
+            if (arg == "--output" && hasValue)
+            {
+                options.outputDirectory = argv[++i];
+            }
+            else if (arg == "--distance" && hasValue)
+            {
+                options.distance = std::stof(argv[++i]);
+            }
+            else if (arg == "--effort" && hasValue)
+            {
+                options.effort = std::stoi(argv[++i]);
+            }
+            else if (arg == "--jobs" && hasValue)
+            {
+                options.jobs = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (arg == "--max-in-flight" && hasValue)
+            {
+                options.maxInFlight = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (arg == "--runner" && hasValue)
+            {
+                const std::string runner = argv[++i];
+
+                if (runner == "work-stealing")
+                {
+                    options.runnerType = ParallelRunnerType::WorkStealing;
+                }
+                else if (runner == "resizable")
+                {
+                    options.runnerType = ParallelRunnerType::Resizable;
+                }
+                else
+                {
+                    throw std::invalid_argument("Unknown parallel runner: " + runner);
+                }
+            }
+            else if (arg == "--skip-existing")
+            {
+                options.skipExisting = true;
+            }
+            else if (arg == "--raw-size" && hasValue)
+            {
+                const std::string size = argv[++i];
+                const size_t separator = size.find('x');
+
+                if (separator == std::string::npos)
+                {
+                    throw std::invalid_argument("The raw image size must use the <width>x<height> format.");
+                }
+
+                options.rawWidth = static_cast<uint32_t>(std::stoul(size.substr(0, separator)));
+                options.rawHeight = static_cast<uint32_t>(std::stoul(size.substr(separator + 1)));
+            }
+            else if (arg == "--raw-channels" && hasValue)
+            {
+                options.rawChannelCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (arg == "--raw-output")
+            {
+                options.rawOutput = true;
+            }
+            else if (arg == "--help")
+            {
+                throw std::invalid_argument("");
+            }
+            else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0)
+            {
+                throw std::runtime_error("Unknown option: " + arg);
+            }
+            else
+            {
+                options.inputs.push_back(arg);
+            }
+        }
+
+        if (options.outputDirectory.empty() || options.inputs.empty())
+        {
+            throw std::invalid_argument("The output directory and at least one input are required.");
+        }
+
+        if (options.distance < 0.0f || options.distance > 25.0f || options.effort < 1 || options.effort > 10)
+        {
+            throw std::invalid_argument("The distance must be in the range of 0 to 25 and the effort in the range of 1 to 10.");
+        }
+
+        if (options.rawChannelCount < 1 || options.rawChannelCount > 4)
+        {
+            throw std::invalid_argument("The raw channel count must be in the range of 1 to 4.");
+        }
+
+        return options;
+    }
+
+    bool TryGetConversion(const fs::path& path, Conversion& conversion)
+    {
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+
+        if (extension == ".jxl")
+        {
+            conversion = Conversion::JxlToImage;
+        }
+        else if (extension == ".ppm" || extension == ".pgm" || extension == ".pnm")
+        {
+            conversion = Conversion::PnmToJxl;
+        }
+        else if (extension == ".raw")
+        {
+            conversion = Conversion::RawToJxl;
+        }
+        else if (extension == ".jpg" || extension == ".jpeg")
+        {
+            conversion = Conversion::JpegToJxl;
+        }
+        else
+        {
+            return false;
+        }
+
+        return true;
+    }
+
+    void AddInputFile(const fs::path& path, const fs::path& outputStem, bool isExplicitInput, std::vector<InputFile>& files)
+    {
+        Conversion conversion;
+
+        if (TryGetConversion(path, conversion))
+        {
+            files.push_back(InputFile{ path, fs::path(outputStem).replace_extension(), conversion });
+        }
+        else if (isExplicitInput)
+        {
+            throw std::runtime_error("Unsupported input file: " + path.string());
+        }
+    }
+
+    std::vector<InputFile> EnumerateInputFiles(const std::vector<std::string>& inputs)
+    {
+        std::vector<InputFile> files;
+
+        for (const std::string& input : inputs)
+        {
+            if (input.size() > 1 && input[0] == '@')
+            {
+                std::ifstream list(input.substr(1));
+
+                if (!list)
+                {
+                    throw std::runtime_error("Unable to open the list file: " + input.substr(1));
+                }
+
+                std::string line;
+
+                while (std::getline(list, line))
+                {
+                    if (!line.empty() && line.back() == '\r')
+                    {
+                        line.pop_back();
+                    }
+
+                    if (!line.empty())
+                    {
+                        const fs::path path(line);
+
+                        AddInputFile(path, path.filename(), true, files);
+                    }
+                }
+            }
+            else if (fs::is_directory(input))
+            {
+                std::vector<fs::path> directoryFiles;
+
+                for (const fs::directory_entry& entry : fs::recursive_directory_iterator(input))
+                {
+                    if (entry.is_regular_file())
+                    {
+                        directoryFiles.push_back(entry.path());
+                    }
+                }
+
+                std::sort(directoryFiles.begin(), directoryFiles.end());
+
+                for (const fs::path& path : directoryFiles)
+                {
+                    AddInputFile(path, path.lexically_relative(input), false, files);
+                }
+            }
+            else
+            {
+                const fs::path path(input);
+
+                AddInputFile(path, path.filename(), true, files);
+            }
+        }
+
+        return files;
+    }
+
+    PnmImage DecodeRawImage(std::vector<uint8_t>& data, const Options& options, const std::string& name)
+    {
+        if (options.rawWidth == 0 || options.rawHeight == 0)
+        {
+            throw std::runtime_error("The --raw-size option is required for raw images: " + name);
+        }
+
+        PnmImage image{};
+        image.width = options.rawWidth;
+        image.height = options.rawHeight;
+        image.channelCount = options.rawChannelCount;
+        image.maxValue = 255;
+
+        if (data.size() != static_cast<size_t>(image.width) * image.height * image.channelCount)
+        {
+            throw std::runtime_error("The raw image size does not match the --raw-size and --raw-channels options: " + name);
+        }
+
+        image.pixels = std::move(data);
+
+        return image;
+    }
+
+    void Convert(WorkItem& item, const Options& options)
+    {
+        const InputFile& file = *item.file;
+        const fs::path outputBase = fs::path(options.outputDirectory) / file.outputStem;
+
+        switch (file.conversion)
+        {
+        case Conversion::JxlToImage:
+        {
+            PnmImage image = ImageTranscode::DecodeJxl(item.data);
+
+            if (options.rawOutput)
+            {
+                item.outputPath = fs::path(outputBase).replace_extension(".raw");
+                item.data = std::move(image.pixels);
+            }
+            else
+            {
+                item.outputPath = fs::path(outputBase).replace_extension(GetPnmFileExtension(image));
+                item.data = EncodePnmImage(image);
+            }
+            break;
+        }
+        case Conversion::PnmToJxl:
+        {
+            const PnmImage image = DecodePnmImage(item.data, file.path.string());
+
+            item.outputPath = fs::path(outputBase).replace_extension(".jxl");
+            item.data = ImageTranscode::EncodeJxl(image, options.distance, options.effort);
+            break;
+        }
+        case Conversion::RawToJxl:
+        {
+            const PnmImage image = DecodeRawImage(item.data, options, file.path.string());
+
+            item.outputPath = fs::path(outputBase).replace_extension(".jxl");
+            item.data = ImageTranscode::EncodeJxl(image, options.distance, options.effort);
+            break;
+        }
+        case Conversion::JpegToJxl:
+            item.outputPath = fs::path(outputBase).replace_extension(".jxl");
+            item.data = ImageTranscode::RecompressJpeg(item.data, options.effort);
+            break;
+        }
+    }
+
+    bool OutputExists(const InputFile& file, const Options& options)
+    {
+        const fs::path outputBase = fs::path(options.outputDirectory) / file.outputStem;
+
+        if (file.conversion == Conversion::JxlToImage)
+        {
+            if (options.rawOutput)
+            {
+                return fs::exists(fs::path(outputBase).replace_extension(".raw"));
+            }
+
+            return fs::exists(fs::path(outputBase).replace_extension(".pgm"))
+                || fs::exists(fs::path(outputBase).replace_extension(".ppm"))
+                || fs::exists(fs::path(outputBase).replace_extension(".pam"));
+        }
+
+        return fs::exists(fs::path(outputBase).replace_extension(".jxl"));
+    }
+
+    uint32_t GetDefaultJobCount(size_t fileCount)
+    {
+        const uint32_t hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+        // The workers are also used by the parallel runner, so half of the hardware threads
+        // are enough to keep the pool busy when the images are small.
+        const uint32_t jobs = std::max(hardwareThreads / 2, 1u);
+
+        return static_cast<uint32_t>(std::min<size_t>(jobs, std::max<size_t>(fileCount, 1)));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        const Options options = ParseCommandLine(argc, argv);
+
+        std::vector<InputFile> files = EnumerateInputFiles(options.inputs);
+
+        if (options.skipExisting)
+        {
+            files.erase(
+                std::remove_if(files.begin(), files.end(), [&](const InputFile& file) { return OutputExists(file, options); }),
+                files.end());
+        }
+
+        if (files.empty())
+        {
+            std::cerr << "There are no images to convert." << std::endl;
+            return 0;
+        }
+
+        const uint32_t jobs = options.jobs != 0 ? options.jobs : GetDefaultJobCount(files.size());
+        const uint32_t maxInFlight = std::max(options.maxInFlight != 0 ? options.maxInFlight : jobs * 2, 1u);
+
+        ParallelRunnerOptions::Set(options.runnerType, ParallelRunnerThreadAffinity::None);
+
+        const auto startTime = std::chrono::steady_clock::now();
+
+        InFlightLimiter limiter(maxInFlight);
+        WorkQueue<std::unique_ptr<WorkItem>> readQueue;
+        WorkQueue<std::unique_ptr<WorkItem>> writeQueue;
+        std::atomic<uint64_t> bytesRead(0);
+        std::atomic<size_t> readFailedCount(0);
+        std::mutex errorOutputMutex;
+
+        std::thread reader([&]()
+        {
+            for (const InputFile& file : files)
+            {
+                limiter.Acquire();
+
+                // An exception must not leave the thread, the failure is reported for the file and
+                // the reader continues with the next one.
+                try
+                {
+                    std::unique_ptr<WorkItem> item = std::make_unique<WorkItem>();
+                    item->file = &file;
+
+                    try
+                    {
+                        item->data = ReadFileBytes(file.path.string());
+                        bytesRead += item->data.size();
+                    }
+                    catch (const std::exception& ex)
+                    {
+                        item->error = ex.what();
+                    }
+
+                    readQueue.Push(std::move(item));
+                }
+                catch (const std::exception& ex)
+                {
+                    // The item did not reach the writer, so it is reported here.
+                    limiter.Release();
+                    readFailedCount++;
+
+                    std::lock_guard<std::mutex> lock(errorOutputMutex);
+                    std::cerr << file.path.string() << ": " << ex.what() << std::endl;
+                }
+            }
+
+            readQueue.Close();
+        });
+
+        std::atomic<uint32_t> activeWorkers(jobs);
+        std::vector<std::thread> workers;
+        workers.reserve(jobs);
+
+        for (uint32_t i = 0; i < jobs; i++)
+        {
+            workers.emplace_back([&]()
+            {
+                std::unique_ptr<WorkItem> item;
+
+                while (readQueue.Pop(item))
+                {
+                    if (item->error.empty())
+                    {
+                        const auto convertStartTime = std::chrono::steady_clock::now();
+
+                        try
+                        {
+                            Convert(*item, options);
+                        }
+                        catch (const std::exception& ex)
+                        {
+                            item->error = ex.what();
+                        }
+
+                        item->convertSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - convertStartTime).count();
+                    }
+
+                    writeQueue.Push(std::move(item));
+                }
+
+                if (--activeWorkers == 0)
+                {
+                    writeQueue.Close();
+                }
+            });
+        }
+
+        size_t convertedCount = 0;
+        size_t failedCount = 0;
+        uint64_t bytesWritten = 0;
+        double convertSeconds = 0.0;
+
+        std::unique_ptr<WorkItem> item;
+
+        while (writeQueue.Pop(item))
+        {
+            if (item->error.empty())
+            {
+                try
+                {
+                    fs::create_directories(item->outputPath.parent_path());
+                    WriteFileBytes(item->outputPath.string(), item->data.data(), item->data.size());
+
+                    bytesWritten += item->data.size();
+                }
+                catch (const std::exception& ex)
+                {
+                    item->error = ex.what();
+                }
+            }
+
+            if (item->error.empty())
+            {
+                convertedCount++;
+                convertSeconds += item->convertSeconds;
+            }
+            else
+            {
+                failedCount++;
+
+                std::lock_guard<std::mutex> lock(errorOutputMutex);
+                std::cerr << item->file->path.string() << ": " << item->error << std::endl;
+            }
+
+            item.reset();
+            limiter.Release();
+        }
+
+        reader.join();
+
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+
+        failedCount += readFailedCount;
+
+        const double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+        std::cout << std::fixed << std::setprecision(2)
+                  << "Converted " << convertedCount << " of " << files.size() << " images in " << wallSeconds << " s"
+                  << " with " << jobs << " job(s), " << (wallSeconds > 0.0 ? convertedCount / wallSeconds : 0.0) << " images/s.\n"
+                  << "Read " << bytesRead / 1048576.0 << " MiB, wrote " << bytesWritten / 1048576.0 << " MiB, "
+                  << convertSeconds << " s of conversion time.\n";
+
+        if (failedCount > 0)
+        {
+            std::cerr << failedCount << " image(s) could not be converted." << std::endl;
+            return 1;
+        }
+    }
+    catch (const std::invalid_argument& ex)
+    {
+        if (ex.what()[0] != '\0')
+        {
+            std::cerr << ex.what() << "\n\n";
+        }
+        PrintUsage();
+        return 1;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,429 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "ImageTranscode.h"
+#include "JxlDecoder.h"
+#include "JxlEncoder.h"
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string.h>
+
+namespace
+{
+    // The decoder and encoder callbacks do not have a user data parameter, so the
+    // state of each conversion is stored in thread local variables.
+
+    struct DecodeState
+    {
+        uint32_t width;
+        uint32_t height;
+        DecoderImageFormat format;
+        ImageChannelRepresentation channelFormat;
+        bool hasTransparency;
+        // The canvas uses floating point RGBA pixels in the range of 0 to 1, so the 16-bit samples keep
+        // their precision and the add and multiply blend modes can exceed 1 before the output is clamped.
+        // Gray images use the same value for the color channels.
+        std::vector<float> canvas;
+        std::string error;
+    };
+
+    struct EncodeOutput
+    {
+        std::vector<uint8_t> data;
+        size_t position;
+    };
+
+    thread_local DecodeState decodeState;
+    thread_local EncodeOutput encodeOutput;
+
+    constexpr int32_t ResultOk = 0;
+    constexpr int32_t ResultOutOfMemory = static_cast<int32_t>(0x8007000E);
+
+    float ReadChannel(const uint8_t* pixels, size_t index, ImageChannelRepresentation channelFormat)
+    {
+        if (channelFormat == ImageChannelRepresentation::Uint16)
+        {
+            uint16_t value;
+            memcpy(&value, pixels + (index * sizeof(uint16_t)), sizeof(value));
+
+            return value / 65535.0f;
+        }
+
+        return pixels[index] / 255.0f;
+    }
+
+    // Blends the layer pixel into the canvas with the JPEG XL blend mode of the layer. The decoder does not
+    // report the blend mode of the alpha channel, so the alpha uses the same operation as the color channels,
+    // except for the MulAdd mode that keeps the canvas alpha.
+    void BlendPixel(float* dst, const float (&src)[4], DecoderLayerBlendMode blendMode)
+    {
+        switch (blendMode)
+        {
+        case DecoderLayerBlendMode::Replace:
+            memcpy(dst, src, sizeof(src));
+            break;
+        case DecoderLayerBlendMode::Add:
+            for (int i = 0; i < 4; i++)
+            {
+                dst[i] += src[i];
+            }
+            break;
+        case DecoderLayerBlendMode::MulAdd:
+            for (int i = 0; i < 3; i++)
+            {
+                dst[i] += src[i] * src[3];
+            }
+            break;
+        case DecoderLayerBlendMode::Mul:
+            for (int i = 0; i < 4; i++)
+            {
+                dst[i] *= src[i];
+            }
+            break;
+        case DecoderLayerBlendMode::Blend:
+        default:
+        {
+            // The decoder output is not premultiplied, so the source over operator divides by the output alpha.
+            const float srcAlpha = src[3];
+            const float dstAlpha = dst[3] * (1.0f - srcAlpha);
+            const float outAlpha = srcAlpha + dstAlpha;
+
+            if (outAlpha <= 0.0f)
+            {
+                memset(dst, 0, sizeof(float) * 4);
+                break;
+            }
+
+            for (int i = 0; i < 3; i++)
+            {
+                dst[i] = ((src[i] * srcAlpha) + (dst[i] * dstAlpha)) / outAlpha;
+            }
+            dst[3] = outAlpha;
+            break;
+        }
+        }
+    }
+
+    uint16_t QuantizeSample(float value, uint32_t maxValue)
+    {
+        // NaN values are mapped to 0.
+        if (!(value > 0.0f))
+        {
+            return 0;
+        }
+
+        return value >= 1.0f ? static_cast<uint16_t>(maxValue) : static_cast<uint16_t>((value * maxValue) + 0.5f);
+    }
+
+    void __stdcall SetBasicInfo(
+        int32_t width,
+        int32_t height,
+        DecoderImageFormat format,
+        ImageChannelRepresentation channelFormat,
+        bool hasTransparency,
+        bool hasAnimation)
+    {
+        (void)hasAnimation;
+
+        decodeState.width = static_cast<uint32_t>(width);
+        decodeState.height = static_cast<uint32_t>(height);
+        decodeState.format = format;
+        decodeState.channelFormat = channelFormat;
+        decodeState.hasTransparency = hasTransparency;
+    }
+
+    bool __stdcall SetMetadata(uint8_t* data, size_t length)
+    {
+        (void)data;
+        (void)length;
+
+        // The PNM formats cannot store the color profile or the EXIF and XMP metadata.
+        return true;
+    }
+
+    bool __stdcall SetKnownColorProfile(KnownColorProfile profile)
+    {
+        (void)profile;
+
+        return true;
+    }
+
+    bool __stdcall SetLayerData(
+        uint8_t* pixels,
+        const DecoderLayerInfo* layerInfo,
+        char* name,
+        size_t nameLength)
+    {
+        (void)name;
+        (void)nameLength;
+
+        DecodeState& state = decodeState;
+
+        if (state.format == DecoderImageFormat::Cmyk)
+        {
+            state.error = "CMYK images are not supported.";
+            return false;
+        }
+
+        if (state.channelFormat != ImageChannelRepresentation::Uint8 && state.channelFormat != ImageChannelRepresentation::Uint16)
+        {
+            // The PNM formats only store integer samples, and cannot describe the transfer function of
+            // the floating point samples or the values outside of the 0 to 1 range.
+            state.error = "Floating point images are not supported.";
+            return false;
+        }
+
+        try
+        {
+            if (state.canvas.empty())
+            {
+                state.canvas.resize(static_cast<size_t>(state.width) * state.height * 4);
+            }
+        }
+        catch (const std::bad_alloc&)
+        {
+            return false;
+        }
+
+        const size_t colorChannelCount = state.format == DecoderImageFormat::Gray ? 1 : 3;
+        const size_t channelCount = colorChannelCount + (state.hasTransparency ? 1 : 0);
+
+        // Clip the layer to the canvas, the layer position may be negative.
+        const int64_t left = std::max<int64_t>(layerInfo->x, 0);
+        const int64_t top = std::max<int64_t>(layerInfo->y, 0);
+        const int64_t right = std::min<int64_t>(static_cast<int64_t>(layerInfo->x) + layerInfo->width, state.width);
+        const int64_t bottom = std::min<int64_t>(static_cast<int64_t>(layerInfo->y) + layerInfo->height, state.height);
+
+        for (int64_t y = top; y < bottom; y++)
+        {
+            const size_t layerRowStart = static_cast<size_t>(y - layerInfo->y) * static_cast<size_t>(layerInfo->width);
+            float* dst = state.canvas.data() + ((static_cast<size_t>(y) * state.width) + static_cast<size_t>(left)) * 4;
+
+            for (int64_t x = left; x < right; x++)
+            {
+                const size_t sourceIndex = (layerRowStart + static_cast<size_t>(x - layerInfo->x)) * channelCount;
+
+                float src[4];
+
+                for (size_t i = 0; i < 3; i++)
+                {
+                    src[i] = ReadChannel(pixels, sourceIndex + (colorChannelCount == 1 ? 0 : i), state.channelFormat);
+                }
+                src[3] = state.hasTransparency ? ReadChannel(pixels, sourceIndex + colorChannelCount, state.channelFormat) : 1.0f;
+
+                BlendPixel(dst, src, layerInfo->blendMode);
+                dst += 4;
+            }
+        }
+
+        return true;
+    }
+
+    int32_t __stdcall WriteOutput(const uint8_t* buffer, size_t sizeInBytes)
+    {
+        EncodeOutput& output = encodeOutput;
+
+        try
+        {
+            if (output.data.size() < output.position + sizeInBytes)
+            {
+                output.data.resize(output.position + sizeInBytes);
+            }
+        }
+        catch (const std::bad_alloc&)
+        {
+            return ResultOutOfMemory;
+        }
+
+        memcpy(output.data.data() + output.position, buffer, sizeInBytes);
+        output.position += sizeInBytes;
+
+        return ResultOk;
+    }
+
+    int32_t __stdcall SeekOutput(uint64_t position)
+    {
+        encodeOutput.position = static_cast<size_t>(position);
+
+        return ResultOk;
+    }
+
+    std::string GetErrorText(const ErrorInfo& errorInfo, const char* fallback, int32_t status)
+    {
+        if (errorInfo.errorMessage[0] != '\0')
+        {
+            return errorInfo.errorMessage;
+        }
+
+        return std::string(fallback) + ", status " + std::to_string(status) + '.';
+    }
+
+    std::vector<uint8_t> TakeEncodeOutput()
+    {
+        // The output is moved out of the thread local buffer, so it is not kept alive
+        // by the worker thread after the file has been written.
+        std::vector<uint8_t> data = std::move(encodeOutput.data);
+        data.resize(encodeOutput.position);
+
+        encodeOutput.data.clear();
+        encodeOutput.position = 0;
+
+        return data;
+    }
+}
+
+PnmImage ImageTranscode::DecodeJxl(const std::vector<uint8_t>& data)
+{
+    DecodeState& state = decodeState;
+    state = DecodeState{};
+
+    DecoderCallbacks callbacks{ SetBasicInfo, SetMetadata, SetKnownColorProfile, SetMetadata, SetMetadata, SetLayerData };
+    ErrorInfo errorInfo{};
+
+    // The metadata is not written to the PNM output, so the metadata boxes are skipped.
+    const DecoderStatus status = DecoderReadImage(
+        &callbacks,
+        data.data(),
+        data.size(),
+        DecoderMetadataFlags::None,
+        &errorInfo,
+        nullptr,
+        nullptr);
+
+    if (status != DecoderStatus::Ok)
+    {
+        if (!state.error.empty())
+        {
+            throw std::runtime_error(state.error);
+        }
+
+        throw std::runtime_error(GetErrorText(errorInfo, "DecoderReadImage failed", static_cast<int32_t>(status)));
+    }
+
+    if (state.canvas.empty())
+    {
+        throw std::runtime_error("The image does not have any layers.");
+    }
+
+    const size_t colorChannelCount = state.format == DecoderImageFormat::Gray ? 1 : 3;
+
+    PnmImage image{};
+    image.width = state.width;
+    image.height = state.height;
+    image.channelCount = static_cast<uint32_t>(colorChannelCount) + (state.hasTransparency ? 1 : 0);
+    image.maxValue = state.channelFormat == ImageChannelRepresentation::Uint16 ? 65535 : 255;
+
+    const size_t bytesPerSample = image.maxValue > 255 ? 2 : 1;
+    image.pixels.resize(static_cast<size_t>(image.width) * image.height * image.channelCount * bytesPerSample);
+
+    const float* src = state.canvas.data();
+    uint8_t* dst = image.pixels.data();
+
+    for (size_t i = 0, pixelCount = static_cast<size_t>(image.width) * image.height; i < pixelCount; i++)
+    {
+        for (uint32_t channel = 0; channel < image.channelCount; channel++)
+        {
+            // The alpha channel follows the color channels.
+            const size_t canvasChannel = channel < colorChannelCount ? channel : 3;
+            const uint16_t value = QuantizeSample(src[canvasChannel], image.maxValue);
+
+            if (bytesPerSample == 2)
+            {
+                *dst++ = static_cast<uint8_t>(value >> 8);
+            }
+            *dst++ = static_cast<uint8_t>(value);
+        }
+
+        src += 4;
+    }
+
+    // Release the canvas, the worker threads are reused for the other images.
+    state = DecodeState{};
+
+    return image;
+}
+
+std::vector<uint8_t> ImageTranscode::EncodeJxl(const PnmImage& image, float distance, int32_t effort)
+{
+    if (image.maxValue != 255 || image.channelCount < 1 || image.channelCount > 4)
+    {
+        throw std::runtime_error("Only 8-bit gray and RGB images, with an optional alpha channel, are supported.");
+    }
+
+    std::vector<ColorBgra> pixels(static_cast<size_t>(image.width) * image.height);
+
+    const uint8_t* src = image.pixels.data();
+    const bool hasAlpha = image.channelCount == 2 || image.channelCount == 4;
+
+    for (ColorBgra& dst : pixels)
+    {
+        if (image.channelCount <= 2)
+        {
+            dst.r = dst.g = dst.b = src[0];
+        }
+        else
+        {
+            dst.r = src[0];
+            dst.g = src[1];
+            dst.b = src[2];
+        }
+        dst.a = hasAlpha ? src[image.channelCount - 1] : 255;
+
+        src += image.channelCount;
+    }
+
+    const BitmapData bitmap
+    {
+        reinterpret_cast<uint8_t*>(pixels.data()),
+        image.width,
+        image.height,
+        image.width * static_cast<uint32_t>(sizeof(ColorBgra))
+    };
+
+    const EncoderOptions options{ distance, effort, distance == 0.0f, 0, 0 };
+    const EncoderImageMetadata metadata{};
+    IOCallbacks callbacks{ WriteOutput, SeekOutput };
+    ErrorInfo errorInfo{};
+
+    encodeOutput.position = 0;
+
+    const EncoderStatus status = EncoderWriteImage(&bitmap, &options, &metadata, &callbacks, &errorInfo, nullptr, nullptr, nullptr);
+
+    if (status != EncoderStatus::Ok)
+    {
+        TakeEncodeOutput();
+        throw std::runtime_error(GetErrorText(errorInfo, "EncoderWriteImage failed", static_cast<int32_t>(status)));
+    }
+
+    return TakeEncodeOutput();
+}
+
+std::vector<uint8_t> ImageTranscode::RecompressJpeg(const std::vector<uint8_t>& data, int32_t effort)
+{
+    const EncoderOptions options{ 0.0f, effort, true, 0, 0 };
+    IOCallbacks callbacks{ WriteOutput, SeekOutput };
+    ErrorInfo errorInfo{};
+
+    encodeOutput.position = 0;
+
+    const EncoderStatus status = EncoderRecompressJpeg(data.data(), data.size(), &options, &callbacks, &errorInfo, nullptr);
+
+    if (status != EncoderStatus::Ok)
+    {
+        TakeEncodeOutput();
+        throw std::runtime_error(GetErrorText(errorInfo, "EncoderRecompressJpeg failed", static_cast<int32_t>(status)));
+    }
+
+    return TakeEncodeOutput();
+}
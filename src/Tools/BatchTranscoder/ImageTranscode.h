@@ -0,0 +1,35 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "PnmImage.h"
+#include <stdint.h>
+#include <vector>
+
+// Converts between JPEG XL and the other formats with the plugin decoder and encoder.
+// The functions can be called from multiple threads at the same time.
+// Throws std::runtime_error if the conversion fails.
+namespace ImageTranscode
+{
+    // Decodes a JPEG XL image to an 8-bit or 16-bit gray or RGB image, with an alpha channel if the
+    // image has one. The layers are composited onto the image canvas, and the pixels are not converted
+    // from the color space of the image.
+    // CMYK and floating point images cannot be represented and are rejected.
+    PnmImage DecodeJxl(const std::vector<uint8_t>& data);
+
+    // The image must use 8-bit samples. A distance of 0 selects lossless encoding.
+    std::vector<uint8_t> EncodeJxl(const PnmImage& image, float distance, int32_t effort);
+
+    // Losslessly recompresses a JPEG image, the JPEG file can be reconstructed from the output.
+    std::vector<uint8_t> RecompressJpeg(const std::vector<uint8_t>& data, int32_t effort);
+}
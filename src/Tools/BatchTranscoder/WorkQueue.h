@@ -0,0 +1,78 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+// A queue that connects the stages of the transcoding pipeline.
+// Pop blocks until an item is available or the queue is closed and empty.
+template <typename T>
+class WorkQueue
+{
+public:
+    WorkQueue() : closed(false)
+    {
+    }
+
+    WorkQueue(const WorkQueue&) = delete;
+    WorkQueue& operator=(const WorkQueue&) = delete;
+
+    void Push(T item)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            items.push_back(std::move(item));
+        }
+
+        itemAvailable.notify_one();
+    }
+
+    bool Pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        itemAvailable.wait(lock, [this]() { return closed || !items.empty(); });
+
+        if (items.empty())
+        {
+            return false;
+        }
+
+        item = std::move(items.front());
+        items.pop_front();
+
+        return true;
+    }
+
+    // Wakes the waiting consumers after the producers have finished.
+    void Close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            closed = true;
+        }
+
+        itemAvailable.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable itemAvailable;
+    std::deque<T> items;
+    bool closed;
+};
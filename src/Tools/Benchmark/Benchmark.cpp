@@ -0,0 +1,832 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+// Measures the throughput, latency and memory usage of the plugin decoder and encoder.
+//
+// The benchmark calls DecoderReadImage and EncoderWriteImage directly with in-memory callbacks,
+// so the results do not include any Paint.NET or .NET interop overhead. The results are written
+// as JSON, which allows them to be compared between libjxl versions and plugin changes.
+
+#include "BenchmarkCorpus.h"
+#include "CommandLine.h"
+#include "JxlDecoder.h"
+#include "JxlEncoder.h"
+#include "ParallelRunner.h"
+#include "Tracing.h"
+#include "jxl/version.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        std::vector<uint32_t> sizes{ 512, 2048 };
+        std::vector<int32_t> efforts{ 3, 7 };
+        // A distance of 0 selects lossless encoding.
+        std::vector<float> distances{ 0.0f, 1.0f };
+        std::vector<uint32_t> threadCounts;
+        uint32_t iterations = 5;
+        uint32_t warmupIterations = 1;
+        bool decode = true;
+        bool encode = true;
+        bool synthetic = true;
+        std::string outputPath;
+        std::string tracePath;
+        ParallelRunnerType runnerType = ParallelRunnerType::Resizable;
+        ParallelRunnerThreadAffinity runnerAffinity = ParallelRunnerThreadAffinity::None;
+        std::vector<std::string> inputs;
+    };
+
+    struct CaseResult
+    {
+        std::string operation;
+        std::string imageName;
+        uint32_t width;
+        uint32_t height;
+        int32_t effort;
+        float distance;
+        uint32_t threadCount;
+        uint32_t operationCount;
+        double wallSeconds;
+        std::vector<double> latencyMilliseconds;
+        size_t encodedSize;
+        // The largest peak number of bytes that libjxl had allocated in a single operation.
+        uint64_t peakMemoryBytes;
+        std::string error;
+    };
+
+    // The decoder and encoder callbacks do not have a user data parameter, so the
+    // output of each benchmark thread is stored in thread local variables.
+
+    struct DecodeOutput
+    {
+        size_t bytesPerPixel;
+        std::vector<uint8_t> surface;
+        std::vector<uint8_t> metadata;
+    };
+
+    struct EncodeOutput
+    {
+        std::vector<uint8_t> data;
+        size_t position;
+    };
+
+    thread_local DecodeOutput decodeOutput;
+    thread_local EncodeOutput encodeOutput;
+
+    constexpr int32_t ResultOk = 0;
+    constexpr int32_t ResultOutOfMemory = static_cast<int32_t>(0x8007000E);
+
+    void __stdcall SetBasicInfo(
+        int32_t width,
+        int32_t height,
+        DecoderImageFormat format,
+        ImageChannelRepresentation channelFormat,
+        bool hasTransparency,
+        bool hasAnimation)
+    {
+        (void)width;
+        (void)height;
+        (void)hasAnimation;
+
+        size_t channelCount;
+
+        switch (format)
+        {
+        case DecoderImageFormat::Gray:
+            channelCount = 1;
+            break;
+        case DecoderImageFormat::Cmyk:
+            channelCount = 4;
+            break;
+        case DecoderImageFormat::Rgb:
+        default:
+            channelCount = 3;
+            break;
+        }
+
+        if (hasTransparency)
+        {
+            channelCount++;
+        }
+
+        size_t bytesPerChannel;
+
+        switch (channelFormat)
+        {
+        case ImageChannelRepresentation::Uint16:
+        case ImageChannelRepresentation::Float16:
+            bytesPerChannel = 2;
+            break;
+        case ImageChannelRepresentation::Float32:
+            bytesPerChannel = 4;
+            break;
+        case ImageChannelRepresentation::Uint8:
+        default:
+            bytesPerChannel = 1;
+            break;
+        }
+
+        decodeOutput.bytesPerPixel = channelCount * bytesPerChannel;
+    }
+
+    bool __stdcall SetMetadata(uint8_t* data, size_t length)
+    {
+        try
+        {
+            decodeOutput.metadata.assign(data, data + length);
+        }
+        catch (const std::bad_alloc&)
+        {
+            return false;
+        }
+
+        return true;
+    }
+
+    bool __stdcall SetKnownColorProfile(KnownColorProfile profile)
+    {
+        (void)profile;
+
+        return true;
+    }
+
+    bool __stdcall SetLayerData(
+        uint8_t* pixels,
+        const DecoderLayerInfo* layerInfo,
+        char* name,
+        size_t nameLength)
+    {
+        (void)name;
+        (void)nameLength;
+
+        // Copy the pixels in the same way that the plugin copies them to a Paint.NET surface.
+        const size_t size = static_cast<size_t>(layerInfo->width) * static_cast<size_t>(layerInfo->height) * decodeOutput.bytesPerPixel;
+
+        try
+        {
+            if (decodeOutput.surface.size() < size)
+            {
+                decodeOutput.surface.resize(size);
+            }
+        }
+        catch (const std::bad_alloc&)
+        {
+            return false;
+        }
+
+        memcpy(decodeOutput.surface.data(), pixels, size);
+
+        return true;
+    }
+
+    int32_t __stdcall WriteOutput(const uint8_t* buffer, size_t sizeInBytes)
+    {
+        EncodeOutput& output = encodeOutput;
+
+        try
+        {
+            if (output.data.size() < output.position + sizeInBytes)
+            {
+                output.data.resize(output.position + sizeInBytes);
+            }
+        }
+        catch (const std::bad_alloc&)
+        {
+            return ResultOutOfMemory;
+        }
+
+        memcpy(output.data.data() + output.position, buffer, sizeInBytes);
+        output.position += sizeInBytes;
+
+        return ResultOk;
+    }
+
+    int32_t __stdcall SeekOutput(uint64_t position)
+    {
+        encodeOutput.position = static_cast<size_t>(position);
+
+        return ResultOk;
+    }
+
+    void PrintUsage()
+    {
+        std::cout << "Usage: Benchmark [options] [.jxl, .ppm or .pgm images or directories]\n"
+                     "\n"
+                     "Options:\n"
+                     "  --sizes <list>           Comma separated synthetic image sizes, the default is 512,2048.\n"
+                     "  --efforts <list>         Comma separated effort values, the default is 3,7.\n"
+                     "  --distances <list>       Comma separated distance values, 0 is lossless. The default is 0,1.\n"
+                     "  --threads <list>         Comma separated numbers of images that are processed concurrently.\n"
+                     "                           The default is 1 and the number of hardware threads.\n"
+                     "  --iterations <n>         The number of timed operations per thread, the default is 5.\n"
+                     "  --warmup <n>             The number of untimed operations before each case, the default is 1.\n"
+                     "  --decode-only            Only run the decoder benchmarks.\n"
+                     "  --encode-only            Only run the encoder benchmarks.\n"
+                     "  --no-synthetic           Only use the images from the command line.\n"
+                     "  --output <path>          The JSON output file, the results are written to stdout if not set.\n"
+                     "  --trace <path>           Writes a Chrome trace event file of the plugin decoder and encoder,\n"
+                     "                           tracing adds overhead to the measured times.\n"
+                     "  --runner <name>          The plugin parallel runner, resizable (the default) or work-stealing.\n"
+                     "  --pin-threads            Pins the work-stealing runner threads to separate logical processors.\n"
+                     "\n"
+                     "JPEG XL images are added to the decoder corpus, e.g. for CMYK images that the synthetic\n"
+                     "corpus does not include. PGM and PPM images are added to the encoder corpus.\n";
+    }
+
+    Options ParseCommandLine(int argc, char** argv)
+    {
+        Options options;
+
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string arg = argv[i];
+            const bool hasValue = (i + 1) < argc;
+
+            if (arg == "--sizes" && hasValue)
+            {
+                options.sizes = ParseList<uint32_t>(argv[++i]);
+            }
+            else if (arg == "--efforts" && hasValue)
+            {
+                options.efforts = ParseList<int32_t>(argv[++i]);
+            }
+            else if (arg == "--distances" && hasValue)
+            {
+                options.distances = ParseList<float>(argv[++i]);
+            }
+            else if (arg == "--threads" && hasValue)
+            {
+                options.threadCounts = ParseList<uint32_t>(argv[++i]);
+            }
+            else if (arg == "--iterations" && hasValue)
+            {
+                options.iterations = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (arg == "--warmup" && hasValue)
+            {
+                options.warmupIterations = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (arg == "--decode-only")
+            {
+                options.encode = false;
+            }
+            else if (arg == "--encode-only")
+            {
+                options.decode = false;
+            }
+            else if (arg == "--no-synthetic")
+            {
+                options.synthetic = false;
+            }
+            else if (arg == "--output" && hasValue)
+            {
+                options.outputPath = argv[++i];
+            }
+            else if (arg == "--trace" && hasValue)
+            {
+                options.tracePath = argv[++i];
+            }
+            else if (arg == "--runner" && hasValue)
+            {
+                const std::string runner = argv[++i];
+
+                if (runner == "resizable")
+                {
+                    options.runnerType = ParallelRunnerType::Resizable;
+                }
+                else if (runner == "work-stealing")
+                {
+                    options.runnerType = ParallelRunnerType::WorkStealing;
+                }
+                else
+                {
+                    throw std::invalid_argument("Unknown parallel runner: " + runner);
+                }
+            }
+            else if (arg == "--pin-threads")
+            {
+                options.runnerAffinity = ParallelRunnerThreadAffinity::PinWorkerThreads;
+            }
+            else if (arg == "--help")
+            {
+                throw std::invalid_argument("");
+            }
+            else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0)
+            {
+                throw std::runtime_error("Unknown option: " + arg);
+            }
+            else
+            {
+                options.inputs.push_back(arg);
+            }
+        }
+
+        if (options.threadCounts.empty())
+        {
+            options.threadCounts.push_back(1);
+
+            const uint32_t hardwareThreads = std::thread::hardware_concurrency();
+
+            if (hardwareThreads > 1)
+            {
+                options.threadCounts.push_back(hardwareThreads);
+            }
+        }
+
+        if (options.iterations == 0
+            || std::find(options.threadCounts.begin(), options.threadCounts.end(), 0u) != options.threadCounts.end())
+        {
+            throw std::invalid_argument("The iteration and thread counts must be greater than zero.");
+        }
+
+        if (!options.synthetic && options.inputs.empty())
+        {
+            throw std::invalid_argument("The --no-synthetic option requires at least one input image.");
+        }
+
+        return options;
+    }
+
+    // Runs the operation on the specified number of threads, each thread performs the warmup
+    // operations and then waits for the other threads before the timed operations start.
+    // The operation returns an empty string on success or an error message on failure, and sets
+    // its parameter to the peak number of bytes that libjxl allocated during the operation.
+    template <typename Operation>
+    void RunConcurrently(uint32_t threadCount, const Options& options, Operation operation, CaseResult& result)
+    {
+        std::mutex mutex;
+        std::condition_variable condition;
+        uint32_t readyThreadCount = 0;
+        bool start = false;
+        std::vector<std::vector<double>> threadLatencies(threadCount);
+        std::vector<std::string> threadErrors(threadCount);
+        std::vector<uint64_t> threadPeakMemoryBytes(threadCount);
+
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount);
+
+        for (uint32_t i = 0; i < threadCount; i++)
+        {
+            threads.emplace_back([&, i]()
+            {
+                std::string error;
+                uint64_t peakMemoryBytes = 0;
+
+                for (uint32_t j = 0; j < options.warmupIterations && error.empty(); j++)
+                {
+                    error = operation(peakMemoryBytes);
+                }
+
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    readyThreadCount++;
+                    condition.notify_all();
+                    condition.wait(lock, [&]() { return start; });
+                }
+
+                std::vector<double>& latencies = threadLatencies[i];
+
+                for (uint32_t j = 0; j < options.iterations && error.empty(); j++)
+                {
+                    const auto operationStart = std::chrono::steady_clock::now();
+
+                    error = operation(peakMemoryBytes);
+
+                    latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - operationStart).count());
+
+                    threadPeakMemoryBytes[i] = std::max(threadPeakMemoryBytes[i], peakMemoryBytes);
+                }
+
+                threadErrors[i] = error;
+            });
+        }
+
+        std::chrono::steady_clock::time_point wallStart;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [&]() { return readyThreadCount == threadCount; });
+            start = true;
+            wallStart = std::chrono::steady_clock::now();
+        }
+        condition.notify_all();
+
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+
+        result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+        result.threadCount = threadCount;
+        result.peakMemoryBytes = 0;
+
+        for (uint32_t i = 0; i < threadCount; i++)
+        {
+            result.peakMemoryBytes = std::max(result.peakMemoryBytes, threadPeakMemoryBytes[i]);
+            result.latencyMilliseconds.insert(result.latencyMilliseconds.end(), threadLatencies[i].begin(), threadLatencies[i].end());
+
+            if (result.error.empty() && !threadErrors[i].empty())
+            {
+                result.error = threadErrors[i];
+            }
+        }
+
+        result.operationCount = static_cast<uint32_t>(result.latencyMilliseconds.size());
+    }
+
+    std::string GetErrorText(const ErrorInfo& errorInfo, const char* fallback, int32_t status)
+    {
+        if (errorInfo.errorMessage[0] != '\0')
+        {
+            return errorInfo.errorMessage;
+        }
+
+        return std::string(fallback) + ", status " + std::to_string(status) + '.';
+    }
+
+    CaseResult RunDecodeCase(const DecodeCorpusImage& image, uint32_t threadCount, const Options& options)
+    {
+        CaseResult result{ "decode", image.name, image.width, image.height, 0, 0.0f };
+        result.encodedSize = image.data.size();
+
+        RunConcurrently(threadCount, options, [&](uint64_t& peakMemoryBytes) -> std::string
+        {
+            DecoderCallbacks callbacks{ SetBasicInfo, SetMetadata, SetKnownColorProfile, SetMetadata, SetMetadata, SetLayerData };
+            ErrorInfo errorInfo{};
+            DecoderStats stats{};
+
+            const DecoderStatus status = DecoderReadImage(
+                &callbacks,
+                image.data.data(),
+                image.data.size(),
+                DecoderMetadataFlags::All,
+                &errorInfo,
+                nullptr,
+                &stats);
+
+            peakMemoryBytes = stats.peakMemoryBytes;
+
+            return status == DecoderStatus::Ok ? std::string() : GetErrorText(errorInfo, "DecoderReadImage failed", static_cast<int32_t>(status));
+        }, result);
+
+        return result;
+    }
+
+    CaseResult RunEncodeCase(
+        const EncodeCorpusImage& image,
+        int32_t effort,
+        float distance,
+        uint32_t threadCount,
+        const Options& options,
+        const EncoderImageMetadata& corpusMetadata)
+    {
+        CaseResult result{ "encode", image.name, image.width, image.height, effort, distance };
+
+        const EncoderOptions encoderOptions{ distance, effort, distance == 0.0f, 0, 0 };
+        const EncoderImageMetadata emptyMetadata{};
+        const EncoderImageMetadata* metadata = image.includeMetadata ? &corpusMetadata : &emptyMetadata;
+
+        std::mutex encodedSizeMutex;
+        size_t encodedSize = 0;
+
+        RunConcurrently(threadCount, options, [&](uint64_t& peakMemoryBytes) -> std::string
+        {
+            // The plugin does not modify the bitmap, but BitmapData uses a non-const pointer
+            // because the same structure is used for the decoder output.
+            const BitmapData bitmap
+            {
+                reinterpret_cast<uint8_t*>(const_cast<ColorBgra*>(image.pixels.data())),
+                image.width,
+                image.height,
+                image.width * static_cast<uint32_t>(sizeof(ColorBgra))
+            };
+
+            IOCallbacks callbacks{ WriteOutput, SeekOutput };
+            ErrorInfo errorInfo{};
+            EncoderStats stats{};
+
+            encodeOutput.position = 0;
+
+            const EncoderStatus status = EncoderWriteImage(&bitmap, &encoderOptions, metadata, &callbacks, &errorInfo, nullptr, nullptr, &stats);
+
+            peakMemoryBytes = stats.peakMemoryBytes;
+
+            if (status != EncoderStatus::Ok)
+            {
+                return GetErrorText(errorInfo, "EncoderWriteImage failed", static_cast<int32_t>(status));
+            }
+
+            std::lock_guard<std::mutex> lock(encodedSizeMutex);
+            encodedSize = encodeOutput.position;
+
+            return std::string();
+        }, result);
+
+        result.encodedSize = encodedSize;
+
+        return result;
+    }
+
+    double Percentile(const std::vector<double>& sortedValues, double percentile)
+    {
+        if (sortedValues.empty())
+        {
+            return 0.0;
+        }
+
+        // The nearest-rank method.
+        const size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0 * static_cast<double>(sortedValues.size())));
+
+        return sortedValues[std::clamp<size_t>(rank, 1, sortedValues.size()) - 1];
+    }
+
+    std::string EscapeJsonString(const std::string& value)
+    {
+        std::ostringstream stream;
+
+        for (const char c : value)
+        {
+            switch (c)
+            {
+            case '"':
+                stream << "\\\"";
+                break;
+            case '\\':
+                stream << "\\\\";
+                break;
+            case '\n':
+                stream << "\\n";
+                break;
+            case '\r':
+                stream << "\\r";
+                break;
+            case '\t':
+                stream << "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    stream << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+                }
+                else
+                {
+                    stream << c;
+                }
+                break;
+            }
+        }
+
+        return stream.str();
+    }
+
+    void WriteJson(std::ostream& stream, const Options& options, const std::vector<CaseResult>& results)
+    {
+        stream << std::fixed << std::setprecision(3);
+
+        stream << "{\n"
+               << "  \"libjxlVersion\": \"" << JPEGXL_MAJOR_VERSION << '.' << JPEGXL_MINOR_VERSION << '.' << JPEGXL_PATCH_VERSION << "\",\n"
+               << "  \"libjxlNumericVersion\": " << JPEGXL_NUMERIC_VERSION << ",\n"
+#ifdef NDEBUG
+               << "  \"configuration\": \"Release\",\n"
+#else
+               << "  \"configuration\": \"Debug\",\n"
+#endif
+               << "  \"hardwareThreads\": " << std::thread::hardware_concurrency() << ",\n"
+               << "  \"parallelRunnerType\": \""
+               << (options.runnerType == ParallelRunnerType::WorkStealing ? "work-stealing" : "resizable") << "\",\n"
+               << "  \"pinWorkerThreads\": "
+               << (options.runnerAffinity == ParallelRunnerThreadAffinity::PinWorkerThreads ? "true" : "false") << ",\n"
+               << "  \"results\": [";
+
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const CaseResult& result = results[i];
+
+            std::vector<double> latencies = result.latencyMilliseconds;
+            std::sort(latencies.begin(), latencies.end());
+
+            double totalLatency = 0.0;
+
+            for (const double latency : latencies)
+            {
+                totalLatency += latency;
+            }
+
+            const double megapixels = static_cast<double>(result.width) * result.height / 1000000.0;
+            const double megapixelsPerSecond = result.wallSeconds > 0.0 ? megapixels * result.operationCount / result.wallSeconds : 0.0;
+
+            stream << (i == 0 ? "\n" : ",\n")
+                   << "    {\n"
+                   << "      \"operation\": \"" << result.operation << "\",\n"
+                   << "      \"image\": \"" << EscapeJsonString(result.imageName) << "\",\n"
+                   << "      \"width\": " << result.width << ",\n"
+                   << "      \"height\": " << result.height << ",\n";
+
+            if (result.operation == "encode")
+            {
+                stream << "      \"effort\": " << result.effort << ",\n"
+                       << "      \"distance\": " << result.distance << ",\n";
+            }
+
+            stream << "      \"threads\": " << result.threadCount << ",\n"
+                   << "      \"operations\": " << result.operationCount << ",\n"
+                   << "      \"megapixelsPerSecond\": " << megapixelsPerSecond << ",\n"
+                   << "      \"latencyMilliseconds\": {"
+                   << " \"min\": " << (latencies.empty() ? 0.0 : latencies.front())
+                   << ", \"mean\": " << (latencies.empty() ? 0.0 : totalLatency / latencies.size())
+                   << ", \"p50\": " << Percentile(latencies, 50.0)
+                   << ", \"p90\": " << Percentile(latencies, 90.0)
+                   << ", \"p99\": " << Percentile(latencies, 99.0)
+                   << ", \"max\": " << (latencies.empty() ? 0.0 : latencies.back())
+                   << " },\n"
+                   << "      \"encodedBytes\": " << result.encodedSize << ",\n"
+                   << "      \"peakMemoryBytes\": " << result.peakMemoryBytes;
+
+            if (!result.error.empty())
+            {
+                stream << ",\n      \"error\": \"" << EscapeJsonString(result.error) << '"';
+            }
+
+            stream << "\n    }";
+        }
+
+        std::vector<ParallelRunnerStats> runnerStats(ParallelRunnerStatistics::Get(nullptr, 0));
+        runnerStats.resize(ParallelRunnerStatistics::Get(runnerStats.data(), static_cast<uint32_t>(runnerStats.size())));
+
+        stream << "\n  ],\n"
+               << "  \"parallelRunner\": [";
+
+        for (size_t i = 0; i < runnerStats.size(); i++)
+        {
+            const ParallelRunnerStats& entry = runnerStats[i];
+
+            // The busy fraction shows how much of the runner thread time was spent running tasks.
+            const double threadTime = static_cast<double>(entry.wallTime) * entry.threadCount;
+            const double busyFraction = threadTime > 0.0 ? entry.busyTime / threadTime : 0.0;
+
+            stream << (i == 0 ? "\n" : ",\n")
+                   << "    {"
+                   << " \"threads\": " << entry.threadCount
+                   << ", \"imageSizeLog2\": " << entry.imageSizeLog2
+                   << ", \"runs\": " << entry.runCount
+                   << ", \"tasks\": " << entry.taskCount
+                   << ", \"wallMilliseconds\": " << entry.wallTime / 1000000.0
+                   << ", \"busyMilliseconds\": " << entry.busyTime / 1000000.0
+                   << ", \"idleMilliseconds\": " << entry.idleTime / 1000000.0
+                   << ", \"busiestThreadMilliseconds\": " << entry.busiestThreadTime / 1000000.0
+                   << ", \"longestTaskMilliseconds\": " << entry.longestTaskTime / 1000000.0
+                   << ", \"busyFraction\": " << busyFraction
+                   << " }";
+        }
+
+        stream << "\n  ]\n}\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        const Options options = ParseCommandLine(argc, argv);
+
+        std::vector<CaseResult> results;
+
+        ParallelRunnerOptions::Set(options.runnerType, options.runnerAffinity);
+        ParallelRunnerStatistics::SetEnabled(true);
+
+        if (!options.tracePath.empty())
+        {
+            Tracing::Start();
+        }
+
+        if (options.decode)
+        {
+            std::vector<DecodeCorpusImage> corpus;
+
+            if (options.synthetic)
+            {
+                corpus = CreateSyntheticDecodeCorpus(options.sizes);
+            }
+
+            for (DecodeCorpusImage& image : LoadDecodeCorpusFiles(options.inputs))
+            {
+                corpus.push_back(std::move(image));
+            }
+
+            for (const DecodeCorpusImage& image : corpus)
+            {
+                for (const uint32_t threadCount : options.threadCounts)
+                {
+                    std::cerr << "decode " << image.name << ", " << threadCount << " thread(s)" << std::endl;
+
+                    results.push_back(RunDecodeCase(image, threadCount, options));
+                }
+            }
+        }
+
+        if (options.encode)
+        {
+            std::vector<EncodeCorpusImage> corpus;
+
+            if (options.synthetic)
+            {
+                corpus = CreateSyntheticEncodeCorpus(options.sizes);
+            }
+
+            for (EncodeCorpusImage& image : LoadEncodeCorpusFiles(options.inputs))
+            {
+                corpus.push_back(std::move(image));
+            }
+
+            std::vector<uint8_t> exif = GetSyntheticExif();
+            std::vector<uint8_t> xmp = GetSyntheticXmp();
+
+            const EncoderImageMetadata metadata{ exif.data(), exif.size(), nullptr, 0, xmp.data(), xmp.size() };
+
+            for (const EncodeCorpusImage& image : corpus)
+            {
+                for (const int32_t effort : options.efforts)
+                {
+                    for (const float distance : options.distances)
+                    {
+                        for (const uint32_t threadCount : options.threadCounts)
+                        {
+                            std::cerr << "encode " << image.name << ", effort " << effort << ", distance " << distance
+                                      << ", " << threadCount << " thread(s)" << std::endl;
+
+                            results.push_back(RunEncodeCase(image, effort, distance, threadCount, options, metadata));
+                        }
+                    }
+                }
+            }
+        }
+
+        if (!options.tracePath.empty())
+        {
+            std::ofstream traceStream(options.tracePath, std::ios::binary);
+
+            if (!traceStream)
+            {
+                throw std::runtime_error("Failed to create the trace file: " + options.tracePath);
+            }
+
+            traceStream << Tracing::Stop();
+        }
+
+        if (options.outputPath.empty())
+        {
+            WriteJson(std::cout, options, results);
+        }
+        else
+        {
+            std::ofstream stream(options.outputPath);
+
+            if (!stream)
+            {
+                throw std::runtime_error("Failed to create the output file: " + options.outputPath);
+            }
+
+            WriteJson(stream, options, results);
+        }
+    }
+    catch (const std::invalid_argument& ex)
+    {
+        if (ex.what()[0] != '\0')
+        {
+            std::cerr << ex.what() << "\n\n";
+        }
+        PrintUsage();
+        return 1;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,488 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "BenchmarkCorpus.h"
+#include "PnmImage.h"
+#include "jxl/decode_cxx.h"
+#include "jxl/encode_cxx.h"
+#include "jxl/resizable_parallel_runner_cxx.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <stdexcept>
+#include <string.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    struct SyntheticFormat
+    {
+        const char* name;
+        uint32_t colorChannelCount;
+        bool hasAlpha;
+        JxlDataType dataType;
+        bool addBoxes;
+    };
+
+    // The synthetic images combine smooth gradients with a small amount of noise, this gives
+    // the encoder a mix of flat and detailed areas that is closer to a photograph than a
+    // solid color or pure noise.
+    float GetSyntheticSample(uint32_t x, uint32_t y, uint32_t channel, uint32_t width, uint32_t height)
+    {
+        const float u = static_cast<float>(x) / static_cast<float>(width);
+        const float v = static_cast<float>(y) / static_cast<float>(height);
+
+        float value;
+
+        switch (channel)
+        {
+        case 0:
+            value = u;
+            break;
+        case 1:
+            value = v;
+            break;
+        case 2:
+            value = 0.5f + 0.5f * std::sin((u + v) * 12.0f);
+            break;
+        default:
+            // The alpha channel is opaque in the top half of the image and fades out in the bottom half.
+            value = v < 0.5f ? 1.0f : 2.0f - (2.0f * v);
+            return value;
+        }
+
+        uint32_t hash = (x * 73856093u) ^ (y * 19349663u) ^ (channel * 83492791u);
+        hash ^= hash >> 13;
+        hash *= 0x5bd1e995u;
+        hash ^= hash >> 15;
+
+        const float noise = (static_cast<float>(hash & 0xff) / 255.0f - 0.5f) * 0.08f;
+
+        return std::clamp(value + noise, 0.0f, 1.0f);
+    }
+
+    std::vector<uint8_t> CreateSyntheticPixels(
+        uint32_t width,
+        uint32_t height,
+        uint32_t channelCount,
+        JxlDataType dataType)
+    {
+        const size_t sampleCount = static_cast<size_t>(width) * height * channelCount;
+        size_t bytesPerSample;
+
+        switch (dataType)
+        {
+        case JXL_TYPE_UINT8:
+            bytesPerSample = 1;
+            break;
+        case JXL_TYPE_UINT16:
+            bytesPerSample = 2;
+            break;
+        case JXL_TYPE_FLOAT:
+            bytesPerSample = 4;
+            break;
+        default:
+            throw std::runtime_error("Unsupported synthetic image data type.");
+        }
+
+        std::vector<uint8_t> pixels(sampleCount * bytesPerSample);
+        size_t index = 0;
+
+        for (uint32_t y = 0; y < height; y++)
+        {
+            for (uint32_t x = 0; x < width; x++)
+            {
+                for (uint32_t c = 0; c < channelCount; c++)
+                {
+                    // Gray images use the first color sample, the last channel is alpha
+                    // when the image has 2 or 4 channels.
+                    const bool isAlpha = (channelCount == 2 || channelCount == 4) && c == channelCount - 1;
+                    const float sample = GetSyntheticSample(x, y, isAlpha ? 3 : c, width, height);
+
+                    switch (dataType)
+                    {
+                    case JXL_TYPE_UINT8:
+                        pixels[index] = static_cast<uint8_t>(std::lround(sample * 255.0f));
+                        break;
+                    case JXL_TYPE_UINT16:
+                    {
+                        const uint16_t value = static_cast<uint16_t>(std::lround(sample * 65535.0f));
+                        memcpy(&pixels[index * 2], &value, sizeof(value));
+                        break;
+                    }
+                    case JXL_TYPE_FLOAT:
+                        memcpy(&pixels[index * 4], &sample, sizeof(sample));
+                        break;
+                    default:
+                        break;
+                    }
+
+                    index++;
+                }
+            }
+        }
+
+        return pixels;
+    }
+
+    std::vector<uint8_t> CreateSyntheticExif()
+    {
+        // The JPEG XL Exif box starts with the offset of the TIFF header, followed by
+        // a little-endian TIFF header and an empty IFD.
+        return std::vector<uint8_t>
+        {
+            0, 0, 0, 0,
+            'I', 'I', 0x2a, 0, 8, 0, 0, 0,
+            0, 0,
+            0, 0, 0, 0
+        };
+    }
+
+    std::vector<uint8_t> CreateSyntheticXmp()
+    {
+        const char packet[] =
+            "<?xpacket begin=\"\xEF\xBB\xBF\" id=\"W5M0MpCehiHzreSzNTczkc9d\"?>"
+            "<x:xmpmeta xmlns:x=\"adobe:ns:meta/\">"
+            "<rdf:RDF xmlns:rdf=\"http://www.w3.org/1999/02/22-rdf-syntax-ns#\">"
+            "<rdf:Description rdf:about=\"\" xmlns:xmp=\"http://ns.adobe.com/xap/1.0/\" xmp:CreatorTool=\"pdn-jpegxl benchmark\"/>"
+            "</rdf:RDF>"
+            "</x:xmpmeta>"
+            "<?xpacket end=\"w\"?>";
+
+        return std::vector<uint8_t>(packet, packet + sizeof(packet) - 1);
+    }
+
+    std::vector<uint8_t> EncodeSyntheticImage(uint32_t width, uint32_t height, const SyntheticFormat& format)
+    {
+        auto runner = JxlResizableParallelRunnerMake(nullptr);
+
+        JxlResizableParallelRunnerSetThreads(
+            runner.get(),
+            JxlResizableParallelRunnerSuggestThreads(width, height));
+
+        auto enc = JxlEncoderMake(nullptr);
+
+        if (JxlEncoderSetParallelRunner(enc.get(), JxlResizableParallelRunner, runner.get()) != JXL_ENC_SUCCESS)
+        {
+            throw std::runtime_error("JxlEncoderSetParallelRunner failed.");
+        }
+
+        const bool isFloat = format.dataType == JXL_TYPE_FLOAT;
+        const uint32_t bitsPerSample = format.dataType == JXL_TYPE_UINT8 ? 8 : format.dataType == JXL_TYPE_UINT16 ? 16 : 32;
+
+        JxlBasicInfo basicInfo;
+        JxlEncoderInitBasicInfo(&basicInfo);
+
+        basicInfo.xsize = width;
+        basicInfo.ysize = height;
+        basicInfo.bits_per_sample = bitsPerSample;
+        basicInfo.exponent_bits_per_sample = isFloat ? 8 : 0;
+        basicInfo.num_color_channels = format.colorChannelCount;
+
+        if (format.hasAlpha)
+        {
+            basicInfo.num_extra_channels = 1;
+            basicInfo.alpha_bits = bitsPerSample;
+            basicInfo.alpha_exponent_bits = basicInfo.exponent_bits_per_sample;
+        }
+
+        if (JxlEncoderSetBasicInfo(enc.get(), &basicInfo) != JXL_ENC_SUCCESS)
+        {
+            throw std::runtime_error("JxlEncoderSetBasicInfo failed.");
+        }
+
+        JxlColorEncoding colorEncoding{};
+
+        if (isFloat)
+        {
+            JxlColorEncodingSetToLinearSRGB(&colorEncoding, format.colorChannelCount == 1);
+        }
+        else
+        {
+            JxlColorEncodingSetToSRGB(&colorEncoding, format.colorChannelCount == 1);
+        }
+
+        if (JxlEncoderSetColorEncoding(enc.get(), &colorEncoding) != JXL_ENC_SUCCESS)
+        {
+            throw std::runtime_error("JxlEncoderSetColorEncoding failed.");
+        }
+
+        if (format.addBoxes)
+        {
+            const std::vector<uint8_t>& exif = GetSyntheticExif();
+            const std::vector<uint8_t>& xmp = GetSyntheticXmp();
+
+            if (JxlEncoderUseBoxes(enc.get()) != JXL_ENC_SUCCESS
+                || JxlEncoderAddBox(enc.get(), "Exif", exif.data(), exif.size(), JXL_FALSE) != JXL_ENC_SUCCESS
+                || JxlEncoderAddBox(enc.get(), "xml ", xmp.data(), xmp.size(), JXL_FALSE) != JXL_ENC_SUCCESS)
+            {
+                throw std::runtime_error("Failed to add the metadata boxes.");
+            }
+
+            JxlEncoderCloseBoxes(enc.get());
+        }
+
+        JxlEncoderFrameSettings* frameSettings = JxlEncoderFrameSettingsCreate(enc.get(), nullptr);
+
+        if (JxlEncoderSetFrameDistance(frameSettings, 1.0f) != JXL_ENC_SUCCESS)
+        {
+            throw std::runtime_error("JxlEncoderSetFrameDistance failed.");
+        }
+
+        const uint32_t channelCount = format.colorChannelCount + (format.hasAlpha ? 1 : 0);
+        const std::vector<uint8_t> pixels = CreateSyntheticPixels(width, height, channelCount, format.dataType);
+        const JxlPixelFormat pixelFormat{ channelCount, format.dataType, JXL_NATIVE_ENDIAN, 0 };
+
+        if (JxlEncoderAddImageFrame(frameSettings, &pixelFormat, pixels.data(), pixels.size()) != JXL_ENC_SUCCESS)
+        {
+            throw std::runtime_error("JxlEncoderAddImageFrame failed.");
+        }
+
+        JxlEncoderCloseInput(enc.get());
+
+        std::vector<uint8_t> output(65536);
+        uint8_t* nextOut = output.data();
+        size_t availableOut = output.size();
+
+        JxlEncoderStatus status;
+
+        while ((status = JxlEncoderProcessOutput(enc.get(), &nextOut, &availableOut)) == JXL_ENC_NEED_MORE_OUTPUT)
+        {
+            const size_t offset = static_cast<size_t>(nextOut - output.data());
+
+            output.resize(output.size() * 2);
+            nextOut = output.data() + offset;
+            availableOut = output.size() - offset;
+        }
+
+        if (status != JXL_ENC_SUCCESS)
+        {
+            throw std::runtime_error("JxlEncoderProcessOutput failed.");
+        }
+
+        output.resize(static_cast<size_t>(nextOut - output.data()));
+
+        return output;
+    }
+
+    EncodeCorpusImage CreateSyntheticBgraImage(
+        const std::string& name,
+        uint32_t width,
+        uint32_t height,
+        bool isGray,
+        bool hasTransparency,
+        bool includeMetadata)
+    {
+        EncodeCorpusImage image{ name, width, height, {}, includeMetadata };
+        image.pixels.resize(static_cast<size_t>(width) * height);
+
+        ColorBgra* dst = image.pixels.data();
+
+        for (uint32_t y = 0; y < height; y++)
+        {
+            for (uint32_t x = 0; x < width; x++)
+            {
+                const uint8_t r = static_cast<uint8_t>(std::lround(GetSyntheticSample(x, y, 0, width, height) * 255.0f));
+
+                dst->r = r;
+                dst->g = isGray ? r : static_cast<uint8_t>(std::lround(GetSyntheticSample(x, y, 1, width, height) * 255.0f));
+                dst->b = isGray ? r : static_cast<uint8_t>(std::lround(GetSyntheticSample(x, y, 2, width, height) * 255.0f));
+                dst->a = hasTransparency ? static_cast<uint8_t>(std::lround(GetSyntheticSample(x, y, 3, width, height) * 255.0f)) : 255;
+                dst++;
+            }
+        }
+
+        return image;
+    }
+
+    std::string FormatSizeName(const char* name, uint32_t size)
+    {
+        return std::string(name) + '_' + std::to_string(size);
+    }
+
+    std::vector<fs::path> EnumerateFiles(
+        const std::vector<std::string>& inputs,
+        bool (*isMatchingFile)(const fs::path&))
+    {
+        std::vector<fs::path> files;
+
+        for (const std::string& input : inputs)
+        {
+            if (fs::is_directory(input))
+            {
+                for (const fs::directory_entry& entry : fs::recursive_directory_iterator(input))
+                {
+                    if (entry.is_regular_file() && isMatchingFile(entry.path()))
+                    {
+                        files.push_back(entry.path());
+                    }
+                }
+            }
+            else if (isMatchingFile(input))
+            {
+                files.push_back(input);
+            }
+        }
+
+        std::sort(files.begin(), files.end());
+
+        return files;
+    }
+
+    bool IsJxlFile(const fs::path& path)
+    {
+        return path.extension() == ".jxl";
+    }
+
+    bool IsPnmFile(const fs::path& path)
+    {
+        const std::string extension = path.extension().string();
+
+        return extension == ".ppm" || extension == ".pgm" || extension == ".pnm";
+    }
+
+    bool TryGetJxlImageSize(const std::vector<uint8_t>& data, uint32_t& width, uint32_t& height)
+    {
+        auto dec = JxlDecoderMake(nullptr);
+
+        if (!dec
+            || JxlDecoderSubscribeEvents(dec.get(), JXL_DEC_BASIC_INFO) != JXL_DEC_SUCCESS
+            || JxlDecoderSetInput(dec.get(), data.data(), data.size()) != JXL_DEC_SUCCESS)
+        {
+            return false;
+        }
+
+        JxlDecoderCloseInput(dec.get());
+
+        JxlBasicInfo basicInfo;
+
+        if (JxlDecoderProcessInput(dec.get()) != JXL_DEC_BASIC_INFO
+            || JxlDecoderGetBasicInfo(dec.get(), &basicInfo) != JXL_DEC_SUCCESS)
+        {
+            return false;
+        }
+
+        width = basicInfo.xsize;
+        height = basicInfo.ysize;
+
+        return true;
+    }
+}
+
+const std::vector<uint8_t>& GetSyntheticExif()
+{
+    static const std::vector<uint8_t> exif = CreateSyntheticExif();
+
+    return exif;
+}
+
+const std::vector<uint8_t>& GetSyntheticXmp()
+{
+    static const std::vector<uint8_t> xmp = CreateSyntheticXmp();
+
+    return xmp;
+}
+
+std::vector<DecodeCorpusImage> CreateSyntheticDecodeCorpus(const std::vector<uint32_t>& sizes)
+{
+    static const SyntheticFormat formats[] =
+    {
+        { "gray8", 1, false, JXL_TYPE_UINT8, false },
+        { "rgba8", 3, true, JXL_TYPE_UINT8, false },
+        { "rgb16", 3, false, JXL_TYPE_UINT16, false },
+        { "rgba32f", 3, true, JXL_TYPE_FLOAT, false },
+        { "rgb8_boxes", 3, false, JXL_TYPE_UINT8, true },
+    };
+
+    std::vector<DecodeCorpusImage> corpus;
+
+    for (uint32_t size : sizes)
+    {
+        for (const SyntheticFormat& format : formats)
+        {
+            corpus.push_back({ FormatSizeName(format.name, size), size, size, EncodeSyntheticImage(size, size, format) });
+        }
+    }
+
+    return corpus;
+}
+
+std::vector<EncodeCorpusImage> CreateSyntheticEncodeCorpus(const std::vector<uint32_t>& sizes)
+{
+    std::vector<EncodeCorpusImage> corpus;
+
+    for (uint32_t size : sizes)
+    {
+        corpus.push_back(CreateSyntheticBgraImage(FormatSizeName("gray", size), size, size, true, false, false));
+        corpus.push_back(CreateSyntheticBgraImage(FormatSizeName("rgb", size), size, size, false, false, false));
+        corpus.push_back(CreateSyntheticBgraImage(FormatSizeName("rgba", size), size, size, false, true, false));
+        corpus.push_back(CreateSyntheticBgraImage(FormatSizeName("rgb_metadata", size), size, size, false, false, true));
+    }
+
+    return corpus;
+}
+
+std::vector<DecodeCorpusImage> LoadDecodeCorpusFiles(const std::vector<std::string>& inputs)
+{
+    std::vector<DecodeCorpusImage> corpus;
+
+    for (const fs::path& path : EnumerateFiles(inputs, IsJxlFile))
+    {
+        DecodeCorpusImage image{ path.filename().string(), 0, 0, ReadFileBytes(path.string()) };
+
+        if (!TryGetJxlImageSize(image.data, image.width, image.height))
+        {
+            throw std::runtime_error("Failed to read the image header: " + path.string());
+        }
+
+        corpus.push_back(std::move(image));
+    }
+
+    return corpus;
+}
+
+std::vector<EncodeCorpusImage> LoadEncodeCorpusFiles(const std::vector<std::string>& inputs)
+{
+    std::vector<EncodeCorpusImage> corpus;
+
+    for (const fs::path& path : EnumerateFiles(inputs, IsPnmFile))
+    {
+        const PnmImage pnm = ReadPnmImage(path.string());
+
+        EncodeCorpusImage image{ path.filename().string(), pnm.width, pnm.height, {}, false };
+        image.pixels.resize(static_cast<size_t>(pnm.width) * pnm.height);
+
+        const uint8_t* src = pnm.pixels.data();
+
+        for (ColorBgra& dst : image.pixels)
+        {
+            if (pnm.channelCount == 1)
+            {
+                dst.r = dst.g = dst.b = src[0];
+            }
+            else
+            {
+                dst.r = src[0];
+                dst.g = src[1];
+                dst.b = src[2];
+            }
+
+            dst.a = 255;
+            src += pnm.channelCount;
+        }
+
+        corpus.push_back(std::move(image));
+    }
+
+    return corpus;
+}
@@ -0,0 +1,61 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// An encoded image that is used for the decoder benchmarks.
+struct DecodeCorpusImage
+{
+    std::string name;
+    uint32_t width;
+    uint32_t height;
+    std::vector<uint8_t> data;
+};
+
+// A BGRA image that is used for the encoder benchmarks, in the format that
+// Paint.NET passes to the SaveImage export.
+struct EncodeCorpusImage
+{
+    std::string name;
+    uint32_t width;
+    uint32_t height;
+    std::vector<ColorBgra> pixels;
+    bool includeMetadata;
+};
+
+// Creates the synthetic decoder corpus, every size is encoded as 8-bit gray, 8-bit RGBA,
+// 16-bit RGB, 32-bit floating point RGBA and 8-bit RGB with Exif and XMP boxes.
+// Throws std::runtime_error if an image cannot be encoded.
+std::vector<DecodeCorpusImage> CreateSyntheticDecodeCorpus(const std::vector<uint32_t>& sizes);
+
+// Creates the synthetic encoder corpus, every size is included as an opaque gray image,
+// an opaque color image, a color image with transparency and an opaque color image with
+// Exif and XMP metadata.
+std::vector<EncodeCorpusImage> CreateSyntheticEncodeCorpus(const std::vector<uint32_t>& sizes);
+
+// Loads the JPEG XL images from the specified files or directories, this is used for
+// formats that the synthetic corpus does not cover, e.g. CMYK images.
+// Throws std::runtime_error if a file cannot be read.
+std::vector<DecodeCorpusImage> LoadDecodeCorpusFiles(const std::vector<std::string>& inputs);
+
+// Loads the PGM and PPM images from the specified files or directories.
+// Throws std::runtime_error if a file cannot be read.
+std::vector<EncodeCorpusImage> LoadEncodeCorpusFiles(const std::vector<std::string>& inputs);
+
+// Returns the Exif and XMP payloads that are used for the images with metadata.
+const std::vector<uint8_t>& GetSyntheticExif();
+const std::vector<uint8_t>& GetSyntheticXmp();
@@ -0,0 +1,43 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Parses a comma separated list of values, e.g. "1,3,7".
+// Throws std::runtime_error if a value cannot be parsed.
+template <typename T>
+std::vector<T> ParseList(const std::string& value)
+{
+    std::vector<T> items;
+    std::stringstream stream(value);
+    std::string item;
+
+    while (std::getline(stream, item, ','))
+    {
+        std::stringstream itemStream(item);
+        T parsed;
+
+        if (!(itemStream >> parsed))
+        {
+            throw std::runtime_error("Invalid list value: " + value);
+        }
+
+        items.push_back(parsed);
+    }
+
+    return items;
+}
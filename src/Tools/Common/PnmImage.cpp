@@ -0,0 +1,178 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "PnmImage.h"
+#include <ctype.h>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace
+{
+    uint32_t ReadHeaderValue(const std::vector<uint8_t>& data, size_t& offset)
+    {
+        // Skip the white space and comments before the value.
+        while (offset < data.size())
+        {
+            if (data[offset] == '#')
+            {
+                while (offset < data.size() && data[offset] != '\n')
+                {
+                    offset++;
+                }
+            }
+            else if (isspace(data[offset]))
+            {
+                offset++;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        uint64_t value = 0;
+        size_t digitCount = 0;
+
+        while (offset < data.size() && isdigit(data[offset]))
+        {
+            value = (value * 10) + (data[offset] - '0');
+            offset++;
+            digitCount++;
+
+            if (value > UINT32_MAX)
+            {
+                throw std::runtime_error("The PNM header value is too large.");
+            }
+        }
+
+        if (digitCount == 0)
+        {
+            throw std::runtime_error("The PNM header is invalid.");
+        }
+
+        return static_cast<uint32_t>(value);
+    }
+}
+
+PnmImage ReadPnmImage(const std::string& path)
+{
+    return DecodePnmImage(ReadFileBytes(path), path);
+}
+
+PnmImage DecodePnmImage(const std::vector<uint8_t>& data, const std::string& name)
+{
+    if (data.size() < 2 || data[0] != 'P' || (data[1] != '5' && data[1] != '6'))
+    {
+        throw std::runtime_error("Only binary PGM and PPM images are supported: " + name);
+    }
+
+    size_t offset = 2;
+
+    PnmImage image{};
+    image.channelCount = data[1] == '5' ? 1 : 3;
+    image.width = ReadHeaderValue(data, offset);
+    image.height = ReadHeaderValue(data, offset);
+    image.maxValue = ReadHeaderValue(data, offset);
+
+    if (image.maxValue != 255)
+    {
+        throw std::runtime_error("Only 8-bit PNM images are supported: " + name);
+    }
+
+    // A single white space character separates the header from the image data.
+    offset++;
+
+    const size_t imageDataSize = static_cast<size_t>(image.width) * image.height * image.channelCount;
+
+    if (image.width == 0 || image.height == 0 || data.size() < offset || (data.size() - offset) < imageDataSize)
+    {
+        throw std::runtime_error("The PNM image data is truncated: " + name);
+    }
+
+    image.pixels.assign(data.begin() + offset, data.begin() + offset + imageDataSize);
+
+    return image;
+}
+
+void WritePnmImage(const std::string& path, const PnmImage& image)
+{
+    const std::vector<uint8_t> data = EncodePnmImage(image);
+
+    WriteFileBytes(path, data.data(), data.size());
+}
+
+std::vector<uint8_t> EncodePnmImage(const PnmImage& image)
+{
+    std::string header;
+
+    switch (image.channelCount)
+    {
+    case 1:
+    case 3:
+        header = std::string(image.channelCount == 1 ? "P5\n" : "P6\n")
+            + std::to_string(image.width) + " " + std::to_string(image.height) + "\n"
+            + std::to_string(image.maxValue) + "\n";
+        break;
+    case 2:
+    case 4:
+        header = "P7\nWIDTH " + std::to_string(image.width)
+            + "\nHEIGHT " + std::to_string(image.height)
+            + "\nDEPTH " + std::to_string(image.channelCount)
+            + "\nMAXVAL " + std::to_string(image.maxValue)
+            + (image.channelCount == 2 ? "\nTUPLTYPE GRAYSCALE_ALPHA" : "\nTUPLTYPE RGB_ALPHA")
+            + "\nENDHDR\n";
+        break;
+    default:
+        throw std::runtime_error("The PNM image has an unsupported channel count.");
+    }
+
+    std::vector<uint8_t> data(header.begin(), header.end());
+    data.insert(data.end(), image.pixels.begin(), image.pixels.end());
+
+    return data;
+}
+
+const char* GetPnmFileExtension(const PnmImage& image)
+{
+    switch (image.channelCount)
+    {
+    case 1:
+        return ".pgm";
+    case 3:
+        return ".ppm";
+    default:
+        return ".pam";
+    }
+}
+
+std::vector<uint8_t> ReadFileBytes(const std::string& path)
+{
+    std::ifstream stream(path, std::ios::binary);
+
+    if (!stream)
+    {
+        throw std::runtime_error("Unable to open the file: " + path);
+    }
+
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+void WriteFileBytes(const std::string& path, const uint8_t* data, size_t dataSize)
+{
+    std::ofstream stream(path, std::ios::binary);
+
+    if (!stream.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(dataSize)))
+    {
+        throw std::runtime_error("Unable to write the file: " + path);
+    }
+}
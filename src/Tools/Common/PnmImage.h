@@ -0,0 +1,52 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// A gray (PGM) or RGB (PPM) image, the tools use these formats because they can
+// be read without any additional libraries and are supported by the libjxl
+// command line tools. The images with an alpha channel use the PAM format.
+struct PnmImage
+{
+    uint32_t width;
+    uint32_t height;
+    // 1 for gray, 2 for gray and alpha, 3 for RGB and 4 for RGB and alpha.
+    uint32_t channelCount;
+    // 255 for 8-bit samples or 65535 for 16-bit samples.
+    uint32_t maxValue;
+    // The interleaved samples, the 16-bit samples are stored in big-endian byte order.
+    std::vector<uint8_t> pixels;
+};
+
+// Reads an 8-bit binary PGM (P5) or PPM (P6) image.
+// Throws std::runtime_error if the file cannot be read or uses an unsupported format.
+PnmImage ReadPnmImage(const std::string& path);
+
+// Parses a binary PGM or PPM image from memory, the name is used in the error messages.
+// Throws std::runtime_error if the data uses an unsupported format or is truncated.
+PnmImage DecodePnmImage(const std::vector<uint8_t>& data, const std::string& name);
+
+// Writes the image as a binary PGM or PPM file, or a PAM file if it has an alpha channel.
+// Throws std::runtime_error if the file cannot be written.
+void WritePnmImage(const std::string& path, const PnmImage& image);
+
+std::vector<uint8_t> EncodePnmImage(const PnmImage& image);
+
+// Returns the file extension that EncodePnmImage uses for the image, including the period.
+const char* GetPnmFileExtension(const PnmImage& image);
+
+std::vector<uint8_t> ReadFileBytes(const std::string& path);
+void WriteFileBytes(const std::string& path, const uint8_t* data, size_t dataSize);
@@ -0,0 +1,101 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+// A minimal replacement for the parts of Windows.h and the MSVC runtime that the
+// plugin sources use, it allows the tools to compile the plugin sources on Linux
+// and macOS.
+//
+// This header must be force included before any other header, e.g. with the
+// GCC and Clang -include option, because Common.h uses the __stdcall calling
+// convention without including Windows.h.
+
+#pragma once
+
+#if defined(_WIN32)
+#error "This header is only used on non-Windows platforms."
+#endif
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef __stdcall
+#define __stdcall
+#endif
+
+#ifndef __declspec
+#define __declspec(x)
+#endif
+
+#ifdef __cplusplus
+
+typedef int32_t HRESULT;
+
+#define S_OK ((HRESULT)0)
+#define E_ABORT ((HRESULT)0x80004004L)
+#define E_FAIL ((HRESULT)0x80004005L)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000EL)
+
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+
+typedef void* HANDLE;
+typedef uintptr_t DWORD_PTR;
+
+inline HANDLE GetCurrentThread()
+{
+    return nullptr;
+}
+
+// Thread affinity is not supported, the work-stealing runner threads are not pinned.
+inline DWORD_PTR SetThreadAffinityMask(HANDLE, DWORD_PTR)
+{
+    return 0;
+}
+
+template <typename T>
+inline T min(T a, T b)
+{
+    return b < a ? b : a;
+}
+
+template <typename T>
+inline T max(T a, T b)
+{
+    return a < b ? b : a;
+}
+
+template <size_t N>
+inline int strncpy_s(char (&destination)[N], const char* source, size_t count)
+{
+    const size_t length = min(strnlen(source, count), N - 1);
+
+    memcpy(destination, source, length);
+    destination[length] = '\0';
+
+    return 0;
+}
+
+template <size_t N>
+inline int vsprintf_s(char (&destination)[N], const char* format, va_list args)
+{
+    return vsnprintf(destination, N, format, args);
+}
+
+inline int _vscprintf(const char* format, va_list args)
+{
+    return vsnprintf(nullptr, 0, format, args);
+}
+
+#endif // __cplusplus
@@ -0,0 +1,700 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+// Checks the pixel format conversion kernels against simple reference implementations
+// and measures their throughput.
+//
+// The correctness tests cover odd and narrow widths, padded strides, unaligned scan0
+// pointers and the different alpha patterns. The output buffers are surrounded by guard
+// bytes to detect writes outside of the image. The process exit code is 1 if any of the
+// tests fail, so the tool can be used to validate changes to the kernels.
+
+#include "CmykConversion.h"
+#include "PixelFormatConversion.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string.h>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define HAVE_TIMESTAMP_COUNTER 1
+#endif
+
+namespace
+{
+    constexpr size_t guardSize = 64;
+    constexpr uint8_t guardValue = 0xa5;
+    constexpr uint8_t stridePaddingValue = 0xcd;
+
+    enum class AlphaPattern
+    {
+        Opaque,
+        Transparent,
+        Random,
+        FirstPixelTranslucent,
+        LastPixelTranslucent
+    };
+
+    enum class ColorPattern
+    {
+        Gray,
+        Color,
+        LastPixelColor
+    };
+
+    const char* GetAlphaPatternName(AlphaPattern pattern)
+    {
+        switch (pattern)
+        {
+        case AlphaPattern::Opaque:
+            return "opaque";
+        case AlphaPattern::Transparent:
+            return "transparent";
+        case AlphaPattern::Random:
+            return "random";
+        case AlphaPattern::FirstPixelTranslucent:
+            return "first-translucent";
+        case AlphaPattern::LastPixelTranslucent:
+            return "last-translucent";
+        default:
+            return "unknown";
+        }
+    }
+
+    const char* GetColorPatternName(ColorPattern pattern)
+    {
+        switch (pattern)
+        {
+        case ColorPattern::Gray:
+            return "gray";
+        case ColorPattern::Color:
+            return "color";
+        case ColorPattern::LastPixelColor:
+            return "last-color";
+        default:
+            return "unknown";
+        }
+    }
+
+    // A BGRA image with a padded stride, the scan0 pointer can be offset from
+    // the start of the allocation to test unaligned images.
+    class TestBitmap
+    {
+    public:
+        TestBitmap(uint32_t width, uint32_t height, uint32_t stridePadding, size_t scan0Offset)
+            : storage(scan0Offset + static_cast<size_t>(width * 4 + stridePadding) * height, stridePaddingValue),
+              bitmap{ storage.data() + scan0Offset, width, height, width * 4 + stridePadding }
+        {
+        }
+
+        const BitmapData* Get() const
+        {
+            return &bitmap;
+        }
+
+        ColorBgra& Pixel(uint32_t x, uint32_t y)
+        {
+            return reinterpret_cast<ColorBgra*>(bitmap.scan0 + (static_cast<size_t>(y) * bitmap.stride))[x];
+        }
+
+        const ColorBgra& Pixel(uint32_t x, uint32_t y) const
+        {
+            return reinterpret_cast<const ColorBgra*>(bitmap.scan0 + (static_cast<size_t>(y) * bitmap.stride))[x];
+        }
+
+        void Fill(ColorPattern colorPattern, AlphaPattern alphaPattern, std::mt19937& random)
+        {
+            std::uniform_int_distribution<int> distribution(0, 255);
+
+            for (uint32_t y = 0; y < bitmap.height; y++)
+            {
+                for (uint32_t x = 0; x < bitmap.width; x++)
+                {
+                    ColorBgra& pixel = Pixel(x, y);
+
+                    pixel.r = static_cast<uint8_t>(distribution(random));
+
+                    if (colorPattern == ColorPattern::Color)
+                    {
+                        pixel.g = static_cast<uint8_t>(distribution(random));
+                        pixel.b = static_cast<uint8_t>(distribution(random));
+                    }
+                    else
+                    {
+                        pixel.g = pixel.r;
+                        pixel.b = pixel.r;
+                    }
+
+                    switch (alphaPattern)
+                    {
+                    case AlphaPattern::Transparent:
+                        pixel.a = 0;
+                        break;
+                    case AlphaPattern::Random:
+                        pixel.a = static_cast<uint8_t>(distribution(random));
+                        break;
+                    case AlphaPattern::Opaque:
+                    case AlphaPattern::FirstPixelTranslucent:
+                    case AlphaPattern::LastPixelTranslucent:
+                    default:
+                        pixel.a = 255;
+                        break;
+                    }
+                }
+            }
+
+            if (alphaPattern == AlphaPattern::FirstPixelTranslucent)
+            {
+                Pixel(0, 0).a = 254;
+            }
+            else if (alphaPattern == AlphaPattern::LastPixelTranslucent)
+            {
+                Pixel(bitmap.width - 1, bitmap.height - 1).a = 254;
+            }
+
+            if (colorPattern == ColorPattern::LastPixelColor)
+            {
+                ColorBgra& last = Pixel(bitmap.width - 1, bitmap.height - 1);
+                last.g = static_cast<uint8_t>(last.r ^ 1);
+            }
+        }
+
+    private:
+        std::vector<uint8_t> storage;
+        BitmapData bitmap;
+    };
+
+    // An output buffer with guard bytes before and after the image data.
+    class GuardedBuffer
+    {
+    public:
+        explicit GuardedBuffer(size_t size) : storage(size + (guardSize * 2), guardValue), size(size)
+        {
+        }
+
+        uint8_t* Data()
+        {
+            return storage.data() + guardSize;
+        }
+
+        const uint8_t* Data() const
+        {
+            return storage.data() + guardSize;
+        }
+
+        size_t Size() const
+        {
+            return size;
+        }
+
+        bool GuardsAreIntact() const
+        {
+            for (size_t i = 0; i < guardSize; i++)
+            {
+                if (storage[i] != guardValue || storage[guardSize + size + i] != guardValue)
+                {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+    private:
+        std::vector<uint8_t> storage;
+        size_t size;
+    };
+
+    // The reference implementations use the simplest possible code, they are the
+    // specification that the optimized kernels are checked against.
+
+    void ReferenceBgraToInterleaved(const TestBitmap& bitmap, const int* channelOrder, size_t channelCount, uint8_t* output)
+    {
+        const BitmapData* data = bitmap.Get();
+        size_t index = 0;
+
+        for (uint32_t y = 0; y < data->height; y++)
+        {
+            for (uint32_t x = 0; x < data->width; x++)
+            {
+                const ColorBgra& pixel = bitmap.Pixel(x, y);
+                const uint8_t channels[4] = { pixel.r, pixel.g, pixel.b, pixel.a };
+
+                for (size_t c = 0; c < channelCount; c++)
+                {
+                    output[index++] = channels[channelOrder[c]];
+                }
+            }
+        }
+    }
+
+    OutputPixelFormat ReferenceGetOutputPixelFormat(const TestBitmap& bitmap, bool hasICCProfile)
+    {
+        const BitmapData* data = bitmap.Get();
+        bool isGray = true;
+        bool hasTransparency = false;
+
+        for (uint32_t y = 0; y < data->height; y++)
+        {
+            for (uint32_t x = 0; x < data->width; x++)
+            {
+                const ColorBgra& pixel = bitmap.Pixel(x, y);
+
+                isGray = isGray && pixel.r == pixel.g && pixel.g == pixel.b;
+                hasTransparency = hasTransparency || pixel.a != 255;
+            }
+        }
+
+        if (isGray && !hasICCProfile)
+        {
+            return hasTransparency ? OutputPixelFormat::GrayAlpha : OutputPixelFormat::Gray;
+        }
+
+        return hasTransparency ? OutputPixelFormat::Rgba : OutputPixelFormat::Rgb;
+    }
+
+    void ReferenceCmyaAndKeyToCmyka(
+        const std::vector<uint8_t>& cmya,
+        const std::vector<uint8_t>& key,
+        size_t width,
+        size_t height,
+        bool hasTransparency,
+        uint8_t* output)
+    {
+        const size_t cmyaChannelCount = hasTransparency ? 4 : 3;
+        const size_t outputChannelCount = hasTransparency ? 5 : 4;
+
+        for (size_t i = 0; i < width * height; i++)
+        {
+            for (size_t c = 0; c < 3; c++)
+            {
+                output[(i * outputChannelCount) + c] = static_cast<uint8_t>(255 - cmya[(i * cmyaChannelCount) + c]);
+            }
+
+            output[(i * outputChannelCount) + 3] = static_cast<uint8_t>(255 - key[i]);
+
+            if (hasTransparency)
+            {
+                output[(i * outputChannelCount) + 4] = cmya[(i * cmyaChannelCount) + 3];
+            }
+        }
+    }
+
+    struct BgraKernel
+    {
+        const char* name;
+        void (*function)(const BitmapData*, uint8_t*);
+        size_t channelCount;
+        int channelOrder[4];
+    };
+
+    const BgraKernel bgraKernels[] =
+    {
+        { "BgraToGray", PixelFormatConversion::BgraToGray, 1, { 2 } },
+        { "BgraToGrayAlpha", PixelFormatConversion::BgraToGrayAlpha, 2, { 2, 3 } },
+        { "BgraToRgb", PixelFormatConversion::BgraToRgb, 3, { 0, 1, 2 } },
+        { "BgraToRgba", PixelFormatConversion::BgraToRgba, 4, { 0, 1, 2, 3 } },
+    };
+
+    const uint32_t testWidths[] = { 1, 2, 3, 4, 5, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 128, 129, 255, 1021 };
+    const uint32_t testHeights[] = { 1, 2, 7 };
+    // Paint.NET surfaces always have a stride that is a multiple of 4.
+    const uint32_t testStridePaddings[] = { 0, 4, 12, 60 };
+    const size_t testScan0Offsets[] = { 0, 4 };
+    const AlphaPattern alphaPatterns[] =
+    {
+        AlphaPattern::Opaque,
+        AlphaPattern::Transparent,
+        AlphaPattern::Random,
+        AlphaPattern::FirstPixelTranslucent,
+        AlphaPattern::LastPixelTranslucent
+    };
+    const ColorPattern colorPatterns[] = { ColorPattern::Gray, ColorPattern::Color, ColorPattern::LastPixelColor };
+
+    class TestResults
+    {
+    public:
+        TestResults() : passed(0), failed(0)
+        {
+        }
+
+        void Check(bool condition, const std::string& description)
+        {
+            if (condition)
+            {
+                passed++;
+            }
+            else
+            {
+                failed++;
+
+                if (failed <= 20)
+                {
+                    std::cout << "FAILED: " << description << '\n';
+                }
+            }
+        }
+
+        uint64_t Passed() const
+        {
+            return passed;
+        }
+
+        uint64_t Failed() const
+        {
+            return failed;
+        }
+
+    private:
+        uint64_t passed;
+        uint64_t failed;
+    };
+
+    std::string DescribeCase(
+        const char* kernel,
+        uint32_t width,
+        uint32_t height,
+        uint32_t stridePadding,
+        size_t scan0Offset,
+        ColorPattern colorPattern,
+        AlphaPattern alphaPattern)
+    {
+        return std::string(kernel)
+            + " width=" + std::to_string(width)
+            + " height=" + std::to_string(height)
+            + " padding=" + std::to_string(stridePadding)
+            + " offset=" + std::to_string(scan0Offset)
+            + " color=" + GetColorPatternName(colorPattern)
+            + " alpha=" + GetAlphaPatternName(alphaPattern);
+    }
+
+    void RunBgraTests(TestResults& results)
+    {
+        std::mt19937 random(12345);
+
+        for (const uint32_t width : testWidths)
+        {
+            for (const uint32_t height : testHeights)
+            {
+                for (const uint32_t stridePadding : testStridePaddings)
+                {
+                    for (const size_t scan0Offset : testScan0Offsets)
+                    {
+                        for (const ColorPattern colorPattern : colorPatterns)
+                        {
+                            for (const AlphaPattern alphaPattern : alphaPatterns)
+                            {
+                                TestBitmap bitmap(width, height, stridePadding, scan0Offset);
+                                bitmap.Fill(colorPattern, alphaPattern, random);
+
+                                for (const BgraKernel& kernel : bgraKernels)
+                                {
+                                    const size_t outputSize = static_cast<size_t>(width) * height * kernel.channelCount;
+
+                                    std::vector<uint8_t> expected(outputSize);
+                                    ReferenceBgraToInterleaved(bitmap, kernel.channelOrder, kernel.channelCount, expected.data());
+
+                                    GuardedBuffer actual(outputSize);
+                                    kernel.function(bitmap.Get(), actual.Data());
+
+                                    const std::string description = DescribeCase(kernel.name, width, height, stridePadding, scan0Offset, colorPattern, alphaPattern);
+
+                                    results.Check(memcmp(expected.data(), actual.Data(), outputSize) == 0, description + ": output mismatch");
+                                    results.Check(actual.GuardsAreIntact(), description + ": write outside of the output buffer");
+                                }
+
+                                for (const bool hasICCProfile : { false, true })
+                                {
+                                    const OutputPixelFormat expected = ReferenceGetOutputPixelFormat(bitmap, hasICCProfile);
+                                    const OutputPixelFormat actual = PixelFormatConversion::GetOutputPixelFormat(bitmap.Get(), hasICCProfile);
+
+                                    results.Check(
+                                        expected == actual,
+                                        DescribeCase("GetOutputPixelFormat", width, height, stridePadding, scan0Offset, colorPattern, alphaPattern)
+                                        + (hasICCProfile ? " icc=true" : " icc=false"));
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void RunCmykTests(TestResults& results)
+    {
+        std::mt19937 random(67890);
+        std::uniform_int_distribution<int> distribution(0, 255);
+
+        for (const uint32_t width : testWidths)
+        {
+            for (const uint32_t height : testHeights)
+            {
+                for (const bool hasTransparency : { false, true })
+                {
+                    const size_t pixelCount = static_cast<size_t>(width) * height;
+
+                    std::vector<uint8_t> cmya(pixelCount * (hasTransparency ? 4 : 3));
+                    std::vector<uint8_t> key(pixelCount);
+
+                    for (uint8_t& value : cmya)
+                    {
+                        value = static_cast<uint8_t>(distribution(random));
+                    }
+
+                    for (uint8_t& value : key)
+                    {
+                        value = static_cast<uint8_t>(distribution(random));
+                    }
+
+                    const size_t outputSize = pixelCount * (hasTransparency ? 5 : 4);
+
+                    std::vector<uint8_t> expected(outputSize);
+                    ReferenceCmyaAndKeyToCmyka(cmya, key, width, height, hasTransparency, expected.data());
+
+                    GuardedBuffer actual(outputSize);
+                    CmykConversion::CmyaAndKeyToCmyka(cmya.data(), key.data(), width, height, hasTransparency, actual.Data());
+
+                    const std::string description = std::string("CmyaAndKeyToCmyka")
+                        + " width=" + std::to_string(width)
+                        + " height=" + std::to_string(height)
+                        + (hasTransparency ? " alpha=true" : " alpha=false");
+
+                    results.Check(memcmp(expected.data(), actual.Data(), outputSize) == 0, description + ": output mismatch");
+                    results.Check(actual.GuardsAreIntact(), description + ": write outside of the output buffer");
+                }
+            }
+        }
+    }
+
+    struct Measurement
+    {
+        double nanosecondsPerPixel;
+        double cyclesPerPixel;
+        double gigabytesPerSecond;
+    };
+
+    // Runs the kernel repeatedly for at least the minimum time and reports the fastest run,
+    // the fastest run is the least affected by interrupts and other processes.
+    Measurement Measure(const std::function<void()>& kernel, uint64_t pixelCount, uint64_t bytesPerRun, double minimumMilliseconds)
+    {
+        using clock = std::chrono::steady_clock;
+
+        kernel();
+
+        double bestSeconds = 0.0;
+        uint64_t bestCycles = 0;
+        const clock::time_point start = clock::now();
+        uint32_t runCount = 0;
+
+        do
+        {
+#if HAVE_TIMESTAMP_COUNTER
+            const uint64_t cycleStart = __rdtsc();
+#endif
+            const clock::time_point runStart = clock::now();
+
+            kernel();
+
+            const double seconds = std::chrono::duration<double>(clock::now() - runStart).count();
+#if HAVE_TIMESTAMP_COUNTER
+            const uint64_t cycles = __rdtsc() - cycleStart;
+#else
+            const uint64_t cycles = 0;
+#endif
+
+            if (runCount == 0 || seconds < bestSeconds)
+            {
+                bestSeconds = seconds;
+                bestCycles = cycles;
+            }
+
+            runCount++;
+        } while (runCount < 5 || std::chrono::duration<double, std::milli>(clock::now() - start).count() < minimumMilliseconds);
+
+        Measurement measurement{};
+        measurement.nanosecondsPerPixel = bestSeconds * 1e9 / static_cast<double>(pixelCount);
+        measurement.cyclesPerPixel = static_cast<double>(bestCycles) / static_cast<double>(pixelCount);
+        measurement.gigabytesPerSecond = bestSeconds > 0.0 ? static_cast<double>(bytesPerRun) / bestSeconds / 1e9 : 0.0;
+
+        return measurement;
+    }
+
+    void PrintMeasurement(const std::string& name, uint32_t width, uint32_t height, const Measurement& measurement)
+    {
+        std::cout << std::left << std::setw(24) << name
+                  << std::right << std::setw(6) << width << 'x' << std::left << std::setw(6) << height
+                  << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(12) << measurement.nanosecondsPerPixel
+#if HAVE_TIMESTAMP_COUNTER
+                  << std::setw(12) << measurement.cyclesPerPixel
+#else
+                  << std::setw(12) << "n/a"
+#endif
+                  << std::setw(10) << measurement.gigabytesPerSecond << '\n';
+    }
+
+    void RunBenchmarks(double minimumMilliseconds)
+    {
+        // The narrow images measure the per-row overhead, the wide images measure the inner loop.
+        // Every size has roughly the same number of pixels.
+        struct BenchmarkSize
+        {
+            uint32_t width;
+            uint32_t height;
+        };
+
+        const BenchmarkSize sizes[] = { { 7, 149796 }, { 33, 31775 }, { 1021, 1027 }, { 4096, 256 } };
+
+        std::cout << "\n"
+                  << std::left << std::setw(24) << "kernel" << std::setw(13) << "size"
+                  << std::right << std::setw(12) << "ns/pixel" << std::setw(12) << "cycles/px" << std::setw(10) << "GB/s" << '\n';
+
+        std::mt19937 random(24680);
+
+        for (const BenchmarkSize& size : sizes)
+        {
+            const uint64_t pixelCount = static_cast<uint64_t>(size.width) * size.height;
+
+            // Use a padded stride to match the Paint.NET surfaces, which are aligned to 32 bytes.
+            const uint32_t stridePadding = ((size.width * 4 + 31) & ~31u) - (size.width * 4);
+
+            TestBitmap bitmap(size.width, size.height, stridePadding, 0);
+            bitmap.Fill(ColorPattern::Color, AlphaPattern::Random, random);
+
+            for (const BgraKernel& kernel : bgraKernels)
+            {
+                std::vector<uint8_t> output(pixelCount * kernel.channelCount);
+
+                const Measurement measurement = Measure(
+                    [&]() { kernel.function(bitmap.Get(), output.data()); },
+                    pixelCount,
+                    pixelCount * (4 + kernel.channelCount),
+                    minimumMilliseconds);
+
+                PrintMeasurement(kernel.name, size.width, size.height, measurement);
+            }
+
+            // Use a gray and opaque image for the output format check because it scans every
+            // pixel, the same as the encoder does for most images.
+            TestBitmap grayBitmap(size.width, size.height, stridePadding, 0);
+            grayBitmap.Fill(ColorPattern::Gray, AlphaPattern::Opaque, random);
+
+            volatile OutputPixelFormat format = OutputPixelFormat::Rgb;
+
+            const Measurement formatMeasurement = Measure(
+                [&]() { format = PixelFormatConversion::GetOutputPixelFormat(grayBitmap.Get(), false); },
+                pixelCount,
+                pixelCount * 4,
+                minimumMilliseconds);
+            (void)format;
+
+            PrintMeasurement("GetOutputPixelFormat", size.width, size.height, formatMeasurement);
+
+            for (const bool hasTransparency : { false, true })
+            {
+                std::vector<uint8_t> cmya(pixelCount * (hasTransparency ? 4 : 3), 0x40);
+                std::vector<uint8_t> key(pixelCount, 0x80);
+                std::vector<uint8_t> output(pixelCount * (hasTransparency ? 5 : 4));
+
+                const Measurement measurement = Measure(
+                    [&]() { CmykConversion::CmyaAndKeyToCmyka(cmya.data(), key.data(), size.width, size.height, hasTransparency, output.data()); },
+                    pixelCount,
+                    cmya.size() + key.size() + output.size(),
+                    minimumMilliseconds);
+
+                PrintMeasurement(hasTransparency ? "CmyaAndKeyToCmyka(A)" : "CmyaAndKeyToCmyka", size.width, size.height, measurement);
+            }
+        }
+    }
+
+    void PrintUsage()
+    {
+        std::cout << "Usage: PixelKernels [options]\n"
+                     "\n"
+                     "Options:\n"
+                     "  --test-only              Only run the correctness tests.\n"
+                     "  --benchmark-only         Only run the benchmarks.\n"
+                     "  --min-time <ms>          The minimum time for each benchmark, the default is 200.\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool runTests = true;
+    bool runBenchmarks = true;
+    double minimumMilliseconds = 200.0;
+
+    try
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string arg = argv[i];
+
+            if (arg == "--test-only")
+            {
+                runBenchmarks = false;
+            }
+            else if (arg == "--benchmark-only")
+            {
+                runTests = false;
+            }
+            else if (arg == "--min-time" && (i + 1) < argc)
+            {
+                minimumMilliseconds = std::stod(argv[++i]);
+            }
+            else
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+
+        if (runTests)
+        {
+            TestResults results;
+
+            RunBgraTests(results);
+            RunCmykTests(results);
+
+            std::cout << results.Passed() << " checks passed, " << results.Failed() << " checks failed.\n";
+
+            if (results.Failed() > 0)
+            {
+                return 1;
+            }
+        }
+
+        if (runBenchmarks)
+        {
+            RunBenchmarks(minimumMilliseconds);
+        }
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,174 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "JxlCodec.h"
+#include "jxl/decode_cxx.h"
+#include "jxl/encode_cxx.h"
+#include "jxl/resizable_parallel_runner_cxx.h"
+#include <stdexcept>
+
+std::vector<uint8_t> EncodeJxl(const PnmImage& image, float distance, int32_t effort)
+{
+    auto runner = JxlResizableParallelRunnerMake(nullptr);
+
+    JxlResizableParallelRunnerSetThreads(
+        runner.get(),
+        JxlResizableParallelRunnerSuggestThreads(image.width, image.height));
+
+    auto enc = JxlEncoderMake(nullptr);
+
+    if (JxlEncoderSetParallelRunner(enc.get(), JxlResizableParallelRunner, runner.get()) != JXL_ENC_SUCCESS)
+    {
+        throw std::runtime_error("JxlEncoderSetParallelRunner failed.");
+    }
+
+    const bool lossless = distance == 0.0f;
+
+    JxlBasicInfo basicInfo;
+    JxlEncoderInitBasicInfo(&basicInfo);
+
+    basicInfo.xsize = image.width;
+    basicInfo.ysize = image.height;
+    basicInfo.bits_per_sample = 8;
+    basicInfo.num_color_channels = image.channelCount;
+    basicInfo.uses_original_profile = lossless;
+
+    if (JxlEncoderSetBasicInfo(enc.get(), &basicInfo) != JXL_ENC_SUCCESS)
+    {
+        throw std::runtime_error("JxlEncoderSetBasicInfo failed.");
+    }
+
+    JxlColorEncoding colorEncoding{};
+    JxlColorEncodingSetToSRGB(&colorEncoding, image.channelCount == 1);
+    colorEncoding.rendering_intent = JXL_RENDERING_INTENT_PERCEPTUAL;
+
+    if (JxlEncoderSetColorEncoding(enc.get(), &colorEncoding) != JXL_ENC_SUCCESS)
+    {
+        throw std::runtime_error("JxlEncoderSetColorEncoding failed.");
+    }
+
+    JxlEncoderFrameSettings* frameSettings = JxlEncoderFrameSettingsCreate(enc.get(), nullptr);
+
+    if (JxlEncoderSetFrameDistance(frameSettings, distance) != JXL_ENC_SUCCESS
+        || JxlEncoderSetFrameLossless(frameSettings, lossless) != JXL_ENC_SUCCESS
+        || JxlEncoderFrameSettingsSetOption(frameSettings, JXL_ENC_FRAME_SETTING_EFFORT, effort) != JXL_ENC_SUCCESS)
+    {
+        throw std::runtime_error("Failed to set the encoder frame settings.");
+    }
+
+    const JxlPixelFormat format{ image.channelCount, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0 };
+
+    if (JxlEncoderAddImageFrame(frameSettings, &format, image.pixels.data(), image.pixels.size()) != JXL_ENC_SUCCESS)
+    {
+        throw std::runtime_error("JxlEncoderAddImageFrame failed.");
+    }
+
+    JxlEncoderCloseInput(enc.get());
+
+    std::vector<uint8_t> output(65536);
+    uint8_t* nextOut = output.data();
+    size_t availableOut = output.size();
+
+    JxlEncoderStatus status;
+
+    while ((status = JxlEncoderProcessOutput(enc.get(), &nextOut, &availableOut)) == JXL_ENC_NEED_MORE_OUTPUT)
+    {
+        const size_t offset = static_cast<size_t>(nextOut - output.data());
+
+        output.resize(output.size() * 2);
+        nextOut = output.data() + offset;
+        availableOut = output.size() - offset;
+    }
+
+    if (status != JXL_ENC_SUCCESS)
+    {
+        throw std::runtime_error("JxlEncoderProcessOutput failed.");
+    }
+
+    output.resize(static_cast<size_t>(nextOut - output.data()));
+
+    return output;
+}
+
+PnmImage DecodeJxl(const std::vector<uint8_t>& data, uint32_t channelCount)
+{
+    auto runner = JxlResizableParallelRunnerMake(nullptr);
+    auto dec = JxlDecoderMake(nullptr);
+
+    if (JxlDecoderSubscribeEvents(dec.get(), JXL_DEC_BASIC_INFO | JXL_DEC_FULL_IMAGE) != JXL_DEC_SUCCESS)
+    {
+        throw std::runtime_error("JxlDecoderSubscribeEvents failed.");
+    }
+
+    if (JxlDecoderSetParallelRunner(dec.get(), JxlResizableParallelRunner, runner.get()) != JXL_DEC_SUCCESS)
+    {
+        throw std::runtime_error("JxlDecoderSetParallelRunner failed.");
+    }
+
+    if (JxlDecoderSetInput(dec.get(), data.data(), data.size()) != JXL_DEC_SUCCESS)
+    {
+        throw std::runtime_error("JxlDecoderSetInput failed.");
+    }
+    JxlDecoderCloseInput(dec.get());
+
+    const JxlPixelFormat format{ channelCount, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0 };
+
+    PnmImage image{};
+    image.channelCount = channelCount;
+    image.maxValue = 255;
+
+    while (true)
+    {
+        const JxlDecoderStatus status = JxlDecoderProcessInput(dec.get());
+
+        if (status == JXL_DEC_BASIC_INFO)
+        {
+            JxlBasicInfo basicInfo;
+
+            if (JxlDecoderGetBasicInfo(dec.get(), &basicInfo) != JXL_DEC_SUCCESS)
+            {
+                throw std::runtime_error("JxlDecoderGetBasicInfo failed.");
+            }
+
+            image.width = basicInfo.xsize;
+            image.height = basicInfo.ysize;
+
+            JxlResizableParallelRunnerSetThreads(
+                runner.get(),
+                JxlResizableParallelRunnerSuggestThreads(basicInfo.xsize, basicInfo.ysize));
+        }
+        else if (status == JXL_DEC_NEED_IMAGE_OUT_BUFFER)
+        {
+            size_t bufferSize;
+
+            if (JxlDecoderImageOutBufferSize(dec.get(), &format, &bufferSize) != JXL_DEC_SUCCESS)
+            {
+                throw std::runtime_error("JxlDecoderImageOutBufferSize failed.");
+            }
+
+            image.pixels.resize(bufferSize);
+
+            if (JxlDecoderSetImageOutBuffer(dec.get(), &format, image.pixels.data(), image.pixels.size()) != JXL_DEC_SUCCESS)
+            {
+                throw std::runtime_error("JxlDecoderSetImageOutBuffer failed.");
+            }
+        }
+        else if (status == JXL_DEC_FULL_IMAGE)
+        {
+            return image;
+        }
+        else
+        {
+            throw std::runtime_error("The JPEG XL image could not be decoded.");
+        }
+    }
+}
@@ -0,0 +1,25 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "PnmImage.h"
+#include <stdint.h>
+#include <vector>
+
+// Encodes the image with the same settings that the plugin uses for 8-bit sRGB images.
+// Throws std::runtime_error if the image cannot be encoded.
+std::vector<uint8_t> EncodeJxl(const PnmImage& image, float distance, int32_t effort);
+
+// Decodes the image to the channel count of the original image.
+// Throws std::runtime_error if the image cannot be decoded.
+PnmImage DecodeJxl(const std::vector<uint8_t>& data, uint32_t channelCount);
@@ -0,0 +1,117 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "PerceptualMetrics.h"
+#include <array>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+namespace
+{
+    std::string Quote(const std::string& value)
+    {
+        return "\"" + value + "\"";
+    }
+
+    std::string RunCommand(const std::string& command)
+    {
+        std::string commandLine = command;
+
+#ifdef _WIN32
+        // cmd.exe strips the outer quotes when the command starts with a quoted path.
+        commandLine = "\"" + commandLine + "\"";
+#endif
+
+        FILE* pipe = popen(commandLine.c_str(), "r");
+
+        if (!pipe)
+        {
+            throw std::runtime_error("Unable to start the command: " + command);
+        }
+
+        std::string output;
+        std::array<char, 256> buffer;
+
+        while (fgets(buffer.data(), static_cast<int>(buffer.size()), pipe))
+        {
+            output += buffer.data();
+        }
+
+        const int exitCode = pclose(pipe);
+
+        if (exitCode != 0)
+        {
+            throw std::runtime_error("The command failed: " + command);
+        }
+
+        return output;
+    }
+
+    double ParseNumber(const std::string& output, size_t offset, const std::string& toolName)
+    {
+        const char* start = output.c_str() + offset;
+        char* end = nullptr;
+
+        const double value = strtod(start, &end);
+
+        if (end == start)
+        {
+            throw std::runtime_error("Unable to parse the " + toolName + " output: " + output);
+        }
+
+        return value;
+    }
+}
+
+PerceptualMetrics::PerceptualMetrics(const std::string& ssimulacra2Path, const std::string& butteraugliPath)
+    : ssimulacra2Path(ssimulacra2Path), butteraugliPath(butteraugliPath)
+{
+}
+
+PerceptualScores PerceptualMetrics::Compute(const std::string& originalPath, const std::string& distortedPath) const
+{
+    PerceptualScores scores{};
+
+    // ssimulacra2 prints a single score, 100 is identical and 90 is visually lossless.
+    const std::string ssimulacra2Output = RunCommand(
+        Quote(ssimulacra2Path) + " " + Quote(originalPath) + " " + Quote(distortedPath));
+
+    scores.ssimulacra2 = ParseNumber(ssimulacra2Output, 0, "ssimulacra2");
+
+    if (!butteraugliPath.empty())
+    {
+        // butteraugli_main prints the max-norm distance followed by a "3-norm: <value>" line.
+        const std::string butteraugliOutput = RunCommand(
+            Quote(butteraugliPath) + " " + Quote(originalPath) + " " + Quote(distortedPath));
+
+        scores.butteraugliMaxNorm = ParseNumber(butteraugliOutput, 0, "butteraugli");
+
+        const std::string pnormLabel = "3-norm:";
+        const size_t pnormOffset = butteraugliOutput.find(pnormLabel);
+
+        if (pnormOffset == std::string::npos)
+        {
+            throw std::runtime_error("Unable to parse the butteraugli output: " + butteraugliOutput);
+        }
+
+        scores.butteraugli3Norm = ParseNumber(butteraugliOutput, pnormOffset + pnormLabel.size(), "butteraugli");
+        scores.hasButteraugli = true;
+    }
+
+    return scores;
+}
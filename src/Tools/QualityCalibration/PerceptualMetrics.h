@@ -0,0 +1,39 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <string>
+
+// The scores are computed by the ssimulacra2 and butteraugli_main tools that are built
+// with the libjxl development tools, both tools read PNM and JPEG XL files.
+struct PerceptualScores
+{
+    double ssimulacra2;
+    double butteraugliMaxNorm;
+    double butteraugli3Norm;
+    bool hasButteraugli;
+};
+
+class PerceptualMetrics
+{
+public:
+    // The butteraugli path is optional, an empty string skips the butteraugli scores.
+    PerceptualMetrics(const std::string& ssimulacra2Path, const std::string& butteraugliPath);
+
+    // Throws std::runtime_error if a metric tool fails or its output cannot be parsed.
+    PerceptualScores Compute(const std::string& originalPath, const std::string& distortedPath) const;
+
+private:
+    std::string ssimulacra2Path;
+    std::string butteraugliPath;
+};
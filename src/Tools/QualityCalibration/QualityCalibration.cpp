@@ -0,0 +1,482 @@
+﻿////////////////////////////////////////////////////////////////////////
+//
+// This file is part of pdn-jpegxl, a FileType plugin for Paint.NET
+// that loads and saves JPEG XL images.
+//
+// Copyright (c) 2022, 2023, 2024, 2025, 2026 Nicholas Hayes
+//
+// This file is licensed under the MIT License.
+// See LICENSE.txt for complete licensing and attribution information.
+//
+////////////////////////////////////////////////////////////////////////
+
+// Encodes a corpus of images across a range of distance and effort values, scores each
+// result with SSIMULACRA2 and butteraugli and writes the following files to the output directory:
+//
+// results.csv - The size, timing and scores of every encoded image.
+// quality_table.csv - A quality to distance table fitted to the corpus SSIMULACRA2 scores.
+// QualityToDistanceLookupTable.txt - The fitted table as a C# array initializer.
+// pareto.txt - The distance and effort combinations that are not dominated in size, CPU time and quality.
+
+#include "CommandLine.h"
+#include "JxlCodec.h"
+#include "PerceptualMetrics.h"
+#include "PnmImage.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    struct Options
+    {
+        std::string ssimulacra2Path;
+        std::string butteraugliPath;
+        std::string outputDirectory;
+        std::vector<float> distances{ 0.1f, 0.25f, 0.5f, 0.75f, 1.0f, 1.5f, 2.0f, 3.0f, 4.0f, 6.0f, 8.0f, 11.0f, 15.0f };
+        std::vector<int32_t> efforts{ 3, 5, 7, 9 };
+        int32_t referenceEffort = 7;
+        std::vector<std::string> inputs;
+    };
+
+    struct TrialResult
+    {
+        std::string imageName;
+        uint64_t pixelCount;
+        float distance;
+        int32_t effort;
+        size_t encodedSize;
+        double encodeMilliseconds;
+        double decodeMilliseconds;
+        PerceptualScores scores;
+    };
+
+    struct ConfigurationSummary
+    {
+        float distance;
+        int32_t effort;
+        double bitsPerPixel;
+        double ssimulacra2;
+        double butteraugli3Norm;
+        double cpuMillisecondsPerMegapixel;
+    };
+
+    void PrintUsage()
+    {
+        std::cout << "Usage: QualityCalibration --ssimulacra2 <path> --output <directory> [options] <images or directories>\n"
+                     "\n"
+                     "Options:\n"
+                     "  --butteraugli <path>     The butteraugli_main executable, the butteraugli scores are skipped if not set.\n"
+                     "  --distances <list>       Comma separated distance values.\n"
+                     "  --efforts <list>         Comma separated effort values.\n"
+                     "  --reference-effort <n>   The effort used to fit the quality table, the default is 7.\n"
+                     "\n"
+                     "The input images must be 8-bit binary PGM or PPM files.\n";
+    }
+
+    Options ParseCommandLine(int argc, char** argv)
+    {
+        Options options;
+
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string arg = argv[i];
+            const bool hasValue = (i + 1) < argc;
+
+            if (arg == "--ssimulacra2" && hasValue)
+            {
+                options.ssimulacra2Path = argv[++i];
+            }
+            else if (arg == "--butteraugli" && hasValue)
+            {
+                options.butteraugliPath = argv[++i];
+            }
+            else if (arg == "--output" && hasValue)
+            {
+                options.outputDirectory = argv[++i];
+            }
+            else if (arg == "--distances" && hasValue)
+            {
+                options.distances = ParseList<float>(argv[++i]);
+            }
+            else if (arg == "--efforts" && hasValue)
+            {
+                options.efforts = ParseList<int32_t>(argv[++i]);
+            }
+            else if (arg == "--reference-effort" && hasValue)
+            {
+                options.referenceEffort = std::stoi(argv[++i]);
+            }
+            else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0)
+            {
+                throw std::runtime_error("Unknown option: " + arg);
+            }
+            else
+            {
+                options.inputs.push_back(arg);
+            }
+        }
+
+        if (options.ssimulacra2Path.empty() || options.outputDirectory.empty() || options.inputs.empty())
+        {
+            throw std::invalid_argument("A required argument is missing.");
+        }
+
+        if (std::find(options.efforts.begin(), options.efforts.end(), options.referenceEffort) == options.efforts.end())
+        {
+            options.efforts.push_back(options.referenceEffort);
+        }
+
+        std::sort(options.distances.begin(), options.distances.end());
+
+        return options;
+    }
+
+    bool IsPnmFile(const fs::path& path)
+    {
+        const std::string extension = path.extension().string();
+
+        return extension == ".ppm" || extension == ".pgm" || extension == ".pnm";
+    }
+
+    std::vector<fs::path> EnumerateImages(const std::vector<std::string>& inputs)
+    {
+        std::vector<fs::path> images;
+
+        for (const std::string& input : inputs)
+        {
+            if (fs::is_directory(input))
+            {
+                for (const fs::directory_entry& entry : fs::recursive_directory_iterator(input))
+                {
+                    if (entry.is_regular_file() && IsPnmFile(entry.path()))
+                    {
+                        images.push_back(entry.path());
+                    }
+                }
+            }
+            else
+            {
+                images.push_back(input);
+            }
+        }
+
+        std::sort(images.begin(), images.end());
+
+        return images;
+    }
+
+    double ElapsedMilliseconds(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void WriteResults(const fs::path& path, const std::vector<TrialResult>& results)
+    {
+        std::ofstream stream(path);
+
+        stream << "image,distance,effort,bytes,bits_per_pixel,encode_ms,decode_ms,ssimulacra2,butteraugli_max,butteraugli_3norm\n";
+
+        for (const TrialResult& result : results)
+        {
+            stream << result.imageName << ','
+                   << result.distance << ','
+                   << result.effort << ','
+                   << result.encodedSize << ','
+                   << (result.encodedSize * 8.0) / static_cast<double>(result.pixelCount) << ','
+                   << result.encodeMilliseconds << ','
+                   << result.decodeMilliseconds << ','
+                   << result.scores.ssimulacra2 << ',';
+
+            if (result.scores.hasButteraugli)
+            {
+                stream << result.scores.butteraugliMaxNorm << ',' << result.scores.butteraugli3Norm;
+            }
+            else
+            {
+                stream << ',';
+            }
+
+            stream << '\n';
+        }
+    }
+
+    std::vector<ConfigurationSummary> Summarize(const std::vector<TrialResult>& results)
+    {
+        struct Totals
+        {
+            double bits = 0;
+            double pixels = 0;
+            double ssimulacra2 = 0;
+            double butteraugli3Norm = 0;
+            double cpuMilliseconds = 0;
+            size_t count = 0;
+        };
+
+        std::map<std::pair<float, int32_t>, Totals> totals;
+
+        for (const TrialResult& result : results)
+        {
+            Totals& total = totals[{ result.distance, result.effort }];
+
+            total.bits += result.encodedSize * 8.0;
+            total.pixels += static_cast<double>(result.pixelCount);
+            total.ssimulacra2 += result.scores.ssimulacra2;
+            total.butteraugli3Norm += result.scores.butteraugli3Norm;
+            total.cpuMilliseconds += result.encodeMilliseconds + result.decodeMilliseconds;
+            total.count++;
+        }
+
+        std::vector<ConfigurationSummary> summaries;
+
+        for (const auto& item : totals)
+        {
+            const Totals& total = item.second;
+
+            summaries.push_back(ConfigurationSummary
+            {
+                item.first.first,
+                item.first.second,
+                total.bits / total.pixels,
+                total.ssimulacra2 / static_cast<double>(total.count),
+                total.butteraugli3Norm / static_cast<double>(total.count),
+                total.cpuMilliseconds / (total.pixels / 1000000.0)
+            });
+        }
+
+        return summaries;
+    }
+
+    // Fits a table that maps the plugin quality value to the distance that produces the same
+    // mean SSIMULACRA2 score, the distance is interpolated logarithmically between the measured values.
+    std::vector<float> FitQualityTable(const std::vector<ConfigurationSummary>& summaries, int32_t referenceEffort)
+    {
+        std::vector<ConfigurationSummary> reference;
+
+        for (const ConfigurationSummary& summary : summaries)
+        {
+            if (summary.effort == referenceEffort && summary.distance > 0.0f)
+            {
+                reference.push_back(summary);
+            }
+        }
+
+        if (reference.size() < 2)
+        {
+            throw std::runtime_error("At least two lossy distance values are required to fit the quality table.");
+        }
+
+        std::sort(reference.begin(), reference.end(), [](const ConfigurationSummary& a, const ConfigurationSummary& b)
+        {
+            return a.distance < b.distance;
+        });
+
+        std::vector<float> table(101);
+
+        for (size_t quality = 0; quality < table.size(); quality++)
+        {
+            // SSIMULACRA2 uses a similar scale to the quality setting, 90 is visually lossless
+            // and 30 is low quality.
+            const double targetScore = static_cast<double>(quality);
+
+            float distance = reference.back().distance;
+
+            if (targetScore >= reference.front().ssimulacra2)
+            {
+                distance = reference.front().distance;
+            }
+            else
+            {
+                for (size_t i = 1; i < reference.size(); i++)
+                {
+                    const ConfigurationSummary& lower = reference[i - 1];
+                    const ConfigurationSummary& upper = reference[i];
+
+                    if (targetScore <= lower.ssimulacra2 && targetScore >= upper.ssimulacra2)
+                    {
+                        const double scoreRange = lower.ssimulacra2 - upper.ssimulacra2;
+                        const double t = scoreRange > 0.0 ? (lower.ssimulacra2 - targetScore) / scoreRange : 0.0;
+                        const double logDistance = std::log(lower.distance) + (t * (std::log(upper.distance) - std::log(lower.distance)));
+
+                        distance = static_cast<float>(std::exp(logDistance));
+                        break;
+                    }
+                }
+            }
+
+            table[quality] = distance;
+        }
+
+        // The scores are not guaranteed to decrease monotonically, the distance must never
+        // decrease as the quality value decreases.
+        for (size_t quality = table.size() - 1; quality > 0; quality--)
+        {
+            table[quality - 1] = std::max(table[quality - 1], table[quality]);
+        }
+
+        return table;
+    }
+
+    void WriteQualityTable(const fs::path& outputDirectory, const std::vector<float>& table)
+    {
+        std::ofstream csv(outputDirectory / "quality_table.csv");
+        std::ofstream csharp(outputDirectory / "QualityToDistanceLookupTable.txt");
+
+        csv << "quality,distance\n";
+        csharp << "private static readonly float[] lookupTable =\n[\n";
+
+        for (size_t quality = 0; quality < table.size(); quality++)
+        {
+            csv << quality << ',' << table[quality] << '\n';
+            csharp << "    " << std::fixed << std::setprecision(4) << table[quality] << 'f'
+                   << (quality + 1 < table.size() ? "," : "") << " // " << quality << '\n';
+        }
+
+        csharp << "];\n";
+    }
+
+    bool Dominates(const ConfigurationSummary& a, const ConfigurationSummary& b)
+    {
+        const bool noWorse = a.bitsPerPixel <= b.bitsPerPixel
+                          && a.ssimulacra2 >= b.ssimulacra2
+                          && a.cpuMillisecondsPerMegapixel <= b.cpuMillisecondsPerMegapixel;
+        const bool better = a.bitsPerPixel < b.bitsPerPixel
+                         || a.ssimulacra2 > b.ssimulacra2
+                         || a.cpuMillisecondsPerMegapixel < b.cpuMillisecondsPerMegapixel;
+
+        return noWorse && better;
+    }
+
+    void WriteParetoReport(const fs::path& path, std::vector<ConfigurationSummary> summaries)
+    {
+        std::sort(summaries.begin(), summaries.end(), [](const ConfigurationSummary& a, const ConfigurationSummary& b)
+        {
+            return a.ssimulacra2 > b.ssimulacra2;
+        });
+
+        std::ofstream stream(path);
+
+        stream << "Distance and effort combinations that no other combination beats in size, CPU time and SSIMULACRA2.\n\n";
+        stream << std::setw(10) << "distance" << std::setw(8) << "effort" << std::setw(12) << "bpp"
+               << std::setw(14) << "ssimulacra2" << std::setw(14) << "butteraugli" << std::setw(16) << "cpu ms/MP" << '\n';
+
+        for (const ConfigurationSummary& candidate : summaries)
+        {
+            const bool dominated = std::any_of(summaries.begin(), summaries.end(), [&](const ConfigurationSummary& other)
+            {
+                return Dominates(other, candidate);
+            });
+
+            if (!dominated)
+            {
+                stream << std::fixed << std::setprecision(3)
+                       << std::setw(10) << candidate.distance
+                       << std::setw(8) << candidate.effort
+                       << std::setw(12) << candidate.bitsPerPixel
+                       << std::setw(14) << candidate.ssimulacra2
+                       << std::setw(14) << candidate.butteraugli3Norm
+                       << std::setw(16) << candidate.cpuMillisecondsPerMegapixel << '\n';
+            }
+        }
+    }
+
+    std::vector<TrialResult> RunCorpus(const Options& options, const std::vector<fs::path>& images)
+    {
+        const PerceptualMetrics metrics(options.ssimulacra2Path, options.butteraugliPath);
+        const fs::path scratchDirectory = fs::path(options.outputDirectory) / "scratch";
+
+        fs::create_directories(scratchDirectory);
+
+        std::vector<TrialResult> results;
+
+        for (const fs::path& imagePath : images)
+        {
+            const PnmImage image = ReadPnmImage(imagePath.string());
+            const std::string imageName = imagePath.filename().string();
+
+            std::cout << imageName << std::endl;
+
+            for (int32_t effort : options.efforts)
+            {
+                for (float distance : options.distances)
+                {
+                    TrialResult result{};
+                    result.imageName = imageName;
+                    result.pixelCount = static_cast<uint64_t>(image.width) * image.height;
+                    result.distance = distance;
+                    result.effort = effort;
+
+                    auto start = std::chrono::steady_clock::now();
+                    const std::vector<uint8_t> encoded = EncodeJxl(image, distance, effort);
+                    result.encodeMilliseconds = ElapsedMilliseconds(start);
+                    result.encodedSize = encoded.size();
+
+                    start = std::chrono::steady_clock::now();
+                    DecodeJxl(encoded, image.channelCount);
+                    result.decodeMilliseconds = ElapsedMilliseconds(start);
+
+                    // The metric tools decode the JPEG XL file with the same libjxl
+                    // version, so the decoded PNM file is not written.
+                    const fs::path encodedPath = scratchDirectory / (imagePath.stem().string() + ".jxl");
+                    WriteFileBytes(encodedPath.string(), encoded.data(), encoded.size());
+
+                    result.scores = metrics.Compute(imagePath.string(), encodedPath.string());
+
+                    results.push_back(result);
+                }
+            }
+        }
+
+        fs::remove_all(scratchDirectory);
+
+        return results;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        const Options options = ParseCommandLine(argc, argv);
+        const std::vector<fs::path> images = EnumerateImages(options.inputs);
+
+        if (images.empty())
+        {
+            std::cerr << "No input images were found." << std::endl;
+            return 1;
+        }
+
+        const fs::path outputDirectory(options.outputDirectory);
+        fs::create_directories(outputDirectory);
+
+        const std::vector<TrialResult> results = RunCorpus(options, images);
+        const std::vector<ConfigurationSummary> summaries = Summarize(results);
+
+        WriteResults(outputDirectory / "results.csv", results);
+        WriteQualityTable(outputDirectory, FitQualityTable(summaries, options.referenceEffort));
+        WriteParetoReport(outputDirectory / "pareto.txt", summaries);
+    }
+    catch (const std::invalid_argument& ex)
+    {
+        std::cerr << ex.what() << "\n\n";
+        PrintUsage();
+        return 1;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}